@@ -0,0 +1,83 @@
+import struct
+import sys
+
+# Compresses a firmware image for update_firmware_hs.cgi: an 8 byte header
+# ("HS", window bits, lookahead bits, image size LE) followed by a heatshrink
+# compatible bit stream. The probe supports up to 11 window bits.
+
+def compress(data, window_bits, lookahead_bits):
+    window = 1 << window_bits
+    max_len = 1 << lookahead_bits
+    backref_bits = 1 + window_bits + lookahead_bits
+    min_len = backref_bits // 9 + 1     # shorter matches are cheaper as literals
+
+    bits = []
+
+    def put(value, count):
+        for i in range(count - 1, -1, -1):
+            bits.append((value >> i) & 1)
+
+    heads = {}
+    pos = 0
+    while pos < len(data):
+        best_len = 0
+        best_off = 0
+        key = data[pos:pos + 2]
+        for cand in reversed(heads.get(key, [])):
+            if pos - cand > window:
+                break
+            length = 0
+            while (length < max_len and pos + length < len(data)
+                   and data[cand + length] == data[pos + length]):
+                length += 1
+            if length > best_len:
+                best_len = length
+                best_off = pos - cand
+                if length == max_len:
+                    break
+
+        if best_len >= min_len:
+            put(0, 1)
+            put(best_off - 1, window_bits)
+            put(best_len - 1, lookahead_bits)
+            step = best_len
+        else:
+            put(1, 1)
+            put(data[pos], 8)
+            step = 1
+
+        for i in range(pos, pos + step):
+            chain = heads.setdefault(data[i:i + 2], [])
+            chain.append(i)
+            if len(chain) > 64:
+                del chain[0]
+        pos += step
+
+    bits.extend([0] * (-len(bits) % 8))
+    out = bytearray()
+    for i in range(0, len(bits), 8):
+        byte = 0
+        for bit in bits[i:i + 8]:
+            byte = byte << 1 | bit
+        out.append(byte)
+
+    return struct.pack("<2sBBI", b"HS", window_bits, lookahead_bits, len(data)) + bytes(out)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print("Usage: python3 bin2hs.py firmware.bin firmware.hs [window_bits [lookahead_bits]]")
+        sys.exit(1)
+
+    window_bits = int(sys.argv[3]) if len(sys.argv) > 3 else 11
+    lookahead_bits = int(sys.argv[4]) if len(sys.argv) > 4 else 4
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+
+    packed = compress(data, window_bits, lookahead_bits)
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(packed)
+
+    print(f"{len(data)} -> {len(packed)} bytes")
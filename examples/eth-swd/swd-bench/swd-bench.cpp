@@ -0,0 +1,195 @@
+/**
+ * SWD throughput benchmark
+ *
+ * Runs RAM loads, block reads and CRC verification for a matrix of SWD clock
+ * rates and block sizes. Each measurement is printed as one JSON object per
+ * line (lines starting with '{'), other lines are log output of the loader.
+ *
+ * Build with SWD_HOST_SIMULATION to run against a simulated RP2040 on a host
+ * (see README.md). Time is simulated then and only includes the wire.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Includes
+ * ----------------------------------------------------------------------------------------------------
+ */
+#include <stdio.h>
+#include "swdloader.h"
+#ifdef SWD_HOST_SIMULATION
+#include "swdsimtarget.hpp"
+#else
+#include "pico/stdlib.h"
+#endif
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Macros
+ * ----------------------------------------------------------------------------------------------------
+ */
+/* GPIO pins */
+#define SWCLK_PIN 2
+#define SWDIO_PIN 3
+#define SWD_RESET_PIN 4 // 0 for none
+
+/* Benchmark */
+#define BENCH_RAM_ADDRESS 0x20000000U
+#define BENCH_MAX_BLOCK_SIZE (16 * 1024)
+#define BENCH_MIN_BYTES (64 * 1024) // per measurement, blocks are repeated
+#define BENCH_FILL_WORD 0xE7FEE7FEU // "b ." in Thumb, the loaded image spins
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Variables
+ * ----------------------------------------------------------------------------------------------------
+ */
+static const unsigned g_clock_rates_khz[] = {400, 1000, 4000, 12000, 24000};
+static const unsigned g_block_sizes[] = {256, 1024, 4096, BENCH_MAX_BLOCK_SIZE};
+
+static uint32_t g_image[BENCH_MAX_BLOCK_SIZE / 4];
+static uint32_t g_read_buffer[BENCH_MAX_BLOCK_SIZE / 4];
+
+enum bench_op
+{
+    BENCH_OP_LOAD,
+    BENCH_OP_READ,
+    BENCH_OP_VERIFY,
+    BENCH_OP_COUNT
+};
+
+static const char *g_op_names[BENCH_OP_COUNT] = {"load", "read", "verify"};
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Functions
+ * ----------------------------------------------------------------------------------------------------
+ */
+static uint64_t get_ticks_us(void)
+{
+    return TSWDWire::TTimer::Get()->GetClockTicks();
+}
+
+static bool run_op(CSWDLoader &loader, bench_op op, size_t block_size)
+{
+    switch (op)
+    {
+    case BENCH_OP_LOAD:
+        return loader.Load(g_image, block_size, BENCH_RAM_ADDRESS);
+
+    case BENCH_OP_READ:
+        return loader.ReadBlock(BENCH_RAM_ADDRESS, g_read_buffer, block_size / 4);
+
+    case BENCH_OP_VERIFY:
+        return loader.VerifyCRC(g_image, block_size, BENCH_RAM_ADDRESS);
+
+    default:
+        return false;
+    }
+}
+
+/* Splits the time per transfer into the SWD phases, the rest is idle cycles and CPU overhead */
+static void report(CSWDLoader &loader, bench_op op, unsigned clock_khz, size_t block_size,
+                   size_t bytes, uint64_t elapsed_us, bool ok)
+{
+    const CSWDLoader::TStatistics &stats = loader.GetStatistics();
+
+    unsigned transfers = stats.nTransfers > 0 ? stats.nTransfers : 1;
+    double seconds = elapsed_us > 0 ? elapsed_us / 1e6 : 1e-6;
+    double bit_ns = 1e6 / loader.GetClockRateKHz();
+    uint64_t wire_bits = stats.nRequestBits + stats.nAckBits + stats.nDataBits + stats.nIdleBits;
+
+    double ns_transfer = elapsed_us * 1000.0 / transfers;
+    double ns_request = stats.nRequestBits * bit_ns / transfers;
+    double ns_ack = stats.nAckBits * bit_ns / transfers;
+    double ns_data = stats.nDataBits * bit_ns / transfers;
+
+    printf("{\"op\":\"%s\",\"clock_khz\":%u,\"actual_khz\":%u,\"block\":%u,\"bytes\":%u,\"ok\":%s,"
+           "\"kbytes_s\":%.1f,\"wire_kbit_s\":%.1f,\"transfers\":%u,"
+           "\"ns_transfer\":%.0f,\"ns_request\":%.0f,\"ns_ack\":%.0f,\"ns_data\":%.0f,\"ns_other\":%.0f,"
+           "\"tar_csw_share\":%.4f,\"irq_free\":%s,\"irq_off_us\":%llu,\"irq_off_max_us\":%u}\n",
+           g_op_names[op], clock_khz, loader.GetClockRateKHz(), (unsigned)block_size, (unsigned)bytes,
+           ok ? "true" : "false",
+           bytes / seconds / 1024.0, wire_bits / seconds / 1000.0, stats.nTransfers,
+           ns_transfer, ns_request, ns_ack, ns_data, ns_transfer - ns_request - ns_ack - ns_data,
+           (double)(stats.nTARWrites + stats.nCSWWrites) / transfers,
+           loader.IsInterruptFree() ? "true" : "false",
+           (unsigned long long)stats.nInterruptsOffTicks, stats.nMaxInterruptsOffTicks);
+}
+
+static void run_benchmark(void)
+{
+    for (unsigned i = 0; i < sizeof g_image / sizeof g_image[0]; i++)
+    {
+        g_image[i] = BENCH_FILL_WORD;
+    }
+
+    for (unsigned clock_khz : g_clock_rates_khz)
+    {
+        CSWDLoader loader(SWCLK_PIN, SWDIO_PIN, SWD_RESET_PIN, clock_khz);
+        if (!loader.Initialize())
+        {
+            printf("{\"clock_khz\":%u,\"ok\":false,\"error\":\"initialize\"}\n", clock_khz);
+
+            continue;
+        }
+
+        for (unsigned block_size : g_block_sizes)
+        {
+            for (unsigned op = 0; op < BENCH_OP_COUNT; op++)
+            {
+                unsigned repeat = BENCH_MIN_BYTES / block_size;
+                bool ok = true;
+
+                loader.ResetStatistics();
+                uint64_t start_us = get_ticks_us();
+
+                for (unsigned n = 0; n < repeat && ok; n++)
+                {
+                    ok = run_op(loader, (bench_op)op, block_size);
+                }
+
+                report(loader, (bench_op)op, clock_khz, block_size, repeat * block_size,
+                       get_ticks_us() - start_us, ok);
+            }
+        }
+    }
+}
+
+/**
+ * ----------------------------------------------------------------------------------------------------
+ * Main
+ * ----------------------------------------------------------------------------------------------------
+ */
+#ifdef SWD_HOST_SIMULATION
+
+int main()
+{
+    static CSWDSimTarget target;
+    CSWDSimBus::Get()->Connect(&target, SWCLK_PIN, SWDIO_PIN);
+
+    run_benchmark();
+
+    return 0;
+}
+
+#else
+
+int main()
+{
+    stdio_init_all();
+
+    sleep_ms(3000); // time to open the USB serial port
+
+    run_benchmark();
+
+    printf("Benchmark done\n");
+
+    while (1)
+    {
+        tight_loop_contents();
+    }
+}
+
+#endif
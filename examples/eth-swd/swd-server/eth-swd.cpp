@@ -17,6 +17,11 @@ extern "C" {
 #include "wizchip_spi.h"
 
 #include "httpServer.h"
+#include "dapServer.h"
+#include "gdbServer.h"
+#include "rttServer.h"
+#include "watchServer.h"
+#include "imageStore.h"
 
 }
 #include "swdloader.h"
@@ -39,6 +44,14 @@ static const uint8_t Firmware[] =
 
 /* Socket */
 #define HTTP_SOCKET_MAX_NUM 4
+#define DAP_SOCKET 4 // CMSIS-DAP server (after the HTTP sockets)
+#define GDB_SOCKET 5 // GDB server
+#define RTT_SOCKET 6 // RTT log streaming
+#define WATCH_SOCKET 7 // data watch (UDP)
+
+/* Target */
+#define AUTO_PROGRAM 0 // 1 to write Firmware[] (firmware.h) to the target at power-up (production fixtures),
+                       // skipped for a flash image (SWD_PROGRAM_FLASH 1), which the target holds already
 
 /**
  * ----------------------------------------------------------------------------------------------------
@@ -97,6 +110,9 @@ static uint8_t g_http_socket_num_list[HTTP_SOCKET_MAX_NUM] = {0, 1, 2, 3};
 /* Clock */
 static void set_clock_khz(void);
 
+/* Target */
+extern "C" void swdloader_auto_program(const uint8_t* image, size_t size);
+
 /**
  * ----------------------------------------------------------------------------------------------------
  * Main
@@ -111,6 +127,11 @@ int main()
 
     stdio_init_all();
 
+#if AUTO_PROGRAM
+    /* Program the target on core 1, while the network is brought up */
+    swdloader_auto_program(Firmware, sizeof Firmware);
+#endif
+
     wizchip_spi_initialize();
     wizchip_cris_initialize();
 
@@ -120,7 +141,14 @@ int main()
 
     network_initialize(g_net_info);
 
+    /* Images kept in the probe flash */
+    imageStore_init();
+
     httpServer_init(g_http_send_buf, g_http_recv_buf, HTTP_SOCKET_MAX_NUM, g_http_socket_num_list);
+    dapServer_init(DAP_SOCKET);
+    gdbServer_init(GDB_SOCKET);
+    rttServer_init(RTT_SOCKET);
+    watchServer_init(WATCH_SOCKET);
     
     /* Get network information */
     print_network_information(g_net_info);
@@ -141,6 +169,18 @@ int main()
         {
             httpServer_run(i);
         }
+
+        /* Run CMSIS-DAP server */
+        dapServer_run();
+
+        /* Run GDB server */
+        gdbServer_run();
+
+        /* Run RTT server */
+        rttServer_run();
+
+        /* Run data watch server */
+        watchServer_run();
     }
 
 }
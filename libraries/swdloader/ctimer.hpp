@@ -4,6 +4,8 @@
 #include "pico/stdlib.h"
 #include "pico/time.h"
 #include "hardware/timer.h"
+#include "hardware/clocks.h"
+#include "pico/platform.h"
 
 class CTimer {
 public:
@@ -14,15 +16,21 @@ public:
     }
 
     // Delay methods
-    void DelayNanos(uint32_t ns)  { busy_wait_us(ns / 1000); }
+    void DelayNanos(uint32_t ns)  { CycleDelay(NanosToCycles(ns)); }
     void DelayMicros(uint32_t us) { busy_wait_us(us); }
-    void nsDelay(uint32_t ns)     { busy_wait_us(ns / 1000); }  // <- Circle-style method
+    void nsDelay(uint32_t ns)     { CycleDelay(NanosToCycles(ns)); }  // <- Circle-style method
+    void CycleDelay(uint32_t cycles) { busy_wait_at_least_cycles(cycles); }  // clk_sys cycles
     void DelayMillis(uint32_t ms) { sleep_ms(ms); }
     void MsDelay(uint32_t ms)     { sleep_ms(ms); }
 
     // Clock tick counter (since boot, in microseconds)
     uint64_t GetClockTicks()      { return time_us_64(); }
 
+    // Rounded up, so that delays are never shorter than requested
+    static uint32_t NanosToCycles(uint32_t ns) {
+        return ((uint64_t) ns * clock_get_hz(clk_sys) + 999999999U) / 1000000000U;
+    }
+
 private:
     CTimer() {}  // Private constructor for singleton pattern
 };
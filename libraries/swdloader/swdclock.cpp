@@ -0,0 +1,137 @@
+//
+// swdclock.cpp
+//
+// SWCLK timing for CSWDLoader, derived from the system clock
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "swdclock.h"
+#include "swdwire.h"
+#include <assert.h>
+
+#define PIO_DIVIDER_MAX		0xFFFF
+
+CSWDClock::CSWDClock (unsigned nRateKHz)
+:	m_nRequestedRate (nRateKHz * 1000),
+	m_nMaxRate (0),
+	m_nSystemClock (0),
+	m_nOverheadCycles (0)
+{
+	assert (nRateKHz > 0);
+
+	Update ();
+}
+
+bool CSWDClock::Update (void)
+{
+	unsigned nSystemClock = TSWDWire::GetSystemClock ();
+	if (nSystemClock == m_nSystemClock)
+	{
+		return false;
+	}
+
+	m_nSystemClock = nSystemClock;
+
+	Calculate ();
+
+	return true;
+}
+
+bool CSWDClock::SetRate (unsigned nRateKHz)
+{
+	assert (nRateKHz > 0);
+
+	if (nRateKHz * 1000 == m_nRequestedRate)
+	{
+		return false;
+	}
+
+	m_nRequestedRate = nRateKHz * 1000;
+
+	Calculate ();
+
+	return true;
+}
+
+bool CSWDClock::SetMaxRate (unsigned nRateKHz)
+{
+	if (nRateKHz * 1000 == m_nMaxRate)
+	{
+		return false;
+	}
+
+	m_nMaxRate = nRateKHz * 1000;
+
+	Calculate ();
+
+	return true;
+}
+
+unsigned CSWDClock::GetTargetRate (void) const
+{
+	if (   m_nMaxRate != 0
+	    && m_nMaxRate < m_nRequestedRate)
+	{
+		return m_nMaxRate;
+	}
+
+	return m_nRequestedRate;
+}
+
+unsigned CSWDClock::GetPIORate (void) const
+{
+	return m_nSystemClock / (2 * m_nPIODivider);
+}
+
+void CSWDClock::SetOverheadCycles (unsigned nCycles)
+{
+	m_nOverheadCycles = nCycles;
+
+	Calculate ();
+}
+
+unsigned CSWDClock::GetBitBangRate (void) const
+{
+	unsigned nPeriod = 2 * m_nDelayCycles + m_nOverheadCycles;
+	if (nPeriod == 0)
+	{
+		return m_nSystemClock;
+	}
+
+	return m_nSystemClock / nPeriod;
+}
+
+void CSWDClock::Calculate (void)
+{
+	// cycles per SWCLK period, rounded up
+	unsigned nRate = GetTargetRate ();
+	unsigned nPeriod = (m_nSystemClock + nRate - 1) / nRate;
+
+	// an integer divider, a fractional one would shorten single periods
+	m_nPIODivider = (nPeriod + 1) / 2;
+	if (m_nPIODivider < 1)
+	{
+		m_nPIODivider = 1;
+	}
+	else if (m_nPIODivider > PIO_DIVIDER_MAX)
+	{
+		m_nPIODivider = PIO_DIVIDER_MAX;
+	}
+
+	m_nDelayCycles = 0;
+	if (nPeriod > m_nOverheadCycles)
+	{
+		m_nDelayCycles = (nPeriod - m_nOverheadCycles + 1) / 2;
+	}
+}
@@ -0,0 +1,84 @@
+//
+// swdclock.h
+//
+// SWCLK timing for CSWDLoader, derived from the system clock
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdclock_h
+#define _pico_swdclock_h
+
+#include <stdint.h>
+
+class CSWDClock		/// Derives cycle counts per SWCLK edge from clk_sys
+{
+public:
+	/// \param nRateKHz Requested interface clock rate in KHz
+	/// \note All rates are rounded down, SWCLK never runs faster than requested.
+	CSWDClock (unsigned nRateKHz);
+
+	/// \brief Recalculate the timing, if clk_sys has been changed
+	/// \return Has the timing been recalculated?
+	bool Update (void);
+
+	/// \brief Change the requested interface clock rate
+	/// \param nRateKHz Requested interface clock rate in KHz
+	/// \return Has the timing been recalculated?
+	bool SetRate (unsigned nRateKHz);
+
+	/// \brief Limit the interface clock rate to the maximum of the current target
+	/// \param nRateKHz Maximum clock rate in KHz (0 for no limit)
+	/// \return Has the timing been recalculated?
+	bool SetMaxRate (unsigned nRateKHz);
+
+	/// \return Integer clock divider for a PIO state machine,\n
+	///	    which needs two cycles per SWCLK period
+	unsigned GetPIODivider (void) const		{ return m_nPIODivider; }
+
+	/// \return SWCLK rate with the PIO divider in Hz
+	unsigned GetPIORate (void) const;
+
+	/// \brief Set the code overhead of one bit-banged SWCLK period
+	/// \param nCycles Number of clk_sys cycles, spent outside of the delays
+	void SetOverheadCycles (unsigned nCycles);
+
+	/// \return clk_sys cycles to be waited per SWCLK half period (bit-banging)
+	unsigned GetDelayCycles (void) const		{ return m_nDelayCycles; }
+
+	/// \return Expected bit-banged SWCLK rate in Hz
+	unsigned GetBitBangRate (void) const;
+
+	/// \return Requested SWCLK rate in Hz
+	unsigned GetRequestedRate (void) const		{ return m_nRequestedRate; }
+
+	/// \return Requested SWCLK rate, limited to the maximum of the target in Hz
+	unsigned GetTargetRate (void) const;
+
+	/// \return Current clk_sys rate in Hz
+	unsigned GetSystemClock (void) const		{ return m_nSystemClock; }
+
+private:
+	void Calculate (void);
+
+private:
+	unsigned m_nRequestedRate;
+	unsigned m_nMaxRate;			// 0 for no limit
+	unsigned m_nSystemClock;
+	unsigned m_nOverheadCycles;
+
+	unsigned m_nPIODivider;
+	unsigned m_nDelayCycles;
+};
+
+#endif
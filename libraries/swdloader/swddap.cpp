@@ -0,0 +1,891 @@
+//
+// swddap.cpp
+//
+// Executes CMSIS-DAP commands with the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// The transfer commands follow the reference implementation of CMSIS-DAP
+// (DAP.c): AP reads are posted, the result of the previous read is returned
+// with the next one and the last result is collected from DP RDBUFF. The
+// last write of a packet is checked with a RDBUFF read.
+//
+#include "swddap.h"
+#include <string.h>
+#include <assert.h>
+
+//
+// References:
+//
+// [1] CMSIS-DAP Debug Unit Firmware, Command Specification (version 2.1)
+//
+
+#define DAP_PROTOCOL_VERSION	"2.1.1"
+#define DAP_PRODUCT_NAME	"eth-swd CMSIS-DAP"
+
+// Commands
+#define ID_DAP_Info			0x00
+	#define DAP_ID_VENDOR			0x01
+	#define DAP_ID_PRODUCT			0x02
+	#define DAP_ID_SER_NUM			0x03
+	#define DAP_ID_DAP_FW_VER		0x04
+	#define DAP_ID_CAPABILITIES		0xF0
+		#define DAP_CAP_SWD			(1U << 0)
+		#define DAP_CAP_ATOMIC_COMMANDS		(1U << 4)
+	#define DAP_ID_PACKET_COUNT		0xFE
+	#define DAP_ID_PACKET_SIZE		0xFF
+#define ID_DAP_HostStatus		0x01
+#define ID_DAP_Connect			0x02
+	#define DAP_PORT_AUTODETECT		0
+	#define DAP_PORT_DISABLED		0
+	#define DAP_PORT_SWD			1
+#define ID_DAP_Disconnect		0x03
+#define ID_DAP_TransferConfigure	0x04
+#define ID_DAP_Transfer			0x05
+#define ID_DAP_TransferBlock		0x06
+#define ID_DAP_TransferAbort		0x07
+#define ID_DAP_WriteABORT		0x08
+#define ID_DAP_Delay			0x09
+#define ID_DAP_ResetTarget		0x0A
+#define ID_DAP_SWJ_Pins			0x10
+	#define DAP_SWJ_nRESET			(1U << 7)
+#define ID_DAP_SWJ_Clock		0x11
+#define ID_DAP_SWJ_Sequence		0x12
+#define ID_DAP_SWD_Configure		0x13
+	#define DAP_SWD_TURNAROUND__MASK	0x03	// 0: 1 cycle
+	#define DAP_SWD_DATA_PHASE		(1U << 2)
+#define ID_DAP_SWD_Sequence		0x1D
+	#define DAP_SWD_SEQUENCE_CLK__MASK	0x3F	// 0: 64 cycles
+	#define DAP_SWD_SEQUENCE_DIN		(1U << 7)
+#define ID_DAP_QueueCommands		0x7E
+#define ID_DAP_ExecuteCommands		0x7F
+#define ID_DAP_Invalid			0xFF
+
+// Status
+#define DAP_OK				0x00
+#define DAP_ERROR			0xFF
+
+// Transfer request
+#define DAP_TRANSFER_APnDP		(1U << 0)
+#define DAP_TRANSFER_RnW		(1U << 1)
+#define DAP_TRANSFER_A__MASK		(3U << 2)
+#define DAP_TRANSFER_MATCH_VALUE	(1U << 4)
+#define DAP_TRANSFER_MATCH_MASK		(1U << 5)
+
+#define DP_ABORT			0x00	// as transfer request
+#define DP_RDBUFF			0x0C
+
+// Transfer response
+#define DAP_TRANSFER_OK			0x01
+#define DAP_TRANSFER_WAIT		0x02
+#define DAP_TRANSFER_FAULT		0x04
+#define DAP_TRANSFER_ERROR		0x08	// parity error or not connected
+#define DAP_TRANSFER_MISMATCH		0x10
+
+#define RESET_PULSE_MS			10
+
+CSWDDAP::CSWDDAP (unsigned nClockPin, unsigned nDataPin, unsigned nResetPin,
+		  unsigned nClockRateKHz)
+:	m_nClockPin (nClockPin),
+	m_nDataPin (nDataPin),
+	m_nResetPin (nResetPin),
+	m_nClockRateKHz (nClockRateKHz),
+	m_pLoader (0),
+	m_bInBatch (false),
+	m_bResetAsserted (false),
+	m_nIdleCycles (0),
+	m_nWaitRetries (100),
+	m_nMatchRetries (0),
+	m_nMatchMask (0),
+	m_pRequest (0),
+	m_pRequestEnd (0),
+	m_bRequestOverrun (false),
+	m_pResponse (0),
+	m_pResponseEnd (0)
+{
+}
+
+CSWDDAP::~CSWDDAP (void)
+{
+	Disconnect ();
+}
+
+unsigned CSWDDAP::Process (const uint8_t *pRequest, unsigned nRequestLength, uint8_t *pResponse)
+{
+	assert (pRequest != 0);
+	assert (pResponse != 0);
+
+	if (nRequestLength == 0)
+	{
+		return 0;
+	}
+
+	m_pRequest = pRequest;
+	m_pRequestEnd = pRequest + nRequestLength;
+	m_bRequestOverrun = false;
+
+	m_pResponse = pResponse;
+	m_pResponseEnd = pResponse + PacketSize;
+
+	// the whole packet is one transaction
+	m_bInBatch = true;
+	if (m_pLoader != 0)
+	{
+		m_pLoader->BeginRaw ();
+	}
+
+	uint8_t uchCommand = *m_pRequest;
+	if (   uchCommand == ID_DAP_ExecuteCommands
+	    || uchCommand == ID_DAP_QueueCommands)	// queued by the host already
+	{
+		Get8 ();
+		unsigned nCount = Get8 ();
+
+		Put8 (ID_DAP_ExecuteCommands);
+		uint8_t *pCount = m_pResponse;
+		Put8 (0);
+
+		for (unsigned i = 0; i < nCount && !m_bRequestOverrun; i++)
+		{
+			uint8_t *pCommandResponse = m_pResponse;
+			if (!ExecuteCommand ())
+			{
+				break;
+			}
+
+			if (m_pResponse != pCommandResponse)	// not DAP_TransferAbort
+			{
+				(*pCount)++;
+			}
+		}
+	}
+	else
+	{
+		ExecuteCommand ();
+	}
+
+	if (m_pLoader != 0)
+	{
+		m_pLoader->EndRaw ();
+	}
+	m_bInBatch = false;
+
+	return m_pResponse - pResponse;
+}
+
+void CSWDDAP::Disconnect (void)
+{
+	if (m_pLoader == 0)
+	{
+		return;
+	}
+
+	if (m_bInBatch)
+	{
+		m_pLoader->EndRaw ();
+	}
+
+	delete m_pLoader;
+	m_pLoader = 0;
+}
+
+// Returns false, if the command is unknown (its length is unknown too)
+bool CSWDDAP::ExecuteCommand (void)
+{
+	uint8_t *pResponse = m_pResponse;
+
+	uint8_t uchCommand = Get8 ();
+
+	// packets are executed at once, there is nothing to abort and no response
+	if (uchCommand == ID_DAP_TransferAbort)
+	{
+		return true;
+	}
+
+	Put8 (uchCommand);
+
+	switch (uchCommand)
+	{
+	case ID_DAP_Info:
+		Info ();
+		break;
+
+	case ID_DAP_HostStatus:
+		Get8 ();			// type
+		Get8 ();			// status
+		Put8 (DAP_OK);
+		break;
+
+	case ID_DAP_Connect:
+		Connect ();
+		break;
+
+	case ID_DAP_Disconnect:
+		Disconnect ();
+		Put8 (DAP_OK);
+		break;
+
+	case ID_DAP_TransferConfigure:
+		m_nIdleCycles = Get8 ();
+		m_nWaitRetries = Get16 ();
+		m_nMatchRetries = Get16 ();
+		Put8 (DAP_OK);
+		break;
+
+	case ID_DAP_Transfer:
+		Transfer ();
+		break;
+
+	case ID_DAP_TransferBlock:
+		TransferBlock ();
+		break;
+
+	case ID_DAP_WriteABORT:
+		WriteAbort ();
+		break;
+
+	case ID_DAP_Delay:
+		TSWDWire::TTimer::Get ()->DelayMicros (Get16 ());
+		Put8 (DAP_OK);
+		break;
+
+	case ID_DAP_ResetTarget:
+		ResetTarget ();
+		break;
+
+	case ID_DAP_SWJ_Pins:
+		SWJPins ();
+		break;
+
+	case ID_DAP_SWJ_Clock:
+		SWJClock ();
+		break;
+
+	case ID_DAP_SWJ_Sequence:
+		SWJSequence ();
+		break;
+
+	case ID_DAP_SWD_Configure:
+		SWDConfigure ();
+		break;
+
+	case ID_DAP_SWD_Sequence:
+		SWDSequence ();
+		break;
+
+	default:
+		m_pResponse = pResponse;
+		Put8 (ID_DAP_Invalid);
+		return false;
+	}
+
+	return true;
+}
+
+void CSWDDAP::Info (void)
+{
+	uint8_t uchID = Get8 ();
+	switch (uchID)
+	{
+	case DAP_ID_PRODUCT:
+		PutString (DAP_PRODUCT_NAME);
+		break;
+
+	case DAP_ID_DAP_FW_VER:
+		PutString (DAP_PROTOCOL_VERSION);
+		break;
+
+	case DAP_ID_CAPABILITIES:
+		Put8 (1);
+		Put8 (DAP_CAP_SWD | DAP_CAP_ATOMIC_COMMANDS);
+		break;
+
+	case DAP_ID_PACKET_COUNT:
+		Put8 (1);
+		Put8 (PacketCount);
+		break;
+
+	case DAP_ID_PACKET_SIZE:
+		Put8 (2);
+		Put16 (PacketSize);
+		break;
+
+	default:				// not available
+		Put8 (0);
+		break;
+	}
+}
+
+void CSWDDAP::Connect (void)
+{
+	uint8_t uchPort = Get8 ();
+	if (   uchPort != DAP_PORT_AUTODETECT
+	    && uchPort != DAP_PORT_SWD)
+	{
+		Put8 (DAP_PORT_DISABLED);		// no JTAG
+
+		return;
+	}
+
+	if (m_pLoader == 0)
+	{
+		m_pLoader = new CSWDLoader (m_nClockPin, m_nDataPin, m_nResetPin, m_nClockRateKHz);
+		assert (m_pLoader != 0);
+
+		m_bResetAsserted = false;
+
+		if (m_bInBatch)
+		{
+			m_pLoader->BeginRaw ();
+		}
+	}
+
+	Put8 (DAP_PORT_SWD);
+}
+
+// Request byte of a SWD packet from that of DAP_Transfer
+static uint8_t SWDRequest (uint8_t uchRequest)
+{
+	uchRequest &= DAP_TRANSFER_APnDP | DAP_TRANSFER_RnW | DAP_TRANSFER_A__MASK;
+
+	unsigned nParity = __builtin_popcount (uchRequest) & 1;
+
+	return 0x81 | uchRequest << 1 | nParity << 5;	// with start and park bit
+}
+
+// Transfers one packet, while the target responds with WAIT
+unsigned CSWDDAP::TransferRetry (uint8_t uchRequest, uint32_t *pData)
+{
+	assert (m_pLoader != 0);
+
+	uint32_t nDummy = 0;
+	if (pData == 0)
+	{
+		pData = &nDummy;
+	}
+
+	unsigned nResponse;
+	unsigned nRetry = m_nWaitRetries;
+	do
+	{
+		nResponse = m_pLoader->RawTransfer (SWDRequest (uchRequest), pData);
+	}
+	while (   nResponse == DAP_TRANSFER_WAIT
+	       && nRetry-- > 0);
+
+	if (m_nIdleCycles > 0)
+	{
+		static const uint8_t Zero[256 / 8] = {0};
+		m_pLoader->RawSequence (Zero, m_nIdleCycles);
+	}
+
+	return nResponse;
+}
+
+void CSWDDAP::Transfer (void)
+{
+	Get8 ();				// DAP index (JTAG only)
+	unsigned nCount = Get8 ();
+
+	uint8_t *pResponseHead = m_pResponse;
+	Put8 (0);				// transfer count
+	Put8 (0);				// transfer response
+
+	unsigned nResponseCount = 0;
+	unsigned nResponse = m_pLoader != 0 ? 0 : DAP_TRANSFER_ERROR;
+	bool bPostRead = false;
+	bool bCheckWrite = false;
+	uint32_t nData;
+
+	for (; nCount > 0 && m_pLoader != 0; nCount--)
+	{
+		uint8_t uchRequest = Get8 ();
+		if (uchRequest & DAP_TRANSFER_RnW)
+		{
+			// consumed first, so that a failed request is skipped completely
+			uint32_t nMatchValue = uchRequest & DAP_TRANSFER_MATCH_VALUE ? Get32 () : 0;
+
+			if (bPostRead)
+			{
+				if ((uchRequest & (DAP_TRANSFER_APnDP | DAP_TRANSFER_MATCH_VALUE))
+				    == DAP_TRANSFER_APnDP)
+				{
+					// read previous AP data and post next AP read
+					nResponse = TransferRetry (uchRequest, &nData);
+				}
+				else
+				{
+					// read previous AP data
+					nResponse = TransferRetry (DP_RDBUFF | DAP_TRANSFER_RnW, &nData);
+					bPostRead = false;
+				}
+
+				if (nResponse != DAP_TRANSFER_OK)
+				{
+					break;
+				}
+
+				Put32 (nData);
+			}
+
+			if (uchRequest & DAP_TRANSFER_MATCH_VALUE)
+			{
+				unsigned nMatchRetry = m_nMatchRetries;
+
+				if (uchRequest & DAP_TRANSFER_APnDP)
+				{
+					nResponse = TransferRetry (uchRequest, 0);	// post AP read
+					if (nResponse != DAP_TRANSFER_OK)
+					{
+						break;
+					}
+				}
+
+				do
+				{
+					// read register until its value matches or the retries expire
+					nResponse = TransferRetry (uchRequest, &nData);
+					if (nResponse != DAP_TRANSFER_OK)
+					{
+						break;
+					}
+				}
+				while (   (nData & m_nMatchMask) != nMatchValue
+				       && nMatchRetry-- > 0);
+
+				if ((nData & m_nMatchMask) != nMatchValue)
+				{
+					nResponse |= DAP_TRANSFER_MISMATCH;
+				}
+
+				if (nResponse != DAP_TRANSFER_OK)
+				{
+					break;
+				}
+			}
+			else if (uchRequest & DAP_TRANSFER_APnDP)
+			{
+				if (!bPostRead)
+				{
+					nResponse = TransferRetry (uchRequest, 0);	// post AP read
+					if (nResponse != DAP_TRANSFER_OK)
+					{
+						break;
+					}
+
+					bPostRead = true;
+				}
+			}
+			else
+			{
+				nResponse = TransferRetry (uchRequest, &nData);	// DP register
+				if (nResponse != DAP_TRANSFER_OK)
+				{
+					break;
+				}
+
+				Put32 (nData);
+			}
+
+			bCheckWrite = false;
+		}
+		else
+		{
+			if (bPostRead)
+			{
+				// read previous data
+				nResponse = TransferRetry (DP_RDBUFF | DAP_TRANSFER_RnW, &nData);
+				if (nResponse != DAP_TRANSFER_OK)
+				{
+					break;
+				}
+
+				Put32 (nData);
+				bPostRead = false;
+			}
+
+			nData = Get32 ();
+			if (uchRequest & DAP_TRANSFER_MATCH_MASK)
+			{
+				m_nMatchMask = nData;
+				nResponse = DAP_TRANSFER_OK;
+			}
+			else
+			{
+				nResponse = TransferRetry (uchRequest, &nData);
+				if (nResponse != DAP_TRANSFER_OK)
+				{
+					break;
+				}
+
+				bCheckWrite = true;
+			}
+		}
+
+		nResponseCount++;
+	}
+
+	// skip the remaining requests
+	if (nCount > 0 && m_pLoader != 0)
+	{
+		nCount--;			// the failed one has been read
+	}
+
+	for (; nCount > 0; nCount--)
+	{
+		uint8_t uchRequest = Get8 ();
+		if (   !(uchRequest & DAP_TRANSFER_RnW)
+		    || (uchRequest & DAP_TRANSFER_MATCH_VALUE))
+		{
+			Get32 ();
+		}
+	}
+
+	if (nResponse == DAP_TRANSFER_OK)
+	{
+		if (bPostRead)
+		{
+			nResponse = TransferRetry (DP_RDBUFF | DAP_TRANSFER_RnW, &nData);
+			if (nResponse == DAP_TRANSFER_OK)
+			{
+				Put32 (nData);
+			}
+		}
+		else if (bCheckWrite)
+		{
+			nResponse = TransferRetry (DP_RDBUFF | DAP_TRANSFER_RnW, 0);
+		}
+	}
+
+	pResponseHead[0] = (uint8_t) nResponseCount;
+	pResponseHead[1] = (uint8_t) nResponse;
+}
+
+void CSWDDAP::TransferBlock (void)
+{
+	Get8 ();				// DAP index (JTAG only)
+	unsigned nCount = Get16 ();
+	uint8_t uchRequest = Get8 ();
+
+	uint8_t *pResponseHead = m_pResponse;
+	Put16 (0);				// transfer count
+	Put8 (0);				// transfer response
+
+	unsigned nResponseCount = 0;
+	unsigned nResponse = m_pLoader != 0 ? 0 : DAP_TRANSFER_ERROR;
+	uint32_t nData;
+
+	if (uchRequest & DAP_TRANSFER_RnW)
+	{
+		// the response must fit into one packet
+		unsigned nMaxCount = GetResponseSpace () / 4;
+		if (nCount > nMaxCount)
+		{
+			nCount = nMaxCount;
+		}
+
+		if (   nCount > 0
+		    && m_pLoader != 0
+		    && (uchRequest & DAP_TRANSFER_APnDP))
+		{
+			nResponse = TransferRetry (uchRequest, 0);	// post AP read
+			if (nResponse != DAP_TRANSFER_OK)
+			{
+				nCount = 0;
+			}
+		}
+
+		for (; nCount > 0 && m_pLoader != 0; nCount--)
+		{
+			if (   nCount == 1
+			    && (uchRequest & DAP_TRANSFER_APnDP))
+			{
+				uchRequest = DP_RDBUFF | DAP_TRANSFER_RnW;	// last AP result
+			}
+
+			nResponse = TransferRetry (uchRequest, &nData);
+			if (nResponse != DAP_TRANSFER_OK)
+			{
+				break;
+			}
+
+			Put32 (nData);
+			nResponseCount++;
+		}
+	}
+	else
+	{
+		while (nCount > 0 && m_pLoader != 0)
+		{
+			nData = Get32 ();
+			nCount--;
+			if (m_bRequestOverrun)
+			{
+				nResponse = DAP_TRANSFER_ERROR;
+				break;
+			}
+
+			nResponse = TransferRetry (uchRequest, &nData);
+			if (nResponse != DAP_TRANSFER_OK)
+			{
+				break;
+			}
+
+			nResponseCount++;
+		}
+
+		if (nResponse == DAP_TRANSFER_OK)
+		{
+			nResponse = TransferRetry (DP_RDBUFF | DAP_TRANSFER_RnW, 0);	// check last write
+		}
+
+		Skip (nCount * 4);		// remaining data of a failed block
+	}
+
+	pResponseHead[0] = (uint8_t) nResponseCount;
+	pResponseHead[1] = (uint8_t) (nResponseCount >> 8);
+	pResponseHead[2] = (uint8_t) nResponse;
+}
+
+void CSWDDAP::WriteAbort (void)
+{
+	Get8 ();				// DAP index (JTAG only)
+	uint32_t nData = Get32 ();
+
+	if (m_pLoader == 0)
+	{
+		Put8 (DAP_ERROR);
+
+		return;
+	}
+
+	TransferRetry (DP_ABORT, &nData);
+
+	Put8 (DAP_OK);
+}
+
+void CSWDDAP::ResetTarget (void)
+{
+	if (   m_pLoader == 0
+	    || !m_pLoader->SetResetLine (true))
+	{
+		Put8 (DAP_OK);
+		Put8 (0);			// no device specific reset
+
+		return;
+	}
+
+	TSWDWire::TTimer::Get ()->MsDelay (RESET_PULSE_MS);
+	m_pLoader->SetResetLine (false);
+	m_bResetAsserted = false;
+
+	Put8 (DAP_OK);
+	Put8 (1);
+}
+
+// Only nRESET can be controlled, the other pins belong to the engine
+void CSWDDAP::SWJPins (void)
+{
+	uint8_t uchValue = Get8 ();
+	uint8_t uchSelect = Get8 ();
+	Get32 ();				// wait time
+
+	if (   (uchSelect & DAP_SWJ_nRESET)
+	    && m_pLoader != 0
+	    && m_pLoader->SetResetLine (!(uchValue & DAP_SWJ_nRESET)))
+	{
+		m_bResetAsserted = !(uchValue & DAP_SWJ_nRESET);
+	}
+
+	Put8 (m_bResetAsserted ? 0 : DAP_SWJ_nRESET);
+}
+
+void CSWDDAP::SWJClock (void)
+{
+	uint32_t nClockHz = Get32 ();
+	if (nClockHz == 0)
+	{
+		Put8 (DAP_ERROR);
+
+		return;
+	}
+
+	m_nClockRateKHz = nClockHz >= 1000 ? nClockHz / 1000 : 1;
+	if (m_pLoader != 0)
+	{
+		m_pLoader->SetClockRateKHz (m_nClockRateKHz);
+	}
+
+	Put8 (DAP_OK);
+}
+
+void CSWDDAP::SWJSequence (void)
+{
+	unsigned nBitCount = Get8 ();
+	if (nBitCount == 0)
+	{
+		nBitCount = 256;
+	}
+
+	const uint8_t *pData = m_pRequest;
+	if (   !Skip ((nBitCount + 7) / 8)
+	    || m_pLoader == 0)
+	{
+		Put8 (DAP_ERROR);
+
+		return;
+	}
+
+	m_pLoader->RawSequence (pData, nBitCount);
+
+	Put8 (DAP_OK);
+}
+
+void CSWDDAP::SWDConfigure (void)
+{
+	uint8_t uchConfig = Get8 ();
+
+	// the engines use one turnaround cycle and no data phase after WAIT or FAULT
+	Put8 (   (uchConfig & DAP_SWD_TURNAROUND__MASK)
+	      || (uchConfig & DAP_SWD_DATA_PHASE) ? DAP_ERROR : DAP_OK);
+}
+
+void CSWDDAP::SWDSequence (void)
+{
+	unsigned nSequences = Get8 ();
+
+	uint8_t *pStatus = m_pResponse;
+	Put8 (m_pLoader != 0 ? DAP_OK : DAP_ERROR);
+
+	for (; nSequences > 0; nSequences--)
+	{
+		uint8_t uchInfo = Get8 ();
+		unsigned nBitCount = uchInfo & DAP_SWD_SEQUENCE_CLK__MASK;
+		if (nBitCount == 0)
+		{
+			nBitCount = 64;
+		}
+
+		unsigned nBytes = (nBitCount + 7) / 8;
+
+		if (uchInfo & DAP_SWD_SEQUENCE_DIN)
+		{
+			if (   *pStatus != DAP_OK
+			    || GetResponseSpace () < nBytes)
+			{
+				*pStatus = DAP_ERROR;
+
+				continue;
+			}
+
+			// the PIO engines do not sample the bits, but hosts use input
+			// sequences to skip the undriven ACK phase of TARGETSEL only
+			m_pLoader->RawReadSequence (m_pResponse, nBitCount);
+			m_pResponse += nBytes;
+		}
+		else
+		{
+			const uint8_t *pData = m_pRequest;
+			if (!Skip (nBytes))
+			{
+				*pStatus = DAP_ERROR;
+
+				break;
+			}
+
+			if (*pStatus == DAP_OK)
+			{
+				m_pLoader->RawSequence (pData, nBitCount);
+			}
+		}
+	}
+}
+
+void CSWDDAP::PutString (const char *pString)
+{
+	unsigned nLength = strlen (pString) + 1;	// with NUL
+
+	Put8 (nLength);
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		Put8 (pString[i]);
+	}
+}
+
+uint8_t CSWDDAP::Get8 (void)
+{
+	if (m_pRequest >= m_pRequestEnd)
+	{
+		m_bRequestOverrun = true;
+
+		return 0;
+	}
+
+	return *m_pRequest++;
+}
+
+uint16_t CSWDDAP::Get16 (void)
+{
+	uint16_t usValue = Get8 ();
+
+	return usValue | Get8 () << 8;
+}
+
+uint32_t CSWDDAP::Get32 (void)
+{
+	uint32_t nValue = Get16 ();
+
+	return nValue | (uint32_t) Get16 () << 16;
+}
+
+bool CSWDDAP::Skip (unsigned nBytes)
+{
+	if (nBytes > (unsigned) (m_pRequestEnd - m_pRequest))
+	{
+		m_pRequest = m_pRequestEnd;
+		m_bRequestOverrun = true;
+
+		return false;
+	}
+
+	m_pRequest += nBytes;
+
+	return true;
+}
+
+// Bytes, which do not fit into the response packet, are dropped
+void CSWDDAP::Put8 (uint8_t uchValue)
+{
+	if (m_pResponse < m_pResponseEnd)
+	{
+		*m_pResponse++ = uchValue;
+	}
+}
+
+void CSWDDAP::Put16 (uint16_t usValue)
+{
+	Put8 (usValue & 0xFF);
+	Put8 (usValue >> 8);
+}
+
+void CSWDDAP::Put32 (uint32_t nValue)
+{
+	Put16 (nValue & 0xFFFF);
+	Put16 (nValue >> 16);
+}
+
+unsigned CSWDDAP::GetResponseSpace (void) const
+{
+	return m_pResponseEnd - m_pResponse;
+}
@@ -0,0 +1,110 @@
+//
+// swddap.h
+//
+// Executes CMSIS-DAP commands with the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swddap_h
+#define _pico_swddap_h
+
+#include "swdloader.h"
+#include <stdint.h>
+
+class CSWDDAP	/// CMSIS-DAP v2 command processor (SWD only), independent of the transport
+{
+public:
+	const static unsigned PacketSize = 1024;	///< Maximum request and response size
+	const static unsigned PacketCount = 1;		///< Requests, which may be sent in advance
+
+public:
+	/// \param nClockPin GPIO pin to which SWCLK is connected
+	/// \param nDataPin GPIO pin to which SWDIO is connected
+	/// \param nResetPin Optional GPIO pin to which RESET (RUN) is connected (active LOW)
+	/// \param nClockRateKHz Initial interface clock rate in KHz
+	CSWDDAP (unsigned nClockPin, unsigned nDataPin, unsigned nResetPin = 0,
+		 unsigned nClockRateKHz = CSWDLoader::DefaultClockRateKHz);
+
+	~CSWDDAP (void);
+
+	/// \brief Execute one request packet
+	/// \param pRequest Pointer to the request
+	/// \param nRequestLength Length of the request
+	/// \param pResponse Response is returned here (PacketSize bytes)
+	/// \return Length of the response (0 for DAP_TransferAbort, which has none)
+	/// \note The transfers of the whole packet are executed in one transaction\n
+	///	  (including DAP_ExecuteCommands), with WAIT retries and posted AP\n
+	///	  reads resolved on the probe.
+	unsigned Process (const uint8_t *pRequest, unsigned nRequestLength, uint8_t *pResponse);
+
+	/// \return Has the host connected with DAP_Connect?
+	bool IsConnected (void) const		{ return m_pLoader != 0; }
+
+	/// \brief Release the SWD pins (e.g. before another loader uses them)
+	/// \note The host gets errors until it sends DAP_Connect again.
+	void Disconnect (void);
+
+private:
+	bool ExecuteCommand (void);
+
+	void Info (void);
+	void Connect (void);
+	void Transfer (void);
+	void TransferBlock (void);
+	void WriteAbort (void);
+	void ResetTarget (void);
+	void SWJPins (void);
+	void SWJClock (void);
+	void SWJSequence (void);
+	void SWDConfigure (void);
+	void SWDSequence (void);
+
+	unsigned TransferRetry (uint8_t uchRequest, uint32_t *pData);
+
+	void PutString (const char *pString);
+
+	uint8_t Get8 (void);
+	uint16_t Get16 (void);
+	uint32_t Get32 (void);
+	bool Skip (unsigned nBytes);
+
+	void Put8 (uint8_t uchValue);
+	void Put16 (uint16_t usValue);
+	void Put32 (uint32_t nValue);
+	unsigned GetResponseSpace (void) const;
+
+private:
+	unsigned m_nClockPin;
+	unsigned m_nDataPin;
+	unsigned m_nResetPin;
+	unsigned m_nClockRateKHz;
+
+	CSWDLoader *m_pLoader;			// between DAP_Connect and DAP_Disconnect
+	bool m_bInBatch;			// in Process()
+	bool m_bResetAsserted;
+
+	unsigned m_nIdleCycles;			// after each transfer
+	unsigned m_nWaitRetries;
+	unsigned m_nMatchRetries;
+	uint32_t m_nMatchMask;
+
+	const uint8_t *m_pRequest;		// next byte of the request
+	const uint8_t *m_pRequestEnd;
+	bool m_bRequestOverrun;			// request was too short
+
+	uint8_t *m_pResponse;			// next byte of the response
+	uint8_t *m_pResponseEnd;
+};
+
+#endif
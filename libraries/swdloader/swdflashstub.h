@@ -0,0 +1,68 @@
+//
+// swdflashstub.h
+//
+// Flash programming stub for CSWDLoader, runs in SRAM of the RP2040 target
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdflashstub_h
+#define _pico_swdflashstub_h
+
+#include <stdint.h>
+
+// Target SRAM layout
+#define FLASH_STUB_CODE		0x20000000U
+#define FLASH_STUB_MAILBOX	0x20000100U
+#define FLASH_STUB_STACK_TOP	0x20001000U
+#define FLASH_STUB_SCRATCH	0x20000180U		// DMA sink for verification
+#define FLASH_STUB_BUFFER(n)	(0x20001000U + (n) * 0x1000U)	// two sector buffers
+
+// Mailbox, the probe writes the call(s) and sets CALL1_FUNC last. The stub
+// executes CALL1 and optionally CALL2 and clears CALL1_FUNC, when it is done.
+#define FLASH_STUB_CALL1_FUNC	0		// word index, 0 if idle
+#define FLASH_STUB_CALL1_ARGS	1		// R0..R3
+#define FLASH_STUB_CALL2_FUNC	5		// 0 to skip
+#define FLASH_STUB_CALL2_ARGS	6
+#define FLASH_STUB_RESULT	10		// R0 after the last call
+#define FLASH_STUB_MAILBOX_WORDS 11
+
+// Thumb code (ARMv6-M, runs on ARMv8-M too), R7 points to the mailbox:
+//
+// loop:	ldr	r4, [r7, #0]
+//		cmp	r4, #0
+//		beq	loop
+//		ldr	r0, [r7, #4]
+//		ldr	r1, [r7, #8]
+//		ldr	r2, [r7, #12]
+//		ldr	r3, [r7, #16]
+//		blx	r4
+//		ldr	r4, [r7, #20]
+//		cmp	r4, #0
+//		beq	done
+//		ldr	r0, [r7, #24]
+//		ldr	r1, [r7, #28]
+//		ldr	r2, [r7, #32]
+//		ldr	r3, [r7, #36]
+//		blx	r4
+// done:	str	r0, [r7, #40]
+//		movs	r4, #0
+//		str	r4, [r7, #0]
+//		b	loop
+static const uint32_t FlashStubCode[] =
+{
+	0x2C00683C, 0x6878D0FC, 0x68FA68B9, 0x47A0693B, 0x2C00697C,
+	0x69B8D004, 0x6A3A69F9, 0x47A06A7B, 0x240062B8, 0xE7EB603C
+};
+
+#endif
@@ -0,0 +1,178 @@
+//
+// swdgang.cpp
+//
+// PIO based Serial Wire Debug gang engine for CSWDLoader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "swdgang.h"
+#include "hardware/dma.h"
+#include "swdgang.pio.h"
+#include <assert.h>
+
+// swd_gang needs eight state machine cycles per SWCLK period, swd.pio two
+#define GANG_SM_CYCLES		8
+#define GANG_DIVIDER(div)	(((div) + 3) / 4)
+
+CSWDGang::CSWDGang (void)
+:	m_pPIO (0),
+	m_nSM (-1),
+	m_nTxDMAChannel (-1),
+	m_nRxDMAChannel (-1),
+	m_nTargets (0),
+	m_nDivider (1)
+{
+}
+
+CSWDGang::~CSWDGang (void)
+{
+	if (m_nSM < 0)
+	{
+		return;
+	}
+
+	dma_channel_unclaim (m_nTxDMAChannel);
+	dma_channel_unclaim (m_nRxDMAChannel);
+
+	pio_sm_set_enabled (m_pPIO, m_nSM, false);
+	pio_sm_unclaim (m_pPIO, m_nSM);
+	pio_remove_program (m_pPIO, &swd_gang_program, m_nOffset);
+
+	gpio_init (m_nClockPin);
+	for (unsigned i = 0; i < m_nTargets; i++)
+	{
+		gpio_init (m_nDataPinBase + i);
+	}
+}
+
+bool CSWDGang::Initialize (unsigned nClockPin, unsigned nDataPinBase, unsigned nTargets,
+			   unsigned nClockDivider)
+{
+	assert (m_nSM < 0);
+	assert (1 <= nTargets && nTargets <= MaxTargets);
+	m_nClockPin = nClockPin;
+	m_nDataPinBase = nDataPinBase;
+	m_nTargets = nTargets;
+
+	static const PIO PIOs[] = {pio0, pio1};
+	for (unsigned i = 0; i < sizeof PIOs / sizeof PIOs[0]; i++)
+	{
+		if (!pio_can_add_program (PIOs[i], &swd_gang_program))
+		{
+			continue;
+		}
+
+		m_nSM = pio_claim_unused_sm (PIOs[i], false);
+		if (m_nSM >= 0)
+		{
+			m_pPIO = PIOs[i];
+
+			break;
+		}
+	}
+
+	if (m_nSM < 0)
+	{
+		return false;
+	}
+
+	m_nTxDMAChannel = dma_claim_unused_channel (false);
+	m_nRxDMAChannel = dma_claim_unused_channel (false);
+	if (   m_nTxDMAChannel < 0
+	    || m_nRxDMAChannel < 0)
+	{
+		if (m_nTxDMAChannel >= 0)
+		{
+			dma_channel_unclaim (m_nTxDMAChannel);
+		}
+
+		pio_sm_unclaim (m_pPIO, m_nSM);
+		m_nSM = -1;
+
+		return false;
+	}
+
+	m_nOffset = pio_add_program (m_pPIO, &swd_gang_program);
+
+	m_nDivider = GANG_DIVIDER (nClockDivider);
+
+	pio_sm_config Config = swd_gang_program_get_default_config (m_nOffset);
+	sm_config_set_sideset_pins (&Config, nClockPin);
+	sm_config_set_out_pins (&Config, nDataPinBase, nTargets);
+	sm_config_set_in_pins (&Config, nDataPinBase);
+	sm_config_set_out_shift (&Config, true, true, 16);
+	sm_config_set_in_shift (&Config, false, true, 8);
+	sm_config_set_clkdiv_int_frac (&Config, m_nDivider, 0);
+
+	uint32_t nDataMask = ((1U << nTargets) - 1) << nDataPinBase;
+	pio_sm_set_pins_with_mask (m_pPIO, m_nSM, 0, 1U << nClockPin | nDataMask);
+	pio_sm_set_pindirs_with_mask (m_pPIO, m_nSM, 1U << nClockPin,
+				      1U << nClockPin | nDataMask);
+	pio_gpio_init (m_pPIO, nClockPin);
+	for (unsigned i = 0; i < nTargets; i++)
+	{
+		pio_gpio_init (m_pPIO, nDataPinBase + i);
+		gpio_pull_up (nDataPinBase + i);	// released lines of dropped targets
+	}
+
+	pio_sm_init (m_pPIO, m_nSM, m_nOffset, &Config);
+	pio_sm_set_enabled (m_pPIO, m_nSM, true);
+
+	Activate (nTargets);
+
+	return true;
+}
+
+void CSWDGang::SetClockDivider (unsigned nClockDivider)
+{
+	assert (m_nSM >= 0);
+	Sync ();
+
+	m_nDivider = GANG_DIVIDER (nClockDivider);
+
+	pio_sm_set_clkdiv_int_frac (m_pPIO, m_nSM, m_nDivider, 0);
+	pio_sm_clkdiv_restart (m_pPIO, m_nSM);
+}
+
+unsigned CSWDGang::GetClockRate (unsigned nSystemClock) const
+{
+	return nSystemClock / (GANG_SM_CYCLES * m_nDivider);
+}
+
+// Streams the cycles through the state machine
+void CSWDGang::Shift (const uint16_t *pTxBuffer, uint8_t *pRxBuffer, unsigned nCycles)
+{
+	dma_channel_config RxConfig = dma_channel_get_default_config (m_nRxDMAChannel);
+	channel_config_set_transfer_data_size (&RxConfig, DMA_SIZE_8);
+	channel_config_set_read_increment (&RxConfig, false);
+	channel_config_set_write_increment (&RxConfig, true);
+	channel_config_set_dreq (&RxConfig, pio_get_dreq (m_pPIO, m_nSM, false));
+	dma_channel_configure (m_nRxDMAChannel, &RxConfig, pRxBuffer, &m_pPIO->rxf[m_nSM],
+			       nCycles, true);
+
+	dma_channel_config TxConfig = dma_channel_get_default_config (m_nTxDMAChannel);
+	channel_config_set_transfer_data_size (&TxConfig, DMA_SIZE_16);
+	channel_config_set_read_increment (&TxConfig, true);
+	channel_config_set_write_increment (&TxConfig, false);
+	channel_config_set_dreq (&TxConfig, pio_get_dreq (m_pPIO, m_nSM, true));
+	dma_channel_configure (m_nTxDMAChannel, &TxConfig, &m_pPIO->txf[m_nSM], pTxBuffer,
+			       nCycles, true);
+
+	dma_channel_wait_for_finish_blocking (m_nRxDMAChannel);
+}
+
+void CSWDGang::Delay (unsigned nMicros)
+{
+	busy_wait_us_32 (nMicros);
+}
@@ -0,0 +1,65 @@
+//
+// swdgang.h
+//
+// PIO based Serial Wire Debug gang engine for CSWDLoader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdgang_h
+#define _pico_swdgang_h
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "swdgangqueue.h"
+
+class CSWDGang : public CSWDGangQueue	/// Shifts SWD packets to several targets in lockstep with a PIO state machine
+{
+public:
+	CSWDGang (void);
+	~CSWDGang (void);
+
+	/// \param nClockPin GPIO pin to which the shared SWCLK is connected
+	/// \param nDataPinBase GPIO pin to which SWDIO of the first target is connected
+	/// \param nTargets Number of targets (SWDIO lines on consecutive pins)
+	/// \param nClockDivider Integer state machine clock divider (see CSWDClock)
+	/// \return Operation successful? (fails, if no PIO or DMA channels are available)
+	bool Initialize (unsigned nClockPin, unsigned nDataPinBase, unsigned nTargets,
+			 unsigned nClockDivider);
+
+	/// \brief Change the clock rate between transfers
+	/// \param nClockDivider Integer state machine clock divider (see CSWDClock)
+	void SetClockDivider (unsigned nClockDivider);
+
+	/// \param nSystemClock clk_sys rate in Hz
+	/// \return SWCLK rate in Hz
+	unsigned GetClockRate (unsigned nSystemClock) const;
+
+protected:
+	void Shift (const uint16_t *pTxBuffer, uint8_t *pRxBuffer, unsigned nCycles) override;
+	void Delay (unsigned nMicros) override;
+
+private:
+	PIO m_pPIO;
+	int m_nSM;
+	unsigned m_nOffset;
+	int m_nTxDMAChannel;
+	int m_nRxDMAChannel;
+
+	unsigned m_nClockPin;
+	unsigned m_nDataPinBase;
+	unsigned m_nTargets;
+	unsigned m_nDivider;
+};
+
+#endif
@@ -0,0 +1,400 @@
+//
+// swdgangqueue.cpp
+//
+// Cycle queue and response check of the Serial Wire Debug gang engine
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// References:
+//
+// [1] ARM Debug Interface Architecture Specification ADIv5.0 to ADIv5.2, IHI 0031E
+//
+#include "swdgangqueue.h"
+#include <stdio.h>
+#include <assert.h>
+
+// Transfer layout in SWCLK cycles (with overrun detection)
+#define GANG_REQUEST_CYCLES	8		// Start to Park
+#define GANG_TURN_CYCLES	1
+#define GANG_ACK_CYCLES		3
+#define GANG_DATA_CYCLES	33		// including parity
+#define GANG_TRANSFER_CYCLES	(  GANG_REQUEST_CYCLES + 2*GANG_TURN_CYCLES \
+				 + GANG_ACK_CYCLES + GANG_DATA_CYCLES)
+
+#define GANG_MAX_CYCLES		2048		// per run
+#define GANG_MAX_TRANSFERS	(GANG_MAX_CYCLES / GANG_TRANSFER_CYCLES - 1)	// one left for ABORT
+
+#define GANG_WAIT_RETRIES	20		// as in swdloader.cpp
+#define GANG_WAIT_BACKOFF_SPIN	4		// retries without delay
+#define GANG_WAIT_BACKOFF_MAX_US 1024
+
+#define SWD_REQUEST_RNW		(1U << 2)
+#define SWD_REQUEST_WR_DP_ABORT	0x81
+#define SWD_ABORT_ORUNERRCLR	(1U << 4)
+
+#define SWD_ACK_OK		0b001
+#define SWD_ACK_WAIT		0b010
+#define SWD_ACK_FAULT		0b100
+
+struct TGangTransfer
+{
+	uint8_t uchRequest;
+	uint32_t nData;
+	uint16_t nAckCycle;		// of the last run
+	unsigned nTargets;		// mask of the targets, to which it was sent in the last run
+};
+
+// static to keep the loader object small, there is only one gang
+static uint16_t s_TxBuffer[GANG_MAX_CYCLES];
+static uint8_t s_RxBuffer[GANG_MAX_CYCLES];
+static TGangTransfer s_Transfer[GANG_MAX_TRANSFERS];
+
+CSWDGangQueue::CSWDGangQueue (void)
+:	m_nTargets (0),
+	m_nActive (0),
+	m_nDiverged (0),
+	m_nCycles (0),
+	m_nTransfers (0)
+{
+}
+
+CSWDGangQueue::~CSWDGangQueue (void)
+{
+}
+
+void CSWDGangQueue::Activate (unsigned nTargets)
+{
+	assert (1 <= nTargets && nTargets <= MaxTargets);
+	m_nTargets = nTargets;
+
+	m_nActive = (1U << nTargets) - 1;
+	m_nDiverged = 0;
+
+	m_nCycles = 0;
+	m_nTransfers = 0;
+}
+
+void CSWDGangQueue::WriteBits (uint32_t nBits, unsigned nBitCount, bool bDriven)
+{
+	assert (1 <= nBitCount && nBitCount <= 32);
+
+	while (nBitCount--)
+	{
+		if (m_nCycles == GANG_MAX_CYCLES)
+		{
+			Run ();
+		}
+
+		PutCycle (nBits & 1, bDriven, m_nActive);
+
+		nBits >>= 1;
+	}
+}
+
+unsigned CSWDGangQueue::WriteData (uint8_t uchRequest, uint32_t nData)
+{
+	assert (!(uchRequest & SWD_REQUEST_RNW));
+	Transfer (uchRequest, nData);
+
+	return m_nActive ? SWD_ACK_OK : SWD_ACK_FAULT;
+}
+
+unsigned CSWDGangQueue::ReadData (uint8_t uchRequest, uint32_t *pData, bool *pParityOK)
+{
+	assert (uchRequest & SWD_REQUEST_RNW);
+	Transfer (uchRequest, 0);
+
+	Run ();
+
+	m_nDiverged = 0;
+	if (!m_nActive)
+	{
+		return SWD_ACK_FAULT;
+	}
+
+	// the value with the most votes, the lowest target wins a tie
+	unsigned nMajority = 0;
+	unsigned nMaxVotes = 0;
+	for (unsigned i = 0; i < m_nTargets; i++)
+	{
+		if (!(m_nActive & (1U << i)))
+		{
+			continue;
+		}
+
+		unsigned nVotes = 0;
+		for (unsigned j = 0; j < m_nTargets; j++)
+		{
+			if (   (m_nActive & (1U << j))
+			    && m_Value[j] == m_Value[i])
+			{
+				nVotes++;
+			}
+		}
+
+		if (nVotes > nMaxVotes)
+		{
+			nMajority = i;
+			nMaxVotes = nVotes;
+		}
+	}
+
+	for (unsigned i = 0; i < m_nTargets; i++)
+	{
+		if (   (m_nActive & (1U << i))
+		    && m_Value[i] != m_Value[nMajority])
+		{
+			m_nDiverged |= 1U << i;
+		}
+	}
+
+	assert (pData != 0);
+	*pData = m_Value[nMajority];
+
+	assert (pParityOK != 0);
+	*pParityOK = true;
+
+	return SWD_ACK_OK;
+}
+
+unsigned CSWDGangQueue::Sync (void)
+{
+	Run ();
+
+	return m_nActive ? SWD_ACK_OK : SWD_ACK_FAULT;
+}
+
+void CSWDGangQueue::Resolve (void)
+{
+	for (unsigned i = 0; i < m_nTargets; i++)
+	{
+		if (m_nDiverged & (1U << i))
+		{
+			Drop (i, "data mismatch", m_Value[i]);
+		}
+	}
+
+	m_nDiverged = 0;
+}
+
+// Queues a complete transfer, so that it is never split between two runs
+void CSWDGangQueue::Transfer (uint8_t uchRequest, uint32_t nData)
+{
+	if (   m_nCycles + GANG_TRANSFER_CYCLES > GANG_MAX_CYCLES
+	    || m_nTransfers == GANG_MAX_TRANSFERS)
+	{
+		Run ();
+	}
+
+	TGangTransfer *pTransfer = &s_Transfer[m_nTransfers++];
+	pTransfer->uchRequest = uchRequest;
+	pTransfer->nData = nData;
+
+	PutTransfer (pTransfer, m_nActive);
+}
+
+void CSWDGangQueue::PutTransfer (TGangTransfer *pTransfer, unsigned nTargets)
+{
+	assert (m_nCycles + GANG_TRANSFER_CYCLES <= GANG_MAX_CYCLES);
+
+	pTransfer->nTargets = nTargets;
+
+	PutBits (pTransfer->uchRequest, GANG_REQUEST_CYCLES, true, nTargets);
+	PutBits (0, GANG_TURN_CYCLES, false, nTargets);
+
+	pTransfer->nAckCycle = m_nCycles;
+	PutBits (0, GANG_ACK_CYCLES, false, nTargets);
+
+	if (pTransfer->uchRequest & SWD_REQUEST_RNW)
+	{
+		PutBits (0, 32, false, nTargets);
+		PutBits (0, 1, false, nTargets);
+		PutBits (0, GANG_TURN_CYCLES, false, nTargets);
+	}
+	else
+	{
+		PutBits (0, GANG_TURN_CYCLES, false, nTargets);
+		PutBits (pTransfer->nData, 32, true, nTargets);
+		PutBits (__builtin_parity (pTransfer->nData), 1, true, nTargets);
+	}
+}
+
+void CSWDGangQueue::PutBits (uint32_t nBits, unsigned nBitCount, bool bDriven, unsigned nTargets)
+{
+	while (nBitCount--)
+	{
+		PutCycle (nBits & 1, bDriven, nTargets);
+
+		nBits >>= 1;
+	}
+}
+
+// Dropped targets are never driven again. Active targets, which do not take
+// part, see SWDIO low (idle cycles).
+void CSWDGangQueue::PutCycle (unsigned nLevel, bool bDriven, unsigned nTargets)
+{
+	assert (m_nCycles < GANG_MAX_CYCLES);
+
+	nTargets &= m_nActive;
+	unsigned nDriven = bDriven ? m_nActive : m_nActive & ~nTargets;
+	unsigned nHigh = bDriven && nLevel ? nTargets : 0;
+
+	s_TxBuffer[m_nCycles++] =   nDriven << GANG_CYCLE_DRIVEN__SHIFT
+				  | nHigh << GANG_CYCLE_LEVEL__SHIFT;
+}
+
+// Shifts the queued cycles out and checks the responses. A WAIT has set
+// STICKYORUN ([1] section B4.2.5), so the following transfers have not been
+// performed. The targets, which have responded with WAIT, get an ABORT, which
+// clears STICKYORUN, and all transfers from the waiting one on again.
+void CSWDGangQueue::Run (void)
+{
+	if (m_nCycles == 0)
+	{
+		return;
+	}
+
+	unsigned Next[MaxTargets] = {0};	// first transfer, which has not been acknowledged
+
+	for (unsigned nRetry = 0; ; nRetry++)
+	{
+		Shift (s_TxBuffer, s_RxBuffer, m_nCycles);
+		m_nCycles = 0;
+
+		unsigned nWaiting = Check (Next);
+		if (!nWaiting)
+		{
+			break;
+		}
+
+		if (nRetry == GANG_WAIT_RETRIES)
+		{
+			for (unsigned i = 0; i < m_nTargets; i++)
+			{
+				if (nWaiting & (1U << i))
+				{
+					Drop (i, "ACK", SWD_ACK_WAIT);
+				}
+			}
+
+			break;
+		}
+
+		if (nRetry >= GANG_WAIT_BACKOFF_SPIN)
+		{
+			unsigned nMicros = 1U << (nRetry - GANG_WAIT_BACKOFF_SPIN);
+			Delay (nMicros < GANG_WAIT_BACKOFF_MAX_US ? nMicros : GANG_WAIT_BACKOFF_MAX_US);
+		}
+
+		TGangTransfer Abort = {SWD_REQUEST_WR_DP_ABORT, SWD_ABORT_ORUNERRCLR, 0, 0};
+		PutTransfer (&Abort, nWaiting);		// ACK not checked, the next transfer fails
+
+		for (unsigned i = 0; i < m_nTransfers; i++)
+		{
+			unsigned nTargets = 0;
+			for (unsigned j = 0; j < m_nTargets; j++)
+			{
+				if (   (nWaiting & (1U << j))
+				    && Next[j] <= i)
+				{
+					nTargets |= 1U << j;
+				}
+			}
+
+			if (nTargets)
+			{
+				PutTransfer (&s_Transfer[i], nTargets);
+			}
+			else
+			{
+				s_Transfer[i].nTargets = 0;
+			}
+		}
+	}
+
+	m_nTransfers = 0;
+}
+
+// Returns the mask of the targets, which have responded with WAIT, and advances
+// pNext[] behind the acknowledged transfers. Drops each target, which did not
+// respond with OK or WAIT or had a parity error on read.
+unsigned CSWDGangQueue::Check (unsigned *pNext)
+{
+	unsigned nWaiting = 0;
+
+	for (unsigned i = 0; i < m_nTransfers; i++)
+	{
+		const TGangTransfer *pTransfer = &s_Transfer[i];
+
+		for (unsigned j = 0; j < m_nTargets; j++)
+		{
+			// after a WAIT, the transfers have been rejected with FAULT
+			unsigned nMask = 1U << j;
+			if (   !(pTransfer->nTargets & m_nActive & nMask)
+			    || (nWaiting & nMask))
+			{
+				continue;
+			}
+
+			unsigned nAck = GetBits (pTransfer->nAckCycle, GANG_ACK_CYCLES, j);
+			if (nAck == SWD_ACK_WAIT)
+			{
+				nWaiting |= nMask;
+
+				continue;
+			}
+
+			if (nAck != SWD_ACK_OK)
+			{
+				Drop (j, "ACK", nAck);
+
+				continue;
+			}
+
+			if (pTransfer->uchRequest & SWD_REQUEST_RNW)
+			{
+				unsigned nDataCycle = pTransfer->nAckCycle + GANG_ACK_CYCLES;
+				m_Value[j] = GetBits (nDataCycle, 32, j);
+				if (GetBits (nDataCycle + 32, 1, j) != (unsigned) __builtin_parity (m_Value[j]))
+				{
+					Drop (j, "parity error, data", m_Value[j]);
+
+					continue;
+				}
+			}
+
+			pNext[j] = i + 1;
+		}
+	}
+
+	return nWaiting;
+}
+
+uint32_t CSWDGangQueue::GetBits (unsigned nCycle, unsigned nBitCount, unsigned nTarget) const
+{
+	uint32_t nBits = 0;
+	for (unsigned i = 0; i < nBitCount; i++)
+	{
+		nBits |= (uint32_t) ((s_RxBuffer[nCycle + i] >> nTarget) & 1) << i;
+	}
+
+	return nBits;
+}
+
+void CSWDGangQueue::Drop (unsigned nTarget, const char *pReason, uint32_t nValue)
+{
+	printf ("Target %u dropped (%s 0x%X)\r\n", nTarget, pReason, (unsigned) nValue);
+
+	m_nActive &= ~(1U << nTarget);
+}
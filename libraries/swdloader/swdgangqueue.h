@@ -0,0 +1,109 @@
+//
+// swdgangqueue.h
+//
+// Cycle queue and response check of the Serial Wire Debug gang engine
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdgangqueue_h
+#define _pico_swdgangqueue_h
+
+#include <stdint.h>
+
+// One SWCLK cycle of the gang (see swdgang.pio)
+#define GANG_CYCLE_DRIVEN__SHIFT	0		// SWDIO lines driven by the host
+#define GANG_CYCLE_LEVEL__SHIFT		8		// levels of the driven lines
+
+struct TGangTransfer;
+
+class CSWDGangQueue	/// Queues SWD transfers to several targets in lockstep and checks the responses
+{
+public:
+	static const unsigned MaxTargets = 8;
+
+public:
+	CSWDGangQueue (void);
+	virtual ~CSWDGangQueue (void);
+
+	/// \brief Queue a raw bit sequence (LSB first) for all targets
+	/// \param nBits Bits to be shifted out
+	/// \param nBitCount Number of bits (1..32)
+	/// \param bDriven Drive SWDIO (or clock with SWDIO released)
+	void WriteBits (uint32_t nBits, unsigned nBitCount, bool bDriven = true);
+
+	/// \brief Queue a write transfer to a DP or AP register of all targets
+	/// \param uchRequest SWD packet request (Start to Park)
+	/// \param nData Data to be written
+	/// \return DP_OK, or DP_FAULT if no target is left
+	/// \note The ACKs are checked, when the queue is shifted out. Targets must\n
+	///	  have overrun detection enabled, the data phase is always clocked.
+	unsigned WriteData (uint8_t uchRequest, uint32_t nData);
+
+	/// \brief Read a 32-bit word from a DP or AP register of all targets
+	/// \param uchRequest SWD packet request (Start to Park)
+	/// \param pData Value read by the majority of the targets
+	/// \param pParityOK Set to true (targets with parity errors are dropped)
+	/// \return DP_OK, or DP_FAULT if no target is left
+	unsigned ReadData (uint8_t uchRequest, uint32_t *pData, bool *pParityOK);
+
+	/// \brief Shift out all queued cycles and check the ACKs
+	/// \return DP_OK, or DP_FAULT if no target is left
+	unsigned Sync (void);
+
+	/// \return Did the targets read different values with the last ReadData()?
+	bool IsDiverged (void) const			{ return m_nDiverged != 0; }
+
+	/// \brief Drop the targets, which did not read the majority value last time
+	void Resolve (void);
+
+	/// \return Bit mask of the targets, which have not been dropped
+	unsigned GetActiveMask (void) const		{ return m_nActive; }
+
+protected:
+	/// \brief Start with all targets active and an empty queue
+	/// \param nTargets Number of targets (SWDIO lines on consecutive pins)
+	void Activate (unsigned nTargets);
+
+	/// \brief Clock the cycles out and sample all SWDIO lines before each rising edge
+	/// \param pTxBuffer One halfword per cycle (GANG_CYCLE_*)
+	/// \param pRxBuffer One byte per cycle (bit n is SWDIO of target n)
+	/// \param nCycles Number of cycles
+	virtual void Shift (const uint16_t *pTxBuffer, uint8_t *pRxBuffer, unsigned nCycles) = 0;
+
+	/// \brief Wait before the transfers are repeated, which got a WAIT response
+	virtual void Delay (unsigned nMicros) = 0;
+
+private:
+	void Transfer (uint8_t uchRequest, uint32_t nData);
+	void PutTransfer (TGangTransfer *pTransfer, unsigned nTargets);
+	void PutBits (uint32_t nBits, unsigned nBitCount, bool bDriven, unsigned nTargets);
+	void PutCycle (unsigned nLevel, bool bDriven, unsigned nTargets);
+	void Run (void);
+	unsigned Check (unsigned *pNext);
+
+	uint32_t GetBits (unsigned nCycle, unsigned nBitCount, unsigned nTarget) const;
+	void Drop (unsigned nTarget, const char *pReason, uint32_t nValue);
+
+private:
+	unsigned m_nTargets;
+
+	unsigned m_nActive;		// bit mask of targets
+	unsigned m_nDiverged;
+	uint32_t m_Value[MaxTargets];	// of the last read
+
+	unsigned m_nCycles;		// queued
+	unsigned m_nTransfers;
+};
+
+#endif
@@ -0,0 +1,993 @@
+//
+// swdgdb.cpp
+//
+// Executes GDB remote serial protocol packets with the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// While the target is halted, its core registers are read once and memory
+// is read in whole pages, which are kept until it runs again. A backtrace,
+// which GDB fetches with many small 'm' packets, costs a few block reads.
+// Memory outside ROM, flash and SRAM (e.g. peripheral registers) is not
+// cached, because reading it may have side effects.
+//
+#include "swdgdb.h"
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+//
+// References:
+//
+// [1] GDB Remote Serial Protocol (Debugging with GDB, appendix E)
+// [2] ARM v6-M Architecture Reference Manual, DDI 0419E
+// [3] ARM v8-M Architecture Reference Manual, DDI 0553
+//
+
+#define BIT(n)			(1U << (n))
+
+// Signals in stop replies
+#define GDB_SIGINT		2
+#define GDB_SIGTRAP		5
+
+// Debug System Registers ([2] section C1.6)
+#define DHCSR			0xE000EDF0
+	#define DHCSR_C_DEBUGEN			BIT(0)
+	#define DHCSR_C_HALT			BIT(1)
+	#define DHCSR_C_STEP			BIT(2)
+	#define DHCSR_C_MASKINTS		BIT(3)
+	#define DHCSR_DBGKEY			(0xA05FU << 16)
+	#define DHCSR_S_HALT			BIT(17)
+#define DCRSR_REGSEL_PC		15
+
+// Flash Patch and Breakpoint unit ([2] section C1.11, [3] section D1.2.76)
+#define FP_CTRL			0xE0002000
+	#define FP_CTRL_ENABLE			BIT(0)
+	#define FP_CTRL_KEY			BIT(1)
+	#define FP_CTRL_NUM_CODE1__SHIFT	4
+	#define FP_CTRL_NUM_CODE1__MASK		(0xF << 4)
+	#define FP_CTRL_NUM_CODE2__SHIFT	12
+	#define FP_CTRL_NUM_CODE2__MASK		(0x7 << 12)
+	#define FP_CTRL_REV__SHIFT		28
+#define FP_COMP(n)		(0xE0002008 + (n) * 4)
+	#define FP_COMP_ENABLE			BIT(0)
+	#define FP_COMP_ADDRESS__MASK		0x1FFFFFFCU	// version 1
+	#define FP_COMP_REPLACE_LOWER		(1U << 30)
+	#define FP_COMP_REPLACE_UPPER		(2U << 30)
+	#define FP_COMP_V1_LIMIT		0x20000000U	// code region only
+
+// ROM, XIP flash and SRAM, which can be read without side effects
+#define CACHEABLE(addr)		(   (addr) < 0x14000000U \
+				 || ((addr) >= 0x20000000U && (addr) < 0x20100000U))
+
+static const char TargetXML[] =
+	"<?xml version=\"1.0\"?>"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+	"<target version=\"1.0\">"
+	"<architecture>arm</architecture>"
+	"<feature name=\"org.gnu.gdb.arm.m-profile\">"
+	"<reg name=\"r0\" bitsize=\"32\"/>"
+	"<reg name=\"r1\" bitsize=\"32\"/>"
+	"<reg name=\"r2\" bitsize=\"32\"/>"
+	"<reg name=\"r3\" bitsize=\"32\"/>"
+	"<reg name=\"r4\" bitsize=\"32\"/>"
+	"<reg name=\"r5\" bitsize=\"32\"/>"
+	"<reg name=\"r6\" bitsize=\"32\"/>"
+	"<reg name=\"r7\" bitsize=\"32\"/>"
+	"<reg name=\"r8\" bitsize=\"32\"/>"
+	"<reg name=\"r9\" bitsize=\"32\"/>"
+	"<reg name=\"r10\" bitsize=\"32\"/>"
+	"<reg name=\"r11\" bitsize=\"32\"/>"
+	"<reg name=\"r12\" bitsize=\"32\"/>"
+	"<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+	"<reg name=\"lr\" bitsize=\"32\"/>"
+	"<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+	"<reg name=\"xpsr\" bitsize=\"32\"/>"		// register numbers are DCRSR REGSEL
+	"</feature>"
+	"</target>";
+
+CSWDGDB::CSWDGDB (unsigned nClockPin, unsigned nDataPin, unsigned nClockRateKHz)
+:	m_nClockPin (nClockPin),
+	m_nDataPin (nDataPin),
+	m_nClockRateKHz (nClockRateKHz),
+	m_pLoader (0),
+	m_bRunning (false),
+	m_nStopSignal (GDB_SIGTRAP),
+	m_bRegistersValid (false),
+	m_nCacheClock (0),
+	m_nCacheHits (0),
+	m_nCacheMisses (0),
+	m_nBreakpoints (0),
+	m_bFPBv2 (false),
+	m_pPacket (0),
+	m_pPacketEnd (0),
+	m_pResponse (0),
+	m_pResponseEnd (0)
+{
+	InvalidateCache ();
+}
+
+CSWDGDB::~CSWDGDB (void)
+{
+	Detach ();
+}
+
+bool CSWDGDB::Process (const char *pPacket, unsigned nLength, char *pResponse, unsigned *pResponseLength)
+{
+	assert (pPacket != 0);
+	assert (pResponse != 0);
+	assert (pResponseLength != 0);
+
+	m_pPacket = pPacket;
+	m_pPacketEnd = pPacket + nLength;
+
+	m_pResponse = pResponse;
+	m_pResponseEnd = pResponse + PacketSize;
+
+	char chCommand = nLength > 0 ? *m_pPacket++ : 0;
+	if (   m_pLoader == 0
+	    && chCommand != 'D'
+	    && chCommand != 'k'
+	    && !Attach ())
+	{
+		PutError ();
+		*pResponseLength = m_pResponse - pResponse;
+
+		return true;
+	}
+
+	bool bReply = true;
+	switch (chCommand)
+	{
+	case '?':
+		PutStopReply ();
+		break;
+
+	case 'g':
+		ReadRegisters ();
+		break;
+
+	case 'G':
+		WriteRegisters ();
+		break;
+
+	case 'p':
+		ReadRegister ();
+		break;
+
+	case 'P':
+		WriteRegister ();
+		break;
+
+	case 'm':
+		ReadMemory ();
+		break;
+
+	case 'M':
+		WriteMemory (false);
+		break;
+
+	case 'X':
+		WriteMemory (true);
+		break;
+
+	case 'c':
+	case 's':
+		bReply = Resume (chCommand == 's');
+		break;
+
+	case 'Z':
+	case 'z':
+		Breakpoint (chCommand == 'Z');
+		break;
+
+	case 'D':
+		Detach ();
+		PutString ("OK");
+		break;
+
+	case 'k':				// the target is not killed, but left running
+		Detach ();
+		bReply = false;
+		break;
+
+	case 'H':				// there is one thread only
+	case 'T':
+		PutString ("OK");
+		break;
+
+	case 'q':
+		Query ();
+		break;
+
+	case 'Q':
+		if (Match ("StartNoAckMode"))	// the transport drops the acknowledgments
+		{
+			PutString ("OK");
+		}
+		break;
+
+	default:				// empty response: not supported
+		break;
+	}
+
+	*pResponseLength = m_pResponse - pResponse;
+
+	return bReply;
+}
+
+bool CSWDGDB::Poll (bool bInterrupt, char *pResponse, unsigned *pResponseLength)
+{
+	assert (pResponse != 0);
+	assert (pResponseLength != 0);
+
+	m_pResponse = pResponse;
+	m_pResponseEnd = pResponse + PacketSize;
+
+	bool bStopped = CheckStopped (bInterrupt);
+
+	*pResponseLength = m_pResponse - pResponse;
+
+	return bStopped;
+}
+
+void CSWDGDB::Detach (void)
+{
+	if (m_pLoader == 0)
+	{
+		return;
+	}
+
+	for (unsigned i = 0; i < m_nBreakpoints; i++)
+	{
+		if (m_Breakpoint[i] != 0)
+		{
+			WriteWord (FP_COMP (i), 0);
+		}
+	}
+
+	WriteWord (FP_CTRL, FP_CTRL_KEY);
+
+	// C_MASKINTS is cleared, while the core is still halted
+	if (!m_bRunning)
+	{
+		WriteWord (DHCSR, DHCSR_DBGKEY | DHCSR_C_DEBUGEN | DHCSR_C_HALT);
+	}
+	WriteWord (DHCSR, DHCSR_DBGKEY);
+
+	printf ("GDB detached (%u of %u page reads from cache)\r\n",
+		m_nCacheHits, m_nCacheHits + m_nCacheMisses);
+
+	delete m_pLoader;
+	m_pLoader = 0;
+
+	m_bRunning = false;
+	m_bRegistersValid = false;
+	InvalidateCache ();
+}
+
+bool CSWDGDB::Attach (void)
+{
+	assert (m_pLoader == 0);
+	m_pLoader = new CSWDLoader (m_nClockPin, m_nDataPin, 0, m_nClockRateKHz);
+	assert (m_pLoader != 0);
+
+	uint32_t nFPCtrl;
+	if (   !m_pLoader->Initialize ()
+	    || !m_pLoader->Halt ()
+	    || !ReadWord (FP_CTRL, &nFPCtrl))
+	{
+		delete m_pLoader;
+		m_pLoader = 0;
+
+		return false;
+	}
+
+	m_bRunning = false;
+	m_nStopSignal = GDB_SIGTRAP;
+	m_bRegistersValid = false;
+	InvalidateCache ();
+	m_nCacheHits = 0;
+	m_nCacheMisses = 0;
+
+	// the comparators may be left enabled by an earlier session
+	m_nBreakpoints =   (nFPCtrl & FP_CTRL_NUM_CODE1__MASK) >> FP_CTRL_NUM_CODE1__SHIFT
+			 | (nFPCtrl & FP_CTRL_NUM_CODE2__MASK) >> (FP_CTRL_NUM_CODE2__SHIFT - 4);
+	if (m_nBreakpoints > MaxBreakpoints)
+	{
+		m_nBreakpoints = MaxBreakpoints;
+	}
+
+	m_bFPBv2 = (nFPCtrl >> FP_CTRL_REV__SHIFT) == 1;
+
+	for (unsigned i = 0; i < m_nBreakpoints; i++)
+	{
+		m_Breakpoint[i] = 0;
+		WriteWord (FP_COMP (i), 0);
+	}
+
+	WriteWord (FP_CTRL, FP_CTRL_KEY | FP_CTRL_ENABLE);
+
+	printf ("GDB attached (%u breakpoints)\r\n", m_nBreakpoints);
+
+	return true;
+}
+
+void CSWDGDB::Query (void)
+{
+	if (Match ("Supported"))
+	{
+		PutString ("PacketSize=");
+		PutHex (PacketSize);
+		PutString (";qXfer:features:read+;QStartNoAckMode+");
+	}
+	else if (Match ("Attached"))
+	{
+		PutString ("1");		// detach on quit, do not kill
+	}
+	else if (Match ("Xfer:features:read:target.xml:"))
+	{
+		ReadFeatures ();
+	}
+}
+
+void CSWDGDB::ReadFeatures (void)
+{
+	unsigned nOffset = GetHex ();
+	if (!GetChar (','))
+	{
+		PutError ();
+
+		return;
+	}
+
+	unsigned nLength = GetHex ();
+	if (nLength > PacketSize - 1)
+	{
+		nLength = PacketSize - 1;
+	}
+
+	const unsigned nSize = sizeof TargetXML - 1;
+	if (nOffset >= nSize)
+	{
+		Put ('l');
+
+		return;
+	}
+
+	if (nLength >= nSize - nOffset)
+	{
+		Put ('l');			// last part
+		nLength = nSize - nOffset;
+	}
+	else
+	{
+		Put ('m');
+	}
+
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		Put (TargetXML[nOffset + i]);
+	}
+}
+
+void CSWDGDB::ReadRegisters (void)
+{
+	if (!LoadRegisters ())
+	{
+		PutError ();
+
+		return;
+	}
+
+	for (unsigned i = 0; i < Registers; i++)
+	{
+		PutHexWord (m_Register[i]);
+	}
+}
+
+void CSWDGDB::WriteRegisters (void)
+{
+	uint32_t Values[Registers];
+	if (!GetHexBytes ((uint8_t *) Values, sizeof Values))
+	{
+		PutError ();
+
+		return;
+	}
+
+	m_bRegistersValid = false;
+	if (!m_pLoader->WriteCoreRegisters (0, Values, Registers))
+	{
+		PutError ();
+
+		return;
+	}
+
+	memcpy (m_Register, Values, sizeof m_Register);
+	m_bRegistersValid = true;
+
+	PutString ("OK");
+}
+
+void CSWDGDB::ReadRegister (void)
+{
+	unsigned nRegister = GetHex ();
+	if (   nRegister >= Registers
+	    || !LoadRegisters ())
+	{
+		PutError ();
+
+		return;
+	}
+
+	PutHexWord (m_Register[nRegister]);
+}
+
+void CSWDGDB::WriteRegister (void)
+{
+	unsigned nRegister = GetHex ();
+
+	uint32_t nValue;
+	if (   nRegister >= Registers
+	    || !GetChar ('=')
+	    || !GetHexBytes ((uint8_t *) &nValue, sizeof nValue))
+	{
+		PutError ();
+
+		return;
+	}
+
+	if (!m_pLoader->WriteCoreRegisters (nRegister, &nValue, 1))
+	{
+		m_bRegistersValid = false;
+
+		PutError ();
+
+		return;
+	}
+
+	m_Register[nRegister] = nValue;
+
+	PutString ("OK");
+}
+
+// All registers are read at once, GDB fetches them one by one otherwise
+bool CSWDGDB::LoadRegisters (void)
+{
+	if (!m_bRegistersValid)
+	{
+		m_bRegistersValid = m_pLoader->ReadCoreRegisters (0, m_Register, Registers);
+	}
+
+	return m_bRegistersValid;
+}
+
+void CSWDGDB::ReadMemory (void)
+{
+	uint32_t nAddress = GetHex ();
+	if (!GetChar (','))
+	{
+		PutError ();
+
+		return;
+	}
+
+	// a shorter response is allowed ([1] section E.2)
+	unsigned nLength = GetHex ();
+	if (nLength > PacketSize / 2)
+	{
+		nLength = PacketSize / 2;
+	}
+
+	const char *pResponse = m_pResponse;
+	while (nLength > 0)
+	{
+		unsigned nChunk = CachePageSize - (nAddress & (CachePageSize-1));
+		if (nChunk > nLength)
+		{
+			nChunk = nLength;
+		}
+
+		uint8_t Data[CachePageSize];
+		if (!ReadTarget (nAddress, Data, nChunk))
+		{
+			break;
+		}
+
+		PutHexBytes (Data, nChunk);
+
+		nAddress += nChunk;
+		nLength -= nChunk;
+	}
+
+	if (m_pResponse == pResponse)		// nothing read
+	{
+		PutError ();
+	}
+}
+
+void CSWDGDB::WriteMemory (bool bBinary)
+{
+	uint32_t nAddress = GetHex ();
+	if (!GetChar (','))
+	{
+		PutError ();
+
+		return;
+	}
+
+	unsigned nLength = GetHex ();
+	if (   !GetChar (':')
+	    || (unsigned) (m_pPacketEnd - m_pPacket) != (bBinary ? nLength : nLength * 2))
+	{
+		PutError ();
+
+		return;
+	}
+
+	InvalidateCache ();		// the write may not have an effect (e.g. to flash)
+
+	bool bOK = true;
+	if (bBinary)
+	{
+		bOK = nLength == 0 || m_pLoader->WriteBytes (nAddress, m_pPacket, nLength);
+	}
+	else
+	{
+		while (bOK && nLength > 0)
+		{
+			unsigned nChunk = nLength < sizeof m_Buffer ? nLength : sizeof m_Buffer;
+
+			bOK =    GetHexBytes ((uint8_t *) m_Buffer, nChunk)
+			      && m_pLoader->WriteBytes (nAddress, m_Buffer, nChunk);
+
+			nAddress += nChunk;
+			nLength -= nChunk;
+		}
+	}
+
+	if (!bOK)
+	{
+		PutError ();
+
+		return;
+	}
+
+	PutString ("OK");
+}
+
+// Reads up to the end of the page of nAddress
+bool CSWDGDB::ReadTarget (uint32_t nAddress, uint8_t *pBuffer, unsigned nLength)
+{
+	unsigned nOffset = nAddress & (CachePageSize-1);
+	assert (nOffset + nLength <= CachePageSize);
+
+	if (   !m_bRunning
+	    && CACHEABLE (nAddress))
+	{
+		const uint8_t *pPage = GetCachePage (nAddress - nOffset);
+		if (pPage == 0)
+		{
+			return false;
+		}
+
+		memcpy (pBuffer, pPage + nOffset, nLength);
+
+		return true;
+	}
+
+	// whole words, each is read once
+	uint32_t nFirstWord = nAddress & ~3U;
+	unsigned nWords = (nAddress + nLength - nFirstWord + 3) / 4;
+	if (!m_pLoader->ReadWords (nFirstWord, m_Buffer, nWords))
+	{
+		return false;
+	}
+
+	memcpy (pBuffer, (const uint8_t *) m_Buffer + (nAddress & 3), nLength);
+
+	return true;
+}
+
+const uint8_t *CSWDGDB::GetCachePage (uint32_t nAddress)
+{
+	assert (!(nAddress & (CachePageSize-1)));
+
+	m_nCacheClock++;
+
+	TCachePage *pVictim = &m_Cache[0];
+	for (unsigned i = 0; i < CachePages; i++)
+	{
+		TCachePage *pPage = &m_Cache[i];
+		if (   pPage->bValid
+		    && pPage->nAddress == nAddress)
+		{
+			pPage->nLastUse = m_nCacheClock;
+			m_nCacheHits++;
+
+			return pPage->Data;
+		}
+
+		if (   !pPage->bValid
+		    || (   pVictim->bValid
+			&& pPage->nLastUse < pVictim->nLastUse))
+		{
+			pVictim = pPage;
+		}
+	}
+
+	m_nCacheMisses++;
+
+	// one block read, the TAR is written once
+	pVictim->bValid = false;
+	if (!m_pLoader->ReadWords (nAddress, (uint32_t *) pVictim->Data, CachePageSize / 4))
+	{
+		return 0;
+	}
+
+	pVictim->nAddress = nAddress;
+	pVictim->bValid = true;
+	pVictim->nLastUse = m_nCacheClock;
+
+	return pVictim->Data;
+}
+
+void CSWDGDB::InvalidateCache (void)
+{
+	for (unsigned i = 0; i < CachePages; i++)
+	{
+		m_Cache[i].bValid = false;
+	}
+}
+
+bool CSWDGDB::Resume (bool bStep)
+{
+	// optional resume address
+	if (m_pPacket < m_pPacketEnd)
+	{
+		uint32_t nPC = GetHex ();
+		if (!m_pLoader->WriteCoreRegisters (DCRSR_REGSEL_PC, &nPC, 1))
+		{
+			PutError ();
+
+			return true;
+		}
+	}
+
+	m_bRegistersValid = false;
+	InvalidateCache ();
+
+	// interrupts are masked while stepping, C_MASKINTS may only be changed
+	// while the core is halted ([2] section C1.6.3)
+	uint32_t nMaskInts = bStep ? DHCSR_C_MASKINTS : 0;
+	if (   !WriteWord (DHCSR, DHCSR_DBGKEY | DHCSR_C_DEBUGEN | DHCSR_C_HALT | nMaskInts)
+	    || !WriteWord (DHCSR,   DHCSR_DBGKEY | DHCSR_C_DEBUGEN | nMaskInts
+				  | (bStep ? DHCSR_C_STEP : 0)))
+	{
+		PutError ();
+
+		return true;
+	}
+
+	m_bRunning = true;
+	m_nStopSignal = GDB_SIGTRAP;
+
+	// a step is usually complete, when DHCSR is read next
+	return bStep && CheckStopped (false);
+}
+
+bool CSWDGDB::CheckStopped (bool bInterrupt)
+{
+	if (!m_bRunning)
+	{
+		return false;
+	}
+
+	if (bInterrupt)
+	{
+		m_nStopSignal = GDB_SIGINT;
+
+		if (!m_pLoader->Halt ())
+		{
+			// report the stop anyway, so that the user gets the prompt back
+			m_bRunning = false;
+			PutStopReply ();
+
+			return true;
+		}
+	}
+
+	uint32_t nDHCSR;
+	if (   !ReadWord (DHCSR, &nDHCSR)
+	    || !(nDHCSR & DHCSR_S_HALT))
+	{
+		return false;
+	}
+
+	m_bRunning = false;
+	PutStopReply ();
+
+	return true;
+}
+
+// PC, SP and LR are sent with the stop reply, which saves the first requests
+// of GDB, the registers are needed for the cache anyway
+void CSWDGDB::PutStopReply (void)
+{
+	if (   m_bRunning
+	    || !LoadRegisters ())
+	{
+		Put ('S');
+		PutHex (m_nStopSignal);
+
+		return;
+	}
+
+	Put ('T');
+	PutHex (m_nStopSignal);
+
+	static const unsigned Expedited[] = {13, 14, 15};	// SP, LR, PC
+	for (unsigned i = 0; i < sizeof Expedited / sizeof Expedited[0]; i++)
+	{
+		PutHex (Expedited[i]);
+		Put (':');
+		PutHexWord (m_Register[Expedited[i]]);
+		Put (';');
+	}
+}
+
+void CSWDGDB::Breakpoint (bool bInsert)
+{
+	// software breakpoints are set in the FPB too, code runs from flash mostly
+	char chType = m_pPacket < m_pPacketEnd ? *m_pPacket++ : 0;
+	if (   chType != '0'
+	    && chType != '1')
+	{
+		return;				// watchpoints are not supported
+	}
+
+	if (!GetChar (','))
+	{
+		PutError ();
+
+		return;
+	}
+
+	uint32_t nAddress = GetHex ();
+	if (   !GetChar (',')		// kind is ignored
+	    || !SetBreakpoint (nAddress, bInsert))
+	{
+		PutError ();
+
+		return;
+	}
+
+	PutString ("OK");
+}
+
+bool CSWDGDB::SetBreakpoint (uint32_t nAddress, bool bInsert)
+{
+	uint32_t nComp;
+	if (m_bFPBv2)
+	{
+		nComp = (nAddress & ~1U) | FP_COMP_ENABLE;
+	}
+	else
+	{
+		if (nAddress >= FP_COMP_V1_LIMIT)
+		{
+			return false;
+		}
+
+		nComp =   (nAddress & FP_COMP_ADDRESS__MASK)
+			| (nAddress & 2 ? FP_COMP_REPLACE_UPPER : FP_COMP_REPLACE_LOWER)
+			| FP_COMP_ENABLE;
+	}
+
+	unsigned nFree = m_nBreakpoints;
+	for (unsigned i = 0; i < m_nBreakpoints; i++)
+	{
+		if (m_Breakpoint[i] == nComp)
+		{
+			if (bInsert)
+			{
+				return true;
+			}
+
+			m_Breakpoint[i] = 0;
+
+			return WriteWord (FP_COMP (i), 0);
+		}
+
+		if (   m_Breakpoint[i] == 0
+		    && nFree == m_nBreakpoints)
+		{
+			nFree = i;
+		}
+	}
+
+	if (!bInsert)
+	{
+		return true;
+	}
+
+	if (   nFree == m_nBreakpoints
+	    || !WriteWord (FP_COMP (nFree), nComp))
+	{
+		return false;
+	}
+
+	m_Breakpoint[nFree] = nComp;
+
+	return true;
+}
+
+bool CSWDGDB::ReadWord (uint32_t nAddress, uint32_t *pValue)
+{
+	return m_pLoader->ReadWords (nAddress, pValue, 1);
+}
+
+bool CSWDGDB::WriteWord (uint32_t nAddress, uint32_t nValue)
+{
+	return m_pLoader->WriteBytes (nAddress, &nValue, sizeof nValue);
+}
+
+bool CSWDGDB::Match (const char *pPrefix)
+{
+	unsigned nLength = strlen (pPrefix);
+	if (   nLength > (unsigned) (m_pPacketEnd - m_pPacket)
+	    || memcmp (m_pPacket, pPrefix, nLength) != 0)
+	{
+		return false;
+	}
+
+	m_pPacket += nLength;
+
+	return true;
+}
+
+bool CSWDGDB::GetChar (char chChar)
+{
+	if (   m_pPacket >= m_pPacketEnd
+	    || *m_pPacket != chChar)
+	{
+		return false;
+	}
+
+	m_pPacket++;
+
+	return true;
+}
+
+static int HexDigit (char chChar)
+{
+	if (chChar >= '0' && chChar <= '9')
+	{
+		return chChar - '0';
+	}
+
+	if (chChar >= 'a' && chChar <= 'f')
+	{
+		return chChar - 'a' + 10;
+	}
+
+	if (chChar >= 'A' && chChar <= 'F')
+	{
+		return chChar - 'A' + 10;
+	}
+
+	return -1;
+}
+
+uint32_t CSWDGDB::GetHex (void)
+{
+	uint32_t nValue = 0;
+
+	int nDigit;
+	while (   m_pPacket < m_pPacketEnd
+	       && (nDigit = HexDigit (*m_pPacket)) >= 0)
+	{
+		nValue = nValue << 4 | nDigit;
+		m_pPacket++;
+	}
+
+	return nValue;
+}
+
+// Bytes are sent in target memory order
+bool CSWDGDB::GetHexBytes (uint8_t *pBuffer, unsigned nLength)
+{
+	if (nLength * 2 > (unsigned) (m_pPacketEnd - m_pPacket))
+	{
+		return false;
+	}
+
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		int nHigh = HexDigit (*m_pPacket++);
+		int nLow = HexDigit (*m_pPacket++);
+		if (nHigh < 0 || nLow < 0)
+		{
+			return false;
+		}
+
+		pBuffer[i] = nHigh << 4 | nLow;
+	}
+
+	return true;
+}
+
+// Characters, which do not fit into the response, are dropped
+void CSWDGDB::Put (char chChar)
+{
+	if (m_pResponse < m_pResponseEnd)
+	{
+		*m_pResponse++ = chChar;
+	}
+}
+
+void CSWDGDB::PutString (const char *pString)
+{
+	while (*pString)
+	{
+		Put (*pString++);
+	}
+}
+
+void CSWDGDB::PutHex (uint32_t nValue)
+{
+	char Digits[8];
+	unsigned nDigits = 0;
+	do
+	{
+		Digits[nDigits++] = "0123456789abcdef"[nValue & 0xF];
+		nValue >>= 4;
+	}
+	while (nValue != 0);
+
+	// at least two digits (e.g. register numbers in stop replies)
+	if (nDigits == 1)
+	{
+		Put ('0');
+	}
+
+	while (nDigits > 0)
+	{
+		Put (Digits[--nDigits]);
+	}
+}
+
+void CSWDGDB::PutHexBytes (const uint8_t *pData, unsigned nLength)
+{
+	for (unsigned i = 0; i < nLength; i++)
+	{
+		Put ("0123456789abcdef"[pData[i] >> 4]);
+		Put ("0123456789abcdef"[pData[i] & 0xF]);
+	}
+}
+
+// Little endian, as in target memory
+void CSWDGDB::PutHexWord (uint32_t nValue)
+{
+	uint8_t Bytes[4] = {(uint8_t) nValue, (uint8_t) (nValue >> 8),
+			    (uint8_t) (nValue >> 16), (uint8_t) (nValue >> 24)};
+
+	PutHexBytes (Bytes, sizeof Bytes);
+}
+
+void CSWDGDB::PutError (void)
+{
+	PutString ("E01");
+}
@@ -0,0 +1,149 @@
+//
+// swdgdb.h
+//
+// Executes GDB remote serial protocol packets with the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdgdb_h
+#define _pico_swdgdb_h
+
+#include "swdloader.h"
+#include <stdint.h>
+
+class CSWDGDB	/// GDB remote serial protocol processor (all-stop, core 0 of target 0), independent of the transport
+{
+public:
+	const static unsigned PacketSize = 1024;	///< Maximum packet and response data (without framing)
+	const static unsigned CachePageSize = 256;	///< Target memory is read in pages of this size
+	const static unsigned CachePages = 16;		///< Pages cached, while the target is halted
+	const static unsigned MaxBreakpoints = 8;	///< Used FPB comparators (at most)
+
+private:
+	const static unsigned Registers = 17;		// R0-R12, SP, LR, PC, xPSR
+
+public:
+	/// \param nClockPin GPIO pin to which SWCLK is connected
+	/// \param nDataPin GPIO pin to which SWDIO is connected
+	/// \param nClockRateKHz Interface clock rate in KHz
+	/// \note The target is not reset, GDB attaches to the running program.
+	CSWDGDB (unsigned nClockPin, unsigned nDataPin,
+		 unsigned nClockRateKHz = CSWDLoader::DefaultClockRateKHz);
+
+	~CSWDGDB (void);
+
+	/// \brief Execute one packet
+	/// \param pPacket Packet data (between '$' and '#', escapes already resolved)
+	/// \param nLength Length of the packet data
+	/// \param pResponse Response data is returned here (PacketSize bytes)
+	/// \param pResponseLength Length of the response data is returned here
+	/// \return Is a response to be sent now? (not after continue or kill)
+	/// \note Attaches to the target and halts it with the first packet.
+	bool Process (const char *pPacket, unsigned nLength, char *pResponse, unsigned *pResponseLength);
+
+	/// \brief Check, if the target has stopped after continue or step
+	/// \param bInterrupt Halt the target first (GDB has sent Ctrl-C)
+	/// \param pResponse Stop reply is returned here (PacketSize bytes)
+	/// \param pResponseLength Length of the stop reply is returned here
+	/// \return Is a stop reply to be sent?
+	bool Poll (bool bInterrupt, char *pResponse, unsigned *pResponseLength);
+
+	/// \return Is the target running? (GDB waits for a stop reply)
+	bool IsRunning (void) const		{ return m_bRunning; }
+
+	/// \return Attached to the target?
+	bool IsAttached (void) const		{ return m_pLoader != 0; }
+
+	/// \brief Remove the breakpoints, let the target run and release the SWD pins
+	/// \note The next packet attaches again.
+	void Detach (void);
+
+private:
+	bool Attach (void);
+
+	void Query (void);
+	void ReadFeatures (void);
+
+	void ReadRegisters (void);
+	void WriteRegisters (void);
+	void ReadRegister (void);
+	void WriteRegister (void);
+	bool LoadRegisters (void);
+
+	void ReadMemory (void);
+	void WriteMemory (bool bBinary);
+	bool ReadTarget (uint32_t nAddress, uint8_t *pBuffer, unsigned nLength);
+	const uint8_t *GetCachePage (uint32_t nAddress);
+	void InvalidateCache (void);
+
+	bool Resume (bool bStep);
+	bool CheckStopped (bool bInterrupt);
+	void PutStopReply (void);
+
+	void Breakpoint (bool bInsert);
+	bool SetBreakpoint (uint32_t nAddress, bool bInsert);
+
+	bool ReadWord (uint32_t nAddress, uint32_t *pValue);
+	bool WriteWord (uint32_t nAddress, uint32_t nValue);
+
+	bool Match (const char *pPrefix);
+	bool GetChar (char chChar);
+	uint32_t GetHex (void);
+	bool GetHexBytes (uint8_t *pBuffer, unsigned nLength);
+
+	void Put (char chChar);
+	void PutString (const char *pString);
+	void PutHex (uint32_t nValue);
+	void PutHexBytes (const uint8_t *pData, unsigned nLength);
+	void PutHexWord (uint32_t nValue);
+	void PutError (void);
+
+private:
+	unsigned m_nClockPin;
+	unsigned m_nDataPin;
+	unsigned m_nClockRateKHz;
+
+	CSWDLoader *m_pLoader;			// while attached
+	bool m_bRunning;			// after continue or step
+	unsigned m_nStopSignal;			// reported in the stop reply
+
+	uint32_t m_Register[Registers];		// valid from the first access after a halt
+	bool m_bRegistersValid;
+
+	struct TCachePage
+	{
+		uint32_t nAddress;
+		bool bValid;
+		unsigned nLastUse;
+		uint8_t Data[CachePageSize];
+	}
+	m_Cache[CachePages];			// invalidated on resume and write
+	unsigned m_nCacheClock;			// for LRU replacement
+	unsigned m_nCacheHits;
+	unsigned m_nCacheMisses;
+
+	unsigned m_nBreakpoints;		// comparators of the FPB (up to MaxBreakpoints)
+	bool m_bFPBv2;				// takes the full address (ARMv8-M)
+	uint32_t m_Breakpoint[MaxBreakpoints];	// comparator values, 0 if unused
+
+	uint32_t m_Buffer[CachePageSize/4 + 1];	// uncached reads and writes
+
+	const char *m_pPacket;			// next byte of the packet
+	const char *m_pPacketEnd;
+
+	char *m_pResponse;			// next byte of the response
+	char *m_pResponseEnd;
+};
+
+#endif
@@ -21,16 +21,13 @@
 #ifndef SWDLOADER_H
 #define SWDLOADER_H
 
-#include "hardware/gpio.h"
-#include "pico/stdlib.h"
-#include "pico/platform.h"
-#include "hardware/sync.h"
 #include <stdio.h>
 #include <assert.h>
 #include "swdloader.h"
-#include "hardware/clocks.h"
-
-#define CLOCKHZ (clock_get_hz(clk_sys))
+#include "swdflashstub.h"
+#include "swdunpackstub.h"
+#include "swdunpack.h"
+#include "swdcrc.h"
 
 #ifndef BIT
 #define BIT(n) (1U << (n))
@@ -41,13 +38,22 @@
 //
 // [1] ARM Debug Interface Architecture Specification ADIv5.0 to ADIv5.2, IHI 0031E
 // [2] ARM v6-M Architecture Reference Manual, DDI 0419E
+// [3] RP2040 Datasheet
 //
 
 // Debug Port v2
 
 #define TURN_CYCLES		1
 
+// Transaction layer
+#define WAIT_RETRIES		20	// per transfer, while the target responds with WAIT
+#define WAIT_BACKOFF_SPIN	4	// retries without delay
+#define WAIT_BACKOFF_MAX_US	1024
+#define BLOCK_REPLAYS		4	// of posted block writes
+#define GANG_DIVERGE_TIMEOUT_US	TARGET_FLASH_TIMEOUT_US	// targets may finish polled operations at different times
+
 // SWD-DP Requests
+#define REQ_RnW			BIT(2)	// in each request byte
 #define WR_DP_ABORT		0x81
 	#define DP_ABORT_STKCMPCLR		BIT(1)
 	#define DP_ABORT_STKERRCLR		BIT(2)
@@ -56,13 +62,14 @@
 #define RD_DP_CTRL_STAT		0x8D
 #define WR_DP_CTRL_STAT		0xA9
 	#define DP_CTRL_STAT_ORUNDETECT		BIT(0)
+	#define DP_CTRL_STAT_STICKYORUN		BIT(1)
 	#define DP_CTRL_STAT_STICKYERR		BIT(5)
+	#define DP_CTRL_STAT_WDATAERR		BIT(7)
 	#define DP_CTRL_STAT_CDBGPWRUPREQ	BIT(28)
 	#define DP_CTRL_STAT_CDBGPWRUPACK	BIT(29)
 	#define DP_CTRL_STAT_CSYSPWRUPREQ	BIT(30)
 	#define DP_CTRL_STAT_CSYSPWRUPACK	BIT(31)
 #define RD_DP_DPIDR		0xA5
-	#define DP_DPIDR_SUPPORTED			0x0BC12477
 #define RD_DP_RDBUFF		0xBD
 #define WR_DP_SELECT		0xB1
 	#define DP_SELECT_DPBANKSEL__SHIFT	0
@@ -70,10 +77,10 @@
 	#define DP_SELECT_APSEL__SHIFT		24
 		#define DP_SELECT_DEFAULT		0	// DP bank 0, AP 0, AP bank 0
 #define WR_DP_TARGETSEL		0x99
-	#define DP_TARGETSEL_CPUAPID_SUPPORTED		0x01002927
 	#define DP_TARGETSEL_TINSTANCE__SHIFT	28
 		#define DP_TARGETSEL_TINSTANCE_CORE0	0
 		#define DP_TARGETSEL_TINSTANCE_CORE1	1
+		#define DP_TARGETSEL_TINSTANCE_RESCUE	15	// resets the chip, never scanned
 
 // SW-DP response
 #define DP_OK			0b001
@@ -83,6 +90,8 @@
 // SWD MEM-AP Requests
 #define WR_AP_CSW		0xA3
 	#define AP_CSW_SIZE__SHIFT		0
+		#define AP_CSW_SIZE_8BITS		0
+		#define AP_CSW_SIZE_16BITS		1
 		#define AP_CSW_SIZE_32BITS		2
 	#define AP_CSW_ADDR_INC__SHIFT		4
 		#define AP_CSW_SIZE_INCREMENT_SINGLE	1
@@ -93,6 +102,7 @@
 #define RD_AP_DRW		0x9F
 #define WR_AP_DRW		0xBB
 #define WR_AP_TAR		0x8B
+	#define TAR_AUTOINC_BOUNDARY		1024	// at least ([1] section C2.2.2)
 
 // ARMv6-M Debug System Registers
 #define DHCSR			0xE000EDF0
@@ -100,11 +110,107 @@
 	#define DHCSR_C_HALT			BIT(1)
 	#define DHCSR_DBGKEY__SHIFT		16
 		#define DHCSR_DBGKEY_KEY		0xA05F
+	#define DHCSR_S_REGRDY			BIT(16)
 #define DCRSR			0xE000EDF4
 	#define DCRSR_REGSEL__SHIFT		0
+		#define DCRSR_REGSEL_R7			7
+		#define DCRSR_REGSEL_SP			13
 		#define DCRSR_REGSEL_R15		15	// PC register
+		#define DCRSR_REGSEL_XPSR		16
+		#define DCRSR_REGSEL_CONTROL_PRIMASK	20
 	#define DCRSR_REGW_N_R			BIT(16)
 #define DCRDR			0xE000EDF8
+#define DCRDR_REGRDY_POLLS	100		// the transfer is complete after a few cycles
+#define AIRCR			0xE000ED0C
+	#define AIRCR_SYSRESETREQ		BIT(2)
+	#define AIRCR_VECTKEY__SHIFT		16
+		#define AIRCR_VECTKEY_KEY		0x05FA
+
+#define XPSR_T			BIT(24)
+
+// Serial flash and boot ROM, the windows depend on the target type (see swdtarget.cpp)
+#define TARGET_FLASH_SECTOR_SIZE 0x1000U
+#define TARGET_FLASH_PAGE_SIZE	0x100U
+#define TARGET_FLASH_BLOCK_SIZE	0x10000U
+#define TARGET_FLASH_BLOCK_CMD	0xD8
+#define TARGET_FLASH_TIMEOUT_US	2000000U	// per stub call
+
+#define ROM_TABLE_CODE(c1, c2)	((c1) | (c2) << 8)
+
+// RP2040 resets and DMA ([3] sections 2.14 and 2.5)
+#define TARGET_RESETS_RESET_CLR	0x4000F000U	// atomic clear alias
+#define TARGET_RESETS_RESET_DONE 0x4000C008U
+	#define RESETS_DMA			BIT(2)
+#define TARGET_DMA_BASE		0x50000000U
+#define TARGET_DMA_READ_ADDR(ch)	(TARGET_DMA_BASE + (ch) * 0x40 + 0x00)
+#define TARGET_DMA_WRITE_ADDR(ch)	(TARGET_DMA_BASE + (ch) * 0x40 + 0x04)
+#define TARGET_DMA_TRANS_COUNT(ch)	(TARGET_DMA_BASE + (ch) * 0x40 + 0x08)
+#define TARGET_DMA_CTRL_TRIG(ch)	(TARGET_DMA_BASE + (ch) * 0x40 + 0x0C)
+	#define DMA_CTRL_EN			BIT(0)
+	#define DMA_CTRL_DATA_SIZE__SHIFT	2
+		#define DMA_CTRL_DATA_SIZE_BYTE		0
+	#define DMA_CTRL_INCR_READ		BIT(4)
+	#define DMA_CTRL_INCR_WRITE		BIT(5)
+	#define DMA_CTRL_CHAIN_TO__SHIFT	11
+	#define DMA_CTRL_TREQ_SEL__SHIFT	15
+		#define DMA_CTRL_TREQ_SEL_PERMANENT	0x3F
+	#define DMA_CTRL_SNIFF_EN		BIT(23)
+	#define DMA_CTRL_BUSY			BIT(24)
+	#define DMA_CTRL_AHB_ERROR		BIT(31)
+#define TARGET_DMA_SNIFF_CTRL	(TARGET_DMA_BASE + 0x434)
+	#define DMA_SNIFF_CTRL_EN		BIT(0)
+	#define DMA_SNIFF_CTRL_DMACH__SHIFT	1
+	#define DMA_SNIFF_CTRL_CALC__SHIFT	5
+		#define DMA_SNIFF_CTRL_CALC_CRC32R	1	// bit-reversed data
+	#define DMA_SNIFF_CTRL_OUT_REV		BIT(10)
+	#define DMA_SNIFF_CTRL_OUT_INV		BIT(11)
+#define TARGET_DMA_SNIFF_DATA	(TARGET_DMA_BASE + 0x438)
+#define TARGET_DMA_CHAN_ABORT	(TARGET_DMA_BASE + 0x444)
+
+#define TARGET_DMA_VERIFY_CHANNEL	11
+#define TARGET_DMA_TIMEOUT_US	1000000U
+
+// Delta mode, images are compared in blocks of this size
+#define DELTA_RAM_BLOCK_SIZE	TAR_AUTOINC_BOUNDARY
+#define DELTA_FLASH_BLOCK_SIZE	TARGET_FLASH_SECTOR_SIZE
+#define DELTA_MAX_BLOCKS	(0x1000000U / DELTA_FLASH_BLOCK_SIZE)	// 16 MB flash
+
+static uint32_t s_BounceBuffer[TAR_AUTOINC_BOUNDARY / 4];	// for unaligned images
+
+static uint32_t s_DeltaMap[DELTA_MAX_BLOCKS / 32];		// 1 for changed blocks
+#define DELTA_CHANGED(block)	(s_DeltaMap[(block) / 32] & BIT ((block) % 32))
+
+static uint32_t s_DeltaBlock[DELTA_RAM_BLOCK_SIZE / 4];		// of a chunked SRAM image
+
+static const uint32_t s_FlashPad[TARGET_FLASH_PAGE_SIZE / 4] =	// fills the last page
+{
+	#define PAD4	0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU
+	PAD4, PAD4, PAD4, PAD4, PAD4, PAD4, PAD4, PAD4,
+	PAD4, PAD4, PAD4, PAD4, PAD4, PAD4, PAD4, PAD4
+	#undef PAD4
+};
+
+// Boot ROM functions used by the flash stub
+enum TFlashFunction
+{
+	FlashConnect,
+	FlashExitXIP,
+	FlashRangeErase,
+	FlashRangeProgram,
+	FlashFlushCache,
+	FlashEnterXIP,
+	FlashFunctionCount
+};
+
+static const uint16_t s_FlashFunctionCode[FlashFunctionCount] =
+{
+	ROM_TABLE_CODE ('I', 'F'),
+	ROM_TABLE_CODE ('E', 'X'),
+	ROM_TABLE_CODE ('R', 'E'),
+	ROM_TABLE_CODE ('R', 'P'),
+	ROM_TABLE_CODE ('F', 'C'),
+	ROM_TABLE_CODE ('C', 'X')
+};
 
 static inline int parity32(uint32_t n)
 {
@@ -116,14 +222,74 @@ static inline int parity32(uint32_t n)
     return parity;
 }
 
+// Continues the CRC-32 of a block of nSize bytes with 0xFF up to nBlockSize
+static uint32_t PadErasedCRC (uint32_t nCRC, size_t nSize, size_t nBlockSize)
+{
+	while (nSize < nBlockSize)
+	{
+		size_t nPadSize = nBlockSize - nSize;
+		if (nPadSize > sizeof s_FlashPad)
+		{
+			nPadSize = sizeof s_FlashPad;
+		}
+
+		nCRC = SWDCRC32 (nCRC, s_FlashPad, nPadSize);
+		nSize += nPadSize;
+	}
+
+	return nCRC;
+}
+
+// Output handler of the verification unpacker
+static bool UpdateCRC (const void *pData, size_t nSize, void *pParam)
+{
+	uint32_t *pCRC = (uint32_t *) pParam;
+	*pCRC = SWDCRC32 (*pCRC, pData, nSize);
+
+	return true;
+}
+
 CSWDLoader::CSWDLoader (unsigned nClockPin, unsigned nDataPin, unsigned nResetPin,
-			unsigned nClockRateKHz)
+			unsigned nClockRateKHz, unsigned nTargets)
 :	m_bResetAvailable (nResetPin != 0),
-	m_nDelayNanos (1000000U / nClockRateKHz / 2),
+	m_Clock (nClockRateKHz),
+	m_nDelayCycles (m_Clock.GetDelayCycles ()),
+	m_nMeasuredRate (0),
+	m_bOverrunDetect (false),
+	m_bVerifyCRC (false),
+	m_bDeltaMode (false),
+	m_nImageAddress (0),
+	m_nImageEnd (0),
+	m_nImageOffset (0),
+	m_nImageCRC (0),
+	m_bImageFlash (false),
+	m_bImageDelta (false),
+	m_nBlockCRC (0),
+	m_nDeltaBlocks (0),
+	m_nDeltaChanged (0),
+	m_nImageStartTicks (0),
+	m_bImagePacked (false),
+	m_nPackedHeaderBytes (0),
+	m_nUnpackArea (0),
+	m_nRingHead (0),
+	m_nRingTail (0),
+	m_pVerifyUnpacker (0),
+	m_nCSW (0),
 	m_ClockPin (nClockPin, GPIOModeOutput),
 	m_DataPin (nDataPin, GPIOModeOutput),
-	m_pTimer (CTimer::Get ())
+	m_nBusTargets (0),
+	m_nCurrentTarget (0),
+	m_pTarget (SWDGetTarget (0)),
+	m_pTimer (TSWDWire::TTimer::Get ()),
+	m_nTransactionStartTicks (0),
+	m_pLoadHook (0),
+	m_pLoadHookParam (0),
+	m_nLoadMaxInterruptsOffTicks (0)
 {
+	assert (FlashFunctionCount <= sizeof m_FlashFunction / sizeof m_FlashFunction[0]);
+
+	ResetStatistics ();
+
 	if (m_bResetAvailable)
 	{
 		m_ResetPin.AssignPin (nResetPin);
@@ -134,10 +300,29 @@ CSWDLoader::CSWDLoader (unsigned nClockPin, unsigned nDataPin, unsigned nResetPi
 	}
 
 	m_DataPin.SetPullMode (GPIOPullUp);
+
+	m_bUseGang =    nTargets > 1
+		     && m_Gang.Initialize (nClockPin, nDataPin, nTargets, m_Clock.GetPIODivider ());
+	if (nTargets > 1 && !m_bUseGang)
+	{
+		printf ("Gang not available, using first target only\r\n");
+	}
+
+	// falls back to bit-banging, if no PIO is available
+	m_bUsePIO = !m_bUseGang && m_PIO.Initialize (nClockPin, nDataPin, m_Clock.GetPIODivider ());
+	m_bUseDMA = m_bUsePIO && m_PIO.HasDMA ();
+
+	// bit-banging depends on the timing of the CPU, the PIO engines do not
+	m_bMaskInterrupts = !m_bUsePIO && !m_bUseGang;
+
+	// lockstep transfers need the data phase, even if a target does not respond with OK
+	m_bOverrunDetect = m_bUseGang;
 }
 
 CSWDLoader::~CSWDLoader (void)
 {
+	delete m_pVerifyUnpacker;
+
 	m_DataPin.SetMode (GPIOModeInput);
 	m_ClockPin.SetMode (GPIOModeInput);
 
@@ -160,151 +345,217 @@ bool CSWDLoader::Initialize (void)
 
 	BeginTransaction ();
 
+	m_nCSW = 0;
+
+	if (!m_bUsePIO && !m_bUseGang)
+	{
+		CalibrateClock ();
+	}
+
 	Dormant2SWD ();
 	WriteIdle ();
-	LineReset ();
-
-	// core 1 remains halted after reset
-	SelectTarget (DP_TARGETSEL_CPUAPID_SUPPORTED, DP_TARGETSEL_TINSTANCE_CORE0);
 
-	uint32_t nIDCode;
-	if (!ReadData (RD_DP_DPIDR, &nIDCode))
+	if (!m_bUseGang)
 	{
-		printf ("Target does not respond");
-
-		return false;
+		ScanTargets ();
+	}
+	else
+	{
+		// a gang cannot scan, missing instances would drop all targets
+		m_BusTarget[0].pDescriptor = SWDGetTarget (0);
+		m_BusTarget[0].uchInstanceID = DP_TARGETSEL_TINSTANCE_CORE0;
+		m_BusTarget[0].nSelect = SWDGetTarget (0)->APSelect[0];
+		m_nBusTargets = 1;
 	}
 
-	if (nIDCode != DP_DPIDR_SUPPORTED)
+	if (m_nBusTargets == 0)
 	{
 		EndTransaction ();
 
-		printf ("Debug target not supported (ID code 0x%X)", nIDCode);
+		printf ("Target does not respond");
 
 		return false;
 	}
 
-	if (!PowerOn ())
+	// in reverse order, so that target 0 (core 0 of the first chip) remains selected
+	for (unsigned i = m_nBusTargets; i-- > 0;)
 	{
-		printf ("Target connect failed");
+		m_BusTarget[i].nCSW = 0;
+		m_BusTarget[i].bPoweredUp = false;
 
-		return false;
+		if (!AttachTarget (i))
+		{
+			printf ("Target connect failed (0x%X)", GetTargetSel (i));
+
+			return false;
+		}
 	}
 
-	EndTransaction ();
+	m_nCurrentTarget = 0;
+	m_pTarget = m_BusTarget[0].pDescriptor;
 
-	return true;
-}
+	EndTransaction ();
 
-bool CSWDLoader::Load (const void *pProgram, size_t nProgSize, uint32_t nAddress)
-{
-	if (!Halt ())
+	for (unsigned i = 0; i < m_nBusTargets; i++)
 	{
-		return false;
+		printf ("Target %u is %s (0x%08X, SELECT 0x%X)\r\n", i, GetTargetName (i),
+			GetTargetSel (i), m_BusTarget[i].nSelect);
 	}
-	
-	unsigned nStartTicks = m_pTimer->GetClockTicks ();
 
-	if (!LoadChunk (pProgram, nProgSize, nAddress))
+	printf ("SWD clock is %u KHz (%u KHz requested)\r\n",
+		GetClockRateKHz (), m_Clock.GetRequestedRate () / 1000);
+
+	if (m_bUseGang)
 	{
-		return false;
+		printf ("Gang target mask is 0x%02X\r\n", GetTargetMask ());
 	}
-	
-	unsigned nEndTicks = m_pTimer->GetClockTicks ();
-	double fDuration = (double) (nEndTicks - nStartTicks) / 1e6;
 
-	printf ("%u bytes loaded in %.2f seconds (%.1f KBytes/s)\r\n",
-		 nProgSize, fDuration, nProgSize / fDuration / 1024.0);
+	return true;
+}
 
-	return Start (nAddress);
+uint32_t CSWDLoader::GetTargetSel (unsigned nTarget) const
+{
+	assert (nTarget < m_nBusTargets);
+	const TBusTarget *pTarget = &m_BusTarget[nTarget];
+
+	return   pTarget->pDescriptor->nTargetID
+	       | (uint32_t) pTarget->uchInstanceID << DP_TARGETSEL_TINSTANCE__SHIFT;
 }
 
-bool CSWDLoader::Halt (void)
+const char *CSWDLoader::GetTargetName (unsigned nTarget) const
+{
+	assert (nTarget < m_nBusTargets);
+
+	return m_BusTarget[nTarget].pDescriptor->pName;
+}
+
+bool CSWDLoader::SwitchTarget (unsigned nTarget)
 {
+	assert (nTarget < m_nBusTargets);
+	if (nTarget == m_nCurrentTarget)
+	{
+		return true;
+	}
+
+	m_BusTarget[m_nCurrentTarget].nCSW = m_nCSW;
+
 	BeginTransaction ();
 
-	if (   !WriteData (WR_AP_CSW,   (AP_CSW_SIZE_32BITS << AP_CSW_SIZE__SHIFT)
-				      | (AP_CSW_SIZE_INCREMENT_SINGLE << AP_CSW_ADDR_INC__SHIFT)
-				      | AP_CSW_DEVICE_EN
-				      | (AP_CSW_PROT_DEFAULT << AP_CSW_PROT__SHIFT)
-				      | AP_CSW_DBG_SW_ENABLE)
-	    || !WriteMem (DHCSR,   DHCSR_C_DEBUGEN
-				 | DHCSR_C_HALT
-				 | (DHCSR_DBGKEY_KEY << DHCSR_DBGKEY__SHIFT)))
+	// another core behind the same debug port needs a DP SELECT write only
+	if (GetTargetSel (nTarget) == GetTargetSel (m_nCurrentTarget))
 	{
-		printf ("Target halt failed");
+		if (!WriteData (WR_DP_SELECT, m_BusTarget[nTarget].nSelect))
+		{
+			printf ("Target switch failed (0x%X)", GetTargetSel (nTarget));
+
+			return false;
+		}
+	}
+	else if (!AttachTarget (nTarget))
+	{
+		printf ("Target switch failed (0x%X)", GetTargetSel (nTarget));
 
 		return false;
 	}
 
 	EndTransaction ();
 
+	m_nCurrentTarget = nTarget;
+	m_nCSW = m_BusTarget[nTarget].nCSW;
+	m_pTarget = m_BusTarget[nTarget].pDescriptor;
+
 	return true;
 }
 
-bool CSWDLoader::LoadChunk (const void *pChunk, size_t nChunkSize, uint32_t nAddress)
+bool CSWDLoader::Load (const void *pProgram, size_t nProgSize, uint32_t nAddress)
 {
-	printf("LoadChunk start: size = %zu, addr = 0x%08X\n", nChunkSize, nAddress);
-	if ((nChunkSize & 3) != 0)
-    printf("⚠️ WARNING: nChunkSize is not 4-byte aligned!\n");
-	
-	const uint32_t *pChunk32 = (const uint32_t *) pChunk;
-	assert (pChunk32 != 0);
+	if (   nAddress < m_pTarget->nRAMBase
+	    || nAddress + nProgSize > m_pTarget->nRAMBase + m_pTarget->nRAMSize)
+	{
+		printf ("Invalid load address (0x%X)", nAddress);
 
-	uint32_t nFirstWord = *pChunk32;
-	uint32_t nAddressCopy = nAddress;
+		return false;
+	}
 
-	assert ((nChunkSize & 3) == 0);
-	while (nChunkSize > 0)
+	BeginLoad ();
+
+	if (!Halt ())
 	{
-		BeginTransaction ();
+		return false;
+	}
+	
+	unsigned nStartTicks = m_pTimer->GetClockTicks ();
 
-		if (!WriteData (WR_AP_TAR, nAddress))
-		{
-			printf ("Cannot write TAR (0x%X)", nAddress);
+	// reading back SRAM is not faster than writing it
+	if (   m_bDeltaMode
+	    && m_pTarget->bDMASniffer)
+	{
+		const uint8_t *pProgram8 = (const uint8_t *) pProgram;
+		assert (pProgram8 != 0);
 
+		unsigned nBlocks;
+		if (!FindChangedBlocks (pProgram8, nProgSize, nAddress, DELTA_RAM_BLOCK_SIZE,
+					false, &nBlocks))
+		{
 			return false;
 		}
 
-		const size_t BlockSize = 1024;
-		for (unsigned i = 0; i < BlockSize; i += 4)
+		for (unsigned nBlock = 0; nBlock < nBlocks; nBlock++)
 		{
-			if (!WriteData (WR_AP_DRW, *pChunk32++))
+			size_t nOffset = nBlock * DELTA_RAM_BLOCK_SIZE;
+			size_t nSize = nProgSize - nOffset;
+			if (nSize > DELTA_RAM_BLOCK_SIZE)
 			{
-				printf ("Memory write failed (0x%X)", nAddress);
-
-				return false;
+				nSize = DELTA_RAM_BLOCK_SIZE;
 			}
 
-			if (nChunkSize > 4)
+			if (   DELTA_CHANGED (nBlock)
+			    && !LoadChunk (pProgram8 + nOffset, nSize, nAddress + nOffset))
 			{
-				nChunkSize -= 4;
-			}
-			else
-			{
-				nChunkSize = 0;
-				break;
+				return false;
 			}
 		}
+	}
+	else if (!LoadChunk (pProgram, nProgSize, nAddress))
+	{
+		return false;
+	}
+	
+	unsigned nEndTicks = m_pTimer->GetClockTicks ();
+	double fDuration = (double) (nEndTicks - nStartTicks) / 1e6;
 
-		nAddress += BlockSize;
+	printf ("%u bytes loaded in %.2f seconds (%.1f KBytes/s)\r\n",
+		 (unsigned) nProgSize, fDuration, nProgSize / fDuration / 1024.0);
 
-		EndTransaction ();
+	EndLoad (nProgSize, nStartTicks);
+
+	if (   m_bVerifyCRC
+	    && !VerifyCRC (pProgram, nProgSize, nAddress))
+	{
+		return false;
 	}
 
-	BeginTransaction ();
+	return Start (nAddress);
+}
+
+bool CSWDLoader::VerifyCRC (const void *pImage, size_t nImageSize, uint32_t nAddress)
+{
+	assert (pImage != 0);
 
-	uint32_t nFirstWordRead;
-	if (!ReadMem (nAddressCopy, &nFirstWordRead))
+	return CompareCRC (SWDCRC32 (0, pImage, nImageSize), nImageSize, nAddress);
+}
+
+bool CSWDLoader::CompareCRC (uint32_t nCRC, size_t nSize, uint32_t nAddress)
+{
+	uint32_t nTargetCRC;
+	if (!GetTargetCRC (nAddress, nSize, &nTargetCRC))
 	{
-		printf ("Memory read failed (0x%X)", nAddressCopy);
+		return false;
 	}
 
-	EndTransaction ();
-
-	if (nFirstWord != nFirstWordRead)
+	if (nCRC != nTargetCRC)
 	{
-		printf ("Data mismatch (0x%X != 0x%X)", nFirstWord, nFirstWordRead);
+		printf ("CRC mismatch (0x%X != 0x%X)", nCRC, nTargetCRC);
 
 		return false;
 	}
@@ -312,164 +563,2130 @@ bool CSWDLoader::LoadChunk (const void *pChunk, size_t nChunkSize, uint32_t nAdd
 	return true;
 }
 
-bool CSWDLoader::Start (uint32_t nAddress)
+// One CRC over the whole image is cheaper than the per-sector CRCs of delta
+// mode, which are only computed, if the image has changed
+bool CSWDLoader::UpdateImage (const void *pImage, size_t nImageSize, uint32_t nAddress,
+			      bool *pChanged)
 {
-	BeginTransaction ();
+	assert (pImage != 0);
+	assert (pChanged != 0);
+	*pChanged = false;
 
-	if (   !WriteMem (DCRDR, nAddress)
-	    || !WriteMem (DCRSR,   (DCRSR_REGSEL_R15 << DCRSR_REGSEL__SHIFT)
-				 | DCRSR_REGW_N_R)
-	    || !WriteMem (DHCSR,   DHCSR_C_DEBUGEN
-				 | (DHCSR_DBGKEY_KEY << DHCSR_DBGKEY__SHIFT)))
+	bool bFlash =    m_pTarget->nFlashBase <= nAddress
+		      && nAddress < m_pTarget->nFlashBase + m_pTarget->nFlashSize;
+
+	// a running SRAM image has changed its .data, .bss and stack, it never matches
+	if (bFlash)
 	{
-		printf ("Target start failed");
+		// the target DMA computes the CRC, the program must not use it meanwhile
+		uint32_t nTargetCRC;
+		if (   !Halt ()
+		    || !GetTargetCRC (nAddress, nImageSize, &nTargetCRC))
+		{
+			return false;
+		}
 
-		return false;
+		// the DMA channel, the sniffer and the scratch word in SRAM have been
+		// overwritten, so the program cannot continue, it is started again
+		if (nTargetCRC == SWDCRC32 (0, pImage, nImageSize))
+		{
+			return ResetTarget ();
+		}
 	}
 
-	EndTransaction ();
+	*pChanged = true;
 
-	return true;
+	bool bDeltaMode = m_bDeltaMode;
+	m_bDeltaMode = true;
+
+	bool bOK;
+	if (bFlash)
+	{
+		bOK = ProgramFlash (pImage, nImageSize, nAddress);
+	}
+	else
+	{
+		bOK = Load (pImage, nImageSize, nAddress);
+	}
+
+	m_bDeltaMode = bDeltaMode;
+
+	return bOK;
 }
 
-bool CSWDLoader::PowerOn (void)
+void CSWDLoader::SetOverrunDetect (bool bEnable)
 {
-	if (!WriteData (WR_DP_ABORT,   DP_ABORT_STKCMPCLR
-				     | DP_ABORT_STKERRCLR
-				     | DP_ABORT_WDERRCLR
-				     | DP_ABORT_ORUNERRCLR))
+	// the PIO engines check each ACK in hardware, the gang needs it always
+	m_bOverrunDetect = m_bUseGang || (bEnable && !m_bUsePIO);
+}
+
+bool CSWDLoader::ProgramFlash (const void *pImage, size_t nImageSize, uint32_t nAddress)
+{
+	if (   nAddress < m_pTarget->nFlashBase
+	    || nAddress + nImageSize > m_pTarget->nFlashBase + m_pTarget->nFlashSize
+	    || (nAddress & (TARGET_FLASH_SECTOR_SIZE-1)))
 	{
+		printf ("Invalid flash address (0x%X)", nAddress);
+
 		return false;
 	}
 
-	if (!WriteData (WR_DP_SELECT, DP_SELECT_DEFAULT))
+	BeginLoad ();
+
+	if (   !Halt ()
+	    || !StartFlashStub (m_FlashFunction))
 	{
 		return false;
 	}
 
-	if (!WriteData (WR_DP_CTRL_STAT,   DP_CTRL_STAT_ORUNDETECT
-					 | DP_CTRL_STAT_STICKYERR
-					 | DP_CTRL_STAT_CDBGPWRUPREQ
-					 | DP_CTRL_STAT_CSYSPWRUPREQ))
+	unsigned nStartTicks = m_pTimer->GetClockTicks ();
+
+	const uint8_t *pImage8 = (const uint8_t *) pImage;
+	assert (pImage8 != 0);
+
+	if (m_bDeltaMode)
 	{
-		return false;
+		// flash is compared through XIP, which is (re-)entered in the safe serial mode
+		unsigned nSectors;
+		if (   !CallFlashStub (m_FlashFunction[FlashConnect], 0, 0, 0, 0,
+				       m_FlashFunction[FlashExitXIP], 0, 0, 0, 0)
+		    || !CallFlashStub (m_FlashFunction[FlashFlushCache], 0, 0, 0, 0,
+				       m_FlashFunction[FlashEnterXIP], 0, 0, 0, 0)
+		    || !WaitFlashStub ()
+		    || !FindChangedBlocks (pImage8, nImageSize, nAddress, DELTA_FLASH_BLOCK_SIZE,
+					   true, &nSectors))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		memset (s_DeltaMap, 0xFF, sizeof s_DeltaMap);
 	}
 
-	uint32_t nCtrlStat;
-	if (!ReadData (RD_DP_CTRL_STAT, &nCtrlStat))
+	if (!CallFlashStub (m_FlashFunction[FlashConnect], 0, 0, 0, 0,
+			    m_FlashFunction[FlashExitXIP], 0, 0, 0, 0))
 	{
 		return false;
 	}
 
-	if (   !(nCtrlStat & DP_CTRL_STAT_CDBGPWRUPACK)
-	    || !(nCtrlStat & DP_CTRL_STAT_CSYSPWRUPACK))
+	uint32_t nOffset = nAddress - m_pTarget->nFlashBase;
+	size_t nRemaining = nImageSize;
+	unsigned nProgrammed = 0;
+	for (unsigned nSector = 0; nRemaining > 0; nSector++)
 	{
-		EndTransaction ();
+		size_t nSize = nRemaining < TARGET_FLASH_SECTOR_SIZE ? nRemaining : TARGET_FLASH_SECTOR_SIZE;
+
+		if (DELTA_CHANGED (nSector))
+		{
+			// shifted in, while the stub programs the previous sector from the other buffer
+			uint32_t nBuffer = FLASH_STUB_BUFFER (nProgrammed++ & 1);
+			if (   !LoadChunk (pImage8, nSize, nBuffer)
+			    || !ProgramSector (nOffset, nBuffer, nSize))
+			{
+				return false;
+			}
+		}
+
+		pImage8 += nSize;
+		nRemaining -= nSize;
+		nOffset += TARGET_FLASH_SECTOR_SIZE;
+	}
 
+	if (!FinishFlash ())
+	{
 		return false;
 	}
 
-	return true;
-}
+	unsigned nEndTicks = m_pTimer->GetClockTicks ();
+	double fDuration = (double) (nEndTicks - nStartTicks) / 1e6;
 
-bool CSWDLoader::WriteMem (uint32_t nAddress, uint32_t nData)
-{
-	return    WriteData (WR_AP_TAR, nAddress)
-	       && WriteData (WR_AP_DRW, nData);
-}
+	printf ("%u bytes programmed in %.2f seconds (%.1f KBytes/s)\r\n",
+		 (unsigned) nImageSize, fDuration, nImageSize / fDuration / 1024.0);
 
-bool CSWDLoader::ReadMem (uint32_t nAddress, uint32_t *pData)
-{
-	return    WriteData (WR_AP_TAR, nAddress)
-	       && ReadData (RD_AP_DRW, pData)
-	       && ReadData (RD_DP_RDBUFF, pData);
+	EndLoad (nImageSize, nStartTicks);
+
+	if (   m_bVerifyCRC
+	    && !VerifyCRC (pImage, nImageSize, nAddress))
+	{
+		return false;
+	}
+
+	return ResetTarget ();
 }
 
-bool CSWDLoader::WriteData (uint8_t nRequest, uint32_t nData)
+bool CSWDLoader::BeginImage (uint32_t nAddress, bool bPacked)
 {
-	WriteBits (nRequest, 7);
+	m_nImageAddress = nAddress;
+	m_nImageOffset = 0;
+	m_nImageCRC = 0;
+
+	m_bImagePacked = bPacked;
+	m_nPackedHeaderBytes = 0;
+	m_nUnpackArea = m_pTarget->nRAMBase + m_pTarget->nRAMSize - UNPACK_STUB_AREA_SIZE;
+	m_nRingHead = 0;
+	m_nRingTail = 0;
+
+	BeginLoad ();
+
+	delete m_pVerifyUnpacker;
+	m_pVerifyUnpacker = 0;
+	if (   bPacked
+	    && m_bVerifyCRC)
+	{
+		// the image is decompressed on the probe too, to get its CRC
+		m_pVerifyUnpacker = new CSWDUnpacker (UpdateCRC, &m_nImageCRC);
+		assert (m_pVerifyUnpacker != 0);
+	}
+	m_nBlockCRC = 0;
+	m_nDeltaBlocks = 0;
+	m_nDeltaChanged = 0;
 
-	assert (nRequest & 0x80);
-	ReadBits (1 + TURN_CYCLES);	// park bit (not driven) and turn cycle
+	if (   m_pTarget->nFlashBase <= nAddress
+	    && nAddress < m_pTarget->nFlashBase + m_pTarget->nFlashSize)
+	{
+		if (nAddress & (TARGET_FLASH_SECTOR_SIZE-1))
+		{
+			printf ("Invalid flash address (0x%X)", nAddress);
 
-	uint32_t nResponse = ReadBits (3);
+			return false;
+		}
 
-	ReadBits (TURN_CYCLES);
+		m_bImageFlash = true;
+		m_bImageDelta = m_bDeltaMode && !bPacked;
+		m_nImageEnd = m_pTarget->nFlashBase + m_pTarget->nFlashSize;
 
-	if (nResponse != DP_OK)
+		if (   !Halt ()
+		    || !StartFlashStub (m_FlashFunction)
+		    || !CallFlashStub (m_FlashFunction[FlashConnect], 0, 0, 0, 0,
+				       m_FlashFunction[FlashExitXIP], 0, 0, 0, 0))
+		{
+			return false;
+		}
+	}
+	else if (   m_pTarget->nRAMBase <= nAddress
+		 && nAddress < m_pTarget->nRAMBase + m_pTarget->nRAMSize)
 	{
-		EndTransaction ();
+		m_bImageFlash = false;
+		m_bImageDelta = m_bDeltaMode && !bPacked && m_pTarget->bDMASniffer;
+		m_nImageEnd = bPacked ? m_nUnpackArea : m_pTarget->nRAMBase + m_pTarget->nRAMSize;
 
-		printf ("Cannot write (req 0x%02X, data 0x%X, resp %u)",
-			 (unsigned) nRequest, nData, nResponse);
+		if (!Halt ())
+		{
+			return false;
+		}
+	}
+	else
+	{
+		printf ("Invalid load address (0x%X)", nAddress);
 
 		return false;
 	}
 
-	WriteBits (nData, 32);
-	WriteBits (parity32 (nData), 1);
+	m_nImageStartTicks = m_pTimer->GetClockTicks ();
 
 	return true;
 }
 
-bool CSWDLoader::ReadData (uint8_t nRequest, uint32_t *pData)
+bool CSWDLoader::WriteImage (const void *pChunk, size_t nChunkSize)
 {
-	WriteBits (nRequest, 7);
-
-	assert (nRequest & 0x80);
-	ReadBits (1 + TURN_CYCLES);	// park bit (not driven) and turn cycle
-
-	uint32_t nResponse = ReadBits (3);
+	const uint8_t *pChunk8 = (const uint8_t *) pChunk;
+	assert (pChunk8 != 0);
 
-	if (nResponse != DP_OK)
+	if (m_bImagePacked)
 	{
-		ReadBits (TURN_CYCLES);
-
-		EndTransaction ();
+		return WritePacked (pChunk8, nChunkSize);
+	}
 
-		printf ("Cannot read (req 0x%02X, resp %u)", (unsigned) nRequest, nResponse);
+	if (m_nImageAddress + m_nImageOffset + nChunkSize > m_nImageEnd)
+	{
+		printf ("Image too large (0x%X)", (unsigned) (m_nImageAddress + m_nImageOffset + nChunkSize));
 
 		return false;
 	}
 
-	uint32_t nData = ReadBits (32);
+	m_nImageCRC = SWDCRC32 (m_nImageCRC, pChunk8, nChunkSize);
 
-	uint32_t nParity = ReadBits (1);
-	if (nParity != parity32 (nData))
+	if (m_bImageDelta && !m_bImageFlash)
 	{
-		ReadBits (TURN_CYCLES);
+		return WriteDeltaRAM (pChunk8, nChunkSize);
+	}
 
-		EndTransaction ();
+	if (!m_bImageFlash)
+	{
+		if (!LoadChunk (pChunk8, nChunkSize, m_nImageAddress + m_nImageOffset))
+		{
+			return false;
+		}
 
-		printf ("Parity error (req 0x%02X)", (unsigned) nRequest);
+		m_nImageOffset += nChunkSize;
 
-		return false;
+		return true;
 	}
 
-	assert (pData != 0);
-	*pData = nData;
+	// collect each sector in a stub buffer and program it, when it is full
+	while (nChunkSize > 0)
+	{
+		size_t nFill = m_nImageOffset & (TARGET_FLASH_SECTOR_SIZE-1);
+		size_t nSize = TARGET_FLASH_SECTOR_SIZE - nFill;
+		if (nSize > nChunkSize)
+		{
+			nSize = nChunkSize;
+		}
 
-	ReadBits (TURN_CYCLES);
+		uint32_t nBuffer = FLASH_STUB_BUFFER ((m_nImageOffset / TARGET_FLASH_SECTOR_SIZE) & 1);
+		if (!LoadChunk (pChunk8, nSize, nBuffer + nFill))
+		{
+			return false;
+		}
+
+		if (m_bImageDelta)
+		{
+			m_nBlockCRC = SWDCRC32 (nFill > 0 ? m_nBlockCRC : 0, pChunk8, nSize);
+		}
+
+		pChunk8 += nSize;
+		nChunkSize -= nSize;
+		m_nImageOffset += nSize;
+
+		if (   !(m_nImageOffset & (TARGET_FLASH_SECTOR_SIZE-1))
+		    && !ProgramImageSector (nBuffer, TARGET_FLASH_SECTOR_SIZE))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CSWDLoader::EndImage (void)
+{
+	size_t nFill = m_nImageOffset & (TARGET_FLASH_SECTOR_SIZE-1);
+	if (m_bImagePacked)
+	{
+		if (!FinishPacked ())
+		{
+			return false;
+		}
+	}
+	else if (   m_bImageFlash
+		 && (   (   nFill > 0
+			 && !ProgramImageSector (FLASH_STUB_BUFFER ((m_nImageOffset / TARGET_FLASH_SECTOR_SIZE) & 1),
+						 nFill))
+		     || !FinishFlash ()))
+	{
+		return false;
+	}
+	else if (   m_bImageDelta
+		 && !m_bImageFlash
+		 && (m_nImageOffset & (DELTA_RAM_BLOCK_SIZE-1))
+		 && !LoadDeltaBlock (m_nImageOffset & (DELTA_RAM_BLOCK_SIZE-1)))
+	{
+		return false;
+	}
+
+	if (m_bImageDelta)
+	{
+		printf ("%u of %u blocks changed\r\n", m_nDeltaChanged, m_nDeltaBlocks);
+	}
+
+	unsigned nEndTicks = m_pTimer->GetClockTicks ();
+	double fDuration = (double) (nEndTicks - m_nImageStartTicks) / 1e6;
+
+	printf ("%u bytes %s in %.2f seconds (%.1f KBytes/s)\r\n", (unsigned) m_nImageOffset,
+		m_bImageFlash ? "programmed" : "loaded", fDuration, m_nImageOffset / fDuration / 1024.0);
+
+	EndLoad (m_nImageOffset, m_nImageStartTicks);
+
+	if (   m_bVerifyCRC
+	    && !CompareCRC (m_nImageCRC, m_nImageOffset, m_nImageAddress))
+	{
+		return false;
+	}
+
+	return m_bImageFlash ? ResetTarget () : Start (m_nImageAddress);
+}
+
+// Collects the 1 KB blocks of a chunked SRAM image on the probe, because target
+// SRAM must be compared, before it is overwritten
+bool CSWDLoader::WriteDeltaRAM (const uint8_t *pChunk, size_t nChunkSize)
+{
+	while (nChunkSize > 0)
+	{
+		size_t nFill = m_nImageOffset & (DELTA_RAM_BLOCK_SIZE-1);
+		size_t nSize = DELTA_RAM_BLOCK_SIZE - nFill;
+		if (nSize > nChunkSize)
+		{
+			nSize = nChunkSize;
+		}
+
+		memcpy ((uint8_t *) s_DeltaBlock + nFill, pChunk, nSize);
+
+		pChunk += nSize;
+		nChunkSize -= nSize;
+		m_nImageOffset += nSize;
+
+		if (   !(m_nImageOffset & (DELTA_RAM_BLOCK_SIZE-1))
+		    && !LoadDeltaBlock (DELTA_RAM_BLOCK_SIZE))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Loads the block in s_DeltaBlock, which ends at the image offset, if it differs
+// from target SRAM
+bool CSWDLoader::LoadDeltaBlock (size_t nSize)
+{
+	uint32_t nAddress = m_nImageAddress + m_nImageOffset - nSize;
+
+	uint32_t nTargetCRC;
+	if (!GetTargetCRC (nAddress, nSize, &nTargetCRC))
+	{
+		return false;
+	}
+
+	m_nDeltaBlocks++;
+	if (nTargetCRC == SWDCRC32 (0, s_DeltaBlock, nSize))
+	{
+		return true;
+	}
+
+	m_nDeltaChanged++;
+
+	return LoadChunk (s_DeltaBlock, nSize, nAddress);
+}
+
+// Programs the sector in a stub buffer, which ends at the image offset. In delta
+// mode it is compared with target flash through XIP first, while the stub waits.
+bool CSWDLoader::ProgramImageSector (uint32_t nBuffer, size_t nSize)
+{
+	uint32_t nOffset = m_nImageAddress - m_pTarget->nFlashBase + m_nImageOffset - nSize;
+
+	if (m_bImageDelta)
+	{
+		uint32_t nTargetCRC;
+		if (   !CallFlashStub (m_FlashFunction[FlashFlushCache], 0, 0, 0, 0,
+				       m_FlashFunction[FlashEnterXIP], 0, 0, 0, 0)
+		    || !WaitFlashStub ()
+		    || !GetTargetCRC (m_pTarget->nFlashBase + nOffset, TARGET_FLASH_SECTOR_SIZE,
+				      &nTargetCRC)
+		    || !CallFlashStub (m_FlashFunction[FlashConnect], 0, 0, 0, 0,
+				       m_FlashFunction[FlashExitXIP], 0, 0, 0, 0))
+		{
+			return false;
+		}
+
+		m_nDeltaBlocks++;
+		if (nTargetCRC == PadErasedCRC (m_nBlockCRC, nSize, TARGET_FLASH_SECTOR_SIZE))
+		{
+			return true;
+		}
+
+		m_nDeltaChanged++;
+	}
+
+	return ProgramSector (nOffset, nBuffer, nSize);
+}
+
+// Passes the stream header to the probe and the rest to the ring of the unpack stub
+bool CSWDLoader::WritePacked (const uint8_t *pChunk, size_t nChunkSize)
+{
+	if (   m_pVerifyUnpacker != 0
+	    && !m_pVerifyUnpacker->Write (pChunk, nChunkSize))
+	{
+		return false;
+	}
+
+	while (   nChunkSize > 0
+	       && m_nPackedHeaderBytes < SWD_UNPACK_HEADER_SIZE)
+	{
+		m_PackedHeader[m_nPackedHeaderBytes++] = *pChunk++;
+		nChunkSize--;
+
+		if (   m_nPackedHeaderBytes == SWD_UNPACK_HEADER_SIZE
+		    && !StartUnpackStub ())
+		{
+			return false;
+		}
+	}
+
+	uint32_t nRing = m_nUnpackArea + UNPACK_STUB_RING;
+	while (nChunkSize > 0)
+	{
+		size_t nFree = UNPACK_STUB_RING_SIZE - (m_nRingHead - m_nRingTail);
+		if (nFree == 0)
+		{
+			if (!WaitUnpackStub (false))
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		size_t nWrap = UNPACK_STUB_RING_SIZE - (m_nRingHead & (UNPACK_STUB_RING_SIZE-1));
+		size_t nSize = nChunkSize;
+		if (nSize > nFree)
+		{
+			nSize = nFree;
+		}
+		if (nSize > nWrap)
+		{
+			nSize = nWrap;
+		}
+
+		if (!LoadChunk (pChunk, nSize, nRing + (m_nRingHead & (UNPACK_STUB_RING_SIZE-1))))
+		{
+			return false;
+		}
+
+		m_nRingHead += nSize;
+
+		BeginTransaction ();
+
+		if (!WriteMem (m_nUnpackArea + UNPACK_STUB_CONTROL + UNPACK_STUB_HEAD*4, m_nRingHead))
+		{
+			return false;
+		}
+
+		EndTransaction ();
+
+		pChunk += nSize;
+		nChunkSize -= nSize;
+	}
+
+	return true;
+}
+
+// Loads the unpack stub to the top of target SRAM and starts it with interrupts disabled
+bool CSWDLoader::StartUnpackStub (void)
+{
+	unsigned nWindowBits = m_PackedHeader[2];
+	unsigned nLookaheadBits = m_PackedHeader[3];
+	m_nImageOffset =   (size_t) m_PackedHeader[4]
+			 | (size_t) m_PackedHeader[5] << 8
+			 | (size_t) m_PackedHeader[6] << 16
+			 | (size_t) m_PackedHeader[7] << 24;
+
+	if (   m_PackedHeader[0] != SWD_UNPACK_MAGIC0
+	    || m_PackedHeader[1] != SWD_UNPACK_MAGIC1
+	    || nWindowBits > CSWDUnpacker::MaxWindowBits
+	    || nLookaheadBits >= nWindowBits)
+	{
+		printf ("Invalid stream header (W%u L%u)", nWindowBits, nLookaheadBits);
+
+		return false;
+	}
+
+	if (m_nImageAddress + m_nImageOffset > m_nImageEnd)
+	{
+		printf ("Image too large (0x%X)", (unsigned) (m_nImageAddress + m_nImageOffset));
+
+		return false;
+	}
+
+	// the flash stub must have completed the exit from XIP
+	if (   m_bImageFlash
+	    && !WaitFlashStub ())
+	{
+		return false;
+	}
+
+	const uint32_t Control[UNPACK_STUB_CONTROL_WORDS] =
+	{
+		0, 0, (uint32_t) m_nImageOffset, 0,
+		m_bImageFlash ? UNPACK_STUB_WINDOW : m_nImageAddress,
+		m_bImageFlash ? UNPACK_STUB_WINDOW_SIZE-1 : 0xFFFFFFFFU,
+		m_nImageAddress - m_pTarget->nFlashBase,
+		m_bImageFlash ? m_FlashFunction[FlashRangeErase] : 0,
+		m_FlashFunction[FlashRangeProgram],
+		m_FlashFunction[FlashFlushCache],
+		m_FlashFunction[FlashEnterXIP],
+		nWindowBits, nLookaheadBits,
+		m_nUnpackArea + UNPACK_STUB_RING, UNPACK_STUB_RING_SIZE-1,
+		0
+	};
+
+	if (   !Halt ()
+	    || !LoadChunk (UnpackStubCode, sizeof UnpackStubCode, m_nUnpackArea + UNPACK_STUB_CODE))
+	{
+		return false;
+	}
+
+	BeginTransaction ();
+
+	if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+	    || !WriteMemBlock (m_nUnpackArea + UNPACK_STUB_CONTROL, Control, UNPACK_STUB_CONTROL_WORDS)
+	    || !WriteCoreRegister (DCRSR_REGSEL_R7, m_nUnpackArea + UNPACK_STUB_CONTROL)
+	    || !WriteCoreRegister (DCRSR_REGSEL_SP, m_nUnpackArea + UNPACK_STUB_STACK_TOP)
+	    || !WriteCoreRegister (DCRSR_REGSEL_XPSR, XPSR_T)
+	    || !WriteCoreRegister (DCRSR_REGSEL_CONTROL_PRIMASK, 1))	// PRIMASK
+	{
+		printf ("Unpack stub setup failed");
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	return Start (m_nUnpackArea + UNPACK_STUB_CODE);
+}
+
+// Waits until the stub has consumed data from the ring, or has completed the image
+bool CSWDLoader::WaitUnpackStub (bool bComplete)
+{
+	uint64_t nStartTicks = m_pTimer->GetClockTicks ();
+
+	uint32_t nControl = m_nUnpackArea + UNPACK_STUB_CONTROL;
+	while (1)
+	{
+		BeginTransaction ();
+
+		uint32_t nTail, nStatus;
+		if (   !ReadMem (nControl + UNPACK_STUB_TAIL*4, &nTail)
+		    || !ReadMem (nControl + UNPACK_STUB_STATUS*4, &nStatus))
+		{
+			return false;
+		}
+
+		EndTransaction ();
+
+		if (bComplete ? nStatus != 0 : nTail != m_nRingTail)
+		{
+			m_nRingTail = nTail;
+
+			return true;
+		}
+
+		// a sector is erased and programmed at most
+		if (m_pTimer->GetClockTicks () - nStartTicks > TARGET_FLASH_TIMEOUT_US)
+		{
+			printf ("Unpack stub timeout");
+
+			return false;
+		}
+	}
+}
+
+bool CSWDLoader::FinishPacked (void)
+{
+	if (m_nPackedHeaderBytes < SWD_UNPACK_HEADER_SIZE)
+	{
+		printf ("Stream truncated");
+
+		return false;
+	}
+
+	if (   !WaitUnpackStub (true)
+	    || !Halt ())
+	{
+		return false;
+	}
+
+	printf ("%u bytes unpacked on the target from %u bytes\r\n",
+		(unsigned) m_nImageOffset, (unsigned) (m_nRingHead + SWD_UNPACK_HEADER_SIZE));
+
+	if (   m_pVerifyUnpacker != 0
+	    && !m_pVerifyUnpacker->Finish ())
+	{
+		return false;
+	}
+
+	if (m_bImageFlash)
+	{
+		return true;
+	}
+
+	// for the image, which is started then
+	BeginTransaction ();
+
+	if (!WriteCoreRegister (DCRSR_REGSEL_CONTROL_PRIMASK, 0))
+	{
+		return false;
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+unsigned CSWDLoader::GetClockRateKHz (void) const
+{
+	if (m_bUseGang)
+	{
+		return m_Gang.GetClockRate (m_Clock.GetSystemClock ()) / 1000;
+	}
+
+	if (m_bUsePIO)
+	{
+		return m_Clock.GetPIORate () / 1000;
+	}
+
+	return m_nMeasuredRate / 1000;
+}
+
+unsigned CSWDLoader::GetTargetMask (void) const
+{
+	return m_bUseGang ? m_Gang.GetActiveMask () : 1;
+}
+
+void CSWDLoader::ResetStatistics (void)
+{
+	memset (&m_Stats, 0, sizeof m_Stats);
+}
+
+bool CSWDLoader::Halt (void)
+{
+	BeginTransaction ();
+
+	if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+	    || !WriteMem (DHCSR,   DHCSR_C_DEBUGEN
+				 | DHCSR_C_HALT
+				 | (DHCSR_DBGKEY_KEY << DHCSR_DBGKEY__SHIFT)))
+	{
+		printf ("Target halt failed");
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+bool CSWDLoader::LoadChunk (const void *pChunk, size_t nChunkSize, uint32_t nAddress)
+{
+	const uint8_t *pChunk8 = (const uint8_t *) pChunk;
+	assert (pChunk8 != 0);
+
+	// first whole word for verification
+	uint32_t nVerifyAddress = (nAddress + 3) & ~3U;
+	size_t nVerifyOffset = nVerifyAddress - nAddress;
+	bool bVerify = nVerifyOffset + 4 <= nChunkSize;
+	uint32_t nVerifyWord = 0;
+	if (bVerify)
+	{
+		memcpy (&nVerifyWord, pChunk8 + nVerifyOffset, 4);
+	}
+
+	if (!WriteBytes (nAddress, pChunk8, nChunkSize))
+	{
+		printf ("Memory write failed (0x%X)", nAddress);
+
+		return false;
+	}
+
+	if (!bVerify)
+	{
+		return true;
+	}
+
+	BeginTransaction ();
+
+	uint32_t nVerifyWordRead;
+	if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+	    || !ReadMem (nVerifyAddress, &nVerifyWordRead))
+	{
+		printf ("Memory read failed (0x%X)", nVerifyAddress);
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	if (nVerifyWord != nVerifyWordRead)
+	{
+		printf ("Data mismatch (0x%X != 0x%X)", nVerifyWord, nVerifyWordRead);
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CSWDLoader::ReadBlock (uint32_t nAddress, uint32_t *pBuffer, size_t nWords)
+{
+	size_t nSize = nWords * 4;
+	unsigned nStartTicks = m_pTimer->GetClockTicks ();
+
+	if (!ReadWords (nAddress, pBuffer, nWords))
+	{
+		printf ("Memory read failed (0x%X)", nAddress);
+
+		return false;
+	}
+
+	unsigned nEndTicks = m_pTimer->GetClockTicks ();
+	double fDuration = (double) (nEndTicks - nStartTicks) / 1e6;
+
+	printf ("%u bytes read in %.2f seconds (%.1f KBytes/s)\r\n",
+		 (unsigned) nSize, fDuration, nSize / fDuration / 1024.0);
+
+	return true;
+}
+
+bool CSWDLoader::Start (uint32_t nAddress)
+{
+	BeginTransaction ();
+
+	if (   !WriteCoreRegister (DCRSR_REGSEL_R15, nAddress)
+	    || !WriteMem (DHCSR,   DHCSR_C_DEBUGEN
+				 | (DHCSR_DBGKEY_KEY << DHCSR_DBGKEY__SHIFT)))
+	{
+		printf ("Target start failed");
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+bool CSWDLoader::ReadWords (uint32_t nAddress, uint32_t *pBuffer, size_t nWords)
+{
+	assert (!(nAddress & 3));
+	assert (pBuffer != 0);
+
+	// TAR is written only where the auto-increment wraps
+	while (nWords > 0)
+	{
+		size_t nBlockWords = (TAR_AUTOINC_BOUNDARY - (nAddress & (TAR_AUTOINC_BOUNDARY-1))) / 4;
+		if (nBlockWords > nWords)
+		{
+			nBlockWords = nWords;
+		}
+
+		BeginTransaction ();
+
+		if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+		    || !ReadMemBlock (nAddress, pBuffer, nBlockWords))
+		{
+			return false;
+		}
+
+		EndTransaction ();
+
+		pBuffer += nBlockWords;
+		nAddress += nBlockWords * 4;
+		nWords -= nBlockWords;
+	}
+
+	return true;
+}
+
+bool CSWDLoader::WriteBytes (uint32_t nAddress, const void *pData, size_t nSize)
+{
+	const uint8_t *pData8 = (const uint8_t *) pData;
+	assert (pData8 != 0);
+
+	// unaligned head, up to the next word boundary
+	if (nAddress & 3)
+	{
+		BeginTransaction ();
+
+		while (nSize > 0 && (nAddress & 3))
+		{
+			unsigned nAccessSize = !(nAddress & 1) && nSize >= 2 ? 2 : 1;
+			if (!WriteMemSmall (nAddress, pData8, nAccessSize))
+			{
+				return false;
+			}
+
+			pData8 += nAccessSize;
+			nAddress += nAccessSize;
+			nSize -= nAccessSize;
+		}
+
+		EndTransaction ();
+	}
+
+	// whole words, TAR is written only where the auto-increment wraps
+	while (nSize >= 4)
+	{
+		size_t nBlockSize = TAR_AUTOINC_BOUNDARY - (nAddress & (TAR_AUTOINC_BOUNDARY-1));
+		if (nBlockSize > (nSize & ~3))
+		{
+			nBlockSize = nSize & ~3;
+		}
+
+		// the block engine reads words from memory
+		const uint32_t *pBlock = (const uint32_t *) pData8;
+		if ((uintptr_t) pData8 & 3)
+		{
+			memcpy (s_BounceBuffer, pData8, nBlockSize);
+			pBlock = s_BounceBuffer;
+		}
+
+		BeginTransaction ();
+
+		if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+		    || !WriteMemBlock (nAddress, pBlock, nBlockSize / 4))
+		{
+			return false;
+		}
+
+		EndTransaction ();
+
+		pData8 += nBlockSize;
+		nAddress += nBlockSize;
+		nSize -= nBlockSize;
+	}
+
+	// tail of less than a word
+	BeginTransaction ();
+
+	while (nSize > 0)
+	{
+		unsigned nAccessSize = nSize >= 2 ? 2 : 1;
+		if (!WriteMemSmall (nAddress, pData8, nAccessSize))
+		{
+			return false;
+		}
+
+		pData8 += nAccessSize;
+		nAddress += nAccessSize;
+		nSize -= nAccessSize;
+	}
+
+	if (!SetAccessSize (AP_CSW_SIZE_32BITS))
+	{
+		return false;
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+bool CSWDLoader::ReadCoreRegisters (unsigned nFirst, uint32_t *pValues, unsigned nCount)
+{
+	assert (pValues != 0);
+
+	BeginTransaction ();
+
+	if (!SetAccessSize (AP_CSW_SIZE_32BITS))
+	{
+		return false;
+	}
+
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		if (!WriteMem (DCRSR, (nFirst + i) << DCRSR_REGSEL__SHIFT))
+		{
+			return false;
+		}
+
+		// the register is copied to DCRDR, when S_REGRDY is set
+		if (   !WaitRegisterReady ()
+		    || !ReadMem (DCRDR, &pValues[i]))
+		{
+			return false;
+		}
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+bool CSWDLoader::WriteCoreRegisters (unsigned nFirst, const uint32_t *pValues, unsigned nCount)
+{
+	assert (pValues != 0);
+
+	BeginTransaction ();
+
+	if (!SetAccessSize (AP_CSW_SIZE_32BITS))
+	{
+		return false;
+	}
+
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		if (!WriteCoreRegister (nFirst + i, pValues[i]))
+		{
+			return false;
+		}
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+// Loads the flash stub to target SRAM, looks up the boot ROM functions and
+// starts the stub on the halted core with interrupts disabled
+bool CSWDLoader::StartFlashStub (uint32_t *pFunctions)
+{
+	if (!LoadChunk (FlashStubCode, sizeof FlashStubCode, FLASH_STUB_CODE))
+	{
+		return false;
+	}
+
+	BeginTransaction ();
+
+	if (   m_pTarget->RomLookup == SWDRomLookupTable16
+	    && !LookupRomTable (pFunctions))
+	{
+		return false;
+	}
+
+	if (   !WriteMem (FLASH_STUB_MAILBOX + FLASH_STUB_CALL1_FUNC*4, 0)
+	    || !WriteCoreRegister (DCRSR_REGSEL_R7, FLASH_STUB_MAILBOX)
+	    || !WriteCoreRegister (DCRSR_REGSEL_SP, FLASH_STUB_STACK_TOP)
+	    || !WriteCoreRegister (DCRSR_REGSEL_XPSR, XPSR_T)
+	    || !WriteCoreRegister (DCRSR_REGSEL_CONTROL_PRIMASK, 1))	// PRIMASK
+	{
+		printf ("Flash stub setup failed");
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	if (!Start (FLASH_STUB_CODE))
+	{
+		return false;
+	}
+
+	return    m_pTarget->RomLookup != SWDRomLookupFunction
+	       || LookupRomFunctions (pFunctions);
+}
+
+// Walks the table of 16-bit code/function pairs in the boot ROM (RP2040)
+bool CSWDLoader::LookupRomTable (uint32_t *pFunctions)
+{
+	uint16_t usTable;
+	if (!ReadMemHalf (m_pTarget->nRomLookupPointer, &usTable))
+	{
+		return false;
+	}
+
+	unsigned nFound = 0;
+	for (uint32_t nEntry = usTable; nFound < FlashFunctionCount; nEntry += 4)
+	{
+		uint16_t usCode, usFunction;
+		if (   !ReadMemHalf (nEntry, &usCode)
+		    || !ReadMemHalf (nEntry + 2, &usFunction))
+		{
+			return false;
+		}
+
+		if (usCode == 0)
+		{
+			EndTransaction ();
+
+			printf ("Boot ROM function not found");
+
+			return false;
+		}
+
+		for (unsigned i = 0; i < FlashFunctionCount; i++)
+		{
+			if (usCode == s_FlashFunctionCode[i])
+			{
+				assert (pFunctions != 0);
+				pFunctions[i] = usFunction | 1;		// Thumb
+				nFound++;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Calls the lookup function of the boot ROM (RP2350) through the running stub
+bool CSWDLoader::LookupRomFunctions (uint32_t *pFunctions)
+{
+	BeginTransaction ();
+
+	uint16_t usLookup;
+	if (!ReadMemHalf (m_pTarget->nRomLookupPointer, &usLookup))
+	{
+		return false;
+	}
+
+	EndTransaction ();
+
+	for (unsigned i = 0; i < FlashFunctionCount; i++)
+	{
+		if (   !CallFlashStub (usLookup | 1, s_FlashFunctionCode[i], m_pTarget->nRomLookupFlags, 0, 0,
+				       0, 0, 0, 0, 0)
+		    || !WaitFlashStub ())
+		{
+			return false;
+		}
+
+		BeginTransaction ();
+
+		assert (pFunctions != 0);
+		if (!ReadMem (FLASH_STUB_MAILBOX + FLASH_STUB_RESULT*4, &pFunctions[i]))
+		{
+			return false;
+		}
+
+		EndTransaction ();
+
+		if (pFunctions[i] == 0)
+		{
+			printf ("Boot ROM function not found");
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Waits for the previous call to complete and posts the next one
+bool CSWDLoader::CallFlashStub (uint32_t nFunction1, uint32_t nArg0, uint32_t nArg1,
+						     uint32_t nArg2, uint32_t nArg3,
+				uint32_t nFunction2, uint32_t nArg4, uint32_t nArg5,
+						     uint32_t nArg6, uint32_t nArg7)
+{
+	if (!WaitFlashStub ())
+	{
+		return false;
+	}
+
+	const uint32_t Mailbox[FLASH_STUB_RESULT] =		// the call words precede the result
+	{
+		nFunction1, nArg0, nArg1, nArg2, nArg3,
+		nFunction2, nArg4, nArg5, nArg6, nArg7
+	};
+
+	BeginTransaction ();
+
+	if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+	    || !WriteMemBlock (FLASH_STUB_MAILBOX + 4, &Mailbox[1], FLASH_STUB_RESULT-1)
+	    || !WriteMem (FLASH_STUB_MAILBOX, nFunction1))
+	{
+		printf ("Flash stub call failed");
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+bool CSWDLoader::WaitFlashStub (void)
+{
+	uint64_t nStartTicks = m_pTimer->GetClockTicks ();
+
+	while (1)
+	{
+		BeginTransaction ();
+
+		uint32_t nFunction;
+		if (!ReadMem (FLASH_STUB_MAILBOX + FLASH_STUB_CALL1_FUNC*4, &nFunction))
+		{
+			return false;
+		}
+
+		EndTransaction ();
+
+		if (nFunction == 0)
+		{
+			return true;
+		}
+
+		if (m_pTimer->GetClockTicks () - nStartTicks > TARGET_FLASH_TIMEOUT_US)
+		{
+			printf ("Flash stub timeout");
+
+			return false;
+		}
+	}
+}
+
+// Lets a spare DMA channel of the target read the region and compute its CRC-32
+// with the sniffer. Flash is read through the non-caching XIP alias and written
+// to a scratch word, SRAM is copied onto itself.
+bool CSWDLoader::GetTargetCRC (uint32_t nAddress, size_t nSize, uint32_t *pCRC)
+{
+	if (!m_pTarget->bDMASniffer)
+	{
+		return ReadBackCRC (nAddress, nSize, pCRC);
+	}
+
+	const unsigned nChannel = TARGET_DMA_VERIFY_CHANNEL;
+
+	uint32_t nReadAddress = nAddress;
+	uint32_t nWriteAddress = nAddress;
+	uint32_t nCtrl =   DMA_CTRL_EN
+			 | (DMA_CTRL_DATA_SIZE_BYTE << DMA_CTRL_DATA_SIZE__SHIFT)
+			 | DMA_CTRL_INCR_READ
+			 | (nChannel << DMA_CTRL_CHAIN_TO__SHIFT)	// no chaining
+			 | (DMA_CTRL_TREQ_SEL_PERMANENT << DMA_CTRL_TREQ_SEL__SHIFT)
+			 | DMA_CTRL_SNIFF_EN;
+
+	if (   m_pTarget->nFlashBase <= nAddress
+	    && nAddress < m_pTarget->nFlashBase + m_pTarget->nFlashSize)
+	{
+		nReadAddress = nAddress - m_pTarget->nFlashBase + m_pTarget->nFlashNoCacheBase;
+		nWriteAddress = FLASH_STUB_SCRATCH;
+	}
+	else
+	{
+		nCtrl |= DMA_CTRL_INCR_WRITE;
+	}
+
+	BeginTransaction ();
+
+	uint32_t nResetDone;
+	if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+	    || !WriteMem (TARGET_RESETS_RESET_CLR, RESETS_DMA)
+	    || !ReadMem (TARGET_RESETS_RESET_DONE, &nResetDone)
+	    || !WriteMem (TARGET_DMA_CHAN_ABORT, BIT (nChannel))
+	    || !WriteMem (TARGET_DMA_SNIFF_DATA, 0xFFFFFFFFU)
+	    || !WriteMem (TARGET_DMA_SNIFF_CTRL,   DMA_SNIFF_CTRL_EN
+						 | (nChannel << DMA_SNIFF_CTRL_DMACH__SHIFT)
+						 | (DMA_SNIFF_CTRL_CALC_CRC32R << DMA_SNIFF_CTRL_CALC__SHIFT)
+						 | DMA_SNIFF_CTRL_OUT_REV
+						 | DMA_SNIFF_CTRL_OUT_INV)
+	    || !WriteMem (TARGET_DMA_READ_ADDR (nChannel), nReadAddress)
+	    || !WriteMem (TARGET_DMA_WRITE_ADDR (nChannel), nWriteAddress)
+	    || !WriteMem (TARGET_DMA_TRANS_COUNT (nChannel), nSize)
+	    || !WriteMem (TARGET_DMA_CTRL_TRIG (nChannel), nCtrl))
+	{
+		printf ("Target DMA setup failed");
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	if (!(nResetDone & RESETS_DMA))
+	{
+		printf ("Target DMA in reset");
+
+		return false;
+	}
+
+	uint64_t nStartTicks = m_pTimer->GetClockTicks ();
+
+	uint32_t nStatus;
+	do
+	{
+		BeginTransaction ();
+
+		if (!ReadMem (TARGET_DMA_CTRL_TRIG (nChannel), &nStatus))
+		{
+			return false;
+		}
+
+		EndTransaction ();
+
+		if (m_pTimer->GetClockTicks () - nStartTicks > TARGET_DMA_TIMEOUT_US)
+		{
+			printf ("Target DMA timeout");
+
+			return false;
+		}
+	}
+	while (nStatus & DMA_CTRL_BUSY);
+
+	BeginTransaction ();
+
+	if (   !ReadMem (TARGET_DMA_SNIFF_DATA, pCRC)
+	    || !WriteMem (TARGET_DMA_SNIFF_CTRL, 0))
+	{
+		return false;
+	}
+
+	EndTransaction ();
+
+	if (nStatus & DMA_CTRL_AHB_ERROR)
+	{
+		printf ("Target DMA bus error");
+
+		return false;
+	}
+
+	return true;
+}
+
+// Compares the image with target memory block by block and marks the changed blocks
+// in s_DeltaMap. With bPadErased the last block is compared as a whole, with the
+// image padded with 0xFF like an erased sector.
+bool CSWDLoader::FindChangedBlocks (const uint8_t *pImage, size_t nImageSize, uint32_t nAddress,
+				    size_t nBlockSize, bool bPadErased, unsigned *pBlocks)
+{
+	unsigned nBlocks = (nImageSize + nBlockSize-1) / nBlockSize;
+	assert (nBlocks <= DELTA_MAX_BLOCKS);
+
+	memset (s_DeltaMap, 0, sizeof s_DeltaMap);
+
+	unsigned nChanged = 0;
+	for (unsigned nBlock = 0; nBlock < nBlocks; nBlock++)
+	{
+		size_t nOffset = nBlock * nBlockSize;
+		size_t nSize = nImageSize - nOffset;
+		if (nSize > nBlockSize)
+		{
+			nSize = nBlockSize;
+		}
+
+		assert (pImage != 0);
+		uint32_t nCRC = SWDCRC32 (0, pImage + nOffset, nSize);
+
+		size_t nCompareSize = nSize;
+		if (bPadErased)
+		{
+			nCRC = PadErasedCRC (nCRC, nSize, nBlockSize);
+			nCompareSize = nBlockSize;
+		}
+
+		uint32_t nTargetCRC;
+		if (!GetTargetCRC (nAddress + nOffset, nCompareSize, &nTargetCRC))
+		{
+			return false;
+		}
+
+		if (nCRC != nTargetCRC)
+		{
+			s_DeltaMap[nBlock / 32] |= BIT (nBlock % 32);
+			nChanged++;
+		}
+	}
+
+	printf ("%u of %u blocks changed\r\n", nChanged, nBlocks);
+
+	assert (pBlocks != 0);
+	*pBlocks = nBlocks;
+
+	return true;
+}
+
+// Programs a sector from a stub buffer, the last page is padded with 0xFF
+bool CSWDLoader::ProgramSector (uint32_t nOffset, uint32_t nBuffer, size_t nSize)
+{
+	size_t nProgSize = (nSize + TARGET_FLASH_PAGE_SIZE-1) & ~(TARGET_FLASH_PAGE_SIZE-1);
+	if (   nProgSize > nSize
+	    && !LoadChunk (s_FlashPad, nProgSize - nSize, nBuffer + nSize))
+	{
+		return false;
+	}
+
+	return CallFlashStub (m_FlashFunction[FlashRangeErase], nOffset, TARGET_FLASH_SECTOR_SIZE,
+							     TARGET_FLASH_BLOCK_SIZE, TARGET_FLASH_BLOCK_CMD,
+			      m_FlashFunction[FlashRangeProgram], nOffset, nBuffer, nProgSize, 0);
+}
+
+// Returns to XIP and waits for the stub to complete
+bool CSWDLoader::FinishFlash (void)
+{
+	return    CallFlashStub (m_FlashFunction[FlashFlushCache], 0, 0, 0, 0,
+				 m_FlashFunction[FlashEnterXIP], 0, 0, 0, 0)
+	       && WaitFlashStub ();
+}
+
+// Reads the region back with posted reads and computes its CRC-32 on the probe
+bool CSWDLoader::ReadBackCRC (uint32_t nAddress, size_t nSize, uint32_t *pCRC)
+{
+	uint32_t nCRC = 0;
+
+	uint32_t nWordAddress = nAddress & ~3U;
+	size_t nSkip = nAddress & 3;
+	size_t nRemaining = nSize + nSkip;
+	while (nRemaining > 0)
+	{
+		size_t nBlockSize = TAR_AUTOINC_BOUNDARY - (nWordAddress & (TAR_AUTOINC_BOUNDARY-1));
+		if (nBlockSize > nRemaining)
+		{
+			nBlockSize = nRemaining;
+		}
+
+		BeginTransaction ();
+
+		if (   !SetAccessSize (AP_CSW_SIZE_32BITS)
+		    || !ReadMemBlock (nWordAddress, s_BounceBuffer, (nBlockSize + 3) / 4))
+		{
+			printf ("Memory read failed (0x%X)", nWordAddress);
+
+			return false;
+		}
+
+		EndTransaction ();
+
+		nCRC = SWDCRC32 (nCRC, (const uint8_t *) s_BounceBuffer + nSkip, nBlockSize - nSkip);
+
+		nSkip = 0;
+		nWordAddress += nBlockSize;
+		nRemaining -= nBlockSize;
+	}
+
+	assert (pCRC != 0);
+	*pCRC = nCRC;
+
+	return true;
+}
+
+// Resets the cores, which boot from flash then
+bool CSWDLoader::ResetTarget (void)
+{
+	BeginTransaction ();
+
+	if (   !WriteMem (DHCSR,   DHCSR_C_DEBUGEN
+				 | (DHCSR_DBGKEY_KEY << DHCSR_DBGKEY__SHIFT))
+	    || !WriteMem (AIRCR,   (AIRCR_VECTKEY_KEY << AIRCR_VECTKEY__SHIFT)
+				 | AIRCR_SYSRESETREQ))
+	{
+		printf ("Target reset failed");
+
+		return false;
+	}
+
+	EndTransaction ();
+
+	return true;
+}
+
+// Probes all instances of each TARGETID in the registry. Targets, which are not
+// selected, do not drive SWDIO, so that the ACK is read as 0b111 ([1] section B4.3.4).
+// Each core (MEM-AP) behind a responding debug port becomes a target.
+void CSWDLoader::ScanTargets (void)
+{
+	m_nBusTargets = 0;
+
+	for (unsigned i = 0; i < SWDGetTargetCount (); i++)
+	{
+		uint32_t nTargetID = SWDGetTarget (i)->nTargetID;
+
+		bool bScanned = false;
+		for (unsigned j = 0; j < i; j++)
+		{
+			bScanned = bScanned || SWDGetTarget (j)->nTargetID == nTargetID;
+		}
+
+		for (unsigned nInstance = 0;
+		     !bScanned && nInstance < DP_TARGETSEL_TINSTANCE_RESCUE;
+		     nInstance++)
+		{
+			LineReset ();
+			SelectTarget (nTargetID, nInstance);
+
+			uint32_t nIDCode;
+			bool bParityOK;
+			if (   ReadOnce (RD_DP_DPIDR, &nIDCode, &bParityOK) != DP_OK
+			    || !bParityOK)
+			{
+				continue;
+			}
+
+			const TSWDTargetDescriptor *pDescriptor = SWDFindTarget (nTargetID, nIDCode);
+			if (pDescriptor == 0)
+			{
+				printf ("Debug target not supported (0x%X, ID code 0x%X)",
+					nTargetID | nInstance << DP_TARGETSEL_TINSTANCE__SHIFT, nIDCode);
+
+				continue;
+			}
+
+			for (unsigned nAP = 0;
+			     nAP < pDescriptor->nAPCount && m_nBusTargets < MaxBusTargets;
+			     nAP++)
+			{
+				TBusTarget *pTarget = &m_BusTarget[m_nBusTargets++];
+				pTarget->pDescriptor = pDescriptor;
+				pTarget->uchInstanceID = nInstance;
+				pTarget->nSelect = pDescriptor->APSelect[nAP];
+			}
+		}
+	}
+}
+
+// TARGETSEL is only accepted after a line reset and must be followed by a DPIDR
+// read ([1] section B4.3.4). The debug port is powered up once per session.
+bool CSWDLoader::AttachTarget (unsigned nTarget)
+{
+	assert (nTarget < m_nBusTargets);
+	TBusTarget *pTarget = &m_BusTarget[nTarget];
+
+	LineReset ();
+	SelectTarget (pTarget->pDescriptor->nTargetID, pTarget->uchInstanceID);
+
+	uint32_t nIDCode;
+	if (!ReadData (RD_DP_DPIDR, &nIDCode))
+	{
+		return false;
+	}
+
+	if (!pTarget->bPoweredUp)
+	{
+		if (!PowerOn ())
+		{
+			return false;
+		}
+
+		for (unsigned i = 0; i < m_nBusTargets; i++)
+		{
+			if (GetTargetSel (i) == GetTargetSel (nTarget))
+			{
+				m_BusTarget[i].bPoweredUp = true;
+			}
+		}
+	}
+
+	if (!WriteData (WR_DP_SELECT, pTarget->nSelect))
+	{
+		return false;
+	}
+
+	// the rate of the previous target may be too fast
+	if (m_Clock.SetMaxRate (pTarget->pDescriptor->nMaxClockKHz))
+	{
+		ApplyClock ();
+	}
+
+	return true;
+}
+
+bool CSWDLoader::PowerOn (void)
+{
+	if (!WriteData (WR_DP_ABORT,   DP_ABORT_STKCMPCLR
+				     | DP_ABORT_STKERRCLR
+				     | DP_ABORT_WDERRCLR
+				     | DP_ABORT_ORUNERRCLR))
+	{
+		return false;
+	}
+
+	if (!WriteData (WR_DP_SELECT, DP_SELECT_DEFAULT))
+	{
+		return false;
+	}
+
+	if (!WriteData (WR_DP_CTRL_STAT,   (m_bOverrunDetect ? DP_CTRL_STAT_ORUNDETECT : 0)
+					 | DP_CTRL_STAT_STICKYERR
+					 | DP_CTRL_STAT_CDBGPWRUPREQ
+					 | DP_CTRL_STAT_CSYSPWRUPREQ))
+	{
+		return false;
+	}
+
+	uint32_t nCtrlStat;
+	if (!ReadData (RD_DP_CTRL_STAT, &nCtrlStat))
+	{
+		return false;
+	}
+
+	if (   !(nCtrlStat & DP_CTRL_STAT_CDBGPWRUPACK)
+	    || !(nCtrlStat & DP_CTRL_STAT_CSYSPWRUPACK))
+	{
+		EndTransaction ();
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CSWDLoader::WriteMem (uint32_t nAddress, uint32_t nData)
+{
+	return    WriteData (WR_AP_TAR, nAddress)
+	       && WriteData (WR_AP_DRW, nData);
+}
+
+// Writes a byte or halfword (nSize 1 or 2) from pData, which may be unaligned.
+// Leaves the access size in CSW set accordingly.
+bool CSWDLoader::WriteMemSmall (uint32_t nAddress, const uint8_t *pData, unsigned nSize)
+{
+	assert (nSize == 1 || nSize == 2);
+	assert (!(nAddress & (nSize-1)));
+
+	uint32_t nData = pData[0];
+	if (nSize == 2)
+	{
+		nData |= (uint32_t) pData[1] << 8;
+	}
+
+	// the data is transferred on its byte lanes ([1] section C2.2.5)
+	return    SetAccessSize (nSize == 1 ? AP_CSW_SIZE_8BITS : AP_CSW_SIZE_16BITS)
+	       && WriteData (WR_AP_TAR, nAddress)
+	       && WriteData (WR_AP_DRW, nData << (nAddress & 3) * 8);
+}
+
+bool CSWDLoader::ReadMemHalf (uint32_t nAddress, uint16_t *pData)
+{
+	uint32_t nData;
+	if (!ReadMem (nAddress & ~3U, &nData))
+	{
+		return false;
+	}
+
+	assert (pData != 0);
+	*pData = nData >> (nAddress & 2) * 8;
+
+	return true;
+}
+
+// DCRDR must not be written again, before the core has taken the value
+bool CSWDLoader::WriteCoreRegister (unsigned nRegister, uint32_t nValue)
+{
+	return    WriteMem (DCRDR, nValue)
+	       && WriteMem (DCRSR,   (nRegister << DCRSR_REGSEL__SHIFT)
+				   | DCRSR_REGW_N_R)
+	       && WaitRegisterReady ();
+}
+
+// The transfer between DCRDR and a core register is complete, when S_REGRDY
+// is set ([2] section C1.6)
+bool CSWDLoader::WaitRegisterReady (void)
+{
+	uint32_t nDHCSR = 0;
+	for (unsigned nPoll = 0; !(nDHCSR & DHCSR_S_REGRDY); nPoll++)
+	{
+		if (   nPoll == DCRDR_REGRDY_POLLS
+		    || !ReadMem (DHCSR, &nDHCSR))
+		{
+			EndTransaction ();
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool CSWDLoader::ReadMem (uint32_t nAddress, uint32_t *pData)
+{
+	// the targets of a gang may disagree for some time, while a status is polled
+	uint64_t nStartTicks = m_pTimer->GetClockTicks ();
+	for (unsigned nRetry = 0; ; nRetry++)
+	{
+		if (   !WriteData (WR_AP_TAR, nAddress)
+		    || !ReadData (RD_AP_DRW, pData)
+		    || !ReadData (RD_DP_RDBUFF, pData))
+		{
+			return false;
+		}
+
+		if (   !m_bUseGang
+		    || !m_Gang.IsDiverged ())
+		{
+			return true;
+		}
+
+		if (m_pTimer->GetClockTicks () - nStartTicks > GANG_DIVERGE_TIMEOUT_US)
+		{
+			m_Gang.Resolve ();
+
+			return true;
+		}
+
+		EndTransaction ();
+		WaitBackoff (nRetry);
+		BeginTransaction ();
+	}
+}
+
+// Reads a block of words with TAR auto-increment, which must not wrap. AP reads
+// are posted, each DRW read returns the result of the previous one and the last
+// result is collected from RDBUFF ([1] section C2.2.5).
+bool CSWDLoader::ReadMemBlock (uint32_t nAddress, uint32_t *pData, unsigned nWords)
+{
+	assert (pData != 0);
+	assert (nWords > 0);
+
+	uint32_t nDummy;
+	if (   !WriteData (WR_AP_TAR, nAddress)
+	    || !ReadData (RD_AP_DRW, &nDummy))
+	{
+		return false;
+	}
+
+	while (--nWords)
+	{
+		if (!ReadData (RD_AP_DRW, pData++))
+		{
+			return false;
+		}
+	}
+
+	return ReadData (RD_DP_RDBUFF, pData);
+}
+
+// Writes a block of words with TAR auto-increment. Posted writes are replayed
+// from the start of the block, if the target has not accepted all of them.
+bool CSWDLoader::WriteMemBlock (uint32_t nAddress, const uint32_t *pData, unsigned nWords)
+{
+	assert (pData != 0);
+
+	if (!m_bUseDMA && !m_bOverrunDetect)
+	{
+		if (!WriteData (WR_AP_TAR, nAddress))
+		{
+			return false;
+		}
+
+		while (nWords--)
+		{
+			if (!WriteData (WR_AP_DRW, *pData++))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	for (unsigned nReplay = 0; nReplay <= BLOCK_REPLAYS; nReplay++)
+	{
+		if (!WriteData (WR_AP_TAR, nAddress))
+		{
+			return false;
+		}
+
+		unsigned nResponse = PostBlock (pData, nWords);
+		if (nResponse == DP_OK)
+		{
+			return true;
+		}
+
+		if (nResponse != DP_WAIT)
+		{
+			break;
+		}
+
+		WaitBackoff (WAIT_BACKOFF_SPIN + nReplay);
+	}
+
+	EndTransaction ();
+
+	printf ("Block write failed (0x%X)", nAddress);
+
+	return false;
+}
+
+// Writes the block to AP DRW without checking each ACK on the CPU. Returns DP_OK,
+// DP_WAIT, if the block can be replayed, or DP_FAULT. Sticky errors are cleared.
+unsigned CSWDLoader::PostBlock (const uint32_t *pData, unsigned nWords)
+{
+	bool bEngineOK = true;
+	if (m_bUseDMA)
+	{
+		// the ACKs are checked by the state machine
+		bEngineOK = m_PIO.WriteBlock (WR_AP_DRW, pData, nWords);
+
+		for (unsigned i = 0; i < nWords; i++)
+		{
+			CountTransfer (WR_AP_DRW, true);
+		}
+	}
+	else
+	{
+		// the ACKs are ignored, a failed write sets STICKYORUN ([1] section B4.2.5)
+		assert (m_bOverrunDetect);
+		while (nWords--)
+		{
+			WriteOnce (WR_AP_DRW, *pData++);
+		}
+	}
+
+	uint32_t nCtrlStat;
+	bool bParityOK;
+	if (   ReadOnce (RD_DP_CTRL_STAT, &nCtrlStat, &bParityOK) != DP_OK
+	    || !bParityOK)
+	{
+		return DP_FAULT;
+	}
+
+	if (!(nCtrlStat & (DP_CTRL_STAT_STICKYORUN | DP_CTRL_STAT_STICKYERR | DP_CTRL_STAT_WDATAERR)))
+	{
+		return bEngineOK ? DP_OK : DP_WAIT;
+	}
+
+	ClearStickyErrors ();
+
+	if (nCtrlStat & DP_CTRL_STAT_STICKYERR)
+	{
+		printf ("Sticky error (CTRL/STAT 0x%X)", nCtrlStat);
+
+		return DP_FAULT;
+	}
+
+	return DP_WAIT;
+}
+
+bool CSWDLoader::WriteData (uint8_t nRequest, uint32_t nData)
+{
+	assert (nRequest & 0x80);
+
+	unsigned nResponse;
+	for (unsigned nRetry = 0; ; nRetry++)
+	{
+		nResponse = WriteOnce (nRequest, nData);
+		if (   nResponse != DP_WAIT
+		    || nRetry >= WAIT_RETRIES)
+		{
+			break;
+		}
+
+		if (m_bOverrunDetect)
+		{
+			ClearStickyErrors ();
+		}
+
+		WaitBackoff (nRetry);
+	}
+
+	if (nResponse != DP_OK)
+	{
+		// with overrun detection, an exhausted WAIT has set STICKYORUN
+		if (   nResponse == DP_FAULT
+		    || m_bOverrunDetect)
+		{
+			ClearStickyErrors ();
+		}
+
+		EndTransaction ();
+
+		printf ("Cannot write (req 0x%02X, data 0x%X, resp %u)",
+			 (unsigned) nRequest, nData, nResponse);
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CSWDLoader::ReadData (uint8_t nRequest, uint32_t *pData)
+{
+	assert (nRequest & 0x80);
+
+	unsigned nResponse;
+	uint32_t nData = 0;
+	bool bParityOK = false;
+	for (unsigned nRetry = 0; ; nRetry++)
+	{
+		nResponse = ReadOnce (nRequest, &nData, &bParityOK);
+		if (   nResponse != DP_WAIT
+		    || nRetry >= WAIT_RETRIES)
+		{
+			break;
+		}
+
+		if (m_bOverrunDetect)
+		{
+			ClearStickyErrors ();
+		}
+
+		WaitBackoff (nRetry);
+	}
+
+	if (nResponse != DP_OK)
+	{
+		// with overrun detection, an exhausted WAIT has set STICKYORUN
+		if (   nResponse == DP_FAULT
+		    || m_bOverrunDetect)
+		{
+			ClearStickyErrors ();
+		}
+
+		EndTransaction ();
+
+		printf ("Cannot read (req 0x%02X, resp %u)", (unsigned) nRequest, nResponse);
+
+		return false;
+	}
+
+	if (!bParityOK)
+	{
+		EndTransaction ();
+
+		printf ("Parity error (req 0x%02X)", (unsigned) nRequest);
+
+		return false;
+	}
+
+	assert (pData != 0);
+	*pData = nData;
+
+	return true;
+}
+
+// Writes CSW only, if the access size has been changed
+bool CSWDLoader::SetAccessSize (unsigned nSize)
+{
+	uint32_t nCSW =   (nSize << AP_CSW_SIZE__SHIFT)
+			| (AP_CSW_SIZE_INCREMENT_SINGLE << AP_CSW_ADDR_INC__SHIFT)
+			| AP_CSW_DEVICE_EN
+			| (AP_CSW_PROT_DEFAULT << AP_CSW_PROT__SHIFT)
+			| AP_CSW_DBG_SW_ENABLE;
+
+	if (nCSW == m_nCSW)
+	{
+		return true;
+	}
+
+	m_nCSW = 0;
+	if (!WriteData (WR_AP_CSW, nCSW))
+	{
+		return false;
+	}
+
+	m_nCSW = nCSW;
+
+	return true;
+}
+
+// Single write transfer, returns the ACK
+unsigned CSWDLoader::WriteOnce (uint8_t nRequest, uint32_t nData)
+{
+	unsigned nResponse;
+	if (m_bUseGang)
+	{
+		nResponse = m_Gang.WriteData (nRequest, nData);		// posted
+	}
+	else if (m_bUsePIO)
+	{
+		nResponse = m_PIO.WriteData (nRequest, nData);
+		if (nResponse != DP_OK)
+		{
+			m_PIO.Recover ();
+		}
+	}
+	else
+	{
+		WriteBits (nRequest, 7);
+
+		ReadBits (1 + TURN_CYCLES);	// park bit (not driven) and turn cycle
+
+		nResponse = ReadBits (3);
+
+		ReadBits (TURN_CYCLES);
+
+		// with overrun detection, the data phase is always required
+		if (   nResponse == DP_OK
+		    || m_bOverrunDetect)
+		{
+			WriteBits (nData, 32);
+			WriteBits (parity32 (nData), 1);
+		}
+	}
+
+	CountTransfer (nRequest, nResponse == DP_OK || m_bOverrunDetect);
+
+	return nResponse;
+}
+
+// Single read transfer, returns the ACK
+unsigned CSWDLoader::ReadOnce (uint8_t nRequest, uint32_t *pData, bool *pParityOK)
+{
+	unsigned nResponse;
+	if (m_bUseGang)
+	{
+		nResponse = m_Gang.ReadData (nRequest, pData, pParityOK);
+
+		// DP registers must read the same, memory is compared in ReadMem()
+		if (   nRequest != RD_AP_DRW
+		    && nRequest != RD_DP_RDBUFF)
+		{
+			m_Gang.Resolve ();
+		}
+	}
+	else if (m_bUsePIO)
+	{
+		nResponse = m_PIO.ReadData (nRequest, pData, pParityOK);
+		if (nResponse != DP_OK)
+		{
+			m_PIO.Recover ();
+		}
+	}
+	else
+	{
+		WriteBits (nRequest, 7);
+
+		ReadBits (1 + TURN_CYCLES);	// park bit (not driven) and turn cycle
+
+		nResponse = ReadBits (3);
+
+		if (   nResponse == DP_OK
+		    || m_bOverrunDetect)
+		{
+			*pData = ReadBits (32);
+
+			*pParityOK = ReadBits (1) == (uint32_t) parity32 (*pData);
+		}
+
+		ReadBits (TURN_CYCLES);
+	}
+
+	CountTransfer (nRequest, nResponse == DP_OK || m_bOverrunDetect);
+
+	return nResponse;
+}
+
+unsigned CSWDLoader::RawTransfer (uint8_t uchRequest, uint32_t *pData)
+{
+	assert (pData != 0);
+
+	if (!(uchRequest & REQ_RnW))
+	{
+		return WriteOnce (uchRequest, *pData);
+	}
+
+	bool bParityOK = false;
+	unsigned nResponse = ReadOnce (uchRequest, pData, &bParityOK);
+	if (   nResponse == DP_OK
+	    && !bParityOK)
+	{
+		return RawParityError;
+	}
+
+	return nResponse;
+}
+
+void CSWDLoader::RawSequence (const uint8_t *pData, unsigned nBitCount)
+{
+	assert (pData != 0);
+
+	m_Stats.nIdleBits += nBitCount;
+
+	while (nBitCount > 0)
+	{
+		unsigned nBits = nBitCount < 8 ? nBitCount : 8;
+
+		WriteBits (*pData++, nBits);
+
+		nBitCount -= nBits;
+	}
+}
+
+bool CSWDLoader::RawReadSequence (uint8_t *pData, unsigned nBitCount)
+{
+	assert (pData != 0);
+
+	m_Stats.nIdleBits += nBitCount;
+
+	// the PIO engines sample SWDIO in the ACK and data phases only,
+	// the cycles are clocked with SWDIO released, but not sampled
+	if (   m_bUsePIO
+	    || m_bUseGang)
+	{
+		for (unsigned i = 0; i < nBitCount; i += 8)
+		{
+			Turnaround (nBitCount - i < 8 ? nBitCount - i : 8);
+
+			*pData++ = 0xFF;
+		}
+
+		return false;
+	}
+
+	while (nBitCount > 0)
+	{
+		unsigned nBits = nBitCount < 8 ? nBitCount : 8;
+
+		*pData++ = ReadBits (nBits);
+
+		nBitCount -= nBits;
+	}
+
+	return true;
+}
+
+void CSWDLoader::SetClockRateKHz (unsigned nRateKHz)
+{
+	if (m_Clock.SetRate (nRateKHz))
+	{
+		ApplyClock ();
+	}
+}
+
+bool CSWDLoader::SetResetLine (bool bAsserted)
+{
+	if (!m_bResetAvailable)
+	{
+		return false;
+	}
+
+	m_ResetPin.Write (bAsserted ? LOW : HIGH);
 
 	return true;
 }
 
+// Adds the SWCLK cycles of a packet to the statistics ([1] section B4.2)
+void CSWDLoader::CountTransfer (uint8_t uchRequest, bool bDataPhase)
+{
+	m_Stats.nTransfers++;
+	m_Stats.nRequestBits += 8;
+	m_Stats.nAckBits += TURN_CYCLES + 3;
+	m_Stats.nDataBits += TURN_CYCLES + (bDataPhase ? 33 : 0);
+
+	if (uchRequest == WR_AP_TAR)
+	{
+		m_Stats.nTARWrites++;
+	}
+	else if (uchRequest == WR_AP_CSW)
+	{
+		m_Stats.nCSWWrites++;
+	}
+}
+
+// Writes to ABORT are accepted, even if a sticky error flag is set
+void CSWDLoader::ClearStickyErrors (void)
+{
+	WriteOnce (WR_DP_ABORT,   DP_ABORT_STKCMPCLR
+				| DP_ABORT_STKERRCLR
+				| DP_ABORT_WDERRCLR
+				| DP_ABORT_ORUNERRCLR);
+}
+
+// Spins for the first retries, then waits with exponentially growing delays
+void CSWDLoader::WaitBackoff (unsigned nRetry)
+{
+	if (nRetry < WAIT_BACKOFF_SPIN)
+	{
+		return;
+	}
+
+	unsigned nMicros = 1U << (nRetry - WAIT_BACKOFF_SPIN);
+	if (nMicros > WAIT_BACKOFF_MAX_US)
+	{
+		nMicros = WAIT_BACKOFF_MAX_US;
+	}
+
+	m_pTimer->DelayMicros (nMicros);
+}
+
 void CSWDLoader::SelectTarget (uint32_t nCPUAPID, uint8_t uchInstanceID)
 {
 	uint32_t nWData = nCPUAPID | ((uint32_t) uchInstanceID << DP_TARGETSEL_TINSTANCE__SHIFT);
 
 	WriteBits (WR_DP_TARGETSEL, 7);
 
-	ReadBits (1 + 5);	// park bit and 5 bits not driven
+	Turnaround (1 + 5);	// park bit and 5 bits not driven
 
 	WriteBits (nWData, 32);
 	WriteBits (parity32 (nWData), 1);
+
+	m_Stats.nTransfers++;
+	m_Stats.nRequestBits += 8;
+	m_Stats.nAckBits += 5;
+	m_Stats.nDataBits += 33;
 }
 
+// A transaction is a sequence of packets, which starts and ends with the line
+// idle. With the PIO engines interrupts remain enabled: an engine stalls with
+// SWCLK held, if its FIFOs run empty or full, and the SWD protocol allows to
+// stop the clock at any point of a packet. The debug port has no timeouts, so
+// a transaction is atomic on the wire, even if the CPU is interrupted.
 void CSWDLoader::BeginTransaction (void)
 {
-	//EnterCritical ();
-	 irq_state = save_and_disable_interrupts();
+	if (m_bMaskInterrupts)
+	{
+		m_nInterruptState = TSWDWire::DisableInterrupts ();
+		m_nTransactionStartTicks = m_pTimer->GetClockTicks ();
+	}
+
+	UpdateClock ();
 
 	WriteIdle ();
 }
@@ -477,8 +2694,105 @@ void CSWDLoader::BeginTransaction (void)
 void CSWDLoader::EndTransaction (void)
 {
 	WriteIdle ();
-	restore_interrupts(irq_state);
-	//LeaveCritical ();
+
+	if (!m_bMaskInterrupts)
+	{
+		return;
+	}
+
+	unsigned nTicks = m_pTimer->GetClockTicks () - m_nTransactionStartTicks;
+	m_Stats.nInterruptsOffTicks += nTicks;
+	if (nTicks > m_Stats.nMaxInterruptsOffTicks)
+	{
+		m_Stats.nMaxInterruptsOffTicks = nTicks;
+	}
+
+	if (nTicks > m_nLoadMaxInterruptsOffTicks)
+	{
+		m_nLoadMaxInterruptsOffTicks = nTicks;
+	}
+
+	TSWDWire::RestoreInterrupts (m_nInterruptState);
+}
+
+void CSWDLoader::BeginLoad (void)
+{
+	m_nLoadMaxInterruptsOffTicks = 0;
+}
+
+// Passes the measurements of the load to the hook
+void CSWDLoader::EndLoad (size_t nBytes, unsigned nStartTicks)
+{
+	if (m_pLoadHook == 0)
+	{
+		return;
+	}
+
+	TLoadReport Report;
+	Report.nBytes = nBytes;
+	Report.nTicks = (unsigned) m_pTimer->GetClockTicks () - nStartTicks;
+	Report.nMaxInterruptsOffTicks = m_nLoadMaxInterruptsOffTicks;
+	Report.bInterruptFree = !m_bMaskInterrupts;
+
+	(*m_pLoadHook) (Report, m_pLoadHookParam);
+}
+
+// Holds the interface clock rate, if clk_sys has been changed since the last transaction
+void CSWDLoader::UpdateClock (void)
+{
+	if (!m_Clock.Update ())
+	{
+		return;
+	}
+
+	ApplyClock ();
+}
+
+void CSWDLoader::ApplyClock (void)
+{
+	if (m_bUseGang)
+	{
+		m_Gang.SetClockDivider (m_Clock.GetPIODivider ());
+	}
+	else if (m_bUsePIO)
+	{
+		m_PIO.SetClockDivider (m_Clock.GetPIODivider ());
+	}
+	else
+	{
+		CalibrateClock ();	// overhead in cycles is constant, but measure again
+	}
+}
+
+// Measures the code overhead of a bit-banged SWCLK period and the achieved
+// clock rate with idle cycles (SWDIO LOW). Interrupts must be disabled.
+void CSWDLoader::CalibrateClock (void)
+{
+	const unsigned Periods = 1000;
+
+	m_DataPin.SetMode (GPIOModeOutput, false);
+	m_DataPin.Write (LOW);
+
+	m_nDelayCycles = 0;
+
+	uint64_t nStartTicks = m_pTimer->GetClockTicks ();
+	for (unsigned i = 0; i < Periods; i++)
+	{
+		WriteClock ();
+	}
+	uint64_t nOverheadTicks = m_pTimer->GetClockTicks () - nStartTicks;
+
+	m_Clock.SetOverheadCycles (nOverheadTicks * m_Clock.GetSystemClock () / 1000000U / Periods);
+	m_nDelayCycles = m_Clock.GetDelayCycles ();
+
+	nStartTicks = m_pTimer->GetClockTicks ();
+	for (unsigned i = 0; i < Periods; i++)
+	{
+		WriteClock ();
+	}
+	uint64_t nTicks = m_pTimer->GetClockTicks () - nStartTicks;
+
+	m_nMeasuredRate = nTicks > 0 ? Periods * 1000000ULL / nTicks : m_Clock.GetBitBangRate ();
 }
 
 // Leaving dormant state and switch to SW-DP ([1] section B5.3.4)
@@ -494,18 +2808,38 @@ void CSWDLoader::Dormant2SWD (void)
 	WriteBits (0x0, 4);		// 4 cycles low
 
 	WriteBits (0x1A, 8);		// activation code
+
+	m_Stats.nIdleBits += 8 + 4*32 + 4 + 8;
 }
 
 void CSWDLoader::LineReset (void)
 {
 	WriteBits (0xFFFFFFFFU, 32);
 	WriteBits (0x00FFFFFU, 28);
+
+	m_Stats.nIdleBits += 32 + 28;
 }
 
 void CSWDLoader::WriteIdle (void)
 {
 	WriteBits (0, 8);
 
+	m_Stats.nIdleBits += 8;
+
+	if (m_bUseGang)
+	{
+		m_Gang.Sync ();
+
+		return;
+	}
+
+	if (m_bUsePIO)
+	{
+		m_PIO.Sync ();
+
+		return;
+	}
+
 	m_ClockPin.Write (LOW);
 
 	m_DataPin.SetMode (GPIOModeOutput, false);
@@ -514,6 +2848,20 @@ void CSWDLoader::WriteIdle (void)
 
 void CSWDLoader::WriteBits (uint32_t nBits, unsigned nBitCount)
 {
+	if (m_bUseGang)
+	{
+		m_Gang.WriteBits (nBits, nBitCount);
+
+		return;
+	}
+
+	if (m_bUsePIO)
+	{
+		m_PIO.WriteBits (nBits, nBitCount);
+
+		return;
+	}
+
 	m_DataPin.SetMode (GPIOModeOutput, false);
 
 	while (nBitCount--)
@@ -545,13 +2893,32 @@ uint32_t CSWDLoader::ReadBits (unsigned nBitCount)
 	return nBits;
 }
 
+void CSWDLoader::Turnaround (unsigned nCycles)
+{
+	if (m_bUseGang)
+	{
+		m_Gang.WriteBits (0, nCycles, false);
+
+		return;
+	}
+
+	if (m_bUsePIO)
+	{
+		m_PIO.WriteBits (0, nCycles, false);
+
+		return;
+	}
+
+	ReadBits (nCycles);
+}
+
 void CSWDLoader::WriteClock (void)
 {
 	m_ClockPin.Write (LOW);
-	m_pTimer->nsDelay (m_nDelayNanos);
+	m_pTimer->CycleDelay (m_nDelayCycles);
 
 	m_ClockPin.Write (HIGH);
-	m_pTimer->nsDelay (m_nDelayNanos);
+	m_pTimer->CycleDelay (m_nDelayCycles);
 }
 
 #endif
\ No newline at end of file
@@ -22,37 +22,242 @@
 
 
 #include <string.h>
-#include "pico/stdlib.h"
-#include "gpiopin.hpp"
-#include "ctimer.hpp"
+#include "swdwire.h"
+#include "swdclock.h"
+#include "swdtarget.h"
+#include "swdunpack.h"
 
-class CSWDLoader	/// Loads a program via the Serial Wire Debug interface to the RP2040
+class CSWDLoader	/// Loads a program via the Serial Wire Debug interface to RP2040/RP2350 targets
 {
 public:
 	const static unsigned DefaultClockRateKHz = 400;	///< Default clock rate in KHz
+	const static unsigned MaxBusTargets = 15;		///< on the multidrop bus
+	const static unsigned RawParityError = 0x08;		///< returned by RawTransfer()
+
+	struct TStatistics	/// Collected since ResetStatistics()
+	{
+		unsigned nTransfers;		///< SWD packets, including TARGETSEL and retries
+		unsigned nTARWrites;
+		unsigned nCSWWrites;
+		uint64_t nRequestBits;		///< SWCLK cycles in the request phase (with park bit)
+		uint64_t nAckBits;		///< SWCLK cycles in the turnaround and ACK phase
+		uint64_t nDataBits;		///< SWCLK cycles in the data phase (with parity and turnaround)
+		uint64_t nIdleBits;		///< SWCLK cycles for idle, line reset and leaving dormant state
+		uint64_t nInterruptsOffTicks;	///< Time with interrupts disabled in microseconds
+		unsigned nMaxInterruptsOffTicks; ///< Longest transaction with interrupts disabled
+	};
+
+	struct TLoadReport	/// Passed to the load hook at the end of each load
+	{
+		size_t nBytes;			///< Size of the image
+		unsigned nTicks;		///< Duration of the load in microseconds
+		unsigned nMaxInterruptsOffTicks; ///< Longest interval with interrupts disabled
+		bool bInterruptFree;		///< Transactions did not disable interrupts
+	};
+
+	/// \param rReport Measurements of the load
+	/// \param pParam Parameter passed to SetLoadHook()
+	typedef void TLoadHook (const TLoadReport &rReport, void *pParam);
+
+private:
+	const static unsigned MaxFlashFunctions = 8;		// used by the flash stub
 
 public:
 	/// \param nClockPin GPIO pin to which SWCLK is connected
 	/// \param nDataPin GPIO pin to which SWDIO is connected
 	/// \param nResetPin Optional GPIO pin to which RESET (RUN) is connected (active LOW)
 	/// \param nClockRateKHz Requested interface clock rate in KHz
+	/// \param nTargets Number of targets for gang programming (up to 8, which share SWCLK\n
+	///		     and have SWDIO on consecutive GPIO pins, starting at nDataPin)
 	/// \note GPIO pin numbers are SoC number, not header positions.
 	/// \note The actual clock rate may be smaller than the requested.
+	/// \note Uses a PIO state machine, if available, otherwise bit-banging.
+	/// \note Program images are streamed by DMA, if a channel is available.
+	/// \note A gang is driven in lockstep. A target, which does not respond with OK\n
+	///	  or reads differently than the majority, is dropped from the gang.
 	CSWDLoader (unsigned nClockPin, unsigned nDataPin, unsigned nResetPin = 0,
-		    unsigned nClockRateKHz = DefaultClockRateKHz);
+		    unsigned nClockRateKHz = DefaultClockRateKHz, unsigned nTargets = 1);
 
 	~CSWDLoader (void);
 
-	/// \brief Reset RP2040 and attach to SW debug port
+	/// \brief Reset the target and attach to SW debug port
 	/// \return Operation successful?
+	/// \note Scans the multidrop bus for all instances of the TARGETIDs in swdtarget.cpp\n
+	///	  (both cores) and powers up their debug ports. Target 0 is selected then.
 	bool Initialize (void);
 
+	/// \return Number of targets found on the multidrop bus (1 with a gang)
+	unsigned GetTargetCount (void) const		{ return m_nBusTargets; }
+
+	/// \param nTarget Index of the target (0 .. GetTargetCount()-1)
+	/// \return TARGETSEL value of the target
+	uint32_t GetTargetSel (unsigned nTarget) const;
+
+	/// \param nTarget Index of the target (0 .. GetTargetCount()-1)
+	/// \return Name of the target type (e.g. "RP2040")
+	const char *GetTargetName (unsigned nTarget) const;
+
+	/// \return Descriptor of the selected target (memory map etc.)
+	/// \note Valid after Initialize() or SwitchTarget()
+	const TSWDTargetDescriptor *GetTargetDescriptor (void) const	{ return m_pTarget; }
+
+	/// \brief Direct the following operations to another target on the multidrop bus
+	/// \param nTarget Index of the target (0 .. GetTargetCount()-1)
+	/// \return Operation successful?
+	/// \note Only a line reset, TARGETSEL and a DPIDR read are needed,\n
+	///	  the power-up and MEM-AP state of each target is kept. Cores\n
+	///	  behind the same debug port are switched with a DP SELECT write.
+	/// \note The interface clock is limited to the maximum of the target.
+	bool SwitchTarget (unsigned nTarget);
+
 	/// \brief Halt the RP2040, load a program image and start it
 	/// \param pProgram Pointer to program image in memory
-	/// \param nProgSize Size of the program image (must be a multiple of 4)
+	/// \param nProgSize Size of the program image
 	/// \param nAddress Load and start address of the program image
 	bool Load (const void *pProgram, size_t nProgSize, uint32_t nAddress);
 
+	/// \brief Halt the RP2040, program an image into its flash and reset it
+	/// \param pImage Pointer to the image in memory
+	/// \param nImageSize Size of the image
+	/// \param nAddress Flash address of the image (must be sector aligned)
+	/// \note The boot ROM functions and the flash window depend on the target type.
+	/// \return Operation successful?
+	/// \note Uses a stub in target SRAM, which calls the boot ROM flash functions.\n
+	///	  The next sector is shifted in, while the previous one is programmed.
+	/// \note Overwrites the first 12 KB of target SRAM.
+	bool ProgramFlash (const void *pImage, size_t nImageSize, uint32_t nAddress);
+
+	/// \brief Start loading or programming an image, which is passed in chunks
+	/// \param nAddress Start address of the image in target SRAM or flash\n
+	///		     (flash addresses must be sector aligned)
+	/// \param bPacked The chunks are a heatshrink stream (see CSWDUnpacker), which\n
+	///		   is decompressed on the target by a stub in the top 8 KB of SRAM
+	/// \return Operation successful?
+	/// \note The image size needs not to be known. It is only limited by the\n
+	///	  size of the SRAM or flash window of the target.
+	/// \note In delta mode each sector or 1 KB SRAM block is compared, when it is\n
+	///	  complete. Delta mode is not used with bPacked.
+	/// \note With bPacked only the compressed stream is shifted over SWD.
+	bool BeginImage (uint32_t nAddress, bool bPacked = false);
+
+	/// \param pChunk Pointer to the next chunk of the image
+	/// \param nChunkSize Size of the chunk (any size)
+	/// \return Operation successful?
+	/// \note Flash sectors are programmed, when they are complete.
+	bool WriteImage (const void *pChunk, size_t nChunkSize);
+
+	/// \brief Complete the image, start it (SRAM) or reset the target (flash)
+	/// \return Operation successful?
+	bool EndImage (void);
+
+	/// \brief Verify loaded and programmed images completely by CRC-32
+	/// \param bEnable Enable CRC verification (default off, only the first word is checked)
+	/// \note The CRC is computed on the RP2040 by DMA channel 11 and its sniffer,\n
+	///	  other targets are read back with posted reads.
+	void SetVerifyCRC (bool bEnable)		{ m_bVerifyCRC = bEnable; }
+
+	/// \brief Compare the CRC-32 of an image with that of target memory
+	/// \param pImage Pointer to the image in memory
+	/// \param nImageSize Size of the image
+	/// \param nAddress Address of the image in target SRAM or flash
+	/// \return Do the CRCs match?
+	bool VerifyCRC (const void *pImage, size_t nImageSize, uint32_t nAddress);
+
+	/// \brief Write only the flash sectors or SRAM blocks, which differ from the image
+	/// \param bEnable Enable delta mode (default off)
+	/// \note Per-sector CRC-32s of the image are compared with those of target memory\n
+	///	  first (see SetVerifyCRC()). SRAM is compared in 1 KB blocks and only on\n
+	///	  targets with a DMA sniffer, on others reading it back is not faster.
+	void SetDeltaMode (bool bEnable)		{ m_bDeltaMode = bEnable; }
+
+	/// \brief Load or program an image, unless target memory holds it already
+	/// \param pImage Pointer to the image in memory
+	/// \param nImageSize Size of the image
+	/// \param nAddress Address of the image in target SRAM or flash (sector aligned)
+	/// \param pChanged Set to true, if the image has been written
+	/// \return Operation successful?
+	/// \note For flash images the CRC-32 of the whole image is compared first. If it\n
+	///	  matches, the target is only reset (the CRC has used its DMA and SRAM).\n
+	///	  Otherwise only the changed sectors are written (delta mode).
+	/// \note SRAM images are always loaded (only the changed blocks) and started,\n
+	///	  the running program has changed its data, so it cannot be compared.
+	bool UpdateImage (const void *pImage, size_t nImageSize, uint32_t nAddress, bool *pChanged);
+
+	/// \brief Post memory writes with overrun detection, instead of checking each ACK
+	/// \param bEnable Enable posted writes (default off)
+	/// \note Must be called before Initialize(). Only used with bit-banging,\n
+	///	  the PIO engines check each ACK in hardware.
+	/// \note Blocks are replayed from their start address after an overrun.
+	void SetOverrunDetect (bool bEnable);
+
+	/// \return Actual interface clock rate in KHz
+	/// \note Valid after Initialize(). Held when clk_sys is changed later.
+	unsigned GetClockRateKHz (void) const;
+
+	/// \return Bit mask of the targets, which are still in the gang (1 without gang)
+	unsigned GetTargetMask (void) const;
+
+	/// \return Transfer and timing statistics
+	/// \note The bit counts are those of the SWD protocol, not measured on the wire.
+	const TStatistics &GetStatistics (void) const	{ return m_Stats; }
+
+	/// \brief Clear the statistics
+	void ResetStatistics (void);
+
+	/// \return Are transactions run with interrupts enabled?
+	/// \note Only bit-banging disables interrupts, the PIO engines keep the timing\n
+	///	  of the wire, if the CPU is interrupted.
+	bool IsInterruptFree (void) const		{ return !m_bMaskInterrupts; }
+
+	/// \brief Set a function, which is called at the end of each successful load
+	/// \param pHook Function to be called (0 to remove it)
+	/// \param pParam Any parameter to be passed to the function
+	/// \note Called from Load(), ProgramFlash() and EndImage(), before verifying.
+	void SetLoadHook (TLoadHook *pHook, void *pParam = 0)
+	{
+		m_pLoadHook = pHook;
+		m_pLoadHookParam = pParam;
+	}
+
+public:
+	// Raw access to the debug port for debug servers (e.g. CMSIS-DAP), which
+	// do not call Initialize(). The caller is responsible for the protocol.
+
+	/// \brief Start a batch of raw operations (a transaction)
+	/// \note Interrupts are disabled until EndRaw(), if bit-banging is used.
+	void BeginRaw (void)				{ BeginTransaction (); }
+
+	/// \brief End a batch of raw operations
+	void EndRaw (void)				{ EndTransaction (); }
+
+	/// \brief Transfer one SWD packet without retries
+	/// \param uchRequest SWD request byte (start bit in bit 0, park bit in bit 7)
+	/// \param pData Data to be written, read data is returned here
+	/// \return ACK (1: OK, 2: WAIT, 4: FAULT, 7: no response),\n
+	///	    or RawParityError, if read data was received with wrong parity
+	unsigned RawTransfer (uint8_t uchRequest, uint32_t *pData);
+
+	/// \brief Output a bit sequence on SWDIO (e.g. line reset or JTAG-to-SWD)
+	/// \param pData Bits to be sent (LSB of the first byte first)
+	/// \param nBitCount Number of bits
+	void RawSequence (const uint8_t *pData, unsigned nBitCount);
+
+	/// \brief Input a bit sequence from SWDIO
+	/// \param pData Bits are returned here (LSB of the first byte first)
+	/// \param nBitCount Number of bits
+	/// \return Have the bits been sampled? (not by the PIO engines, which only\n
+	///	    clock the cycles with SWDIO released and return HIGH bits)
+	bool RawReadSequence (uint8_t *pData, unsigned nBitCount);
+
+	/// \brief Change the interface clock rate
+	/// \param nRateKHz Requested interface clock rate in KHz
+	void SetClockRateKHz (unsigned nRateKHz);
+
+	/// \brief Drive the RESET (RUN) pin of the target
+	/// \param bAsserted Hold the target in reset (LOW)?
+	/// \return Operation successful? (false, if there is no reset pin)
+	bool SetResetLine (bool bAsserted);
+
 public:
 	/// \brief Halt the RP2040
 	/// \return Operation successful?
@@ -60,48 +265,206 @@ public:
 
 	/// \brief Load a chunk of a program image (or entire program)
 	/// \param pChunk Pointer to the chunk in memory
-	/// \param nChunkSize Size of the chunk (must be a multiple of 4)
-	/// \param nAddress Load address of the chunk
+	/// \param nChunkSize Size of the chunk
+	/// \param nAddress Load address of the chunk (may be unaligned)
 	/// \return Operation successful?
 	bool LoadChunk (const void *pChunk, size_t nChunkSize, uint32_t nAddress);
 
+	/// \brief Read a block of words from target memory
+	/// \param nAddress Word aligned start address
+	/// \param pBuffer Buffer, which receives the data
+	/// \param nWords Number of words to be read
+	/// \return Operation successful?
+	/// \note Uses posted AP reads, which need about one transaction per word.
+	/// \note Returns the data of the majority of a gang.
+	bool ReadBlock (uint32_t nAddress, uint32_t *pBuffer, size_t nWords);
+
 	/// \brief Start program image
 	/// \param nAddress Start address of the program image
 	/// \return Operation successful?
 	bool Start (uint32_t nAddress);
+
+public:
+	// Memory and core register access for debug servers (e.g. GDB), after
+	// Initialize(). These do not print errors, a debugger may probe memory,
+	// which does not exist.
+
+	/// \brief Read a block of words from target memory
+	/// \param nAddress Word aligned start address
+	/// \param pBuffer Buffer, which receives the data
+	/// \param nWords Number of words to be read
+	/// \return Operation successful?
+	/// \note Like ReadBlock(), but without the throughput report.
+	bool ReadWords (uint32_t nAddress, uint32_t *pBuffer, size_t nWords);
+
+	/// \brief Write bytes to target memory
+	/// \param nAddress Start address (may be unaligned)
+	/// \param pData Pointer to the data
+	/// \param nSize Number of bytes
+	/// \return Operation successful?
+	/// \note An unaligned head and tail are written with 8- and 16-bit accesses.
+	bool WriteBytes (uint32_t nAddress, const void *pData, size_t nSize);
+
+	/// \brief Read consecutive core registers of the halted core in one transaction
+	/// \param nFirst DCRSR REGSEL of the first register (0-12: R0-R12, 13: SP, 14: LR,\n
+	///		  15: PC, 16: xPSR)
+	/// \param pValues Values are returned here
+	/// \param nCount Number of registers
+	/// \return Operation successful?
+	bool ReadCoreRegisters (unsigned nFirst, uint32_t *pValues, unsigned nCount);
+
+	/// \brief Write consecutive core registers of the halted core in one transaction
+	/// \param nFirst DCRSR REGSEL of the first register
+	/// \param pValues Values to be written
+	/// \param nCount Number of registers
+	/// \return Operation successful?
+	bool WriteCoreRegisters (unsigned nFirst, const uint32_t *pValues, unsigned nCount);
 		bool ReadMem (uint32_t nAddress, uint32_t *pData);
 private:
 	bool PowerOn (void);
 
+	void ScanTargets (void);
+	bool AttachTarget (unsigned nTarget);
+
+	bool StartFlashStub (uint32_t *pFunctions);
+	bool LookupRomTable (uint32_t *pFunctions);
+	bool LookupRomFunctions (uint32_t *pFunctions);
+	bool CallFlashStub (uint32_t nFunction1, uint32_t nArg0, uint32_t nArg1,
+						 uint32_t nArg2, uint32_t nArg3,
+			    uint32_t nFunction2, uint32_t nArg4, uint32_t nArg5,
+						 uint32_t nArg6, uint32_t nArg7);
+	bool WaitFlashStub (void);
+	bool ProgramSector (uint32_t nOffset, uint32_t nBuffer, size_t nSize);
+	bool FinishFlash (void);
+
+	bool WriteDeltaRAM (const uint8_t *pChunk, size_t nChunkSize);
+	bool LoadDeltaBlock (size_t nSize);
+	bool ProgramImageSector (uint32_t nBuffer, size_t nSize);
+
+	bool WritePacked (const uint8_t *pChunk, size_t nChunkSize);
+	bool StartUnpackStub (void);
+	bool WaitUnpackStub (bool bComplete);
+	bool FinishPacked (void);
+	bool ResetTarget (void);
+
+	bool GetTargetCRC (uint32_t nAddress, size_t nSize, uint32_t *pCRC);
+	bool ReadBackCRC (uint32_t nAddress, size_t nSize, uint32_t *pCRC);
+	bool CompareCRC (uint32_t nCRC, size_t nSize, uint32_t nAddress);
+	bool FindChangedBlocks (const uint8_t *pImage, size_t nImageSize, uint32_t nAddress,
+				size_t nBlockSize, bool bPadErased, unsigned *pBlocks);
+
 	bool WriteMem (uint32_t nAddress, uint32_t nData);
+	bool WriteMemSmall (uint32_t nAddress, const uint8_t *pData, unsigned nSize);
+	bool ReadMemHalf (uint32_t nAddress, uint16_t *pData);
+
+	bool WriteCoreRegister (unsigned nRegister, uint32_t nValue);
+	bool WaitRegisterReady (void);
 	
 
+	bool ReadMemBlock (uint32_t nAddress, uint32_t *pData, unsigned nWords);
+	bool WriteMemBlock (uint32_t nAddress, const uint32_t *pData, unsigned nWords);
+	unsigned PostBlock (const uint32_t *pData, unsigned nWords);
+
 	bool WriteData (uint8_t uchRequest, uint32_t nData);
 	bool ReadData (uint8_t uchRequest, uint32_t *pData);
 
+	unsigned WriteOnce (uint8_t uchRequest, uint32_t nData);
+	unsigned ReadOnce (uint8_t uchRequest, uint32_t *pData, bool *pParityOK);
+
+	bool SetAccessSize (unsigned nSize);
+
+	void CountTransfer (uint8_t uchRequest, bool bDataPhase);
+
+	void ClearStickyErrors (void);
+	void WaitBackoff (unsigned nRetry);
+
 	void SelectTarget (uint32_t nCPUAPID, uint8_t uchInstanceID);
 
 	void BeginTransaction (void);
 	void EndTransaction (void);
 
+	void BeginLoad (void);
+	void EndLoad (size_t nBytes, unsigned nStartTicks);
+
+	void UpdateClock (void);
+	void ApplyClock (void);
+	void CalibrateClock (void);
+
 	void Dormant2SWD (void);
 	void LineReset (void);
 	void WriteIdle (void);
 
 	void WriteBits (uint32_t nBits, unsigned nBitCount);
 	uint32_t ReadBits (unsigned nBitCount);
+	void Turnaround (unsigned nCycles);
 	void WriteClock (void);
 
 private:
 	unsigned m_bResetAvailable;
-	unsigned m_nDelayNanos;
 
-	GPIOPin m_ResetPin;
-	GPIOPin m_ClockPin;
-	GPIOPin m_DataPin;
+	CSWDClock m_Clock;
+	unsigned m_nDelayCycles;		// per SWCLK half period (bit-banging)
+	unsigned m_nMeasuredRate;		// in Hz (bit-banging)
+
+	bool m_bOverrunDetect;
+	bool m_bVerifyCRC;
+	bool m_bDeltaMode;
+
+	uint32_t m_nImageAddress;		// passed with WriteImage()
+	uint32_t m_nImageEnd;			// of the SRAM or flash window
+	size_t m_nImageOffset;
+	uint32_t m_nImageCRC;
+	bool m_bImageFlash;
+	bool m_bImageDelta;
+	uint32_t m_nBlockCRC;			// of the current flash sector (delta mode)
+	unsigned m_nDeltaBlocks;		// compared
+	unsigned m_nDeltaChanged;		// written
+	unsigned m_nImageStartTicks;
+	uint32_t m_FlashFunction[MaxFlashFunctions];	// boot ROM functions
+
+	bool m_bImagePacked;
+	uint8_t m_PackedHeader[SWD_UNPACK_HEADER_SIZE];
+	unsigned m_nPackedHeaderBytes;
+	uint32_t m_nUnpackArea;			// at the top of target SRAM
+	uint32_t m_nRingHead;			// bytes written to the ring
+	uint32_t m_nRingTail;			// bytes consumed by the stub (last read)
+	CSWDUnpacker *m_pVerifyUnpacker;	// computes the image CRC on the probe
+	uint32_t m_nCSW;			// last written to the MEM-AP, 0 if unknown
+
+	TSWDWire::TPin m_ResetPin;
+	TSWDWire::TPin m_ClockPin;
+	TSWDWire::TPin m_DataPin;
+
+	TSWDWire::TPIO m_PIO;
+	bool m_bUsePIO;
+	TSWDWire::TGang m_Gang;
+	bool m_bUseGang;
+	bool m_bUseDMA;				// for block writes
+	bool m_bMaskInterrupts;			// during transactions (bit-banging)
+
+	struct TBusTarget		// session state on the multidrop bus
+	{
+		const TSWDTargetDescriptor *pDescriptor;
+		uint8_t uchInstanceID;
+		uint32_t nSelect;	// DP SELECT value for the MEM-AP of the core
+		uint32_t nCSW;		// last written to the MEM-AP, 0 if unknown
+		bool bPoweredUp;	// shared by all cores behind the debug port
+	};
+
+	TBusTarget m_BusTarget[MaxBusTargets];
+	unsigned m_nBusTargets;
+	unsigned m_nCurrentTarget;
+	const TSWDTargetDescriptor *m_pTarget;	// of the current target
+
+	TSWDWire::TTimer *m_pTimer;
+	uint32_t m_nInterruptState;
+	uint64_t m_nTransactionStartTicks;
+
+	TStatistics m_Stats;
 
-	CTimer *m_pTimer;
-    uint32_t irq_state;
+	TLoadHook *m_pLoadHook;
+	void *m_pLoadHookParam;
+	unsigned m_nLoadMaxInterruptsOffTicks;	// since BeginLoad()
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,327 @@
+//
+// swdpio.cpp
+//
+// PIO based Serial Wire Debug engine for CSWDLoader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "swdpio.h"
+#include "hardware/dma.h"
+#include "swd.pio.h"
+#include "swdblock.pio.h"
+
+static_assert (swd_offset_get_next_cmd == SWDPIO_OFFSET_GET_NEXT_CMD, "swd.pio layout");
+static_assert (swd_offset_dispatch == SWDPIO_OFFSET_DISPATCH, "swd.pio layout");
+static_assert (swd_offset_ack_cmd == SWDPIO_OFFSET_ACK_CMD, "swd.pio layout");
+static_assert (swd_offset_ack_fail == SWDPIO_OFFSET_ACK_FAIL, "swd.pio layout");
+static_assert (swd_offset_ack_stall == SWDPIO_OFFSET_ACK_STALL, "swd.pio layout");
+static_assert (swd_offset_write_inline == SWDPIO_OFFSET_WRITE_INLINE, "swd.pio layout");
+
+// both programs are loaded at offset 0 alternately, swd.pio fills the instruction memory
+#define BLOCK_PC_ACK_STALL	swd_block_offset_ack_stall
+
+// swd_block needs two state machine cycles per SWCLK phase
+#define BLOCK_DIVIDER(div)	(((div) + 1) / 2)
+
+#define SWD_ACK_OK		0b001
+
+CSWDPIO::CSWDPIO (void)
+:	m_pPIO (0),
+	m_nSM (-1),
+	m_nDMAChannel (-1)
+{
+}
+
+CSWDPIO::~CSWDPIO (void)
+{
+	if (m_nSM < 0)
+	{
+		return;
+	}
+
+	if (m_nDMAChannel >= 0)
+	{
+		dma_channel_unclaim (m_nDMAChannel);
+	}
+
+	pio_sm_set_enabled (m_pPIO, m_nSM, false);
+	pio_sm_unclaim (m_pPIO, m_nSM);
+	pio_remove_program (m_pPIO, &swd_program, 0);
+
+	gpio_init (m_nClockPin);
+	gpio_init (m_nDataPin);
+}
+
+bool CSWDPIO::Initialize (unsigned nClockPin, unsigned nDataPin, unsigned nClockDivider)
+{
+	assert (m_nSM < 0);
+	m_nClockPin = nClockPin;
+	m_nDataPin = nDataPin;
+
+	// the program must be loaded at offset 0 (see swd.pio)
+	static const PIO PIOs[] = {pio0, pio1};
+	for (unsigned i = 0; i < sizeof PIOs / sizeof PIOs[0]; i++)
+	{
+		if (!pio_can_add_program_at_offset (PIOs[i], &swd_program, 0))
+		{
+			continue;
+		}
+
+		m_nSM = pio_claim_unused_sm (PIOs[i], false);
+		if (m_nSM >= 0)
+		{
+			m_pPIO = PIOs[i];
+
+			break;
+		}
+	}
+
+	if (m_nSM < 0)
+	{
+		return false;
+	}
+
+	pio_add_program_at_offset (m_pPIO, &swd_program, 0);
+
+	m_Config = swd_program_get_default_config (0);
+	sm_config_set_sideset_pins (&m_Config, nClockPin);
+	sm_config_set_out_pins (&m_Config, nDataPin, 1);
+	sm_config_set_set_pins (&m_Config, nDataPin, 1);
+	sm_config_set_in_pins (&m_Config, nDataPin);
+	sm_config_set_out_shift (&m_Config, true, false, 32);
+	sm_config_set_in_shift (&m_Config, true, false, 32);
+
+	m_BlockConfig = swd_block_program_get_default_config (0);
+	sm_config_set_sideset_pins (&m_BlockConfig, nClockPin);
+	sm_config_set_out_pins (&m_BlockConfig, nDataPin, 1);
+	sm_config_set_set_pins (&m_BlockConfig, nDataPin, 1);
+	sm_config_set_jmp_pin (&m_BlockConfig, nDataPin);
+	sm_config_set_out_shift (&m_BlockConfig, true, false, 32);
+
+	sm_config_set_clkdiv_int_frac (&m_Config, nClockDivider, 0);
+	sm_config_set_clkdiv_int_frac (&m_BlockConfig, BLOCK_DIVIDER (nClockDivider), 0);
+
+	pio_sm_set_pins_with_mask (m_pPIO, m_nSM, 0, 1U << nClockPin | 1U << nDataPin);
+	pio_sm_set_pindirs_with_mask (m_pPIO, m_nSM, 1U << nClockPin,
+				      1U << nClockPin | 1U << nDataPin);
+	pio_gpio_init (m_pPIO, nClockPin);
+	pio_gpio_init (m_pPIO, nDataPin);
+
+	pio_sm_init (m_pPIO, m_nSM, SWDPIO_OFFSET_GET_NEXT_CMD, &m_Config);
+	pio_sm_set_enabled (m_pPIO, m_nSM, true);
+
+	// block writes fall back to single transfers, if no channel is available
+	m_nDMAChannel = dma_claim_unused_channel (false);
+
+	return true;
+}
+
+void CSWDPIO::SetClockDivider (unsigned nClockDivider)
+{
+	assert (m_nSM >= 0);
+	Sync ();
+
+	sm_config_set_clkdiv_int_frac (&m_Config, nClockDivider, 0);
+	sm_config_set_clkdiv_int_frac (&m_BlockConfig, BLOCK_DIVIDER (nClockDivider), 0);
+
+	pio_sm_set_clkdiv_int_frac (m_pPIO, m_nSM, nClockDivider, 0);
+	pio_sm_clkdiv_restart (m_pPIO, m_nSM);
+}
+
+unsigned CSWDPIO::WriteData (uint8_t uchRequest, uint32_t nData)
+{
+	assert (!(uchRequest & SWDPIO_REQUEST_RNW));
+	Transfer (uchRequest, nData);
+
+	return Sync ();
+}
+
+unsigned CSWDPIO::ReadData (uint8_t uchRequest, uint32_t *pData, bool *pParityOK)
+{
+	assert (uchRequest & SWDPIO_REQUEST_RNW);
+	Transfer (uchRequest);
+
+	// a successful read pushes two words, a failed one only the ACK
+	while (pio_sm_get_rx_fifo_level (m_pPIO, m_nSM) < 2)
+	{
+		if (IsAckStalled ())
+		{
+			return PopAck ();
+		}
+	}
+
+	uint32_t nData = pio_sm_get (m_pPIO, m_nSM);
+	uint32_t nParity = pio_sm_get (m_pPIO, m_nSM) >> SWDPIO_PARITY__SHIFT;
+
+	assert (pData != 0);
+	*pData = nData;
+
+	assert (pParityOK != 0);
+	*pParityOK = nParity == SWDPIOParity (nData);
+
+	return SWD_ACK_OK;
+}
+
+bool CSWDPIO::WriteBlock (uint8_t uchRequest, const uint32_t *pData, unsigned nWords)
+{
+	assert (m_nDMAChannel >= 0);
+	assert (!(uchRequest & SWDPIO_REQUEST_RNW));
+	assert (pData != 0);
+
+	if (Sync () != SWD_ACK_OK)
+	{
+		Recover ();
+
+		return false;
+	}
+
+	SelectProgram (true);
+
+	pio_sm_put (m_pPIO, m_nSM, uchRequest);
+	pio_sm_set_enabled (m_pPIO, m_nSM, true);
+
+	dma_channel_config Config = dma_channel_get_default_config (m_nDMAChannel);
+	channel_config_set_transfer_data_size (&Config, DMA_SIZE_32);
+	channel_config_set_read_increment (&Config, true);
+	channel_config_set_write_increment (&Config, false);
+	channel_config_set_dreq (&Config, pio_get_dreq (m_pPIO, m_nSM, true));
+	dma_channel_configure (m_nDMAChannel, &Config, &m_pPIO->txf[m_nSM], pData, nWords, true);
+
+	bool bOK = true;
+	while (dma_channel_is_busy (m_nDMAChannel))
+	{
+		if (pio_sm_get_pc (m_pPIO, m_nSM) == BLOCK_PC_ACK_STALL)
+		{
+			dma_channel_abort (m_nDMAChannel);
+			bOK = false;
+
+			break;
+		}
+	}
+
+	if (bOK)
+	{
+		bOK = WaitTxStall (BLOCK_PC_ACK_STALL);
+	}
+
+	SelectProgram (false);
+	pio_sm_set_enabled (m_pPIO, m_nSM, true);
+
+	if (!bOK)
+	{
+		Recover ();
+	}
+
+	return bOK;
+}
+
+unsigned CSWDPIO::Sync (void)
+{
+	Flush ();
+
+	if (!WaitTxStall (SWDPIO_OFFSET_ACK_STALL))
+	{
+		return PopAck ();
+	}
+
+	return SWD_ACK_OK;
+}
+
+void CSWDPIO::Recover (void)
+{
+	pio_sm_set_enabled (m_pPIO, m_nSM, false);
+	pio_sm_clear_fifos (m_pPIO, m_nSM);
+	pio_sm_restart (m_pPIO, m_nSM);
+	pio_sm_exec (m_pPIO, m_nSM,   pio_encode_jmp (SWDPIO_OFFSET_GET_NEXT_CMD)
+				    | pio_encode_sideset (1, 0));
+	pio_sm_set_enabled (m_pPIO, m_nSM, true);
+
+	WriteBits (0, 1, false);		// turnaround
+	Sync ();
+}
+
+void CSWDPIO::PutWord (uint32_t nWord)
+{
+	while (pio_sm_is_tx_fifo_full (m_pPIO, m_nSM))
+	{
+		if (IsAckStalled ())
+		{
+			return;			// dropped by Recover() anyway
+		}
+	}
+
+	pio_sm_put (m_pPIO, m_nSM, nWord);
+}
+
+bool CSWDPIO::IsAckStalled (void)
+{
+	return pio_sm_get_pc (m_pPIO, m_nSM) == SWDPIO_OFFSET_ACK_STALL;
+}
+
+// Waits until the TX FIFO has been drained and the state machine waits for the
+// next command (or transfer). Returns false, if it stalls at nStallPC instead.
+bool CSWDPIO::WaitTxStall (unsigned nStallPC)
+{
+	while (!pio_sm_is_tx_fifo_empty (m_pPIO, m_nSM))
+	{
+		if (pio_sm_get_pc (m_pPIO, m_nSM) == nStallPC)
+		{
+			return false;
+		}
+	}
+
+	// the only pull, which can stall now, is the one at get_next_cmd (or next)
+	const uint32_t nStallMask = 1U << (PIO_FDEBUG_TXSTALL_LSB + m_nSM);
+	m_pPIO->fdebug = nStallMask;
+	while (!(m_pPIO->fdebug & nStallMask))
+	{
+		if (pio_sm_get_pc (m_pPIO, m_nSM) == nStallPC)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Swaps swd.pio and swd_block in the instruction memory. Leaves the state machine disabled.
+void CSWDPIO::SelectProgram (bool bBlock)
+{
+	pio_sm_set_enabled (m_pPIO, m_nSM, false);
+
+	if (bBlock)
+	{
+		pio_remove_program (m_pPIO, &swd_program, 0);
+		pio_add_program_at_offset (m_pPIO, &swd_block_program, 0);
+		pio_sm_init (m_pPIO, m_nSM, swd_block_offset_start, &m_BlockConfig);
+	}
+	else
+	{
+		pio_remove_program (m_pPIO, &swd_block_program, 0);
+		pio_add_program_at_offset (m_pPIO, &swd_program, 0);
+		pio_sm_init (m_pPIO, m_nSM, SWDPIO_OFFSET_GET_NEXT_CMD, &m_Config);
+	}
+}
+
+unsigned CSWDPIO::PopAck (void)
+{
+	// a failed read may leave a pair of a preceding read in the FIFO
+	uint32_t nAck = 0;
+	while (!pio_sm_is_rx_fifo_empty (m_pPIO, m_nSM))
+	{
+		nAck = pio_sm_get (m_pPIO, m_nSM);
+	}
+
+	return nAck >> SWDPIO_ACK__SHIFT;
+}
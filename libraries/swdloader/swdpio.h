@@ -0,0 +1,98 @@
+//
+// swdpio.h
+//
+// PIO based Serial Wire Debug engine for CSWDLoader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdpio_h
+#define _pico_swdpio_h
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "swdpiocode.h"
+
+class CSWDPIO : public CSWDPIOEncoder	/// Shifts SWD packets with a PIO state machine
+{
+public:
+	CSWDPIO (void);
+	~CSWDPIO (void);
+
+	/// \param nClockPin GPIO pin to which SWCLK is connected
+	/// \param nDataPin GPIO pin to which SWDIO is connected
+	/// \param nClockDivider Integer state machine clock divider (see CSWDClock)
+	/// \return Operation successful? (fails, if no PIO is available)
+	bool Initialize (unsigned nClockPin, unsigned nDataPin, unsigned nClockDivider);
+
+	/// \brief Change the clock rate between transfers
+	/// \param nClockDivider Integer state machine clock divider (see CSWDClock)
+	void SetClockDivider (unsigned nClockDivider);
+
+	/// \return Is a DMA channel available for WriteBlock()?
+	bool HasDMA (void) const			{ return m_nDMAChannel >= 0; }
+
+	/// \brief Write a 32-bit word to a DP or AP register
+	/// \param uchRequest SWD packet request (Start to Park)
+	/// \param nData Data to be written
+	/// \return ACK response of the target (DP_OK on success)
+	unsigned WriteData (uint8_t uchRequest, uint32_t nData);
+
+	/// \brief Read a 32-bit word from a DP or AP register
+	/// \param uchRequest SWD packet request (Start to Park)
+	/// \param pData Data read from the target
+	/// \param pParityOK Set to the result of the parity check
+	/// \return ACK response of the target (DP_OK on success)
+	unsigned ReadData (uint8_t uchRequest, uint32_t *pData, bool *pParityOK);
+
+	/// \brief Write a block of words to the same register, streamed by DMA
+	/// \param uchRequest SWD packet request (Start to Park)
+	/// \param pData Data to be written
+	/// \param nWords Number of words (transfers)
+	/// \return Have all transfers been acknowledged with OK?
+	/// \note Runs the swd_block program, which does not report the failed ACK.
+	///	  The state machine is recovered on failure.
+	bool WriteBlock (uint8_t uchRequest, const uint32_t *pData, unsigned nWords);
+
+	/// \brief Wait until all queued commands have been shifted out
+	/// \return ACK response of a failed transfer, or DP_OK
+	unsigned Sync (void);
+
+	/// \brief Restart the state machine after a failed transfer
+	/// \note Drops all queued commands and clocks the turnaround cycle.
+	void Recover (void);
+
+protected:
+	void PutWord (uint32_t nWord) override;
+
+private:
+	bool IsAckStalled (void);
+	unsigned PopAck (void);
+
+	bool WaitTxStall (unsigned nStallPC);
+
+	void SelectProgram (bool bBlock);
+
+private:
+	PIO m_pPIO;
+	int m_nSM;
+	int m_nDMAChannel;
+
+	pio_sm_config m_Config;
+	pio_sm_config m_BlockConfig;
+
+	unsigned m_nClockPin;
+	unsigned m_nDataPin;
+};
+
+#endif
@@ -0,0 +1,165 @@
+//
+// swdpiocode.h
+//
+// Command word encoding for the SWD PIO program (swd.pio)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdpiocode_h
+#define _pico_swdpiocode_h
+
+#include <stdint.h>
+#include <assert.h>
+
+// Program layout of swd.pio (checked against the generated header in swdpio.cpp)
+#define SWDPIO_OFFSET_GET_NEXT_CMD	0
+#define SWDPIO_OFFSET_DISPATCH		1
+#define SWDPIO_OFFSET_ACK_CMD		4
+#define SWDPIO_OFFSET_ACK_FAIL		28
+#define SWDPIO_OFFSET_ACK_STALL		29
+#define SWDPIO_OFFSET_WRITE_INLINE	30
+#define SWDPIO_PROGRAM_LENGTH		32
+
+// Command header
+#define SWDPIO_CMD_COUNT__SHIFT		0		// bit count - 1
+#define SWDPIO_CMD_DRIVEN		(1U << 5)
+#define SWDPIO_CMD_ENTRY__SHIFT		6
+#define SWDPIO_CMD_BITS			11
+
+#define SWDPIO_INLINE_MAX_BITS		(32 - SWDPIO_CMD_BITS)
+
+// Result words in the RX FIFO
+#define SWDPIO_ACK__SHIFT		29
+#define SWDPIO_PARITY__SHIFT		31
+
+#define SWDPIO_REQUEST_RNW		(1U << 2)	// in the SWD packet request
+
+static inline uint32_t SWDPIOCommand (unsigned nEntry, unsigned nBitCount, bool bDriven)
+{
+	assert (1 <= nBitCount && nBitCount <= 32);
+
+	return   ((nBitCount - 1) << SWDPIO_CMD_COUNT__SHIFT)
+	       | (bDriven ? SWDPIO_CMD_DRIVEN : 0)
+	       | (nEntry << SWDPIO_CMD_ENTRY__SHIFT);
+}
+
+static inline unsigned SWDPIOParity (uint32_t nData)
+{
+	return __builtin_parity (nData);
+}
+
+/// \brief Encodes a SWD transfer into one command word
+/// \param uchRequest SWD packet request (Start to Park)
+/// \param nData Data to be written (ignored for reads)
+/// \note Write transfers must be followed by the data word.
+static inline uint32_t SWDPIOTransfer (uint8_t uchRequest, uint32_t nData = 0)
+{
+	uint32_t nWord =   SWDPIOCommand (SWDPIO_OFFSET_WRITE_INLINE, 8, true)
+			 | (uint32_t) uchRequest << SWDPIO_CMD_BITS;
+
+	unsigned nShift = SWDPIO_CMD_BITS + 8;
+	nWord |= SWDPIOCommand (SWDPIO_OFFSET_ACK_CMD, 3, false) << nShift;
+
+	nShift += SWDPIO_CMD_BITS;
+	if (uchRequest & SWDPIO_REQUEST_RNW)
+	{
+		nWord |= 1U << nShift;
+	}
+	else
+	{
+		nWord |= SWDPIOParity (nData) << (nShift + 1);
+	}
+
+	return nWord;
+}
+
+class CSWDPIOEncoder	/// Packs raw bit sequences and transfers into command words
+{
+public:
+	CSWDPIOEncoder (void)
+	:	m_nWord (0),
+		m_nUsed (0)
+	{
+	}
+
+	virtual ~CSWDPIOEncoder (void) {}
+
+	/// \brief Queue a raw bit sequence (LSB first)
+	/// \param nBits Bits to be shifted out
+	/// \param nBitCount Number of bits (1..32)
+	/// \param bDriven Drive SWDIO (or clock with SWDIO released)
+	void WriteBits (uint32_t nBits, unsigned nBitCount, bool bDriven = true)
+	{
+		assert (1 <= nBitCount && nBitCount <= 32);
+
+		while (nBitCount > 0)
+		{
+			if (m_nUsed + SWDPIO_CMD_BITS >= 32)
+			{
+				Flush ();
+			}
+
+			unsigned nCount = SWDPIO_INLINE_MAX_BITS - m_nUsed;
+			if (nCount > nBitCount)
+			{
+				nCount = nBitCount;
+			}
+
+			m_nWord |= SWDPIOCommand (SWDPIO_OFFSET_WRITE_INLINE, nCount, bDriven) << m_nUsed;
+			m_nUsed += SWDPIO_CMD_BITS;
+
+			m_nWord |= (nBits & ((1U << nCount) - 1)) << m_nUsed;
+			m_nUsed += nCount;
+
+			nBits >>= nCount;
+			nBitCount -= nCount;
+		}
+	}
+
+	/// \brief Queue a SWD transfer
+	/// \param uchRequest SWD packet request (Start to Park)
+	/// \param nData Data to be written (ignored for reads)
+	void Transfer (uint8_t uchRequest, uint32_t nData = 0)
+	{
+		Flush ();
+
+		PutWord (SWDPIOTransfer (uchRequest, nData));
+
+		if (!(uchRequest & SWDPIO_REQUEST_RNW))
+		{
+			PutWord (nData);
+		}
+	}
+
+	/// \brief Send a partially filled command word
+	void Flush (void)
+	{
+		if (m_nUsed > 0)
+		{
+			PutWord (m_nWord);
+
+			m_nWord = 0;
+			m_nUsed = 0;
+		}
+	}
+
+protected:
+	virtual void PutWord (uint32_t nWord) = 0;
+
+private:
+	uint32_t m_nWord;
+	unsigned m_nUsed;
+};
+
+#endif
@@ -0,0 +1,333 @@
+//
+// swdpiomodel.hpp
+//
+// Host-side model of the SWD PIO program (swd.pio)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdpiomodel_hpp
+#define _pico_swdpiomodel_hpp
+
+#include <stdint.h>
+#include <deque>
+#include "swdpiocode.h"
+
+class CSWDPIOModel : public CSWDPIOEncoder	/// Executes swd.pio instruction by instruction
+{
+public:
+	class CTarget		/// Target side of the wire
+	{
+	public:
+		virtual ~CTarget (void) {}
+
+		/// \brief Called on each rising edge of SWCLK
+		/// \param bHostDrives Is SWDIO driven by the host?
+		/// \param nLevel Level driven by the host (if bHostDrives)
+		virtual void ClockEdge (bool bHostDrives, unsigned nLevel) = 0;
+
+		/// \return Level of SWDIO, while the host does not drive it
+		virtual unsigned GetLevel (void) = 0;
+	};
+
+public:
+	CSWDPIOModel (CTarget *pTarget)
+	:	m_pTarget (pTarget),
+		m_nCycles (0),
+		m_nClockEdges (0)
+	{
+		Restart ();
+	}
+
+	/// \brief Restart the state machine at get_next_cmd and clear the FIFOs
+	void Restart (void)
+	{
+		m_TxFIFO.clear ();
+		m_RxFIFO.clear ();
+
+		m_nPC = SWDPIO_OFFSET_GET_NEXT_CMD;
+		m_nX = m_nY = 0;
+		m_nOSR = m_nISR = 0;
+		m_nClock = 0;
+		m_nDataLevel = 0;
+		m_bDataDriven = false;
+	}
+
+	/// \brief Run until the state machine stalls
+	/// \return Number of executed instructions (state machine clock cycles)
+	unsigned Run (void)
+	{
+		unsigned nCycles = 0;
+		while (Step ())
+		{
+			nCycles++;
+		}
+
+		m_nCycles += nCycles;
+
+		return nCycles;
+	}
+
+	bool Pop (uint32_t *pWord)
+	{
+		if (m_RxFIFO.empty ())
+		{
+			return false;
+		}
+
+		*pWord = m_RxFIFO.front ();
+		m_RxFIFO.pop_front ();
+
+		return true;
+	}
+
+	unsigned GetRxLevel (void) const	{ return m_RxFIFO.size (); }
+	unsigned GetTxLevel (void) const	{ return m_TxFIFO.size (); }
+
+	/// \return Stalled after an ACK other than OK?
+	bool IsAckStalled (void) const		{ return m_nPC == SWDPIO_OFFSET_ACK_STALL; }
+
+	uint64_t GetCycles (void) const		{ return m_nCycles; }
+	uint64_t GetClockEdges (void) const	{ return m_nClockEdges; }
+
+protected:
+	void PutWord (uint32_t nWord) override
+	{
+		m_TxFIFO.push_back (nWord);
+	}
+
+private:
+	enum TOpcode
+	{
+		OpJmp,
+		OpIn,
+		OpOut,
+		OpPush,
+		OpPull,
+		OpMov,
+		OpSet
+	};
+
+	enum TOperand
+	{
+		LocNone,
+		LocPins,
+		LocPinDirs,
+		LocX,
+		LocY,
+		LocNull,
+		LocISR,
+		LocISRReversed,
+		LocPC,
+		CondAlways,
+		CondNotX,
+		CondXDec,
+		CondNotY,
+		CondXNeY
+	};
+
+	struct TInstruction
+	{
+		TOpcode	Opcode;
+		TOperand Dest;		// or jump condition
+		TOperand Source;
+		unsigned nValue;	// bit count, immediate or jump target
+		unsigned nSideSet;
+	};
+
+	// swd.pio, one entry per instruction
+	static constexpr TInstruction s_Program[SWDPIO_PROGRAM_LENGTH] =
+	{
+		{OpPull, LocNone,    LocNone,         0, 0},	// 0  get_next_cmd
+		{OpOut,  LocX,       LocNone,         5, 0},	// 1  dispatch
+		{OpOut,  LocPinDirs, LocNone,         1, 0},
+		{OpOut,  LocPC,      LocNone,         5, 0},
+		{OpMov,  LocISR,     LocNull,         0, 0},	// 4  ack_cmd
+		{OpMov,  LocY,       LocY,            0, 1},	//    nop
+		{OpIn,   LocNone,    LocPins,         1, 0},	// 6  ack_loop
+		{OpJmp,  CondXDec,   LocNone,         6, 1},
+		{OpMov,  LocX,       LocISRReversed,  0, 0},
+		{OpSet,  LocY,       LocNone,         4, 0},
+		{OpJmp,  CondXNeY,   LocNone,        28, 0},
+		{OpSet,  LocX,       LocNone,        31, 0},
+		{OpOut,  LocY,       LocNone,         1, 0},
+		{OpJmp,  CondNotY,   LocNone,        21, 0},
+		{OpIn,   LocNone,    LocPins,         1, 0},	// 14 read_loop
+		{OpJmp,  CondXDec,   LocNone,        14, 1},
+		{OpPush, LocNone,    LocNone,         0, 0},
+		{OpIn,   LocNone,    LocPins,         1, 0},
+		{OpPush, LocNone,    LocNone,         0, 1},
+		{OpSet,  LocPinDirs, LocNone,         1, 0},
+		{OpJmp,  CondAlways, LocNone,         1, 1},
+		{OpOut,  LocY,       LocNone,         1, 0},	// 21 write_data
+		{OpPull, LocNone,    LocNone,         0, 1},
+		{OpSet,  LocPinDirs, LocNone,         1, 0},
+		{OpOut,  LocPins,    LocNone,         1, 0},	// 24 write_loop
+		{OpJmp,  CondXDec,   LocNone,        24, 1},
+		{OpMov,  LocPins,    LocY,            0, 0},
+		{OpJmp,  CondAlways, LocNone,         1, 1},
+		{OpPush, LocNone,    LocNone,         0, 0},	// 28 ack_fail
+		{OpJmp,  CondAlways, LocNone,        29, 0},	// 29 ack_stall
+		{OpOut,  LocPins,    LocNone,         1, 0},	// 30 write_inline
+		{OpJmp,  CondXDec,   LocNone,        30, 1}
+	};
+
+	static const unsigned WrapTarget = SWDPIO_OFFSET_DISPATCH;
+	static const unsigned Wrap = SWDPIO_PROGRAM_LENGTH - 1;
+
+private:
+	// returns false, if the state machine is stalled
+	bool Step (void)
+	{
+		const TInstruction &rInst = s_Program[m_nPC];
+
+		// side-set takes effect even if the instruction stalls
+		if (!m_nClock && rInst.nSideSet)
+		{
+			m_pTarget->ClockEdge (m_bDataDriven, m_nDataLevel);
+
+			m_nClockEdges++;
+		}
+		m_nClock = rInst.nSideSet;
+
+		if (   (rInst.Opcode == OpPull && m_TxFIFO.empty ())
+		    || m_nPC == SWDPIO_OFFSET_ACK_STALL)
+		{
+			return false;
+		}
+
+		unsigned nNextPC = m_nPC == Wrap ? WrapTarget : m_nPC + 1;
+
+		switch (rInst.Opcode)
+		{
+		case OpJmp: {
+			bool bTaken = false;
+			switch (rInst.Dest)
+			{
+			case CondAlways: bTaken = true; break;
+			case CondNotX: bTaken = m_nX == 0; break;
+			case CondXDec: bTaken = m_nX-- != 0; break;
+			case CondNotY: bTaken = m_nY == 0; break;
+			case CondXNeY: bTaken = m_nX != m_nY; break;
+			default: assert (0); break;
+			}
+
+			if (bTaken)
+			{
+				nNextPC = rInst.nValue;
+			}
+			} break;
+
+		case OpIn:
+			assert (rInst.Source == LocPins && rInst.nValue == 1);
+			m_nISR = (m_nISR >> 1) | (uint32_t) SampleData () << 31;
+			break;
+
+		case OpOut: {
+			uint32_t nValue = m_nOSR & ((1ULL << rInst.nValue) - 1);
+			m_nOSR = rInst.nValue < 32 ? m_nOSR >> rInst.nValue : 0;
+
+			switch (rInst.Dest)
+			{
+			case LocPins: m_nDataLevel = nValue & 1; break;
+			case LocPinDirs: m_bDataDriven = nValue & 1; break;
+			case LocX: m_nX = nValue; break;
+			case LocY: m_nY = nValue; break;
+			case LocPC: nNextPC = nValue; break;
+			default: assert (0); break;
+			}
+			} break;
+
+		case OpPush:
+			m_RxFIFO.push_back (m_nISR);
+			m_nISR = 0;
+			break;
+
+		case OpPull:
+			m_nOSR = m_TxFIFO.front ();
+			m_TxFIFO.pop_front ();
+			break;
+
+		case OpMov: {
+			uint32_t nValue = 0;
+			switch (rInst.Source)
+			{
+			case LocNull: nValue = 0; break;
+			case LocY: nValue = m_nY; break;
+			case LocISRReversed: nValue = Reverse (m_nISR); break;
+			default: assert (0); break;
+			}
+
+			switch (rInst.Dest)
+			{
+			case LocISR: m_nISR = nValue; break;
+			case LocX: m_nX = nValue; break;
+			case LocY: m_nY = nValue; break;
+			case LocPins: m_nDataLevel = nValue & 1; break;
+			default: assert (0); break;
+			}
+			} break;
+
+		case OpSet:
+			switch (rInst.Dest)
+			{
+			case LocPinDirs: m_bDataDriven = rInst.nValue & 1; break;
+			case LocX: m_nX = rInst.nValue; break;
+			case LocY: m_nY = rInst.nValue; break;
+			default: assert (0); break;
+			}
+			break;
+		}
+
+		m_nPC = nNextPC;
+
+		return true;
+	}
+
+	unsigned SampleData (void)
+	{
+		return m_bDataDriven ? m_nDataLevel : m_pTarget->GetLevel () & 1;
+	}
+
+	static uint32_t Reverse (uint32_t nValue)
+	{
+		uint32_t nResult = 0;
+		for (unsigned i = 0; i < 32; i++, nValue >>= 1)
+		{
+			nResult = (nResult << 1) | (nValue & 1);
+		}
+
+		return nResult;
+	}
+
+private:
+	CTarget *m_pTarget;
+
+	std::deque<uint32_t> m_TxFIFO;
+	std::deque<uint32_t> m_RxFIFO;
+
+	unsigned m_nPC;
+	uint32_t m_nX;
+	uint32_t m_nY;
+	uint32_t m_nOSR;
+	uint32_t m_nISR;
+
+	unsigned m_nClock;
+	unsigned m_nDataLevel;
+	bool	 m_bDataDriven;
+
+	uint64_t m_nCycles;
+	uint64_t m_nClockEdges;
+};
+
+#endif
@@ -0,0 +1,90 @@
+//
+// swdring.h
+//
+// Lock-free ring for one producer and one consumer (e.g. core 0 and core 1)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Each index is written by one side only. Loads and stores of the indices
+// are atomic on the Cortex-M0+, the acquire/release ordering inserts the
+// memory barriers, so that an item is complete, before it becomes visible.
+//
+#ifndef _pico_swdring_h
+#define _pico_swdring_h
+
+#include <atomic>
+
+template <typename TItem, unsigned nSize>
+class CSWDRing	/// Single producer, single consumer ring of items (e.g. buffer descriptors)
+{
+	static_assert (nSize >= 2 && (nSize & (nSize-1)) == 0, "Ring size must be a power of 2");
+
+public:
+	CSWDRing (void)
+	:	m_nHead (0),
+		m_nTail (0)
+	{
+	}
+
+	/// \brief Append an item (producer only)
+	/// \param rItem Item to be copied into the ring
+	/// \return Operation successful? (false if the ring is full)
+	bool Put (const TItem &rItem)
+	{
+		unsigned nHead = m_nHead.load (std::memory_order_relaxed);
+		if (nHead - m_nTail.load (std::memory_order_acquire) == nSize)
+		{
+			return false;
+		}
+
+		m_Items[nHead & (nSize-1)] = rItem;
+
+		m_nHead.store (nHead + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/// \brief Remove the oldest item (consumer only)
+	/// \param pItem Item is copied here
+	/// \return Operation successful? (false if the ring is empty)
+	bool Get (TItem *pItem)
+	{
+		unsigned nTail = m_nTail.load (std::memory_order_relaxed);
+		if (nTail == m_nHead.load (std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		*pItem = m_Items[nTail & (nSize-1)];
+
+		m_nTail.store (nTail + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/// \return Number of items in the ring (a snapshot, if called by the other side)
+	unsigned GetCount (void) const
+	{
+		return   m_nHead.load (std::memory_order_acquire)
+		       - m_nTail.load (std::memory_order_acquire);
+	}
+
+private:
+	TItem m_Items[nSize];
+
+	std::atomic<unsigned> m_nHead;		// written by the producer
+	std::atomic<unsigned> m_nTail;		// written by the consumer
+};
+
+#endif
@@ -0,0 +1,411 @@
+//
+// swdrtt.cpp
+//
+// Exchanges RTT channel 0 data with a running target via the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// The target writes its log to a ring buffer in its RAM and advances the
+// write offset, the probe reads the bytes between the read and the write
+// offset (the dirty span) with block reads and advances the read offset.
+// The target is never halted. The control block is found by its ID, which
+// is searched in the RAM with block reads, one block per Poll().
+//
+#include "swdrtt.h"
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+//
+// References:
+//
+// [1] SEGGER RTT, SEGGER_RTT.h and SEGGER_RTT.c (also in pico-sdk, pico_stdio_rtt)
+//
+
+// Control block
+#define RTT_ID				"SEGGER RTT"
+#define RTT_ID_SIZE			16
+#define RTT_MAX_UP_BUFFERS		16		// offset 16
+#define RTT_MAX_DOWN_BUFFERS		16		// offset 20
+#define RTT_BUFFERS_OFFSET		24
+
+// Buffer descriptor
+#define RTT_DESC_SIZE			24
+#define RTT_DESC_BUFFER			4		// char *pBuffer
+#define RTT_DESC_SIZE_OF_BUFFER		8
+#define RTT_DESC_WR_OFF			12
+#define RTT_DESC_RD_OFF			16
+#define RTT_MAX_BUFFER_SIZE		0x100000U	// plausibility check
+
+CSWDRTT::CSWDRTT (unsigned nClockPin, unsigned nDataPin, unsigned nClockRateKHz,
+		  uint32_t nScanStart, size_t nScanSize)
+:	m_nClockPin (nClockPin),
+	m_nDataPin (nDataPin),
+	m_nClockRateKHz (nClockRateKHz),
+	m_bScanTargetRAM (nScanSize == 0),
+	m_nScanStart (nScanStart & ~3U),
+	m_nScanSize (nScanSize),
+	m_pLoader (0),
+	m_bFailed (false),
+	m_nControlBlock (0),
+	m_nUpDescriptor (0),
+	m_nDownDescriptor (0),
+	m_nScanAddress (m_nScanStart),
+	m_nPollInterval (0)
+{
+}
+
+CSWDRTT::~CSWDRTT (void)
+{
+	Detach ();
+}
+
+unsigned CSWDRTT::Poll (const uint8_t *pInput, unsigned nInputLength, unsigned *pInputWritten,
+			uint8_t *pOutput, unsigned nOutputSize)
+{
+	assert (pInputWritten != 0);
+	*pInputWritten = 0;
+
+	m_bFailed = false;
+
+	if (   m_pLoader == 0
+	    && !Attach ())
+	{
+		m_nPollInterval = RetryIntervalUs;
+
+		return 0;
+	}
+
+	unsigned nRead = 0;
+	if (m_nControlBlock == 0)
+	{
+		if (Scan ())
+		{
+			printf ("RTT control block at 0x%X\r\n", m_nControlBlock);
+		}
+	}
+	else
+	{
+		if (   nInputLength > 0
+		    && m_nDownDescriptor != 0)
+		{
+			assert (pInput != 0);
+			*pInputWritten = WriteDown (pInput, nInputLength);
+		}
+
+		if (!m_bFailed)
+		{
+			nRead = ReadUp (pOutput, nOutputSize);
+		}
+
+		if (nRead > 0)
+		{
+			m_nPollInterval = 0;		// more data may be coming
+		}
+		else if (m_nPollInterval < MinIdleIntervalUs)
+		{
+			m_nPollInterval = MinIdleIntervalUs;
+		}
+		else if (m_nPollInterval < MaxIdleIntervalUs)
+		{
+			m_nPollInterval *= 2;
+		}
+	}
+
+	// the target may have been disconnected or powered off
+	if (m_bFailed)
+	{
+		Detach ();
+
+		m_nPollInterval = RetryIntervalUs;
+	}
+
+	return nRead;
+}
+
+void CSWDRTT::Detach (void)
+{
+	delete m_pLoader;
+	m_pLoader = 0;
+}
+
+bool CSWDRTT::Attach (void)
+{
+	assert (m_pLoader == 0);
+	m_pLoader = new CSWDLoader (m_nClockPin, m_nDataPin, 0, m_nClockRateKHz);
+	assert (m_pLoader != 0);
+
+	if (!m_pLoader->Initialize ())
+	{
+		Detach ();
+
+		return false;
+	}
+
+	// another target type may have been connected in the meantime
+	const TSWDTargetDescriptor *pTarget = m_pLoader->GetTargetDescriptor ();
+	if (   m_bScanTargetRAM
+	    && (   m_nScanStart != pTarget->nRAMBase
+		|| m_nScanSize != pTarget->nRAMSize))
+	{
+		m_nScanStart = pTarget->nRAMBase;
+		m_nScanSize = pTarget->nRAMSize;
+
+		m_nControlBlock = 0;
+		m_nScanAddress = m_nScanStart;
+	}
+
+	// the target may have been reset in the meantime
+	if (   m_nControlBlock != 0
+	    && !CheckControlBlock (m_nControlBlock))
+	{
+		m_nControlBlock = 0;
+		m_nScanAddress = m_nScanStart;
+	}
+
+	return true;
+}
+
+// Searches the next block, which overlaps with the following one by the size
+// of the ID, so that an ID across the boundary is found too
+bool CSWDRTT::Scan (void)
+{
+	assert (m_pLoader != 0);
+
+	uint32_t nScanEnd = m_nScanStart + m_nScanSize;
+	if (m_nScanAddress + RTT_ID_SIZE > nScanEnd)
+	{
+		m_nScanAddress = m_nScanStart;
+		m_nPollInterval = RetryIntervalUs;	// not initialized by the target yet
+
+		return false;
+	}
+
+	size_t nSize = ScanBlockSize + RTT_ID_SIZE;
+	if (nSize > nScanEnd - m_nScanAddress)
+	{
+		nSize = (nScanEnd - m_nScanAddress) & ~3U;
+	}
+
+	if (!m_pLoader->ReadWords (m_nScanAddress, m_Buffer, nSize / 4))
+	{
+		m_bFailed = true;
+
+		return false;
+	}
+
+	// the control block contains words, it is aligned
+	const uint8_t *pBuffer = (const uint8_t *) m_Buffer;
+	for (unsigned nOffset = 0; nOffset + RTT_ID_SIZE <= nSize; nOffset += 4)
+	{
+		if (   memcmp (pBuffer + nOffset, RTT_ID, sizeof RTT_ID) == 0
+		    && CheckControlBlock (m_nScanAddress + nOffset))
+		{
+			m_nPollInterval = 0;
+
+			return true;
+		}
+	}
+
+	m_nScanAddress += ScanBlockSize;
+	m_nPollInterval = 0;
+
+	return false;
+}
+
+// Reads the header of the control block and sets the descriptors of channel 0
+bool CSWDRTT::CheckControlBlock (uint32_t nAddress)
+{
+	assert (m_pLoader != 0);
+
+	uint32_t Header[RTT_BUFFERS_OFFSET / 4];
+	if (!m_pLoader->ReadWords (nAddress, Header, RTT_BUFFERS_OFFSET / 4))
+	{
+		m_bFailed = true;
+
+		return false;
+	}
+
+	unsigned nMaxUp = Header[4];
+	unsigned nMaxDown = Header[5];
+	if (   memcmp (Header, RTT_ID, sizeof RTT_ID) != 0
+	    || nMaxUp == 0
+	    || nMaxUp > RTT_MAX_UP_BUFFERS
+	    || nMaxDown > RTT_MAX_DOWN_BUFFERS)
+	{
+		return false;
+	}
+
+	m_nControlBlock = nAddress;
+	m_nUpDescriptor = nAddress + RTT_BUFFERS_OFFSET;
+	m_nDownDescriptor = nMaxDown > 0 ? m_nUpDescriptor + nMaxUp * RTT_DESC_SIZE : 0;
+
+	return true;
+}
+
+// Reads the dirty span of the up-buffer, in two parts, if it wraps
+unsigned CSWDRTT::ReadUp (uint8_t *pOutput, unsigned nOutputSize)
+{
+	assert (pOutput != 0);
+
+	// pBuffer, SizeOfBuffer, WrOff and RdOff with one block read
+	uint32_t Desc[4];
+	if (!m_pLoader->ReadWords (m_nUpDescriptor + RTT_DESC_BUFFER, Desc, 4))
+	{
+		m_bFailed = true;
+
+		return 0;
+	}
+
+	uint32_t nBuffer = Desc[0];
+	unsigned nSize = Desc[1];
+	unsigned nWrOff = Desc[2];
+	unsigned nRdOff = Desc[3];
+	if (   nSize == 0
+	    || nSize > RTT_MAX_BUFFER_SIZE
+	    || nWrOff >= nSize
+	    || nRdOff >= nSize)
+	{
+		m_nControlBlock = 0;		// overwritten, search again
+		m_nScanAddress = m_nScanStart;
+
+		return 0;
+	}
+
+	unsigned nRead = 0;
+	while (   nRdOff != nWrOff
+	       && nRead < nOutputSize)
+	{
+		unsigned nEnd = nWrOff > nRdOff ? nWrOff : nSize;
+		unsigned nChunk = nEnd - nRdOff;
+		if (nChunk > nOutputSize - nRead)
+		{
+			nChunk = nOutputSize - nRead;
+		}
+
+		if (!ReadBytes (nBuffer + nRdOff, pOutput + nRead, nChunk))
+		{
+			m_bFailed = true;
+
+			return 0;
+		}
+
+		nRead += nChunk;
+		nRdOff += nChunk;
+		if (nRdOff == nSize)
+		{
+			nRdOff = 0;
+		}
+	}
+
+	if (   nRead > 0
+	    && !m_pLoader->WriteBytes (m_nUpDescriptor + RTT_DESC_RD_OFF, &nRdOff, sizeof nRdOff))
+	{
+		m_bFailed = true;
+
+		return 0;
+	}
+
+	return nRead;
+}
+
+// Writes as much as fits into the down-buffer, in two parts, if it wraps
+unsigned CSWDRTT::WriteDown (const uint8_t *pInput, unsigned nInputLength)
+{
+	uint32_t Desc[4];
+	if (!m_pLoader->ReadWords (m_nDownDescriptor + RTT_DESC_BUFFER, Desc, 4))
+	{
+		m_bFailed = true;
+
+		return 0;
+	}
+
+	uint32_t nBuffer = Desc[0];
+	unsigned nSize = Desc[1];
+	unsigned nWrOff = Desc[2];
+	unsigned nRdOff = Desc[3];
+	if (   nSize == 0
+	    || nSize > RTT_MAX_BUFFER_SIZE
+	    || nWrOff >= nSize
+	    || nRdOff >= nSize)
+	{
+		return 0;
+	}
+
+	// one byte is kept free, WrOff == RdOff means empty
+	unsigned nFree = (nRdOff + nSize - nWrOff - 1) % nSize;
+	if (nInputLength > nFree)
+	{
+		nInputLength = nFree;
+	}
+
+	unsigned nWritten = 0;
+	while (nWritten < nInputLength)
+	{
+		unsigned nChunk = nSize - nWrOff;
+		if (nChunk > nInputLength - nWritten)
+		{
+			nChunk = nInputLength - nWritten;
+		}
+
+		if (!m_pLoader->WriteBytes (nBuffer + nWrOff, pInput + nWritten, nChunk))
+		{
+			m_bFailed = true;
+
+			return 0;
+		}
+
+		nWritten += nChunk;
+		nWrOff += nChunk;
+		if (nWrOff == nSize)
+		{
+			nWrOff = 0;
+		}
+	}
+
+	// the offset is written last, so that the target sees complete data only
+	if (   nWritten > 0
+	    && !m_pLoader->WriteBytes (m_nDownDescriptor + RTT_DESC_WR_OFF, &nWrOff, sizeof nWrOff))
+	{
+		m_bFailed = true;
+
+		return 0;
+	}
+
+	return nWritten;
+}
+
+// Reads whole words, which cover the bytes
+bool CSWDRTT::ReadBytes (uint32_t nAddress, uint8_t *pBuffer, unsigned nLength)
+{
+	while (nLength > 0)
+	{
+		unsigned nChunk = nLength < ScanBlockSize ? nLength : ScanBlockSize;
+
+		uint32_t nFirstWord = nAddress & ~3U;
+		unsigned nWords = (nAddress + nChunk - nFirstWord + 3) / 4;
+		if (!m_pLoader->ReadWords (nFirstWord, m_Buffer, nWords))
+		{
+			return false;
+		}
+
+		memcpy (pBuffer, (const uint8_t *) m_Buffer + (nAddress & 3), nChunk);
+
+		pBuffer += nChunk;
+		nAddress += nChunk;
+		nLength -= nChunk;
+	}
+
+	return true;
+}
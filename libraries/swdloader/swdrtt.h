@@ -0,0 +1,98 @@
+//
+// swdrtt.h
+//
+// Exchanges RTT channel 0 data with a running target via the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdrtt_h
+#define _pico_swdrtt_h
+
+#include "swdloader.h"
+#include <stdint.h>
+
+class CSWDRTT	/// Polls the RTT control block of a running target (SEGGER layout), independent of the transport
+{
+public:
+	const static unsigned ScanBlockSize = 1024;		///< Searched per Poll(), until the control block is found
+	const static unsigned MinIdleIntervalUs = 1000;		///< First poll interval, after no data was read
+	const static unsigned MaxIdleIntervalUs = 64000;	///< Poll interval, when the target is idle
+	const static unsigned RetryIntervalUs = 1000000;	///< After a failed attach or scan pass
+
+public:
+	/// \param nClockPin GPIO pin to which SWCLK is connected
+	/// \param nDataPin GPIO pin to which SWDIO is connected
+	/// \param nClockRateKHz Interface clock rate in KHz
+	/// \param nScanStart Start address of the target RAM, which is searched
+	/// \param nScanSize Size of the target RAM, which is searched\n
+	///		     (0: the whole RAM of the attached target type)
+	/// \note The target is neither reset, nor halted.
+	CSWDRTT (unsigned nClockPin, unsigned nDataPin, unsigned nClockRateKHz,
+		 uint32_t nScanStart = 0, size_t nScanSize = 0);
+
+	~CSWDRTT (void);
+
+	/// \brief Write to the down-buffer and read from the up-buffer of channel 0
+	/// \param pInput Data for the down-buffer
+	/// \param nInputLength Length of the data (may be 0)
+	/// \param pInputWritten Number of bytes, which fit into the down-buffer, is returned here
+	/// \param pOutput Data from the up-buffer is returned here
+	/// \param nOutputSize Size of the output buffer
+	/// \return Number of bytes read from the up-buffer
+	/// \note Attaches to the target and searches the control block first.
+	unsigned Poll (const uint8_t *pInput, unsigned nInputLength, unsigned *pInputWritten,
+		       uint8_t *pOutput, unsigned nOutputSize);
+
+	/// \return Time until the next Poll() should be done in microseconds
+	/// \note 0 while data flows, doubles up to MaxIdleIntervalUs, while the target is idle.
+	unsigned GetPollInterval (void) const		{ return m_nPollInterval; }
+
+	/// \return Address of the control block (0 if not found yet)
+	uint32_t GetControlBlock (void) const		{ return m_nControlBlock; }
+
+	/// \brief Release the SWD pins (e.g. before another loader uses them)
+	/// \note The next Poll() attaches again and checks the control block.
+	void Detach (void);
+
+private:
+	bool Attach (void);
+	bool Scan (void);
+	bool CheckControlBlock (uint32_t nAddress);
+
+	unsigned ReadUp (uint8_t *pOutput, unsigned nOutputSize);
+	unsigned WriteDown (const uint8_t *pInput, unsigned nInputLength);
+	bool ReadBytes (uint32_t nAddress, uint8_t *pBuffer, unsigned nLength);
+
+private:
+	unsigned m_nClockPin;
+	unsigned m_nDataPin;
+	unsigned m_nClockRateKHz;
+	bool m_bScanTargetRAM;			// the scan range is taken from the target descriptor
+	uint32_t m_nScanStart;
+	size_t m_nScanSize;
+
+	CSWDLoader *m_pLoader;			// while attached
+	bool m_bFailed;				// SWD error, attach again
+
+	uint32_t m_nControlBlock;		// 0 if not found
+	uint32_t m_nUpDescriptor;		// of channel 0
+	uint32_t m_nDownDescriptor;		// of channel 0, 0 if none
+	uint32_t m_nScanAddress;		// next block to be searched
+
+	unsigned m_nPollInterval;		// in microseconds
+
+	uint32_t m_Buffer[(ScanBlockSize + 16) / 4];
+};
+
+#endif
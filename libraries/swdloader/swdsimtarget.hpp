@@ -0,0 +1,851 @@
+//
+// swdsimtarget.hpp
+//
+// Host-side simulation of the SW-DP and MEM-AP of an RP2040 core
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// References:
+//
+// [1] ARM Debug Interface Architecture Specification ADIv5.0 to ADIv5.2, IHI 0031E
+// [2] RP2040 Datasheet
+//
+// The target follows the wire bit by bit, so that it can be driven by the
+// bit-banged loader (swdsimwire.hpp) or by the PIO model (swdpiomodel.hpp).
+// Memory is the SRAM window and a word map for everything else (registers).
+// The DMA completes a transfer immediately, when it is triggered, which is
+// enough for the CRC sniffer, which verifies loaded images.
+//
+#ifndef _pico_swdsimtarget_hpp
+#define _pico_swdsimtarget_hpp
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <map>
+#include <vector>
+#include "swdpiomodel.hpp"
+#include "swdcrc.h"
+
+#define SWD_SIM_TARGETID	0x01002927U	// RP2040 ([2] section 2.3.4.2)
+#define SWD_SIM_DPIDR		0x0BC12477U
+#define SWD_SIM_AP_IDR		0x04770031U	// AHB-AP
+#define SWD_SIM_RAM_BASE	0x20000000U
+#define SWD_SIM_RAM_SIZE	0x42000U
+
+class CSWDSimTarget : public CSWDPIOModel::CTarget	/// Simulated debug port of an RP2040 core
+{
+public:
+	enum TError		/// Injected into transfers, which access the MEM-AP
+	{
+		ErrorWait,	///< ACK is WAIT, the transfer is not performed
+		ErrorFault,	///< ACK is FAULT, sets STICKYERR
+		ErrorParity	///< Read data has a wrong parity, write data is received with one
+	};
+
+	struct TStatistics
+	{
+		unsigned nDPReads;
+		unsigned nDPWrites;
+		unsigned nAPReads;		///< including RDBUFF reads
+		unsigned nAPWrites;
+		unsigned nWaits;		///< WAIT responses
+		unsigned nFaults;		///< FAULT responses
+		unsigned nParityErrors;		///< injected or received
+		unsigned nProtocolErrors;	///< invalid packet requests
+		unsigned nLineResets;
+		uint64_t nClockEdges;
+	};
+
+public:
+	/// \param uchInstance TINSTANCE, which is selected by TARGETSEL (core number)
+	CSWDSimTarget (uint8_t uchInstance = 0)
+	:	m_nTargetSel (SWD_SIM_TARGETID | (uint32_t) uchInstance << 28),
+		m_RAM (SWD_SIM_RAM_SIZE, 0)
+	{
+		m_Registers[RESETS_RESET_DONE] = 0x01FFFFFF;	// all out of reset
+
+		PowerOnReset ();
+	}
+
+	/// \brief Return to the dormant state and clear all registers (memory is kept)
+	void PowerOnReset (void)
+	{
+		m_State = StateDormant;
+		m_nAlertLow = m_nAlertHigh = 0;
+		m_nHighCycles = 0;
+		m_bResetState = false;
+		m_bSelected = false;
+
+		m_nCtrlStat = 0;
+		m_nSelect = 0;
+		m_nReadBuffer = 0;
+		m_nCSW = 0;
+		m_nTAR = 0;
+
+		m_nDHCSR = 0;
+		memset (m_CoreRegister, 0, sizeof m_CoreRegister);
+
+		m_nErrorAfter = 0;
+		m_nErrorCount = 0;
+
+		ResetStatistics ();
+	}
+
+	/// \brief Let transfers fail, which access the MEM-AP (AP registers and RDBUFF)
+	/// \param Error Kind of the error
+	/// \param nAfter Number of MEM-AP transfers, which succeed before
+	/// \param nCount Number of failing MEM-AP transfers
+	void InjectError (TError Error, unsigned nAfter = 0, unsigned nCount = 1)
+	{
+		m_Error = Error;
+		m_nErrorAfter = nAfter;
+		m_nErrorCount = nCount;
+	}
+
+	/// \brief Access memory directly (e.g. to check a loaded image)
+	void ReadMemory (uint32_t nAddress, void *pBuffer, size_t nSize)
+	{
+		uint8_t *pBuffer8 = (uint8_t *) pBuffer;
+		for (; nSize > 0; nSize--, nAddress++)
+		{
+			*pBuffer8++ = ReadWord (nAddress & ~3U) >> (nAddress & 3) * 8;
+		}
+	}
+
+	void WriteMemory (uint32_t nAddress, const void *pBuffer, size_t nSize)
+	{
+		const uint8_t *pBuffer8 = (const uint8_t *) pBuffer;
+		for (; nSize > 0; nSize--, nAddress++)
+		{
+			unsigned nShift = (nAddress & 3) * 8;
+			WriteWord (nAddress & ~3U, (uint32_t) *pBuffer8++ << nShift, 0xFFU << nShift);
+		}
+	}
+
+	bool IsDormant (void) const			{ return m_State == StateDormant; }
+	bool IsHalted (void) const			{ return !!(m_nDHCSR & DHCSR_C_HALT); }
+
+	/// \param nRegister DCRSR REGSEL value (e.g. 15 for the PC)
+	uint32_t GetCoreRegister (unsigned nRegister) const
+	{
+		assert (nRegister < CoreRegisters);
+		return m_CoreRegister[nRegister];
+	}
+
+	const TStatistics &GetStatistics (void) const	{ return m_Stats; }
+	void ResetStatistics (void)			{ memset (&m_Stats, 0, sizeof m_Stats); }
+
+	void ClockEdge (bool bHostDrives, unsigned nLevel) override
+	{
+		m_Stats.nClockEdges++;
+
+		unsigned nBit = bHostDrives ? nLevel & 1 : GetLevel ();
+
+		// line reset: at least 50 cycles HIGH ([1] section B4.3.3)
+		m_nHighCycles = nBit ? m_nHighCycles + 1 : 0;
+		if (   m_nHighCycles >= 50
+		    && m_State != StateDormant
+		    && m_State != StateActivation)
+		{
+			if (m_nHighCycles == 50)
+			{
+				m_State = StateIdle;
+				m_bResetState = true;
+				m_bSelected = true;
+
+				m_Stats.nLineResets++;
+			}
+
+			return;
+		}
+
+		switch (m_State)
+		{
+		case StateDormant:
+			// selection alert ([1] section B5.3.4), first bit in the LSB
+			m_nAlertLow = m_nAlertLow >> 1 | m_nAlertHigh << 63;
+			m_nAlertHigh = m_nAlertHigh >> 1 | (uint64_t) nBit << 63;
+			if (   m_nAlertLow == SelectionAlertLow
+			    && m_nAlertHigh == SelectionAlertHigh)
+			{
+				NextState (StateActivation);
+			}
+			break;
+
+		case StateActivation:
+			// 4 cycles LOW and the SWD activation code
+			m_nShift |= nBit << m_nBitCount++;
+			if (m_nBitCount == 12)
+			{
+				m_nAlertLow = m_nAlertHigh = 0;
+
+				// a line reset is required before the first packet
+				NextState (m_nShift == 0x1A << 4 ? StateLockout : StateDormant);
+			}
+			break;
+
+		case StateLockout:
+			break;
+
+		case StateIdle:
+			if (nBit)
+			{
+				NextState (StateRequest);
+				m_nShift = 1;
+				m_nBitCount = 1;
+			}
+			break;
+
+		case StateRequest:
+			m_nShift |= nBit << m_nBitCount++;
+			if (m_nBitCount == 8)
+			{
+				Request ((uint8_t) m_nShift);
+			}
+			break;
+
+		case StateTurnToAck:
+			NextState (StateAck);
+			break;
+
+		case StateAck:
+			if (++m_nBitCount < 3)
+			{
+				break;
+			}
+
+			if (!m_bRead)
+			{
+				NextState (StateTurnToWrite);
+			}
+			else if (   m_nAck == ACK_OK
+				 || (m_nCtrlStat & CTRL_STAT_ORUNDETECT))
+			{
+				NextState (StateReadData);
+			}
+			else
+			{
+				NextState (StateTurnToIdle);
+			}
+			break;
+
+		case StateReadData:
+			if (++m_nBitCount == 33)
+			{
+				NextState (StateTurnToIdle);
+			}
+			break;
+
+		case StateTurnToIdle:
+			NextState (StateIdle);
+			break;
+
+		case StateTurnToWrite:
+			if (   m_nAck == ACK_OK
+			    || (m_nCtrlStat & CTRL_STAT_ORUNDETECT))
+			{
+				NextState (StateWriteData);
+				m_nShift = 0;
+			}
+			else
+			{
+				NextState (StateIdle);
+			}
+			break;
+
+		case StateWriteData:
+			if (m_nBitCount < 32)
+			{
+				m_nShift |= nBit << m_nBitCount;
+			}
+			else if (m_nAck == ACK_OK)
+			{
+				if (   nBit != Parity (m_nShift)
+				    || m_bCorruptParity)
+				{
+					m_nCtrlStat |= CTRL_STAT_WDATAERR;
+					m_Stats.nParityErrors++;
+				}
+				else
+				{
+					Write (m_nShift);
+				}
+			}
+
+			if (++m_nBitCount == 33)
+			{
+				NextState (StateIdle);
+			}
+			break;
+
+		case StateTargetSelTurn:
+			// TARGETSEL is not acknowledged, the ACK phase is not driven
+			if (++m_nBitCount == 5)
+			{
+				NextState (StateTargetSelData);
+				m_nShift = 0;
+			}
+			break;
+
+		case StateTargetSelData:
+			if (m_nBitCount < 32)
+			{
+				m_nShift |= nBit << m_nBitCount++;
+				break;
+			}
+
+			m_bSelected = m_nShift == m_nTargetSel && nBit == Parity (m_nShift);
+			NextState (m_bSelected ? StateIdle : StateLockout);
+			break;
+		}
+	}
+
+	unsigned GetLevel (void) override
+	{
+		switch (m_State)
+		{
+		case StateAck:
+			return m_nAck >> m_nBitCount & 1;
+
+		case StateReadData:
+			if (m_nAck != ACK_OK)
+			{
+				break;
+			}
+
+			if (m_nBitCount < 32)
+			{
+				return m_nReadData >> m_nBitCount & 1;
+			}
+
+			return Parity (m_nReadData) ^ m_bCorruptParity;
+
+		default:
+			break;
+		}
+
+		return 1;	// not driven, pull-up
+	}
+
+private:
+	enum TState
+	{
+		StateDormant,
+		StateActivation,
+		StateLockout,		// until line reset (protocol error or not selected)
+		StateIdle,
+		StateRequest,
+		StateTurnToAck,
+		StateAck,
+		StateReadData,
+		StateTurnToIdle,
+		StateTurnToWrite,
+		StateWriteData,
+		StateTargetSelTurn,
+		StateTargetSelData
+	};
+
+	void NextState (TState State)
+	{
+		m_State = State;
+		m_nBitCount = 0;
+		m_nShift = 0;
+	}
+
+	// Decodes the packet request ([1] section B4.2.1) and prepares the ACK
+	void Request (uint8_t uchRequest)
+	{
+		bool bAP = !!(uchRequest & BIT_APnDP);
+		m_bRead = !!(uchRequest & BIT_RnW);
+		m_nRegister = uchRequest >> 1 & 0xC;
+		bool bResetState = m_bResetState;
+		m_bResetState = false;
+
+		if (   (uchRequest & BIT_STOP)
+		    || !(uchRequest & BIT_PARK)
+		    || Parity (uchRequest >> 1 & 0xF) != (uchRequest >> 5 & 1))
+		{
+			m_Stats.nProtocolErrors++;
+
+			NextState (StateLockout);
+
+			return;
+		}
+
+		if (!bAP && !m_bRead && m_nRegister == DP_TARGETSEL)
+		{
+			NextState (bResetState ? StateTargetSelTurn : StateLockout);
+
+			return;
+		}
+
+		if (!m_bSelected)
+		{
+			NextState (StateLockout);
+
+			return;
+		}
+
+		m_nAck = ACK_OK;
+		m_bCorruptParity = false;
+
+		bool bMemAP = bAP || (m_bRead && m_nRegister == DP_RDBUFF);
+		bool bExempt = !bAP && (m_bRead ? m_nRegister != DP_RDBUFF && m_nRegister != DP_RESEND
+						: m_nRegister == DP_ABORT);
+
+		// sticky flags block all transfers, but those to recover ([1] section B4.2.4)
+		if (   (m_nCtrlStat & CTRL_STAT_STICKY)
+		    && !bExempt)
+		{
+			m_nAck = ACK_FAULT;
+		}
+		else if (bMemAP && m_nErrorAfter > 0)
+		{
+			m_nErrorAfter--;
+		}
+		else if (bMemAP && m_nErrorCount > 0)
+		{
+			m_nErrorCount--;
+
+			switch (m_Error)
+			{
+			case ErrorWait:		m_nAck = ACK_WAIT;	break;
+			case ErrorFault:	m_nAck = ACK_FAULT;	break;
+			case ErrorParity:	m_bCorruptParity = true;	break;
+			}
+
+			if (m_nAck == ACK_FAULT)
+			{
+				m_nCtrlStat |= CTRL_STAT_STICKYERR;
+			}
+		}
+
+		if (m_nAck != ACK_OK)
+		{
+			if (m_nAck == ACK_WAIT)
+			{
+				m_Stats.nWaits++;
+			}
+			else
+			{
+				m_Stats.nFaults++;
+			}
+
+			// ([1] section B4.2.5)
+			if (m_nCtrlStat & CTRL_STAT_ORUNDETECT)
+			{
+				m_nCtrlStat |= CTRL_STAT_STICKYORUN;
+			}
+		}
+
+		if (bMemAP)
+		{
+			(m_bRead ? m_Stats.nAPReads : m_Stats.nAPWrites)++;
+		}
+		else
+		{
+			(m_bRead ? m_Stats.nDPReads : m_Stats.nDPWrites)++;
+		}
+
+		if (   m_bRead
+		    && m_nAck == ACK_OK)
+		{
+			m_nReadData = bAP ? ReadAP () : ReadDP ();
+
+			if (m_bCorruptParity)
+			{
+				m_Stats.nParityErrors++;
+			}
+		}
+
+		m_bAP = bAP;
+
+		NextState (StateTurnToAck);
+	}
+
+	uint32_t ReadDP (void)
+	{
+		switch (m_nRegister)
+		{
+		case DP_DPIDR:
+			return SWD_SIM_DPIDR;
+
+		case DP_CTRL_STAT:
+			if (m_nSelect & 0xF)
+			{
+				return 0;		// DPBANKSEL other than 0
+			}
+			return   m_nCtrlStat
+			       | (m_nCtrlStat & CTRL_STAT_CDBGPWRUPREQ) << 1	// power-up is immediate
+			       | (m_nCtrlStat & CTRL_STAT_CSYSPWRUPREQ) << 1;
+
+		case DP_RESEND:
+			return m_nReadData;
+
+		default:
+			return m_nReadBuffer;
+		}
+	}
+
+	// AP reads are posted, the result is returned by the next AP read or RDBUFF
+	uint32_t ReadAP (void)
+	{
+		uint32_t nResult = m_nReadBuffer;
+
+		m_nReadBuffer = 0;
+		if (!(m_nSelect >> 24))		// APSEL 0 only
+		{
+			switch ((m_nSelect & 0xF0) | m_nRegister)
+			{
+			case AP_CSW:	m_nReadBuffer = m_nCSW;		break;
+			case AP_TAR:	m_nReadBuffer = m_nTAR;		break;
+			case AP_IDR:	m_nReadBuffer = SWD_SIM_AP_IDR;	break;
+
+			case AP_DRW:
+				m_nReadBuffer = ReadWord (m_nTAR & ~3U);
+				IncrementTAR ();
+				break;
+			}
+		}
+
+		return nResult;
+	}
+
+	void Write (uint32_t nData)
+	{
+		if (!m_bAP)
+		{
+			switch (m_nRegister)
+			{
+			case DP_ABORT:
+				if (nData & ABORT_STKCMPCLR)	m_nCtrlStat &= ~CTRL_STAT_STICKYCMP;
+				if (nData & ABORT_STKERRCLR)	m_nCtrlStat &= ~CTRL_STAT_STICKYERR;
+				if (nData & ABORT_WDERRCLR)	m_nCtrlStat &= ~CTRL_STAT_WDATAERR;
+				if (nData & ABORT_ORUNERRCLR)	m_nCtrlStat &= ~CTRL_STAT_STICKYORUN;
+				break;
+
+			case DP_CTRL_STAT:
+				if (!(m_nSelect & 0xF))
+				{
+					m_nCtrlStat =   (m_nCtrlStat & CTRL_STAT_STICKY)
+						      | (nData & CTRL_STAT_WRITABLE);
+				}
+				break;
+
+			case DP_SELECT:
+				m_nSelect = nData;
+				break;
+			}
+
+			return;
+		}
+
+		if (m_nSelect >> 24)
+		{
+			return;
+		}
+
+		switch ((m_nSelect & 0xF0) | m_nRegister)
+		{
+		case AP_CSW:
+			m_nCSW = nData;
+			break;
+
+		case AP_TAR:
+			m_nTAR = nData;
+			break;
+
+		case AP_DRW: {
+			// the data is transferred on its byte lanes ([1] section C2.2.5)
+			uint32_t nMask = 0xFFFFFFFFU;
+			switch (m_nCSW & CSW_SIZE_MASK)
+			{
+			case CSW_SIZE_8BITS:	nMask = 0xFFU << (m_nTAR & 3) * 8;	break;
+			case CSW_SIZE_16BITS:	nMask = 0xFFFFU << (m_nTAR & 2) * 8;	break;
+			}
+
+			WriteWord (m_nTAR & ~3U, nData, nMask);
+			IncrementTAR ();
+			} break;
+		}
+	}
+
+	// wraps at the auto-increment boundary ([1] section C2.2.2)
+	void IncrementTAR (void)
+	{
+		if ((m_nCSW & CSW_ADDRINC_MASK) != CSW_ADDRINC_SINGLE)
+		{
+			return;
+		}
+
+		uint32_t nIncrement = 1U << (m_nCSW & CSW_SIZE_MASK);
+
+		m_nTAR = (m_nTAR & ~(AutoIncBoundary-1)) | ((m_nTAR + nIncrement) & (AutoIncBoundary-1));
+	}
+
+	uint32_t ReadWord (uint32_t nAddress)
+	{
+		if (nAddress - SWD_SIM_RAM_BASE < SWD_SIM_RAM_SIZE)
+		{
+			uint32_t nData;
+			memcpy (&nData, &m_RAM[nAddress - SWD_SIM_RAM_BASE], 4);
+
+			return nData;
+		}
+
+		if (nAddress == DHCSR)
+		{
+			return   m_nDHCSR
+			       | DHCSR_S_REGRDY
+			       | (m_nDHCSR & DHCSR_C_HALT ? DHCSR_S_HALT : 0);
+		}
+
+		if (   nAddress == DMA_SNIFF_DATA
+		    && (m_Registers[DMA_SNIFF_CTRL] & DMA_SNIFF_CTRL_OUT_INV))
+		{
+			return ~m_Registers[DMA_SNIFF_DATA];
+		}
+
+		std::map<uint32_t, uint32_t>::const_iterator it = m_Registers.find (nAddress);
+
+		return it != m_Registers.end () ? it->second : 0;
+	}
+
+	void WriteWord (uint32_t nAddress, uint32_t nData, uint32_t nMask)
+	{
+		if (nAddress - SWD_SIM_RAM_BASE < SWD_SIM_RAM_SIZE)
+		{
+			uint8_t *pData = &m_RAM[nAddress - SWD_SIM_RAM_BASE];
+			for (unsigned i = 0; i < 4; i++, nData >>= 8, nMask >>= 8)
+			{
+				if (nMask & 0xFF)
+				{
+					pData[i] = (uint8_t) nData;
+				}
+			}
+
+			return;
+		}
+
+		nData = (ReadWord (nAddress) & ~nMask) | (nData & nMask);
+
+		switch (nAddress)
+		{
+		case DHCSR:
+			if ((nData >> 16) == DHCSR_DBGKEY)
+			{
+				m_nDHCSR = nData & DHCSR_C_MASK;
+			}
+			break;
+
+		case DCRSR:
+			if ((nData & DCRSR_REGSEL_MASK) < CoreRegisters)
+			{
+				uint32_t *pRegister = &m_CoreRegister[nData & DCRSR_REGSEL_MASK];
+				if (nData & DCRSR_REGW_N_R)
+				{
+					*pRegister = m_Registers[DCRDR];
+				}
+				else
+				{
+					m_Registers[DCRDR] = *pRegister;
+				}
+			}
+			break;
+
+		default:
+			m_Registers[nAddress] = nData;
+
+			if (   nAddress >= DMA_BASE
+			    && nAddress < DMA_BASE + DMA_CHANNELS * DMA_CHANNEL_SIZE
+			    && (nAddress & (DMA_CHANNEL_SIZE-1)) == DMA_CTRL_TRIG
+			    && (nData & DMA_CTRL_EN))
+			{
+				TransferDMA (nAddress - DMA_CTRL_TRIG);
+			}
+			break;
+		}
+	}
+
+	// Feeds the read data to the sniffer, the data is not written
+	void TransferDMA (uint32_t nChannelBase)
+	{
+		uint32_t nCtrl = m_Registers[nChannelBase + DMA_CTRL_TRIG];
+		uint32_t nReadAddress = m_Registers[nChannelBase + DMA_READ_ADDR];
+		uint32_t nCount = m_Registers[nChannelBase + DMA_TRANS_COUNT];
+		unsigned nSize = 1U << (nCtrl >> DMA_CTRL_DATA_SIZE__SHIFT & 3);
+
+		uint32_t nSniffCtrl = m_Registers[DMA_SNIFF_CTRL];
+		bool bSniff =    (nCtrl & DMA_CTRL_SNIFF_EN)
+			      && (nSniffCtrl & DMA_SNIFF_CTRL_EN)
+			      && (nSniffCtrl >> 1 & 0xF) == (nChannelBase - DMA_BASE) / DMA_CHANNEL_SIZE;
+
+		// the CRC32R result with OUT_REV is the reflected CRC-32 of SWDCRC32()
+		uint32_t nCRC = ~m_Registers[DMA_SNIFF_DATA];
+		for (; nCount > 0; nCount--)
+		{
+			uint8_t Data[4];
+			ReadMemory (nReadAddress, Data, nSize);
+
+			if (bSniff)
+			{
+				nCRC = SWDCRC32 (nCRC, Data, nSize);
+			}
+
+			if (nCtrl & DMA_CTRL_INCR_READ)
+			{
+				nReadAddress += nSize;
+			}
+		}
+
+		m_Registers[DMA_SNIFF_DATA] = ~nCRC;
+		m_Registers[nChannelBase + DMA_READ_ADDR] = nReadAddress;
+		m_Registers[nChannelBase + DMA_TRANS_COUNT] = 0;
+	}
+
+	static unsigned Parity (uint32_t nValue)
+	{
+		nValue ^= nValue >> 16;
+		nValue ^= nValue >> 8;
+		nValue ^= nValue >> 4;
+		nValue ^= nValue >> 2;
+		nValue ^= nValue >> 1;
+
+		return nValue & 1;
+	}
+
+private:
+	// packet request bits
+	static constexpr unsigned BIT_APnDP		= 1 << 1;
+	static constexpr unsigned BIT_RnW		= 1 << 2;
+	static constexpr unsigned BIT_STOP		= 1 << 6;
+	static constexpr unsigned BIT_PARK		= 1 << 7;
+
+	static constexpr unsigned ACK_OK		= 0b001;
+	static constexpr unsigned ACK_WAIT		= 0b010;
+	static constexpr unsigned ACK_FAULT		= 0b100;
+
+	// DP register addresses (A[3:2])
+	static constexpr unsigned DP_DPIDR		= 0x0;	// read
+	static constexpr unsigned DP_ABORT		= 0x0;	// write
+	static constexpr unsigned DP_CTRL_STAT	= 0x4;
+	static constexpr unsigned DP_RESEND		= 0x8;	// read
+	static constexpr unsigned DP_SELECT		= 0x8;	// write
+	static constexpr unsigned DP_RDBUFF		= 0xC;	// read
+	static constexpr unsigned DP_TARGETSEL	= 0xC;	// write
+
+	static constexpr uint32_t ABORT_STKCMPCLR	= 1U << 1;
+	static constexpr uint32_t ABORT_STKERRCLR	= 1U << 2;
+	static constexpr uint32_t ABORT_WDERRCLR	= 1U << 3;
+	static constexpr uint32_t ABORT_ORUNERRCLR	= 1U << 4;
+
+	static constexpr uint32_t CTRL_STAT_ORUNDETECT	= 1U << 0;
+	static constexpr uint32_t CTRL_STAT_STICKYORUN	= 1U << 1;
+	static constexpr uint32_t CTRL_STAT_STICKYCMP	= 1U << 4;
+	static constexpr uint32_t CTRL_STAT_STICKYERR	= 1U << 5;
+	static constexpr uint32_t CTRL_STAT_WDATAERR	= 1U << 7;
+	static constexpr uint32_t CTRL_STAT_CDBGPWRUPREQ	= 1U << 28;
+	static constexpr uint32_t CTRL_STAT_CSYSPWRUPREQ	= 1U << 30;
+	static constexpr uint32_t CTRL_STAT_STICKY		=   CTRL_STAT_STICKYORUN | CTRL_STAT_STICKYCMP
+							  | CTRL_STAT_STICKYERR | CTRL_STAT_WDATAERR;
+	static constexpr uint32_t CTRL_STAT_WRITABLE	=   CTRL_STAT_ORUNDETECT | CTRL_STAT_CDBGPWRUPREQ
+							  | CTRL_STAT_CSYSPWRUPREQ;
+
+	// MEM-AP register addresses (APBANKSEL and A[3:2])
+	static constexpr unsigned AP_CSW		= 0x00;
+	static constexpr unsigned AP_TAR		= 0x04;
+	static constexpr unsigned AP_DRW		= 0x0C;
+	static constexpr unsigned AP_IDR		= 0xFC;
+
+	static constexpr uint32_t CSW_SIZE_MASK	= 0x7;
+	static constexpr uint32_t CSW_SIZE_8BITS	= 0;
+	static constexpr uint32_t CSW_SIZE_16BITS	= 1;
+	static constexpr uint32_t CSW_ADDRINC_MASK	= 0x3 << 4;
+	static constexpr uint32_t CSW_ADDRINC_SINGLE = 0x1 << 4;
+
+	static constexpr uint32_t AutoIncBoundary	= 1024;
+
+	// ARMv6-M debug registers
+	static constexpr uint32_t DHCSR		= 0xE000EDF0;
+	static constexpr uint32_t DHCSR_C_HALT	= 1U << 1;
+	static constexpr uint32_t DHCSR_C_MASK	= 0xF;
+	static constexpr uint32_t DHCSR_DBGKEY	= 0xA05F;
+	static constexpr uint32_t DHCSR_S_REGRDY	= 1U << 16;
+	static constexpr uint32_t DHCSR_S_HALT	= 1U << 17;
+	static constexpr uint32_t DCRSR		= 0xE000EDF4;
+	static constexpr uint32_t DCRSR_REGSEL_MASK	= 0x1F;
+	static constexpr uint32_t DCRSR_REGW_N_R	= 1U << 16;
+	static constexpr uint32_t DCRDR		= 0xE000EDF8;
+
+	// RP2040 peripherals ([2] sections 2.5 and 2.14)
+	static constexpr uint32_t RESETS_RESET_DONE	= 0x4000C008;
+	static constexpr uint32_t DMA_BASE		= 0x50000000;
+	static constexpr unsigned DMA_CHANNELS		= 12;
+	static constexpr uint32_t DMA_CHANNEL_SIZE	= 0x40;
+	static constexpr uint32_t DMA_READ_ADDR		= 0x00;
+	static constexpr uint32_t DMA_TRANS_COUNT	= 0x08;
+	static constexpr uint32_t DMA_CTRL_TRIG		= 0x0C;
+	static constexpr uint32_t DMA_CTRL_EN		= 1U << 0;
+	static constexpr unsigned DMA_CTRL_DATA_SIZE__SHIFT = 2;
+	static constexpr uint32_t DMA_CTRL_INCR_READ	= 1U << 4;
+	static constexpr uint32_t DMA_CTRL_SNIFF_EN	= 1U << 23;
+	static constexpr uint32_t DMA_SNIFF_CTRL	= 0x50000434;
+	static constexpr uint32_t DMA_SNIFF_CTRL_EN	= 1U << 0;
+	static constexpr uint32_t DMA_SNIFF_CTRL_OUT_INV = 1U << 11;
+	static constexpr uint32_t DMA_SNIFF_DATA	= 0x50000438;
+
+	static constexpr unsigned CoreRegisters	= 21;	// R0-R15, xPSR, MSP, PSP, -, CONTROL/PRIMASK
+
+	static constexpr uint64_t SelectionAlertLow	 = 0x86852D956209F392ULL;
+	static constexpr uint64_t SelectionAlertHigh = 0x19BC0EA2E3DDAFE9ULL;
+
+private:
+	uint32_t m_nTargetSel;
+
+	TState m_State;
+	unsigned m_nBitCount;		// in the current state
+	uint32_t m_nShift;
+	uint64_t m_nAlertLow;		// last 128 bits in the dormant state
+	uint64_t m_nAlertHigh;
+	unsigned m_nHighCycles;
+	bool m_bResetState;		// no packet since line reset
+	bool m_bSelected;
+
+	bool m_bAP;			// current transfer
+	bool m_bRead;
+	unsigned m_nRegister;
+	unsigned m_nAck;
+	uint32_t m_nReadData;
+	bool m_bCorruptParity;
+
+	uint32_t m_nCtrlStat;		// without the ACK bits
+	uint32_t m_nSelect;
+	uint32_t m_nReadBuffer;		// RDBUFF
+	uint32_t m_nCSW;
+	uint32_t m_nTAR;
+
+	std::vector<uint8_t> m_RAM;
+	std::map<uint32_t, uint32_t> m_Registers;
+	uint32_t m_nDHCSR;		// C_* bits
+	uint32_t m_CoreRegister[CoreRegisters];
+
+	TError m_Error;
+	unsigned m_nErrorAfter;
+	unsigned m_nErrorCount;
+
+	TStatistics m_Stats;
+};
+
+#endif
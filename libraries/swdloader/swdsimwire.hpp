@@ -0,0 +1,355 @@
+//
+// swdsimwire.hpp
+//
+// Host-side wire policy, which connects the SWD loader to simulated targets
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Selected by SWD_HOST_SIMULATION (see swdwire.h). The loader bit-bangs SWCLK
+// and SWDIO, which are forwarded to the targets on each rising edge of SWCLK.
+// A gang (more than one target) drives one SWDIO line per target instead.
+// Time is simulated: it advances only with the delays of the loader.
+//
+#ifndef _pico_swdsimwire_hpp
+#define _pico_swdsimwire_hpp
+
+#include <stdint.h>
+#include <assert.h>
+#include <vector>
+#include "swdpiomodel.hpp"
+#include "swdgangqueue.h"
+
+#define HIGH 1
+#define LOW  0
+
+#define SWD_SIM_SYSTEM_CLOCK	125000000U	// simulated clk_sys in Hz
+
+enum GPIOMode
+{
+	GPIOModeInput,
+	GPIOModeOutput
+};
+
+enum GPIOPull
+{
+	GPIOPullNone,
+	GPIOPullUp,
+	GPIOPullDown
+};
+
+class CSWDSimBus	/// SWCLK and SWDIO shared by the host and the simulated targets
+{
+public:
+	static CSWDSimBus *Get (void)
+	{
+		static CSWDSimBus Instance;
+		return &Instance;
+	}
+
+	/// \brief Attach a target to the bus, which is driven by the given pins
+	/// \note The SWDIO pin of the first target is bit-banged, the others are\n
+	///	  only reached by the gang (see CSWDSimGang).
+	void Connect (CSWDPIOModel::CTarget *pTarget, unsigned nClockPin, unsigned nDataPin)
+	{
+		assert (pTarget != 0);
+		assert (m_Targets.empty () || nClockPin == m_nClockPin);
+
+		if (m_Targets.empty ())
+		{
+			m_nDataPin = nDataPin;
+		}
+
+		m_Targets.push_back ({pTarget, nDataPin});
+		m_nClockPin = nClockPin;
+	}
+
+	/// \brief Detach all targets
+	void Disconnect (void)
+	{
+		m_Targets.clear ();
+	}
+
+	void SetLevel (unsigned nPin, unsigned nLevel)
+	{
+		if (nPin == m_nClockPin)
+		{
+			if (!m_nClockLevel && nLevel)
+			{
+				for (const TConnection &rConnection : m_Targets)
+				{
+					if (rConnection.nDataPin == m_nDataPin)
+					{
+						rConnection.pTarget->ClockEdge (m_bDataDriven, m_nDataLevel);
+					}
+				}
+
+				m_nClockEdges++;
+			}
+
+			m_nClockLevel = nLevel;
+		}
+		else if (nPin == m_nDataPin)
+		{
+			m_nDataLevel = nLevel;
+		}
+	}
+
+	void SetDriven (unsigned nPin, bool bDriven)
+	{
+		if (nPin == m_nDataPin)
+		{
+			m_bDataDriven = bDriven;
+		}
+	}
+
+	unsigned GetLevel (unsigned nPin)
+	{
+		if (nPin != m_nDataPin)
+		{
+			return nPin == m_nClockPin ? m_nClockLevel : LOW;
+		}
+
+		if (m_bDataDriven)
+		{
+			return m_nDataLevel;
+		}
+
+		return GetLineLevel (m_nDataPin);
+	}
+
+	/// \brief Clock the SWDIO lines nDataPinBase.. of a gang for one cycle
+	/// \param nDriven Bit mask of the lines driven by the host
+	/// \param nLevels Levels of the driven lines
+	/// \return Levels of all lines before the rising edge of SWCLK
+	unsigned ClockGang (unsigned nDataPinBase, unsigned nLines, unsigned nDriven, unsigned nLevels)
+	{
+		unsigned nSampled = 0;
+		for (unsigned i = 0; i < nLines; i++)
+		{
+			bool bDriven = !!(nDriven & (1U << i));
+			unsigned nLevel = bDriven ? nLevels >> i & 1 : GetLineLevel (nDataPinBase + i);
+			nSampled |= nLevel << i;
+
+			for (const TConnection &rConnection : m_Targets)
+			{
+				if (rConnection.nDataPin == nDataPinBase + i)
+				{
+					rConnection.pTarget->ClockEdge (bDriven, nLevel);
+				}
+			}
+		}
+
+		m_nClockEdges++;
+
+		return nSampled;
+	}
+
+	uint64_t GetClockEdges (void) const	{ return m_nClockEdges; }
+
+private:
+	CSWDSimBus (void)
+	:	m_nClockPin (0),
+		m_nDataPin (0),
+		m_nClockLevel (LOW),
+		m_nDataLevel (LOW),
+		m_bDataDriven (false),
+		m_nClockEdges (0)
+	{
+	}
+
+	// targets, which do not drive SWDIO, read as HIGH (pull-up)
+	unsigned GetLineLevel (unsigned nDataPin)
+	{
+		unsigned nLevel = HIGH;
+		for (const TConnection &rConnection : m_Targets)
+		{
+			if (rConnection.nDataPin == nDataPin)
+			{
+				nLevel &= rConnection.pTarget->GetLevel ();
+			}
+		}
+
+		return nLevel;
+	}
+
+private:
+	struct TConnection
+	{
+		CSWDPIOModel::CTarget *pTarget;
+		unsigned nDataPin;
+	};
+
+	std::vector<TConnection> m_Targets;
+
+	unsigned m_nClockPin;
+	unsigned m_nDataPin;
+	unsigned m_nClockLevel;
+	unsigned m_nDataLevel;
+	bool	 m_bDataDriven;
+
+	uint64_t m_nClockEdges;
+};
+
+class CSWDSimPin	/// Replaces GPIOPin, pins other than SWCLK and SWDIO are not connected
+{
+public:
+	CSWDSimPin (void) : m_nPin (0) {}
+
+	CSWDSimPin (unsigned nPin, GPIOMode Mode)
+	{
+		AssignPin (nPin);
+		SetMode (Mode);
+	}
+
+	void AssignPin (unsigned nPin)
+	{
+		m_nPin = nPin;
+	}
+
+	void SetMode (GPIOMode Mode, bool bInitialHigh = false)
+	{
+		CSWDSimBus::Get ()->SetDriven (m_nPin, Mode == GPIOModeOutput);
+		if (Mode == GPIOModeOutput)
+		{
+			CSWDSimBus::Get ()->SetLevel (m_nPin, bInitialHigh ? HIGH : LOW);
+		}
+	}
+
+	void SetPullMode (GPIOPull /* Pull */) {}	// SWDIO always reads HIGH, if not driven
+
+	void Write (bool bValue)
+	{
+		CSWDSimBus::Get ()->SetLevel (m_nPin, bValue ? HIGH : LOW);
+	}
+
+	bool Read (void)
+	{
+		return CSWDSimBus::Get ()->GetLevel (m_nPin) != LOW;
+	}
+
+private:
+	unsigned m_nPin;
+};
+
+class CSWDSimTimer	/// Replaces CTimer, counts simulated clk_sys cycles
+{
+public:
+	static CSWDSimTimer *Get (void)
+	{
+		static CSWDSimTimer Instance;
+		return &Instance;
+	}
+
+	void CycleDelay (uint32_t nCycles)	{ m_nCycles += nCycles; }
+	void DelayMicros (uint32_t nMicros)	{ m_nCycles += (uint64_t) nMicros * (SWD_SIM_SYSTEM_CLOCK / 1000000U); }
+	void MsDelay (uint32_t nMillis)		{ DelayMicros (nMillis * 1000U); }
+
+	/// \return Simulated time in microseconds
+	uint64_t GetClockTicks (void)		{ return m_nCycles / (SWD_SIM_SYSTEM_CLOCK / 1000000U); }
+
+private:
+	CSWDSimTimer (void) : m_nCycles (0) {}
+
+private:
+	uint64_t m_nCycles;
+};
+
+class CSWDSimNoEngine	/// Replaces CSWDPIO, there is no PIO on the host
+{
+public:
+	bool Initialize (unsigned /* nClockPin */, unsigned /* nDataPin */, unsigned /* nClockDivider */)
+	{
+		return false;
+	}
+
+	// not called, while Initialize() has failed
+	void SetClockDivider (unsigned /* nClockDivider */)		{ assert (0); }
+	unsigned GetClockRate (unsigned /* nSystemClock */) const	{ assert (0); return 0; }
+	bool HasDMA (void) const					{ return false; }
+	void WriteBits (uint32_t, unsigned, bool = true)		{ assert (0); }
+	unsigned WriteData (uint8_t, uint32_t)				{ assert (0); return 0; }
+	unsigned ReadData (uint8_t, uint32_t *, bool *)			{ assert (0); return 0; }
+	bool WriteBlock (uint8_t, const uint32_t *, unsigned)		{ assert (0); return false; }
+	unsigned Sync (void)						{ assert (0); return 0; }
+	void Recover (void)						{ assert (0); }
+};
+
+class CSWDSimGang : public CSWDGangQueue	/// Replaces CSWDGang, clocks the targets on the bus like swdgang.pio
+{
+public:
+	CSWDSimGang (void) : m_nDataPinBase (0), m_nTargets (0), m_nDivider (1) {}
+
+	bool Initialize (unsigned /* nClockPin */, unsigned nDataPinBase, unsigned nTargets,
+			 unsigned nClockDivider)
+	{
+		m_nDataPinBase = nDataPinBase;
+		m_nTargets = nTargets;
+		m_nDivider = nClockDivider;
+
+		Activate (nTargets);
+
+		return true;
+	}
+
+	void SetClockDivider (unsigned nClockDivider)
+	{
+		Sync ();
+
+		m_nDivider = nClockDivider;
+	}
+
+	unsigned GetClockRate (unsigned nSystemClock) const
+	{
+		return nSystemClock / (2 * m_nDivider);
+	}
+
+protected:
+	void Shift (const uint16_t *pTxBuffer, uint8_t *pRxBuffer, unsigned nCycles) override
+	{
+		for (unsigned i = 0; i < nCycles; i++)
+		{
+			pRxBuffer[i] = (uint8_t) CSWDSimBus::Get ()->ClockGang (m_nDataPinBase, m_nTargets,
+						pTxBuffer[i] >> GANG_CYCLE_DRIVEN__SHIFT & 0xFF,
+						pTxBuffer[i] >> GANG_CYCLE_LEVEL__SHIFT & 0xFF);
+		}
+
+		CSWDSimTimer::Get ()->CycleDelay (nCycles * 2 * m_nDivider);
+	}
+
+	void Delay (unsigned nMicros) override
+	{
+		CSWDSimTimer::Get ()->DelayMicros (nMicros);
+	}
+
+private:
+	unsigned m_nDataPinBase;
+	unsigned m_nTargets;
+	unsigned m_nDivider;
+};
+
+class CSWDSimWire	/// Wire policy for host builds (see swdwire.h)
+{
+public:
+	typedef CSWDSimPin TPin;
+	typedef CSWDSimTimer TTimer;
+	typedef CSWDSimNoEngine TPIO;
+	typedef CSWDSimGang TGang;
+
+	static uint32_t DisableInterrupts (void)	{ return 0; }
+	static void RestoreInterrupts (uint32_t /* nState */) {}
+
+	static unsigned GetSystemClock (void)		{ return SWD_SIM_SYSTEM_CLOCK; }
+};
+
+#endif
@@ -0,0 +1,87 @@
+//
+// swdtarget.cpp
+//
+// Descriptors of the debug targets supported by CSWDLoader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "swdtarget.h"
+#include <assert.h>
+
+//
+// References:
+//
+// [1] RP2040 Datasheet
+// [2] RP2350 Datasheet
+// [3] ARM Debug Interface Architecture Specification ADIv6.0, IHI 0074
+//
+
+// ADIv6 MEM-AP registers CSW, TAR and DRW are at offset 0xD00 of the AP ([3])
+#define ADIV6_AP_BANK_CSW	0xD00
+
+// RP2350 boot ROM lookup flag for Arm secure code ([2])
+#define RP2350_RT_FLAG_FUNC_ARM_SEC	0x0004
+
+static const TSWDTargetDescriptor s_Targets[] =
+{
+	{
+		"RP2040",
+		0x01002927, 0x0BC12477,		// each core has its own DP (instance 0 and 1)
+		1, {0x00000000},		// AP 0, bank 0 (ADIv5)
+		0x20000000, 0x42000,
+		0x10000000, 0x1000000,
+		0x13000000,
+		SWDRomLookupTable16, 0x14, 0,
+		true,
+		24000
+	},
+
+	{
+		"RP2350",
+		0x00040927, 0x4C013477,		// one DP, the cores are behind APs 0x2000 and 0x4000
+		2, {0x2000 | ADIV6_AP_BANK_CSW, 0x4000 | ADIV6_AP_BANK_CSW},
+		0x20000000, 0x82000,
+		0x10000000, 0x1000000,
+		0x14000000,
+		SWDRomLookupFunction, 0x16, RP2350_RT_FLAG_FUNC_ARM_SEC,
+		false,
+		24000
+	}
+};
+
+const TSWDTargetDescriptor *SWDGetTarget (unsigned nIndex)
+{
+	assert (nIndex < SWDGetTargetCount ());
+
+	return &s_Targets[nIndex];
+}
+
+unsigned SWDGetTargetCount (void)
+{
+	return sizeof s_Targets / sizeof s_Targets[0];
+}
+
+const TSWDTargetDescriptor *SWDFindTarget (uint32_t nTargetID, uint32_t nDPIDR)
+{
+	for (unsigned i = 0; i < SWDGetTargetCount (); i++)
+	{
+		if (   s_Targets[i].nTargetID == nTargetID
+		    && s_Targets[i].nDPIDR == nDPIDR)
+		{
+			return &s_Targets[i];
+		}
+	}
+
+	return 0;
+}
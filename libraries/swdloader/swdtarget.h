@@ -0,0 +1,69 @@
+//
+// swdtarget.h
+//
+// Descriptors of the debug targets supported by CSWDLoader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdtarget_h
+#define _pico_swdtarget_h
+
+#include <stdint.h>
+
+#define SWD_TARGET_MAX_APS	2
+
+enum TSWDRomLookup		/// How the boot ROM flash functions are found
+{
+	SWDRomLookupTable16,	///< 16-bit pointer to a table of 16-bit code/function pairs
+	SWDRomLookupFunction	///< 16-bit pointer to a lookup function (called by the flash stub)
+};
+
+struct TSWDTargetDescriptor	/// Describes a debug target, which is identified by TARGETID and DPIDR
+{
+	const char *pName;
+
+	uint32_t nTargetID;		///< TARGETSEL value without instance
+	uint32_t nDPIDR;
+
+	unsigned nAPCount;		///< MEM-APs (cores) behind one debug port
+	uint32_t APSelect[SWD_TARGET_MAX_APS];	///< DP SELECT value, which addresses CSW, TAR and DRW
+
+	uint32_t nRAMBase;
+	uint32_t nRAMSize;
+	uint32_t nFlashBase;
+	uint32_t nFlashSize;
+	uint32_t nFlashNoCacheBase;	///< XIP alias, which bypasses the cache
+
+	TSWDRomLookup RomLookup;
+	uint32_t nRomLookupPointer;	///< address of the 16-bit pointer in the boot ROM
+	uint32_t nRomLookupFlags;	///< 2nd parameter of the lookup function
+
+	bool bDMASniffer;		///< has the RP2040 DMA CRC sniffer (fast verification)
+
+	unsigned nMaxClockKHz;		///< highest SWCLK rate for this target
+};
+
+/// \param nIndex Index into the registry (0 .. SWDGetTargetCount()-1)
+/// \return Target descriptor
+const TSWDTargetDescriptor *SWDGetTarget (unsigned nIndex);
+
+/// \return Number of descriptors in the registry
+unsigned SWDGetTargetCount (void);
+
+/// \param nTargetID TARGETSEL value without instance
+/// \param nDPIDR Value read from DP DPIDR
+/// \return Target descriptor, or 0 if the target is not supported
+const TSWDTargetDescriptor *SWDFindTarget (uint32_t nTargetID, uint32_t nDPIDR);
+
+#endif
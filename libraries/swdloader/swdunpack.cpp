@@ -0,0 +1,243 @@
+//
+// swdunpack.cpp
+//
+// Streaming decompressor for heatshrink compressed program images
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// The bit stream is that of heatshrink (github.com/atomicobject/heatshrink),
+// MSB first. A tag bit of 1 is followed by a literal byte, a tag bit of 0
+// by a backref of (window bits) index-1 and (lookahead bits) count-1.
+//
+#include "swdunpack.h"
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define WINDOW_MASK	((1U << CSWDUnpacker::MaxWindowBits) - 1)
+
+#define MIN_WINDOW_BITS		4
+#define MIN_LOOKAHEAD_BITS	3
+
+CSWDUnpacker::CSWDUnpacker (TOutputHandler *pHandler, void *pParam)
+:	m_pHandler (pHandler),
+	m_pParam (pParam)
+{
+	Reset ();
+}
+
+void CSWDUnpacker::Reset (void)
+{
+	m_State = StateHeader;
+	m_nHeaderBytes = 0;
+	m_nWindowBits = 0;
+	m_nLookaheadBits = 0;
+	m_nImageSize = 0;
+
+	m_nBits = 0;
+	m_nBitCount = 0;
+	m_nIndex = 0;
+
+	memset (m_Window, 0, sizeof m_Window);		// backrefs before the start read 0
+	m_nOutput = 0;
+	m_nFlushed = 0;
+}
+
+bool CSWDUnpacker::Write (const void *pData, size_t nSize)
+{
+	const uint8_t *pData8 = (const uint8_t *) pData;
+	assert (pData8 != 0);
+
+	while (   nSize > 0
+	       && m_State != StateDone
+	       && m_State != StateError)
+	{
+		if (m_State == StateHeader)
+		{
+			m_Header[m_nHeaderBytes++] = *pData8++;
+			nSize--;
+
+			if (m_nHeaderBytes < SWD_UNPACK_HEADER_SIZE)
+			{
+				continue;
+			}
+
+			m_nWindowBits = m_Header[2];
+			m_nLookaheadBits = m_Header[3];
+			m_nImageSize =   (size_t) m_Header[4]
+				       | (size_t) m_Header[5] << 8
+				       | (size_t) m_Header[6] << 16
+				       | (size_t) m_Header[7] << 24;
+
+			if (   m_Header[0] != SWD_UNPACK_MAGIC0
+			    || m_Header[1] != SWD_UNPACK_MAGIC1
+			    || m_nWindowBits < MIN_WINDOW_BITS
+			    || m_nWindowBits > MaxWindowBits
+			    || m_nLookaheadBits < MIN_LOOKAHEAD_BITS
+			    || m_nLookaheadBits >= m_nWindowBits)
+			{
+				printf ("Invalid stream header (W%u L%u)", m_nWindowBits, m_nLookaheadBits);
+
+				m_State = StateError;
+
+				return false;
+			}
+
+			m_State = m_nImageSize > 0 ? StateTag : StateDone;
+
+			continue;
+		}
+
+		// fields are at most 16 bits long
+		while (nSize > 0 && m_nBitCount <= 24)
+		{
+			m_nBits = m_nBits << 8 | *pData8++;
+			m_nBitCount += 8;
+			nSize--;
+		}
+
+		while (Step ())
+		{
+			// decompress as far as possible
+		}
+	}
+
+	return m_State != StateError;
+}
+
+bool CSWDUnpacker::Finish (void)
+{
+	if (m_State != StateDone)
+	{
+		if (m_State != StateError)
+		{
+			printf ("Stream truncated (%u of %u bytes)", (unsigned) m_nOutput, (unsigned) m_nImageSize);
+		}
+
+		return false;
+	}
+
+	return Flush ();
+}
+
+// Decodes one literal or backref, returns false if more input is needed or on error
+bool CSWDUnpacker::Step (void)
+{
+	unsigned nValue;
+
+	switch (m_State)
+	{
+	case StateTag:
+		if (!GetBits (1, &nValue))
+		{
+			return false;
+		}
+		m_State = nValue ? StateLiteral : StateIndex;
+		return true;
+
+	case StateLiteral:
+		if (   !GetBits (8, &nValue)
+		    || !PutByte ((uint8_t) nValue))
+		{
+			return false;
+		}
+		m_State = m_nOutput < m_nImageSize ? StateTag : StateDone;
+		return m_State == StateTag;
+
+	case StateIndex:
+		if (!GetBits (m_nWindowBits, &m_nIndex))
+		{
+			return false;
+		}
+		m_State = StateCount;
+		return true;
+
+	case StateCount:
+		if (!GetBits (m_nLookaheadBits, &nValue))
+		{
+			return false;
+		}
+
+		for (unsigned nCount = nValue + 1; nCount > 0; nCount--)
+		{
+			if (m_nOutput == m_nImageSize)
+			{
+				printf ("Stream overruns image (%u bytes)", (unsigned) m_nImageSize);
+
+				m_State = StateError;
+
+				return false;
+			}
+
+			if (!PutByte (m_Window[(m_nOutput - m_nIndex - 1) & WINDOW_MASK]))
+			{
+				return false;
+			}
+		}
+		m_State = m_nOutput < m_nImageSize ? StateTag : StateDone;
+		return m_State == StateTag;
+
+	default:
+		return false;
+	}
+}
+
+bool CSWDUnpacker::GetBits (unsigned nCount, unsigned *pValue)
+{
+	assert (nCount <= 16);
+	if (m_nBitCount < nCount)
+	{
+		return false;
+	}
+
+	m_nBitCount -= nCount;
+
+	assert (pValue != 0);
+	*pValue = (m_nBits >> m_nBitCount) & ((1U << nCount) - 1);
+
+	return true;
+}
+
+bool CSWDUnpacker::PutByte (uint8_t uchByte)
+{
+	m_Window[m_nOutput++ & WINDOW_MASK] = uchByte;
+
+	// the window is passed on, before it is overwritten
+	if (   !(m_nOutput & WINDOW_MASK)
+	    && !Flush ())
+	{
+		m_State = StateError;
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CSWDUnpacker::Flush (void)
+{
+	if (m_nFlushed == m_nOutput)
+	{
+		return true;
+	}
+
+	size_t nStart = m_nFlushed & WINDOW_MASK;
+	size_t nSize = m_nOutput - m_nFlushed;
+	assert (nStart + nSize <= sizeof m_Window);
+
+	m_nFlushed = m_nOutput;
+
+	assert (m_pHandler != 0);
+	return (*m_pHandler) (&m_Window[nStart], nSize, m_pParam);
+}
@@ -0,0 +1,100 @@
+//
+// swdunpack.h
+//
+// Streaming decompressor for heatshrink compressed program images
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdunpack_h
+#define _pico_swdunpack_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stream header (8 bytes), followed by the heatshrink bit stream
+#define SWD_UNPACK_MAGIC0	'H'
+#define SWD_UNPACK_MAGIC1	'S'
+#define SWD_UNPACK_HEADER_SIZE	8		// magic, window bits, lookahead bits, size (LE)
+
+class CSWDUnpacker	/// Decompresses a heatshrink stream incrementally in a fixed window
+{
+public:
+	static const unsigned MaxWindowBits = 11;	///< 2 KB window, which is also the output block
+
+	/// \param pData Decompressed data
+	/// \param nSize Size of the data (a whole window, except at the end)
+	/// \param pParam User parameter
+	/// \return Operation successful? (stops decompression otherwise)
+	typedef bool TOutputHandler (const void *pData, size_t nSize, void *pParam);
+
+public:
+	/// \param pHandler Called with each complete window of decompressed data
+	/// \param pParam User parameter handed over to the handler
+	CSWDUnpacker (TOutputHandler *pHandler, void *pParam);
+
+	/// \brief Expect a new stream, starting with its header
+	void Reset (void);
+
+	/// \brief Feed the next chunk of the compressed stream
+	/// \param pData Pointer to the chunk
+	/// \param nSize Size of the chunk (any size)
+	/// \return Operation successful? (false on format errors or if the handler failed)
+	bool Write (const void *pData, size_t nSize);
+
+	/// \brief Pass the rest of the decompressed data to the handler
+	/// \return Operation successful? (false if the stream is incomplete)
+	bool Finish (void);
+
+	/// \return Size of the decompressed image (0 until the header has been received)
+	size_t GetImageSize (void) const		{ return m_nImageSize; }
+
+private:
+	bool Step (void);
+	bool GetBits (unsigned nCount, unsigned *pValue);
+	bool PutByte (uint8_t uchByte);
+	bool Flush (void);
+
+private:
+	TOutputHandler *m_pHandler;
+	void *m_pParam;
+
+	enum TState
+	{
+		StateHeader,
+		StateTag,
+		StateLiteral,
+		StateIndex,
+		StateCount,
+		StateDone,
+		StateError
+	};
+
+	TState m_State;
+
+	uint8_t m_Header[SWD_UNPACK_HEADER_SIZE];
+	unsigned m_nHeaderBytes;
+	unsigned m_nWindowBits;
+	unsigned m_nLookaheadBits;
+	size_t m_nImageSize;
+
+	uint32_t m_nBits;		// input, MSB first
+	unsigned m_nBitCount;
+	unsigned m_nIndex;		// of the current backref
+
+	uint8_t m_Window[1 << MaxWindowBits];
+	size_t m_nOutput;		// total bytes decompressed
+	size_t m_nFlushed;		// total bytes passed to the handler
+};
+
+#endif
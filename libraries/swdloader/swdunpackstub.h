@@ -0,0 +1,206 @@
+//
+// swdunpackstub.h
+//
+// Decompression stub for CSWDLoader, runs in SRAM of the target
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdunpackstub_h
+#define _pico_swdunpackstub_h
+
+#include <stdint.h>
+#include "swdflashstub.h"
+
+// Target SRAM layout, offsets in the area at the top of SRAM
+#define UNPACK_STUB_AREA_SIZE	0x2000U
+#define UNPACK_STUB_CODE	0x0000U
+#define UNPACK_STUB_CONTROL	0x0200U
+#define UNPACK_STUB_STACK_TOP	0x1000U
+#define UNPACK_STUB_RING	0x1000U		// compressed stream
+#define UNPACK_STUB_RING_SIZE	0x1000U
+
+// Flash images are decompressed into both sector buffers of the flash stub,
+// which are used as one ring. SRAM images are decompressed in place.
+#define UNPACK_STUB_WINDOW	FLASH_STUB_BUFFER (0)
+#define UNPACK_STUB_WINDOW_SIZE	0x2000U
+
+// Control block, the probe writes the stream to the ring and advances HEAD.
+// The stub advances TAIL, when it has consumed it, and sets STATUS to 1, when
+// the image is complete. All counts are in bytes and do not wrap.
+#define UNPACK_STUB_HEAD	0		// word index
+#define UNPACK_STUB_TAIL	1
+#define UNPACK_STUB_SIZE	2		// of the decompressed image
+#define UNPACK_STUB_POS		3		// bytes written (padded to a page for flash)
+#define UNPACK_STUB_DEST	4		// image (SRAM) or window (flash)
+#define UNPACK_STUB_MASK	5		// 0xFFFFFFFF (SRAM) or window size - 1 (flash)
+#define UNPACK_STUB_FLASH_OFFSET 6
+#define UNPACK_STUB_ERASE	7		// boot ROM functions, 0 for SRAM
+#define UNPACK_STUB_PROGRAM	8
+#define UNPACK_STUB_FLUSH	9
+#define UNPACK_STUB_ENTER_XIP	10
+#define UNPACK_STUB_WINDOW_BITS	11		// of the heatshrink stream
+#define UNPACK_STUB_LOOKAHEAD_BITS 12
+#define UNPACK_STUB_RING_BASE	13
+#define UNPACK_STUB_RING_MASK	14
+#define UNPACK_STUB_STATUS	15
+#define UNPACK_STUB_CONTROL_WORDS 16
+
+// Thumb code (ARMv6-M, runs on ARMv8-M too), R7 points to the control block.
+// R4 is the output position, R5/R6 hold the input bits. A completed flash
+// sector is erased and programmed by the stub, while the probe continues to
+// fill the ring. Backrefs are copied from the image or window (see CSWDUnpacker).
+//
+// start:	movs	r4, #0
+//		movs	r5, #0
+//		movs	r6, #0
+// loop:	ldr	r0, [r7, #8]
+//		cmp	r4, r0
+//		bhs	done
+//		movs	r0, #1
+//		bl	getbits
+//		cmp	r0, #0
+//		beq	backref
+//		movs	r0, #8
+//		bl	getbits
+//		bl	putbyte
+//		b	loop
+// backref:	ldr	r0, [r7, #44]
+//		bl	getbits
+//		adds	r0, #1
+//		mov	r9, r0
+//		ldr	r0, [r7, #48]
+//		bl	getbits
+//		adds	r0, #1
+//		mov	r8, r0
+// copy:	ldr	r0, [r7, #8]
+//		cmp	r4, r0
+//		bhs	done
+//		mov	r1, r9
+//		subs	r1, r4, r1
+//		ldr	r2, [r7, #20]
+//		ands	r1, r2
+//		ldr	r2, [r7, #16]
+//		ldrb	r0, [r2, r1]
+//		bl	putbyte
+//		mov	r0, r8
+//		subs	r0, #1
+//		mov	r8, r0
+//		bne	copy
+//		b	loop
+// done:	ldr	r0, [r7, #28]
+//		cmp	r0, #0
+//		beq	finish
+//		lsls	r0, r4, #20
+//		beq	flushed
+// pad:		lsls	r0, r4, #24
+//		beq	padded
+//		movs	r0, #0xFF
+//		ldr	r1, [r7, #20]
+//		ands	r1, r4
+//		ldr	r2, [r7, #16]
+//		strb	r0, [r2, r1]
+//		adds	r4, #1
+//		b	pad
+// padded:	bl	program
+// flushed:	ldr	r0, [r7, #36]
+//		blx	r0
+//		ldr	r0, [r7, #40]
+//		blx	r0
+// finish:	str	r4, [r7, #12]
+//		movs	r0, #1
+//		str	r0, [r7, #60]
+// halt:	b	halt
+//
+// getbits:	cmp	r5, r0
+//		bhs	have
+//		ldr	r1, [r7, #4]
+// wait:	ldr	r2, [r7, #0]
+//		cmp	r1, r2
+//		beq	wait
+//		ldr	r2, [r7, #56]
+//		ands	r2, r1
+//		ldr	r3, [r7, #52]
+//		ldrb	r2, [r3, r2]
+//		adds	r1, #1
+//		str	r1, [r7, #4]
+//		lsls	r6, r6, #8
+//		orrs	r6, r2
+//		adds	r5, #8
+//		b	getbits
+// have:	subs	r5, r5, r0
+//		movs	r1, r6
+//		lsrs	r1, r5
+//		movs	r2, #1
+//		lsls	r2, r0
+//		subs	r2, #1
+//		ands	r1, r2
+//		movs	r0, r1
+//		bx	lr
+//
+// putbyte:	push	{lr}
+//		ldr	r1, [r7, #20]
+//		ands	r1, r4
+//		ldr	r2, [r7, #16]
+//		strb	r0, [r2, r1]
+//		adds	r4, #1
+//		ldr	r1, [r7, #28]
+//		cmp	r1, #0
+//		beq	return
+//		lsls	r1, r4, #20
+//		bne	return
+//		bl	program
+// return:	pop	{pc}
+//
+// program:	push	{r4, r5, lr}
+//		subs	r4, #1
+//		lsrs	r4, r4, #12
+//		lsls	r4, r4, #12
+//		ldr	r0, [r7, #24]
+//		adds	r0, r0, r4
+//		movs	r1, #1
+//		lsls	r1, r1, #12
+//		movs	r2, #1
+//		lsls	r2, r2, #16
+//		movs	r3, #0xD8
+//		ldr	r5, [r7, #28]
+//		blx	r5
+//		ldr	r0, [r7, #24]
+//		adds	r0, r0, r4
+//		ldr	r1, [r7, #20]
+//		ands	r1, r4
+//		ldr	r2, [r7, #16]
+//		adds	r1, r1, r2
+//		ldr	r2, [sp, #0]
+//		subs	r2, r2, r4
+//		ldr	r5, [r7, #32]
+//		blx	r5
+//		pop	{r4, r5, pc}
+static const uint32_t UnpackStubCode[] =
+{
+	0x25002400, 0x68B82600, 0xD2244284, 0xF0002001, 0x2800F83A,
+	0x2008D005, 0xF835F000, 0xF84CF000, 0x6AF8E7F1, 0xF82FF000,
+	0x46813001, 0xF0006B38, 0x3001F82A, 0x68B84680, 0xD20C4284,
+	0x1A614649, 0x4011697A, 0x5C50693A, 0xF836F000, 0x38014640,
+	0xD1F04680, 0x69F8E7D7, 0xD0102800, 0xD00A0520, 0xD0060620,
+	0x697920FF, 0x693A4021, 0x34015450, 0xF000E7F6, 0x6A78F82F,
+	0x6AB84780, 0x60FC4780, 0x63F82001, 0x4285E7FE, 0x6879D20D,
+	0x4291683A, 0x6BBAD0FC, 0x6B7B400A, 0x31015C9A, 0x02366079,
+	0x35084316, 0x1A2DE7EF, 0x40E90031, 0x40822201, 0x40113A01,
+	0x47700008, 0x6979B500, 0x693A4021, 0x34015450, 0x290069F9,
+	0x0521D003, 0xF000D101, 0xBD00F801, 0x3C01B530, 0x03240B24,
+	0x190069B8, 0x03092101, 0x04122201, 0x69FD23D8, 0x69B847A8,
+	0x69791900, 0x693A4021, 0x9A001889, 0x6A3D1B12, 0xBD3047A8
+};
+
+#endif
@@ -0,0 +1,448 @@
+//
+// swdwatch.cpp
+//
+// Samples variables of a running target periodically via the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// The variables are read through the MEM-AP while the target runs. When a
+// client configures them, variables with close addresses are merged into
+// blocks, each of which is read with one block read, when any of its
+// variables is due. A sample, which could not be taken in time (SWD too
+// slow, frame buffer full, target gone), is counted as dropped.
+//
+// Frames (all values little-endian):
+//
+//	Configure	'W' 'C' count 0, count * (address:32 rate_hz:32 size:8 0 0 0)
+//	Stop		'W' 'S' 0 0
+//	Acknowledge	'W' 'A' status (0: OK) blocks
+//	Data		'W' 'D' sequence:16 timestamp_us:32 mask:32, value of each
+//			variable in the mask (size bytes, in the order of the request)
+//	Report		'W' 'R' count 0 window_us:32, count * (requested_hz:32
+//			achieved_hz:32 dropped:32)
+//
+#include "swdwatch.h"
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#define WATCH_MAGIC		'W'
+#define WATCH_CONFIGURE		'C'
+#define WATCH_STOP		'S'
+#define WATCH_ACK		'A'
+#define WATCH_DATA		'D'
+#define WATCH_REPORT		'R'
+
+#define WATCH_STATUS_OK		0
+#define WATCH_STATUS_INVALID	1
+
+#define WATCH_HEADER_SIZE	4
+#define WATCH_ENTRY_SIZE	12		// of a configure request
+#define WATCH_DATA_HEADER_SIZE	12
+#define WATCH_REPORT_HEADER_SIZE 8
+#define WATCH_REPORT_ENTRY_SIZE	12
+
+static uint32_t GetLE32 (const uint8_t *pData)
+{
+	return pData[0] | pData[1] << 8 | pData[2] << 16 | (uint32_t) pData[3] << 24;
+}
+
+static void PutLE32 (uint8_t *pData, uint32_t nValue)
+{
+	pData[0] = nValue & 0xFF;
+	pData[1] = (nValue >> 8) & 0xFF;
+	pData[2] = (nValue >> 16) & 0xFF;
+	pData[3] = nValue >> 24;
+}
+
+CSWDWatch::CSWDWatch (unsigned nClockPin, unsigned nDataPin, unsigned nClockRateKHz)
+:	m_nClockPin (nClockPin),
+	m_nDataPin (nDataPin),
+	m_nClockRateKHz (nClockRateKHz),
+	m_pLoader (0),
+	m_nVariables (0),
+	m_nBlocks (0),
+	m_bStarted (false),
+	m_nReportDue (0),
+	m_nWindowStart (0),
+	m_nRetryDue (0),
+	m_usSequence (0)
+{
+}
+
+CSWDWatch::~CSWDWatch (void)
+{
+	Detach ();
+}
+
+unsigned CSWDWatch::Process (const uint8_t *pRequest, unsigned nLength, uint8_t *pResponse)
+{
+	assert (pRequest != 0);
+	assert (pResponse != 0);
+
+	if (   nLength < WATCH_HEADER_SIZE
+	    || pRequest[0] != WATCH_MAGIC)
+	{
+		return 0;
+	}
+
+	uint8_t uchStatus = WATCH_STATUS_OK;
+	switch (pRequest[1])
+	{
+	case WATCH_CONFIGURE:
+		if (!Configure (pRequest, nLength))
+		{
+			uchStatus = WATCH_STATUS_INVALID;
+		}
+		break;
+
+	case WATCH_STOP:
+		if (m_nVariables > 0)
+		{
+			printf ("Data watch stopped\r\n");
+		}
+		m_nVariables = 0;
+		m_nBlocks = 0;
+		Detach ();
+		break;
+
+	default:
+		return 0;
+	}
+
+	pResponse[0] = WATCH_MAGIC;
+	pResponse[1] = WATCH_ACK;
+	pResponse[2] = uchStatus;
+	pResponse[3] = m_nBlocks;
+
+	return 4;
+}
+
+unsigned CSWDWatch::Poll (uint64_t nTimeUs, uint8_t *pFrame, unsigned nFrameSize)
+{
+	assert (pFrame != 0);
+
+	if (m_nVariables == 0)
+	{
+		return 0;
+	}
+
+	if (!m_bStarted)
+	{
+		for (unsigned i = 0; i < m_nVariables; i++)
+		{
+			m_Variables[i].nNextDue = nTimeUs;
+		}
+
+		m_nWindowStart = nTimeUs;
+		m_nReportDue = nTimeUs + ReportIntervalUs;
+		m_nRetryDue = 0;
+		m_bStarted = true;
+	}
+
+	// the report is sent even while the target is gone
+	if (   nTimeUs >= m_nReportDue
+	    && nFrameSize >= WATCH_REPORT_HEADER_SIZE + m_nVariables * WATCH_REPORT_ENTRY_SIZE)
+	{
+		return Report (nTimeUs, pFrame);
+	}
+
+	if (nTimeUs < m_nRetryDue)
+	{
+		return 0;
+	}
+
+	if (   m_pLoader == 0
+	    && !Attach ())
+	{
+		m_nRetryDue = nTimeUs + RetryIntervalUs;
+
+		return 0;
+	}
+
+	return Sample (nTimeUs, pFrame, nFrameSize);
+}
+
+uint64_t CSWDWatch::GetNextDue (void) const
+{
+	if (!m_bStarted)
+	{
+		return 0;
+	}
+
+	uint64_t nNextDue = m_nReportDue;
+	for (unsigned i = 0; i < m_nVariables; i++)
+	{
+		uint64_t nDue = m_Variables[i].nNextDue;
+		if (nDue < m_nRetryDue)
+		{
+			nDue = m_nRetryDue;
+		}
+
+		if (nDue < nNextDue)
+		{
+			nNextDue = nDue;
+		}
+	}
+
+	return nNextDue;
+}
+
+void CSWDWatch::Detach (void)
+{
+	delete m_pLoader;
+	m_pLoader = 0;
+}
+
+bool CSWDWatch::Attach (void)
+{
+	assert (m_pLoader == 0);
+	m_pLoader = new CSWDLoader (m_nClockPin, m_nDataPin, 0, m_nClockRateKHz);
+	assert (m_pLoader != 0);
+
+	if (!m_pLoader->Initialize ())
+	{
+		Detach ();
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CSWDWatch::Configure (const uint8_t *pRequest, unsigned nLength)
+{
+	// the old configuration is dropped, even if the new one is invalid
+	m_nVariables = 0;
+	m_nBlocks = 0;
+	m_bStarted = false;
+	m_usSequence = 0;
+
+	unsigned nCount = pRequest[2];
+	if (   nCount == 0
+	    || nCount > MaxVariables
+	    || nLength != WATCH_HEADER_SIZE + nCount * WATCH_ENTRY_SIZE)
+	{
+		return false;
+	}
+
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		const uint8_t *pEntry = pRequest + WATCH_HEADER_SIZE + i * WATCH_ENTRY_SIZE;
+
+		TVariable *pVar = &m_Variables[i];
+		pVar->nAddress = GetLE32 (pEntry);
+		pVar->nRateHz = GetLE32 (pEntry + 4);
+		pVar->nSize = pEntry[8];
+
+		if (   (pVar->nSize != 1 && pVar->nSize != 2 && pVar->nSize != 4)
+		    || pVar->nRateHz == 0
+		    || pVar->nRateHz > MaxRateHz
+		    || pVar->nAddress > 0xFFFFFFFFU - pVar->nSize)
+		{
+			return false;
+		}
+
+		pVar->nIntervalUs = 1000000 / pVar->nRateHz;
+		pVar->nNextDue = 0;
+		pVar->nSamples = 0;
+		pVar->nDropped = 0;
+	}
+
+	m_nVariables = nCount;
+	MergeBlocks ();
+
+	printf ("Data watch: %u variables in %u block reads\r\n", m_nVariables, m_nBlocks);
+
+	return true;
+}
+
+// Sorts the variables by address and merges neighbours into word aligned blocks
+void CSWDWatch::MergeBlocks (void)
+{
+	unsigned Order[MaxVariables];
+	for (unsigned i = 0; i < m_nVariables; i++)
+	{
+		unsigned j = i;
+		for (; j > 0 && m_Variables[Order[j-1]].nAddress > m_Variables[i].nAddress; j--)
+		{
+			Order[j] = Order[j-1];
+		}
+
+		Order[j] = i;
+	}
+
+	m_nBlocks = 0;
+	for (unsigned i = 0; i < m_nVariables; i++)
+	{
+		TVariable *pVar = &m_Variables[Order[i]];
+		uint32_t nStart = pVar->nAddress & ~3U;
+		uint32_t nEnd = (pVar->nAddress + pVar->nSize + 3) & ~3U;
+
+		if (m_nBlocks > 0)
+		{
+			TBlock *pBlock = &m_Blocks[m_nBlocks-1];
+			uint32_t nBlockEnd = pBlock->nAddress + pBlock->nWords * 4;
+
+			if (   nStart <= nBlockEnd + MergeGapBytes
+			    && nEnd - pBlock->nAddress <= MaxBlockBytes)
+			{
+				if (nEnd > nBlockEnd)
+				{
+					pBlock->nWords = (nEnd - pBlock->nAddress) / 4;
+				}
+
+				pVar->nBlock = m_nBlocks-1;
+
+				continue;
+			}
+		}
+
+		TBlock *pBlock = &m_Blocks[m_nBlocks];
+		pBlock->nAddress = nStart;
+		pBlock->nWords = (nEnd - nStart) / 4;
+
+		pVar->nBlock = m_nBlocks++;
+	}
+}
+
+unsigned CSWDWatch::Sample (uint64_t nTimeUs, uint8_t *pFrame, unsigned nFrameSize)
+{
+	assert (m_pLoader != 0);
+
+	// select the due variables and advance their schedule
+	uint32_t nMask = 0;
+	uint32_t nBlockMask = 0;
+	unsigned nLength = WATCH_DATA_HEADER_SIZE;
+	unsigned Offset[MaxVariables];
+	for (unsigned i = 0; i < m_nVariables; i++)
+	{
+		TVariable *pVar = &m_Variables[i];
+		if (nTimeUs < pVar->nNextDue)
+		{
+			continue;
+		}
+
+		// missed periods (and samples, which do not fit) are dropped
+		uint64_t nMissed = (nTimeUs - pVar->nNextDue) / pVar->nIntervalUs;
+		pVar->nDropped += nMissed;
+		pVar->nNextDue += (nMissed + 1) * pVar->nIntervalUs;
+
+		if (nLength + pVar->nSize > nFrameSize)
+		{
+			pVar->nDropped++;
+
+			continue;
+		}
+
+		nMask |= 1U << i;
+		nBlockMask |= 1U << pVar->nBlock;
+		Offset[i] = nLength;
+		nLength += pVar->nSize;
+	}
+
+	if (nMask == 0)
+	{
+		return 0;
+	}
+
+	// one block read per block with due variables
+	for (unsigned nBlock = 0; nBlock < m_nBlocks; nBlock++)
+	{
+		if (!(nBlockMask & (1U << nBlock)))
+		{
+			continue;
+		}
+
+		const TBlock *pBlock = &m_Blocks[nBlock];
+		if (!m_pLoader->ReadWords (pBlock->nAddress, m_Buffer, pBlock->nWords))
+		{
+			// the target may have been disconnected or powered off
+			for (unsigned i = 0; i < m_nVariables; i++)
+			{
+				if (nMask & (1U << i))
+				{
+					m_Variables[i].nDropped++;
+				}
+			}
+
+			Detach ();
+			m_nRetryDue = nTimeUs + RetryIntervalUs;
+
+			return 0;
+		}
+
+		for (unsigned i = 0; i < m_nVariables; i++)
+		{
+			const TVariable *pVar = &m_Variables[i];
+			if (   (nMask & (1U << i))
+			    && pVar->nBlock == nBlock)
+			{
+				memcpy (pFrame + Offset[i],
+					(const uint8_t *) m_Buffer + (pVar->nAddress - pBlock->nAddress),
+					pVar->nSize);
+			}
+		}
+	}
+
+	for (unsigned i = 0; i < m_nVariables; i++)
+	{
+		if (nMask & (1U << i))
+		{
+			m_Variables[i].nSamples++;
+		}
+	}
+
+	pFrame[0] = WATCH_MAGIC;
+	pFrame[1] = WATCH_DATA;
+	pFrame[2] = m_usSequence & 0xFF;
+	pFrame[3] = m_usSequence >> 8;
+	PutLE32 (pFrame + 4, (uint32_t) nTimeUs);
+	PutLE32 (pFrame + 8, nMask);
+
+	m_usSequence++;
+
+	return nLength;
+}
+
+// Achieved rates in the window since the last report, dropped samples since configured
+unsigned CSWDWatch::Report (uint64_t nTimeUs, uint8_t *pFrame)
+{
+	uint64_t nWindowUs = nTimeUs - m_nWindowStart;
+	assert (nWindowUs > 0);
+
+	pFrame[0] = WATCH_MAGIC;
+	pFrame[1] = WATCH_REPORT;
+	pFrame[2] = m_nVariables;
+	pFrame[3] = 0;
+	PutLE32 (pFrame + 4, (uint32_t) nWindowUs);
+
+	uint8_t *pEntry = pFrame + WATCH_REPORT_HEADER_SIZE;
+	for (unsigned i = 0; i < m_nVariables; i++)
+	{
+		TVariable *pVar = &m_Variables[i];
+
+		PutLE32 (pEntry, pVar->nRateHz);
+		PutLE32 (pEntry + 4, (uint32_t) ((pVar->nSamples * 1000000ULL + nWindowUs / 2) / nWindowUs));
+		PutLE32 (pEntry + 8, pVar->nDropped);
+		pEntry += WATCH_REPORT_ENTRY_SIZE;
+
+		pVar->nSamples = 0;
+	}
+
+	m_nWindowStart = nTimeUs;
+	m_nReportDue = nTimeUs + ReportIntervalUs;
+
+	return pEntry - pFrame;
+}
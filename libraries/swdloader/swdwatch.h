@@ -0,0 +1,122 @@
+//
+// swdwatch.h
+//
+// Samples variables of a running target periodically via the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdwatch_h
+#define _pico_swdwatch_h
+
+#include "swdloader.h"
+#include <stdint.h>
+
+class CSWDWatch	/// Data watch: samples target memory without halting, independent of the transport
+{
+public:
+	const static unsigned MaxVariables = 32;	///< Bits in the sample mask of a data frame
+	const static unsigned MaxRateHz = 10000;	///< Per variable
+	const static unsigned MergeGapBytes = 16;	///< Variables closer than this share a block read
+	const static unsigned MaxBlockBytes = 256;	///< Of a merged block read
+	const static unsigned ReportIntervalUs = 1000000;
+	const static unsigned RetryIntervalUs = 1000000;	///< After a failed attach or read
+
+	const static unsigned RequestSize = 4 + MaxVariables * 12;	///< Maximum
+	const static unsigned FrameSize = 8 + MaxVariables * 12;	///< Maximum (report frame)
+
+public:
+	/// \param nClockPin GPIO pin to which SWCLK is connected
+	/// \param nDataPin GPIO pin to which SWDIO is connected
+	/// \param nClockRateKHz Interface clock rate in KHz
+	/// \note The target is neither reset, nor halted.
+	CSWDWatch (unsigned nClockPin, unsigned nDataPin,
+		   unsigned nClockRateKHz = CSWDLoader::DefaultClockRateKHz);
+
+	~CSWDWatch (void);
+
+	/// \brief Execute a request of the client (configure or stop)
+	/// \param pRequest Request frame ('W', command, ...)
+	/// \param nLength Length of the request frame
+	/// \param pResponse Acknowledge frame is returned here (4 bytes)
+	/// \return Length of the acknowledge frame (0 if the request is not recognized)
+	unsigned Process (const uint8_t *pRequest, unsigned nLength, uint8_t *pResponse);
+
+	/// \brief Sample the variables, which are due, or generate the report
+	/// \param nTimeUs Current time in microseconds (the timestamp of the samples)
+	/// \param pFrame Data or report frame is returned here
+	/// \param nFrameSize Free space for the frame (samples, which do not fit, are dropped)
+	/// \return Length of the frame (0 if nothing is due)
+	/// \note Attaches to the target first.
+	unsigned Poll (uint64_t nTimeUs, uint8_t *pFrame, unsigned nFrameSize);
+
+	/// \return Has a client configured variables?
+	bool IsActive (void) const			{ return m_nVariables > 0; }
+
+	/// \return Time of the next sample or report in microseconds
+	uint64_t GetNextDue (void) const;
+
+	/// \brief Release the SWD pins (e.g. before another loader uses them)
+	/// \note The next Poll() attaches again, the missed samples are counted as dropped.
+	void Detach (void);
+
+private:
+	bool Attach (void);
+
+	bool Configure (const uint8_t *pRequest, unsigned nLength);
+	void MergeBlocks (void);
+
+	unsigned Sample (uint64_t nTimeUs, uint8_t *pFrame, unsigned nFrameSize);
+	unsigned Report (uint64_t nTimeUs, uint8_t *pFrame);
+
+private:
+	struct TVariable
+	{
+		uint32_t nAddress;
+		unsigned nSize;			// 1, 2 or 4
+		unsigned nRateHz;		// requested
+		unsigned nIntervalUs;
+		uint64_t nNextDue;
+		unsigned nBlock;		// index into m_Blocks
+		unsigned nSamples;		// in the current report window
+		uint32_t nDropped;		// since configured
+	};
+
+	struct TBlock
+	{
+		uint32_t nAddress;		// word aligned
+		unsigned nWords;
+	};
+
+private:
+	unsigned m_nClockPin;
+	unsigned m_nDataPin;
+	unsigned m_nClockRateKHz;
+
+	CSWDLoader *m_pLoader;			// while attached
+
+	TVariable m_Variables[MaxVariables];	// in the order of the request (bit in the mask)
+	unsigned m_nVariables;
+	TBlock m_Blocks[MaxVariables];
+	unsigned m_nBlocks;
+
+	bool m_bStarted;			// schedule initialized by the first Poll()
+	uint64_t m_nReportDue;
+	uint64_t m_nWindowStart;		// of the report window
+	uint64_t m_nRetryDue;			// after a failure, 0 if none
+	uint16_t m_usSequence;			// of the data frames
+
+	uint32_t m_Buffer[MaxBlockBytes / 4];
+};
+
+#endif
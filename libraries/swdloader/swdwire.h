@@ -0,0 +1,64 @@
+//
+// swdwire.h
+//
+// Selects the wire layer of the SWD loader at compile time
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// A wire policy provides the pin and timer classes, the PIO engines and the
+// interrupt control, which are used by CSWDLoader. Define SWD_HOST_SIMULATION
+// to build the loader on a host against a simulated debug port (swdsimwire.hpp).
+//
+#ifndef _pico_swdwire_h
+#define _pico_swdwire_h
+
+#ifdef SWD_HOST_SIMULATION
+
+#include "swdsimwire.hpp"
+
+typedef CSWDSimWire TSWDWire;
+
+#else
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "gpiopin.hpp"
+#include "ctimer.hpp"
+#include "swdpio.h"
+#include "swdgang.h"
+
+class CSWDPicoWire	/// Wire policy for the RP2040 (GPIO pins, system timer and PIO)
+{
+public:
+	typedef GPIOPin TPin;
+	typedef CTimer TTimer;
+	typedef CSWDPIO TPIO;
+	typedef CSWDGang TGang;
+
+	/// \return Previous interrupt state
+	static uint32_t DisableInterrupts (void)	{ return save_and_disable_interrupts (); }
+
+	/// \param nState Value returned by DisableInterrupts()
+	static void RestoreInterrupts (uint32_t nState)	{ restore_interrupts (nState); }
+
+	/// \return clk_sys rate in Hz
+	static unsigned GetSystemClock (void)		{ return clock_get_hz (clk_sys); }
+};
+
+typedef CSWDPicoWire TSWDWire;
+
+#endif
+
+#endif
@@ -0,0 +1,204 @@
+//
+// swdgang_test.cpp
+//
+// Loads an image into a gang of simulated RP2040s in lockstep and checks,
+// which targets are kept, if single lines answer WAIT or FAULT
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#include "swdloader.h"
+#include "swdsimtarget.hpp"
+#include "swdtest.h"
+#include <vector>
+
+#define CLOCK_PIN	2
+#define DATA_PIN_BASE	3		// one SWDIO line per target
+
+#define TARGETS		3
+#define ALL_TARGETS	((1U << TARGETS) - 1)
+
+#define WAIT_RETRIES	20		// as in swdgangqueue.cpp
+
+#define IMAGE_ADDRESS	SWD_SIM_RAM_BASE
+#define IMAGE_WORDS	1024
+
+static CSWDSimTarget s_Target[TARGETS];
+static uint32_t s_Image[IMAGE_WORDS];
+
+static bool CheckImage (unsigned nTarget)
+{
+	std::vector<uint32_t> Memory (IMAGE_WORDS);
+	s_Target[nTarget].ReadMemory (IMAGE_ADDRESS, Memory.data (), sizeof s_Image);
+
+	return memcmp (Memory.data (), s_Image, sizeof s_Image) == 0;
+}
+
+struct TInjection
+{
+	unsigned nTarget;
+	CSWDSimTarget::TError Error;
+	unsigned nAfter;
+	unsigned nCount;
+};
+
+// Starts with powered-up targets and cleared memory, injects the errors after
+// Initialize() and returns the mask of the targets, which are left after the load
+static unsigned LoadGang (bool *pOK, const TInjection *pInjections = 0, unsigned nInjections = 0)
+{
+	static const uint32_t Zero[IMAGE_WORDS] = {0};
+
+	for (unsigned i = 0; i < TARGETS; i++)
+	{
+		s_Target[i].PowerOnReset ();
+		s_Target[i].WriteMemory (IMAGE_ADDRESS, Zero, sizeof Zero);
+	}
+
+	CSWDLoader Loader (CLOCK_PIN, DATA_PIN_BASE, 0, 4000, TARGETS);
+	SWD_CHECK (Loader.Initialize ());
+	SWD_CHECK_EQUAL (Loader.GetTargetMask (), ALL_TARGETS);
+
+	for (unsigned i = 0; i < TARGETS; i++)
+	{
+		s_Target[i].ResetStatistics ();
+	}
+
+	for (unsigned i = 0; i < nInjections; i++)
+	{
+		s_Target[pInjections[i].nTarget].InjectError (pInjections[i].Error,
+							      pInjections[i].nAfter, pInjections[i].nCount);
+	}
+
+	*pOK = Loader.Load (s_Image, sizeof s_Image, IMAGE_ADDRESS);
+
+	for (unsigned i = 0; i < TARGETS; i++)
+	{
+		s_Target[i].InjectError (CSWDSimTarget::ErrorWait, 0, 0);
+	}
+
+	return Loader.GetTargetMask ();
+}
+
+static void TestLoad (void)
+{
+	bool bOK;
+	SWD_CHECK_EQUAL (LoadGang (&bOK), ALL_TARGETS);
+	SWD_CHECK (bOK);
+
+	for (unsigned i = 0; i < TARGETS; i++)
+	{
+		SWD_CHECK (CheckImage (i));
+		SWD_CHECK (!s_Target[i].IsHalted ());
+		SWD_CHECK_EQUAL (s_Target[i].GetStatistics ().nFaults, 0);
+	}
+}
+
+// A line, which answers WAIT, gets its transfers again, no target is dropped
+static void TestWait (void)
+{
+	static const TInjection Wait = {1, CSWDSimTarget::ErrorWait, 100, 3};
+
+	bool bOK;
+	SWD_CHECK_EQUAL (LoadGang (&bOK, &Wait, 1), ALL_TARGETS);
+	SWD_CHECK (bOK);
+
+	for (unsigned i = 0; i < TARGETS; i++)
+	{
+		SWD_CHECK (CheckImage (i));
+	}
+
+	SWD_CHECK_EQUAL (s_Target[0].GetStatistics ().nWaits, 0);
+	SWD_CHECK_EQUAL (s_Target[1].GetStatistics ().nWaits, 3);
+	SWD_CHECK_EQUAL (s_Target[2].GetStatistics ().nWaits, 0);
+	SWD_CHECK_EQUAL (s_Target[0].GetStatistics ().nFaults, 0);
+	SWD_CHECK_EQUAL (s_Target[2].GetStatistics ().nFaults, 0);
+}
+
+// Two lines answer WAIT at different transfers of the same run
+static void TestWaitStaggered (void)
+{
+	static const TInjection Waits[] =
+	{
+		{0, CSWDSimTarget::ErrorWait, 50, 1},
+		{2, CSWDSimTarget::ErrorWait, 60, 2}
+	};
+
+	bool bOK;
+	SWD_CHECK_EQUAL (LoadGang (&bOK, Waits, 2), ALL_TARGETS);
+	SWD_CHECK (bOK);
+
+	for (unsigned i = 0; i < TARGETS; i++)
+	{
+		SWD_CHECK (CheckImage (i));
+	}
+}
+
+// A line, which answers WAIT for longer than WAIT_RETRIES, is dropped
+static void TestWaitExhausted (void)
+{
+	static const TInjection Wait = {2, CSWDSimTarget::ErrorWait, 100, 1000};
+
+	bool bOK;
+	SWD_CHECK_EQUAL (LoadGang (&bOK, &Wait, 1), ALL_TARGETS & ~4U);
+	SWD_CHECK (bOK);
+
+	SWD_CHECK (CheckImage (0));
+	SWD_CHECK (CheckImage (1));
+	SWD_CHECK_EQUAL (s_Target[2].GetStatistics ().nWaits, WAIT_RETRIES + 1);
+}
+
+static void TestFault (void)
+{
+	static const TInjection Fault = {0, CSWDSimTarget::ErrorFault, 100, 1};
+
+	bool bOK;
+	SWD_CHECK_EQUAL (LoadGang (&bOK, &Fault, 1), ALL_TARGETS & ~1U);
+	SWD_CHECK (bOK);
+
+	SWD_CHECK (CheckImage (1));
+	SWD_CHECK (CheckImage (2));
+}
+
+static void TestParity (void)
+{
+	static const TInjection Parity = {1, CSWDSimTarget::ErrorParity, 100, 1};
+
+	bool bOK;
+	SWD_CHECK_EQUAL (LoadGang (&bOK, &Parity, 1), ALL_TARGETS & ~2U);
+	SWD_CHECK (bOK);
+
+	SWD_CHECK (CheckImage (0));
+	SWD_CHECK (CheckImage (2));
+}
+
+int main (void)
+{
+	for (unsigned i = 0; i < IMAGE_WORDS; i++)
+	{
+		s_Image[i] = i * 0x9E3779B9U;
+	}
+
+	for (unsigned i = 0; i < TARGETS; i++)
+	{
+		CSWDSimBus::Get ()->Connect (&s_Target[i], CLOCK_PIN, DATA_PIN_BASE + i);
+	}
+
+	TestLoad ();
+	TestWait ();
+	TestWaitStaggered ();
+	TestWaitExhausted ();
+	TestFault ();
+	TestParity ();
+
+	return SWDTestResult ("swdgang_test");
+}
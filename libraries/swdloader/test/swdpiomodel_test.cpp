@@ -0,0 +1,200 @@
+//
+// swdpiomodel_test.cpp
+//
+// Checks the bit sequences of the SWD PIO program (swd.pio) on its host model
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// A recording target logs each rising edge of SWCLK as a driven bit ('0', '1')
+// or as a bit, which it has driven itself ('L', 'H'). It replays a scripted
+// response on the cycles, in which the host has released SWDIO.
+//
+#include "swdpiomodel.hpp"
+#include "swdtest.h"
+#include <deque>
+#include <string>
+
+#define ACK_OK		0b001
+#define ACK_WAIT	0b010
+#define ACK_FAULT	0b100
+
+#define REQUEST_WRITE	0xA3		// DP write, address 0 (ABORT)
+#define REQUEST_READ	0xA5		// DP read, address 0 (DPIDR)
+
+class CRecordingTarget : public CSWDPIOModel::CTarget
+{
+public:
+	void ClockEdge (bool bHostDrives, unsigned nLevel) override
+	{
+		if (bHostDrives)
+		{
+			m_Trace += nLevel ? '1' : '0';
+		}
+		else
+		{
+			m_Trace += GetLevel () ? 'H' : 'L';
+			if (!m_Response.empty ())
+			{
+				m_Response.pop_front ();
+			}
+		}
+	}
+
+	unsigned GetLevel (void) override
+	{
+		return m_Response.empty () ? 1 : m_Response.front ();	// pull-up
+	}
+
+	void Respond (uint32_t nBits, unsigned nBitCount)
+	{
+		for (unsigned i = 0; i < nBitCount; i++)
+		{
+			m_Response.push_back ((nBits >> i) & 1);
+		}
+	}
+
+	const std::string &GetTrace (void) const	{ return m_Trace; }
+
+private:
+	std::deque<unsigned> m_Response;
+	std::string m_Trace;
+};
+
+// LSB first, with the characters for driven or target bits
+static std::string Bits (uint32_t nBits, unsigned nBitCount, bool bHost)
+{
+	std::string Result;
+	for (unsigned i = 0; i < nBitCount; i++)
+	{
+		unsigned nBit = (nBits >> i) & 1;
+		Result += bHost ? (nBit ? '1' : '0') : (nBit ? 'H' : 'L');
+	}
+
+	return Result;
+}
+
+static void TestWrite (void)
+{
+	const uint32_t nData = 0x12345678;
+
+	CRecordingTarget Target;
+	Target.Respond (0, 1);				// turnaround
+	Target.Respond (ACK_OK, 3);
+	Target.Respond (0, 1);				// turnaround
+
+	CSWDPIOModel Model (&Target);
+	Model.Transfer (REQUEST_WRITE, nData);
+	Model.Run ();
+
+	SWD_CHECK (Target.GetTrace () ==   Bits (REQUEST_WRITE, 8, true)
+					 + Bits (0, 1, false)
+					 + Bits (ACK_OK, 3, false)
+					 + Bits (0, 1, false)
+					 + Bits (nData, 32, true)
+					 + Bits (__builtin_parity (nData), 1, true));
+
+	uint32_t nWord;
+	SWD_CHECK (!Model.Pop (&nWord));		// no result for OK writes
+	SWD_CHECK (!Model.IsAckStalled ());
+}
+
+static void TestRead (bool bParityOK)
+{
+	const uint32_t nData = 0xCAFEF00D;
+	unsigned nParity = __builtin_parity (nData) ^ (bParityOK ? 0 : 1);
+
+	CRecordingTarget Target;
+	Target.Respond (0, 1);
+	Target.Respond (ACK_OK, 3);
+	Target.Respond (nData, 32);
+	Target.Respond (nParity, 1);
+
+	CSWDPIOModel Model (&Target);
+	Model.Transfer (REQUEST_READ);
+	Model.Run ();
+
+	// the turnaround back to the host follows the parity bit
+	const std::string &rTrace = Target.GetTrace ();
+	SWD_CHECK_EQUAL (rTrace.size (), 8 + 1 + 3 + 32 + 1 + 1);
+	SWD_CHECK (rTrace.compare (0, 45,   Bits (REQUEST_READ, 8, true)
+					  + Bits (0, 1, false)
+					  + Bits (ACK_OK, 3, false)
+					  + Bits (nData, 32, false)
+					  + Bits (nParity, 1, false)) == 0);
+
+	uint32_t nWord = 0;
+	SWD_CHECK (Model.Pop (&nWord));
+	SWD_CHECK_EQUAL (nWord, nData);
+	SWD_CHECK (Model.Pop (&nWord));
+	SWD_CHECK_EQUAL (nWord >> SWDPIO_PARITY__SHIFT, nParity);
+	SWD_CHECK (!Model.IsAckStalled ());
+}
+
+// The state machine stalls after the ACK and pushes it, there is no data phase
+static void TestAckFailure (unsigned nAck)
+{
+	CRecordingTarget Target;
+	Target.Respond (0, 1);
+	Target.Respond (nAck, 3);
+
+	CSWDPIOModel Model (&Target);
+	Model.Transfer (REQUEST_WRITE, 0xFFFFFFFF);
+	Model.Run ();
+
+	SWD_CHECK (Target.GetTrace () ==   Bits (REQUEST_WRITE, 8, true)
+					 + Bits (0, 1, false)
+					 + Bits (nAck, 3, false));
+
+	uint32_t nWord = 0;
+	SWD_CHECK (Model.Pop (&nWord));
+	SWD_CHECK_EQUAL (nWord >> SWDPIO_ACK__SHIFT, nAck);
+	SWD_CHECK (Model.IsAckStalled ());
+
+	// the data word is left in the TX FIFO, the driver restarts the machine
+	Model.Restart ();
+	SWD_CHECK (!Model.IsAckStalled ());
+	SWD_CHECK_EQUAL (Model.GetTxLevel (), 0);
+}
+
+// Line reset and a JTAG-to-SWD sequence are packed into inline command words
+static void TestRawBits (void)
+{
+	CRecordingTarget Target;
+
+	CSWDPIOModel Model (&Target);
+	Model.WriteBits (0xFFFFFFFF, 32);
+	Model.WriteBits (0xFFFFF, 20);
+	Model.WriteBits (0xE79E, 16);
+	Model.WriteBits (0, 2, false);
+	Model.Flush ();
+	Model.Run ();
+
+	SWD_CHECK (Target.GetTrace () ==   Bits (0xFFFFFFFF, 32, true)
+					 + Bits (0xFFFFF, 20, true)
+					 + Bits (0xE79E, 16, true)
+					 + Bits (0b11, 2, false));	// released, pulled up
+	SWD_CHECK_EQUAL (Model.GetClockEdges (), 32 + 20 + 16 + 2);
+}
+
+int main (void)
+{
+	TestWrite ();
+	TestRead (true);
+	TestRead (false);
+	TestAckFailure (ACK_WAIT);
+	TestAckFailure (ACK_FAULT);
+	TestRawBits ();
+
+	return SWDTestResult ("swdpiomodel_test");
+}
@@ -0,0 +1,272 @@
+//
+// swdsim_test.cpp
+//
+// Loads images through the bit-banged wire into a simulated RP2040 and
+// injects WAIT, FAULT and parity errors into the MEM-AP transfers
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// There is no boot ROM in the simulation, so only SRAM images are loaded. A flash
+// image is only compared with the one, which the target holds already.
+//
+#include "swdloader.h"
+#include "swdsimtarget.hpp"
+#include "swdtest.h"
+#include <vector>
+
+#define CLOCK_PIN	2
+#define DATA_PIN	3
+
+#define WAIT_RETRIES	20		// as in swdloader.cpp
+
+#define IMAGE_ADDRESS	SWD_SIM_RAM_BASE
+#define IMAGE_WORDS	1024
+#define READ_WORDS	16
+
+#define FLASH_ADDRESS		0x10000000
+#define FLASH_NOCACHE_ADDRESS	0x13000000	// RP2040
+
+#define AIRCR			0xE000ED0C
+#define AIRCR_RESET		0x05FA0004	// VECTKEY, SYSRESETREQ
+
+// the AP writes for halting, TAR and CSW setup and starting the image
+#define MAX_OVERHEAD	32
+
+static CSWDSimTarget s_Target;
+static bool s_bOverrunDetect;		// all transfers FAULT, while STICKYORUN is set
+static uint32_t s_Image[IMAGE_WORDS];
+
+static bool CheckImage (void)
+{
+	std::vector<uint32_t> Memory (IMAGE_WORDS);
+	s_Target.ReadMemory (IMAGE_ADDRESS, Memory.data (), sizeof s_Image);
+
+	return memcmp (Memory.data (), s_Image, sizeof s_Image) == 0;
+}
+
+static void ClearImage (void)
+{
+	static const uint32_t Zero[IMAGE_WORDS] = {0};
+	s_Target.WriteMemory (IMAGE_ADDRESS, Zero, sizeof Zero);
+}
+
+static void TestLoad (CSWDLoader &rLoader)
+{
+	ClearImage ();
+	s_Target.ResetStatistics ();
+
+	SWD_CHECK (rLoader.Load (s_Image, sizeof s_Image, IMAGE_ADDRESS));
+	SWD_CHECK (CheckImage ());
+	SWD_CHECK (!s_Target.IsHalted ());
+	SWD_CHECK_EQUAL (s_Target.GetCoreRegister (15), IMAGE_ADDRESS);	// PC
+
+	const CSWDSimTarget::TStatistics &rStats = s_Target.GetStatistics ();
+	SWD_CHECK (rStats.nAPWrites >= IMAGE_WORDS);
+	SWD_CHECK (rStats.nAPWrites <= IMAGE_WORDS + MAX_OVERHEAD);
+	SWD_CHECK_EQUAL (rStats.nWaits, 0);
+	SWD_CHECK_EQUAL (rStats.nFaults, 0);
+	SWD_CHECK_EQUAL (rStats.nParityErrors, 0);
+	SWD_CHECK_EQUAL (rStats.nProtocolErrors, 0);
+}
+
+// Single WAIT responses are retried (or the block is replayed after an overrun),
+// the image is loaded nevertheless
+static void TestWaitRetry (CSWDLoader &rLoader)
+{
+	ClearImage ();
+	s_Target.ResetStatistics ();
+	s_Target.InjectError (CSWDSimTarget::ErrorWait, 100, 3);
+
+	SWD_CHECK (rLoader.Load (s_Image, sizeof s_Image, IMAGE_ADDRESS));
+	SWD_CHECK (CheckImage ());
+
+	const CSWDSimTarget::TStatistics &rStats = s_Target.GetStatistics ();
+	SWD_CHECK_EQUAL (rStats.nWaits, 3);
+	if (!s_bOverrunDetect)
+	{
+		SWD_CHECK_EQUAL (rStats.nFaults, 0);
+		SWD_CHECK (rStats.nAPWrites <= IMAGE_WORDS + MAX_OVERHEAD);
+	}
+	else
+	{
+		SWD_CHECK (rStats.nAPWrites <= 2 * (IMAGE_WORDS + MAX_OVERHEAD));
+	}
+}
+
+// The transfer is given up after WAIT_RETRIES, the next operation must succeed
+// (with overrun detection, STICKYORUN has to be cleared for it)
+static void TestWaitExhausted (CSWDLoader &rLoader)
+{
+	s_Target.ResetStatistics ();
+	s_Target.InjectError (CSWDSimTarget::ErrorWait, 10, 1000);
+
+	SWD_CHECK (!rLoader.Load (s_Image, sizeof s_Image, IMAGE_ADDRESS));
+
+	// the posted write, which has overrun, is not retried itself
+	SWD_CHECK_EQUAL (s_Target.GetStatistics ().nWaits, WAIT_RETRIES + 1 + s_bOverrunDetect);
+
+	s_Target.InjectError (CSWDSimTarget::ErrorWait, 0, 0);
+
+	uint32_t Buffer[READ_WORDS];
+	SWD_CHECK (rLoader.ReadBlock (IMAGE_ADDRESS, Buffer, READ_WORDS));
+}
+
+// FAULT sets STICKYERR, which must be cleared for the next operation
+static void TestFault (CSWDLoader &rLoader)
+{
+	s_Target.ResetStatistics ();
+	s_Target.InjectError (CSWDSimTarget::ErrorFault, 10);
+
+	SWD_CHECK (!rLoader.Load (s_Image, sizeof s_Image, IMAGE_ADDRESS));
+
+	const CSWDSimTarget::TStatistics &rStats = s_Target.GetStatistics ();
+	SWD_CHECK (rStats.nFaults >= 1);
+	SWD_CHECK (rStats.nAPWrites < IMAGE_WORDS);	// stopped at the fault
+
+	TestLoad (rLoader);
+}
+
+// A write with a wrong parity sets WDATAERR, the next transfer gets FAULT.
+// With overrun detection the block is replayed and the load succeeds.
+static void TestWriteParity (CSWDLoader &rLoader)
+{
+	ClearImage ();
+	s_Target.ResetStatistics ();
+	s_Target.InjectError (CSWDSimTarget::ErrorParity, 10);
+
+	SWD_CHECK (rLoader.Load (s_Image, sizeof s_Image, IMAGE_ADDRESS) == s_bOverrunDetect);
+	SWD_CHECK (CheckImage () == s_bOverrunDetect);
+
+	const CSWDSimTarget::TStatistics &rStats = s_Target.GetStatistics ();
+	SWD_CHECK_EQUAL (rStats.nParityErrors, 1);
+	SWD_CHECK (rStats.nFaults >= 1);
+
+	TestLoad (rLoader);
+}
+
+static void TestReadParity (CSWDLoader &rLoader)
+{
+	uint32_t Buffer[READ_WORDS];
+
+	s_Target.ResetStatistics ();
+	s_Target.InjectError (CSWDSimTarget::ErrorParity, 2);
+
+	SWD_CHECK (!rLoader.ReadBlock (IMAGE_ADDRESS, Buffer, READ_WORDS));
+	SWD_CHECK_EQUAL (s_Target.GetStatistics ().nParityErrors, 1);
+
+	s_Target.ResetStatistics ();
+	memset (Buffer, 0, sizeof Buffer);
+
+	SWD_CHECK (rLoader.ReadBlock (IMAGE_ADDRESS, Buffer, READ_WORDS));
+	SWD_CHECK (memcmp (Buffer, s_Image, sizeof Buffer) == 0);
+
+	// posted reads: one more AP read than words, no DP read of RDBUFF
+	const CSWDSimTarget::TStatistics &rStats = s_Target.GetStatistics ();
+	SWD_CHECK_EQUAL (rStats.nAPReads, READ_WORDS + 1);
+	SWD_CHECK_EQUAL (rStats.nDPReads, 0);
+	SWD_CHECK_EQUAL (rStats.nParityErrors, 0);
+}
+
+// A flash image, which the target holds already, is not written, but the target
+// is reset, because the CRC has used its DMA. An SRAM image is always loaded.
+static void TestUpdateImage (CSWDLoader &rLoader)
+{
+	bool bChanged = false;
+	SWD_CHECK (rLoader.UpdateImage (s_Image, sizeof s_Image, IMAGE_ADDRESS, &bChanged));
+	SWD_CHECK (bChanged);
+	SWD_CHECK (CheckImage ());
+	SWD_CHECK (!s_Target.IsHalted ());
+
+	// the DMA reads flash through the non-caching XIP alias
+	s_Target.WriteMemory (FLASH_NOCACHE_ADDRESS, s_Image, sizeof s_Image);
+	s_Target.ResetStatistics ();
+
+	SWD_CHECK (rLoader.UpdateImage (s_Image, sizeof s_Image, FLASH_ADDRESS, &bChanged));
+	SWD_CHECK (!bChanged);
+	SWD_CHECK (s_Target.GetStatistics ().nAPWrites < MAX_OVERHEAD);
+
+	uint32_t nAIRCR = 0;
+	s_Target.ReadMemory (AIRCR, &nAIRCR, sizeof nAIRCR);
+	SWD_CHECK_EQUAL (nAIRCR, AIRCR_RESET);
+}
+
+// A streamed SRAM image in delta mode only writes the 1 KB blocks, which differ
+// from target memory, including a partial block at the end
+static void TestStreamDelta (CSWDLoader &rLoader)
+{
+	static const size_t ChunkSize = 100;
+	static const size_t BlockWords = 1024 / 4;
+
+	for (unsigned nChangedWord = BlockWords + 5; nChangedWord < IMAGE_WORDS; nChangedWord += 2*BlockWords)
+	{
+		s_Target.WriteMemory (IMAGE_ADDRESS, s_Image, sizeof s_Image);
+		s_Image[nChangedWord] ^= 0x5A5A5A5AU;
+		s_Target.ResetStatistics ();
+
+		size_t nImageSize = nChangedWord < 3*BlockWords ? sizeof s_Image : sizeof s_Image - 2*ChunkSize;
+
+		rLoader.SetDeltaMode (true);
+		SWD_CHECK (rLoader.BeginImage (IMAGE_ADDRESS, false));
+		for (size_t nOffset = 0; nOffset < nImageSize; nOffset += ChunkSize)
+		{
+			size_t nSize = nImageSize - nOffset < ChunkSize ? nImageSize - nOffset : ChunkSize;
+			SWD_CHECK (rLoader.WriteImage ((const uint8_t *) s_Image + nOffset, nSize));
+		}
+		SWD_CHECK (rLoader.EndImage ());
+		rLoader.SetDeltaMode (false);
+
+		SWD_CHECK (CheckImage ());
+		SWD_CHECK (s_Target.GetStatistics ().nAPWrites > 0);
+		SWD_CHECK (s_Target.GetStatistics ().nAPWrites <= BlockWords + 4*MAX_OVERHEAD);
+	}
+}
+
+static void TestLoader (bool bOverrunDetect)
+{
+	s_bOverrunDetect = bOverrunDetect;
+	s_Target.PowerOnReset ();
+	s_Target.InjectError (CSWDSimTarget::ErrorWait, 0, 0);
+
+	CSWDLoader Loader (CLOCK_PIN, DATA_PIN, 0, 4000);
+	Loader.SetOverrunDetect (bOverrunDetect);
+	SWD_CHECK (Loader.Initialize ());
+
+	TestLoad (Loader);
+	TestWaitRetry (Loader);
+	TestWaitExhausted (Loader);
+	TestFault (Loader);
+	TestWriteParity (Loader);
+	TestReadParity (Loader);
+
+	if (!bOverrunDetect)
+	{
+		TestUpdateImage (Loader);
+		TestStreamDelta (Loader);
+	}
+}
+
+int main (void)
+{
+	for (unsigned i = 0; i < IMAGE_WORDS; i++)
+	{
+		s_Image[i] = i * 0x9E3779B9U;
+	}
+
+	CSWDSimBus::Get ()->Connect (&s_Target, CLOCK_PIN, DATA_PIN);
+
+	TestLoader (false);
+	TestLoader (true);
+
+	return SWDTestResult ("swdsim_test");
+}
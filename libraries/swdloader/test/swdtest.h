@@ -0,0 +1,59 @@
+//
+// swdtest.h
+//
+// Minimal check macros for the host tests of the SWD loader
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+#ifndef _pico_swdtest_h
+#define _pico_swdtest_h
+
+#include <stdio.h>
+
+static unsigned s_nTestFailures = 0;
+
+#define SWD_CHECK(cond)								\
+	do									\
+	{									\
+		if (!(cond))							\
+		{								\
+			printf ("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			s_nTestFailures++;					\
+		}								\
+	}									\
+	while (0)
+
+#define SWD_CHECK_EQUAL(actual, expected)					\
+	do									\
+	{									\
+		unsigned long long nActual_ = (actual);				\
+		unsigned long long nExpected_ = (expected);			\
+		if (nActual_ != nExpected_)					\
+		{								\
+			printf ("%s:%d: %s is 0x%llX, expected 0x%llX\n",	\
+				__FILE__, __LINE__, #actual, nActual_, nExpected_); \
+			s_nTestFailures++;					\
+		}								\
+	}									\
+	while (0)
+
+/// \return Exit code of the test program
+static inline int SWDTestResult (const char *pName)
+{
+	printf ("%s: %s\n", pName, s_nTestFailures == 0 ? "passed" : "FAILED");
+
+	return s_nTestFailures == 0 ? 0 : 1;
+}
+
+#endif
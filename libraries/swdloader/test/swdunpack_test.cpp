@@ -0,0 +1,153 @@
+//
+// swdunpack_test.cpp
+//
+// Decompresses streams of bin2hs.py and compares them with the original image
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// Usage: swdunpack_test image stream [image stream ...]
+//
+// Each stream is fed whole, byte by byte (each backref straddles chunk edges)
+// and in random chunks. The image is larger than the output window, so that
+// the window wraps and backrefs reach across the wrap.
+//
+#include "swdunpack.h"
+#include "swdtest.h"
+#include <stdlib.h>
+#include <vector>
+
+struct TOutput
+{
+	std::vector<uint8_t> Data;
+	unsigned nCalls;
+	bool bShortBlock;		// a block smaller than the window has been passed
+	bool bBlockAfterShort;		// and another block after it
+};
+
+static bool OutputHandler (const void *pData, size_t nSize, void *pParam)
+{
+	TOutput *pOutput = (TOutput *) pParam;
+	const uint8_t *pData8 = (const uint8_t *) pData;
+
+	pOutput->bBlockAfterShort = pOutput->bBlockAfterShort || pOutput->bShortBlock;
+	pOutput->bShortBlock = pOutput->bShortBlock || nSize != 1U << CSWDUnpacker::MaxWindowBits;
+
+	pOutput->Data.insert (pOutput->Data.end (), pData8, pData8 + nSize);
+	pOutput->nCalls++;
+
+	return true;
+}
+
+static std::vector<uint8_t> ReadFile (const char *pFileName)
+{
+	std::vector<uint8_t> Data;
+
+	FILE *pFile = fopen (pFileName, "rb");
+	if (pFile == 0)
+	{
+		printf ("Cannot open %s\n", pFileName);
+		s_nTestFailures++;
+
+		return Data;
+	}
+
+	int nChar;
+	while ((nChar = fgetc (pFile)) != EOF)
+	{
+		Data.push_back ((uint8_t) nChar);
+	}
+
+	fclose (pFile);
+
+	return Data;
+}
+
+// nMaxChunk 0: whole stream
+static void TestDecode (const std::vector<uint8_t> &rImage, const std::vector<uint8_t> &rStream,
+			unsigned nMaxChunk)
+{
+	TOutput Output = {{}, 0, false, false};
+	CSWDUnpacker Unpacker (OutputHandler, &Output);
+
+	bool bOK = true;
+	for (size_t nOffset = 0; nOffset < rStream.size (); )
+	{
+		size_t nChunk = rStream.size () - nOffset;
+		if (nMaxChunk > 0)
+		{
+			size_t nRandom = nMaxChunk == 1 ? 1 : 1 + rand () % nMaxChunk;
+			nChunk = nChunk < nRandom ? nChunk : nRandom;
+		}
+
+		bOK = bOK && Unpacker.Write (&rStream[nOffset], nChunk);
+		nOffset += nChunk;
+	}
+
+	SWD_CHECK (bOK);
+	SWD_CHECK (Unpacker.Finish ());
+	SWD_CHECK_EQUAL (Unpacker.GetImageSize (), rImage.size ());
+	SWD_CHECK (Output.Data == rImage);
+	SWD_CHECK (!Output.bBlockAfterShort);		// only the last block is short
+}
+
+// Finish() fails, if the end of the stream is missing
+static void TestTruncated (const std::vector<uint8_t> &rStream)
+{
+	TOutput Output = {{}, 0, false, false};
+	CSWDUnpacker Unpacker (OutputHandler, &Output);
+
+	SWD_CHECK (Unpacker.Write (&rStream[0], rStream.size () / 2));
+	SWD_CHECK (!Unpacker.Finish ());
+}
+
+static void TestInvalidHeader (void)
+{
+	static const uint8_t Header[SWD_UNPACK_HEADER_SIZE] = {'H', 'S', 15, 4, 1, 0, 0, 0};
+
+	TOutput Output = {{}, 0, false, false};
+	CSWDUnpacker Unpacker (OutputHandler, &Output);
+
+	SWD_CHECK (!Unpacker.Write (Header, sizeof Header));	// window too large
+}
+
+int main (int argc, char **argv)
+{
+	SWD_CHECK (argc >= 3 && argc % 2 == 1);
+
+	srand (1);
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::vector<uint8_t> Image = ReadFile (argv[i]);
+		std::vector<uint8_t> Stream = ReadFile (argv[i+1]);
+		if (   Image.size () <= 1U << CSWDUnpacker::MaxWindowBits
+		    || Stream.size () <= SWD_UNPACK_HEADER_SIZE)
+		{
+			printf ("%s is too small for the test\n", argv[i]);
+			s_nTestFailures++;
+
+			continue;
+		}
+
+		TestDecode (Image, Stream, 0);
+		TestDecode (Image, Stream, 1);
+		TestDecode (Image, Stream, 7);
+		TestDecode (Image, Stream, 300);
+		TestTruncated (Stream);
+	}
+
+	TestInvalidHeader ();
+
+	return SWDTestResult ("swdunpack_test");
+}
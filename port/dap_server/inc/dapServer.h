@@ -0,0 +1,42 @@
+/**
+ @file		dapServer.h
+ @brief 	CMSIS-DAP server over TCP, the commands are executed by the SWD loader.
+
+ Each packet starts with a header of 8 bytes (little endian), followed by the
+ CMSIS-DAP request or response (the framing of the "cmsis-dap tcp" backend of
+ OpenOCD):
+
+   0..3  signature 0x00504144 ("DAP\0")
+   4..5  length of the request or response
+   6     packet type (1: request, 2: response)
+   7     reserved (0)
+
+ The transfers of a request packet are executed in one pass, the response
+ returns all results (see swddap.h).
+ */
+
+#include <stdint.h>
+
+#ifndef	__DAPSERVER_H__
+#define	__DAPSERVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DAP_SERVER_PORT				4441
+
+#define DAP_PACKET_SIGNATURE		0x00504144
+#define DAP_PACKET_HEADER_SIZE		8
+#define DAP_PACKET_TYPE_REQUEST		0x01
+#define DAP_PACKET_TYPE_RESPONSE	0x02
+#define DAP_PACKET_MAX_SIZE			1024	// CSWDDAP::PacketSize
+
+void dapServer_init(uint8_t sn);
+void dapServer_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "socket.h"
+#include "wizchip_conf.h"
+
+#include "dapServer.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+static uint8_t DAPSock_Num = 0;
+static bool dap_session = false;		/**< Host has sent requests on this connection */
+
+static uint8_t dap_rx_buf[DAP_PACKET_HEADER_SIZE + DAP_PACKET_MAX_SIZE];
+static uint16_t dap_rx_len = 0;			/**< Bytes of the current packet received so far */
+static uint16_t dap_request_len = 0;	/**< From the header of the current packet */
+
+static uint8_t dap_tx_buf[DAP_PACKET_HEADER_SIZE + DAP_PACKET_MAX_SIZE];
+
+/* Executed on core 1 (see swd-interface.cpp) */
+extern bool swdloader_dap_process(const uint8_t* request, size_t length, uint8_t* response, size_t* response_length);
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+static uint32_t get_le32(const uint8_t *buf)
+{
+	return buf[0] | buf[1] << 8 | buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+static void put_header(uint8_t *buf, uint16_t len)
+{
+	buf[0] = (uint8_t)DAP_PACKET_SIGNATURE;
+	buf[1] = (uint8_t)(DAP_PACKET_SIGNATURE >> 8);
+	buf[2] = (uint8_t)(DAP_PACKET_SIGNATURE >> 16);
+	buf[3] = (uint8_t)(DAP_PACKET_SIGNATURE >> 24);
+	buf[4] = (uint8_t)len;
+	buf[5] = (uint8_t)(len >> 8);
+	buf[6] = DAP_PACKET_TYPE_RESPONSE;
+	buf[7] = 0;
+}
+
+static void dap_send_response(uint8_t sn)
+{
+	size_t len;
+	if (!swdloader_dap_process(dap_rx_buf + DAP_PACKET_HEADER_SIZE, dap_request_len,
+				   dap_tx_buf + DAP_PACKET_HEADER_SIZE, &len))
+	{
+		// SWD loader busy with an upload
+		dap_tx_buf[DAP_PACKET_HEADER_SIZE] = 0xFF;	// ID_DAP_Invalid
+		len = 1;
+	}
+
+	dap_session = true;
+
+	if (len == 0)
+	{
+		return;		// command without response (DAP_TransferAbort)
+	}
+
+	put_header(dap_tx_buf, len);
+
+	send(sn, dap_tx_buf, DAP_PACKET_HEADER_SIZE + len);
+}
+
+// Receives the next part of a packet, returns true, if there may be more data
+static bool dap_receive(uint8_t sn)
+{
+	uint16_t len = getSn_RX_RSR(sn);
+	if (len == 0)
+	{
+		return false;
+	}
+
+	uint16_t needed = dap_rx_len < DAP_PACKET_HEADER_SIZE ? DAP_PACKET_HEADER_SIZE - dap_rx_len
+							      : DAP_PACKET_HEADER_SIZE + dap_request_len - dap_rx_len;
+	if (len > needed) len = needed;
+
+	int32_t ret = recv(sn, dap_rx_buf + dap_rx_len, len);
+	if (ret <= 0)
+	{
+		return false;
+	}
+
+	dap_rx_len += ret;
+
+	if (dap_rx_len == DAP_PACKET_HEADER_SIZE)
+	{
+		dap_request_len = dap_rx_buf[4] | dap_rx_buf[5] << 8;
+
+		if (   get_le32(dap_rx_buf) != DAP_PACKET_SIGNATURE
+		    || dap_rx_buf[6] != DAP_PACKET_TYPE_REQUEST
+		    || dap_request_len == 0
+		    || dap_request_len > DAP_PACKET_MAX_SIZE)
+		{
+			printf("> DAPSocket[%d] : Invalid packet header\r\n", sn);
+			disconnect(sn);
+			dap_rx_len = 0;
+
+			return false;
+		}
+	}
+
+	if (   dap_rx_len > DAP_PACKET_HEADER_SIZE
+	    && dap_rx_len == DAP_PACKET_HEADER_SIZE + dap_request_len)
+	{
+		dap_send_response(sn);
+		dap_rx_len = 0;
+	}
+
+	return true;
+}
+
+// Releases the SWD pins, when the host has gone
+static void dap_end_session(void)
+{
+	if (dap_session)
+	{
+		static const uint8_t disconnect_request[] = {0x03};	// ID_DAP_Disconnect
+		size_t len;
+
+		swdloader_dap_process(disconnect_request, sizeof disconnect_request,
+				      dap_tx_buf + DAP_PACKET_HEADER_SIZE, &len);
+		dap_session = false;
+	}
+
+	dap_rx_len = 0;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+void dapServer_init(uint8_t sn)
+{
+	DAPSock_Num = sn;
+}
+
+void dapServer_run(void)
+{
+	uint8_t sn = DAPSock_Num;
+
+	switch(getSn_SR(sn))
+	{
+		case SOCK_ESTABLISHED:
+			// Interrupt clear
+			if(getSn_IR(sn) & Sn_IR_CON)
+			{
+				setSn_IR(sn, Sn_IR_CON);
+				printf("> DAPSocket[%d] : Connected\r\n", sn);
+				dap_rx_len = 0;
+			}
+
+			// all complete packets, the SWD work is done on core 1
+			while(dap_receive(sn))
+			{
+			}
+			break;
+
+		case SOCK_CLOSE_WAIT:
+			dap_end_session();
+			disconnect(sn);
+			break;
+
+		case SOCK_CLOSED:
+			dap_end_session();
+			if(socket(sn, Sn_MR_TCP, DAP_SERVER_PORT, 0x00) == sn)
+			{
+				printf("> DAPSocket[%d] : OPEN (port %d)\r\n", sn, DAP_SERVER_PORT);
+			}
+			break;
+
+		case SOCK_INIT:
+			listen(sn);
+			break;
+
+		default :
+			break;
+	}
+}
@@ -0,0 +1,35 @@
+/**
+ @file		gdbServer.h
+ @brief 	GDB remote serial protocol server over TCP, the packets are executed by the SWD loader.
+
+ Connect with "target extended-remote <probe address>:3333" (or "target remote").
+ The server attaches to the running target without resetting it and halts it.
+ Breakpoints use the FPB of the target, memory can be read and written, flash
+ programming is not supported (use the HTTP upload).
+
+ The framing ($data#checksum), the acknowledgments and Ctrl-C are handled
+ here, the packets are executed on core 1 (see swdgdb.h).
+ */
+
+#include <stdint.h>
+
+#ifndef	__GDBSERVER_H__
+#define	__GDBSERVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GDB_SERVER_PORT				3333
+
+#define GDB_PACKET_MAX_SIZE			1024	// CSWDGDB::PacketSize
+#define GDB_POLL_INTERVAL_MS		20		// while the target runs
+
+void gdbServer_init(uint8_t sn);
+void gdbServer_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
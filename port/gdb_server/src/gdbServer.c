@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "pico/time.h"
+
+#include "socket.h"
+#include "wizchip_conf.h"
+
+#include "gdbServer.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+enum gdb_rx_state
+{
+	GDB_RX_IDLE,						/**< Between packets */
+	GDB_RX_DATA,
+	GDB_RX_ESCAPE,						/**< After '}' */
+	GDB_RX_CHECKSUM1,
+	GDB_RX_CHECKSUM2
+};
+
+static uint8_t GDBSock_Num = 0;
+static bool gdb_session = false;		/**< Host has sent packets on this connection */
+static bool gdb_no_ack = false;			/**< QStartNoAckMode has been accepted */
+static bool gdb_running = false;		/**< Target runs, a stop reply is pending */
+static bool gdb_interrupt = false;		/**< Host has sent Ctrl-C */
+static uint32_t gdb_poll_time = 0;
+
+static enum gdb_rx_state gdb_rx_state = GDB_RX_IDLE;
+static char gdb_rx_buf[GDB_PACKET_MAX_SIZE];
+static uint16_t gdb_rx_len = 0;
+static bool gdb_rx_overflow = false;
+static uint8_t gdb_rx_sum = 0;			/**< Computed over the packet data */
+static uint8_t gdb_rx_checksum = 0;		/**< Received after '#' */
+
+static char gdb_response[GDB_PACKET_MAX_SIZE];
+static uint8_t gdb_tx_buf[1 + 2 * GDB_PACKET_MAX_SIZE + 3];	/**< All characters escaped */
+static uint16_t gdb_tx_len = 0;			/**< Last packet, sent again on '-' */
+
+static const char gdb_hex_digits[] = "0123456789abcdef";
+
+/* Executed on core 1 (see swd-interface.cpp) */
+extern bool swdloader_gdb_process(const char* packet, size_t length, char* response, size_t* response_length);
+extern bool swdloader_gdb_poll(bool interrupt, char* response, size_t* response_length);
+extern void swdloader_gdb_detach(void);
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+static int hex_value(uint8_t ch)
+{
+	if (ch >= '0' && ch <= '9') return ch - '0';
+	if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+
+	return 0;
+}
+
+static void gdb_send_packet(uint8_t sn, const char *data, size_t len)
+{
+	uint8_t sum = 0;
+	uint16_t n = 0;
+
+	gdb_tx_buf[n++] = '$';
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t ch = data[i];
+		if (ch == '$' || ch == '#' || ch == '}' || ch == '*')
+		{
+			gdb_tx_buf[n++] = '}';
+			sum += '}';
+			ch ^= 0x20;
+		}
+
+		gdb_tx_buf[n++] = ch;
+		sum += ch;
+	}
+	gdb_tx_buf[n++] = '#';
+	gdb_tx_buf[n++] = gdb_hex_digits[sum >> 4];
+	gdb_tx_buf[n++] = gdb_hex_digits[sum & 0xF];
+
+	gdb_tx_len = n;
+	send(sn, gdb_tx_buf, n);
+}
+
+static void gdb_process_packet(uint8_t sn)
+{
+	size_t len = 0;
+	bool reply = swdloader_gdb_process(gdb_rx_buf, gdb_rx_len, gdb_response, &len);
+
+	gdb_session = true;
+
+	if (!reply)
+	{
+		// continue or step, the stop reply is sent later (kill has no reply)
+		gdb_running = gdb_rx_len > 0 && (gdb_rx_buf[0] == 'c' || gdb_rx_buf[0] == 's');
+		gdb_poll_time = to_ms_since_boot(get_absolute_time());
+
+		return;
+	}
+
+	gdb_send_packet(sn, gdb_response, len);
+
+	if (   gdb_rx_len == 15 && memcmp(gdb_rx_buf, "QStartNoAckMode", 15) == 0
+	    && len == 2 && memcmp(gdb_response, "OK", 2) == 0)
+	{
+		gdb_no_ack = true;
+	}
+}
+
+static void gdb_receive_byte(uint8_t sn, uint8_t ch)
+{
+	switch(gdb_rx_state)
+	{
+		case GDB_RX_IDLE:
+			if(ch == '$')
+			{
+				gdb_rx_len = 0;
+				gdb_rx_sum = 0;
+				gdb_rx_overflow = false;
+				gdb_rx_state = GDB_RX_DATA;
+			}
+			else if(ch == 0x03)			// Ctrl-C
+			{
+				gdb_interrupt = true;
+			}
+			else if(ch == '-' && !gdb_no_ack && gdb_tx_len > 0)
+			{
+				send(sn, gdb_tx_buf, gdb_tx_len);
+			}
+			break;						// '+' is ignored
+
+		case GDB_RX_DATA:
+		case GDB_RX_ESCAPE:
+			if(ch == '#' && gdb_rx_state == GDB_RX_DATA)
+			{
+				gdb_rx_state = GDB_RX_CHECKSUM1;
+				break;
+			}
+
+			gdb_rx_sum += ch;
+
+			if(ch == '}' && gdb_rx_state == GDB_RX_DATA)
+			{
+				gdb_rx_state = GDB_RX_ESCAPE;
+				break;
+			}
+
+			if(gdb_rx_state == GDB_RX_ESCAPE)
+			{
+				ch ^= 0x20;
+				gdb_rx_state = GDB_RX_DATA;
+			}
+
+			if(gdb_rx_len < sizeof gdb_rx_buf)
+			{
+				gdb_rx_buf[gdb_rx_len++] = ch;
+			}
+			else
+			{
+				gdb_rx_overflow = true;
+			}
+			break;
+
+		case GDB_RX_CHECKSUM1:
+			gdb_rx_checksum = hex_value(ch) << 4;
+			gdb_rx_state = GDB_RX_CHECKSUM2;
+			break;
+
+		case GDB_RX_CHECKSUM2:
+			gdb_rx_checksum |= hex_value(ch);
+			gdb_rx_state = GDB_RX_IDLE;
+
+			if(gdb_rx_checksum != gdb_rx_sum || gdb_rx_overflow)
+			{
+				printf("> GDBSocket[%d] : Bad packet\r\n", sn);
+				if(!gdb_no_ack) send(sn, (uint8_t *)"-", 1);
+				break;
+			}
+
+			if(!gdb_no_ack) send(sn, (uint8_t *)"+", 1);
+
+			gdb_process_packet(sn);
+			break;
+	}
+}
+
+static void gdb_receive(uint8_t sn)
+{
+	uint8_t buf[256];
+
+	uint16_t len;
+	while((len = getSn_RX_RSR(sn)) > 0)
+	{
+		if(len > sizeof buf) len = sizeof buf;
+
+		int32_t ret = recv(sn, buf, len);
+		if(ret <= 0)
+		{
+			break;
+		}
+
+		for(int32_t i = 0; i < ret; i++)
+		{
+			gdb_receive_byte(sn, buf[i]);
+		}
+	}
+}
+
+// Sends the stop reply, when the target has halted (at a breakpoint or on Ctrl-C)
+static void gdb_poll(uint8_t sn)
+{
+	if(!gdb_running)
+	{
+		gdb_interrupt = false;
+		return;
+	}
+
+	uint32_t now = to_ms_since_boot(get_absolute_time());
+	if(!gdb_interrupt && now - gdb_poll_time < GDB_POLL_INTERVAL_MS)
+	{
+		return;
+	}
+
+	gdb_poll_time = now;
+
+	size_t len = 0;
+	if(swdloader_gdb_poll(gdb_interrupt, gdb_response, &len))
+	{
+		gdb_running = false;
+		gdb_send_packet(sn, gdb_response, len);
+	}
+
+	gdb_interrupt = false;
+}
+
+// Removes the breakpoints and lets the target run, when the host has gone
+static void gdb_end_session(void)
+{
+	if (gdb_session)
+	{
+		swdloader_gdb_detach();
+		gdb_session = false;
+	}
+
+	gdb_no_ack = false;
+	gdb_running = false;
+	gdb_interrupt = false;
+	gdb_rx_state = GDB_RX_IDLE;
+	gdb_tx_len = 0;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+void gdbServer_init(uint8_t sn)
+{
+	GDBSock_Num = sn;
+}
+
+void gdbServer_run(void)
+{
+	uint8_t sn = GDBSock_Num;
+
+	switch(getSn_SR(sn))
+	{
+		case SOCK_ESTABLISHED:
+			// Interrupt clear
+			if(getSn_IR(sn) & Sn_IR_CON)
+			{
+				setSn_IR(sn, Sn_IR_CON);
+				printf("> GDBSocket[%d] : Connected\r\n", sn);
+				gdb_rx_state = GDB_RX_IDLE;
+			}
+
+			// the packets are executed on core 1
+			gdb_receive(sn);
+			gdb_poll(sn);
+			break;
+
+		case SOCK_CLOSE_WAIT:
+			gdb_end_session();
+			disconnect(sn);
+			break;
+
+		case SOCK_CLOSED:
+			gdb_end_session();
+			if(socket(sn, Sn_MR_TCP, GDB_SERVER_PORT, 0x00) == sn)
+			{
+				printf("> GDBSocket[%d] : OPEN (port %d)\r\n", sn, GDB_SERVER_PORT);
+			}
+			break;
+
+		case SOCK_INIT:
+			listen(sn);
+			break;
+
+		default :
+			break;
+	}
+}
@@ -0,0 +1,66 @@
+/**
+ @file		httpMultipart.h
+ @brief 	Incremental parser for multipart/form-data request bodies.
+
+ The body is passed in chunks of any size, as it is received. The payload of
+ the file part is passed to a sink as spans of the chunks, it is not copied.
+ A delimiter may straddle the edge of two chunks, the parser keeps the number
+ of delimiter bytes matched so far. These bytes are passed later, if the
+ delimiter does not complete.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef	__HTTPMULTIPART_H__
+#define	__HTTPMULTIPART_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HTTP_MULTIPART_BOUNDARY_MAX	70				// RFC 2046
+
+typedef bool (*http_multipart_sink_t)(const uint8_t *data, size_t len, void *param);
+
+typedef enum
+{
+	MULTIPART_PREAMBLE,
+	MULTIPART_DELIMITER,					// after a delimiter
+	MULTIPART_DELIMITER_DASH,				// "-" after a delimiter
+	MULTIPART_DELIMITER_CR,					// "\r" after a delimiter
+	MULTIPART_HEADERS,
+	MULTIPART_DATA,
+	MULTIPART_DONE,							// after the close delimiter
+	MULTIPART_ERROR
+} http_multipart_state_t;
+
+typedef struct
+{
+	http_multipart_state_t state;
+	uint8_t delimiter[4 + HTTP_MULTIPART_BOUNDARY_MAX];	/**< "\r\n--" boundary */
+	uint8_t delimiter_len;
+	uint8_t matched;						/**< Bytes of the delimiter or the header end */
+	uint8_t filename_matched;				/**< Bytes of "filename=" in the part headers */
+	bool file_part;							/**< The payload of this part is passed */
+	unsigned files;							/**< File parts, which have been passed */
+	http_multipart_sink_t sink;
+	void *param;
+} http_multipart_t;
+
+/* boundary: from the Content-Type header, without quotes */
+bool http_multipart_init(http_multipart_t *parser, const char *boundary, size_t boundary_len,
+						 http_multipart_sink_t sink, void *param);
+
+/* Returns false on a syntax error or if the sink has failed */
+bool http_multipart_write(http_multipart_t *parser, const uint8_t *data, size_t len);
+
+/* Has the close delimiter been found after a file part? */
+bool http_multipart_finish(const http_multipart_t *parser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
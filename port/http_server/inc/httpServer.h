@@ -43,6 +43,7 @@ extern "C" {
 #define STATE_HTTP_REQ_DONE    		2           /* The end of HTTP request parse */
 #define STATE_HTTP_RES_INPROC  		3           /* Sending the HTTP response to HTTP client (in progress) */
 #define STATE_HTTP_RES_DONE    		4           /* The end of HTTP response send (HTTP transaction ended) */
+#define STATE_HTTP_BODY_INPROC 		5           /* Receiving the body of an HTTP POST request (in progress) */
 
 /*********************************************
 * HTTP Simple Return Value
@@ -51,6 +52,7 @@ extern "C" {
 #define HTTP_OK						1
 #define HTTP_RESET					2
 #define HTTP_FWUP					3
+#define HTTP_PENDING				4
 
 /*********************************************
 * HTTP Content NAME length
@@ -15,6 +15,8 @@ extern "C" {
 
 uint8_t http_get_cgi_handler(uint8_t * uri_name, uint8_t * buf, uint32_t * file_len);
 uint8_t http_post_cgi_handler(uint8_t * uri_name, st_http_request * p_http_request, uint8_t * buf, uint32_t * file_len);
+uint8_t http_post_cgi_resume(uint8_t s, uint8_t * buf, uint32_t * file_len);
+void http_post_cgi_abort(uint8_t s);
 
 uint8_t predefined_get_cgi_processor(uint8_t * uri_name, uint8_t * buf, uint16_t * len);
 uint8_t predefined_set_cgi_processor(uint8_t * uri_name, st_http_request * p_http_request, uint8_t * buf, uint16_t * len);
@@ -7,7 +7,18 @@
 
 #define DATA_BUF_SIZE 2048
 
-uint8_t http_update_firmware(st_http_request * p_http_request, uint8_t *buf);
+// The handlers, which receive a body, return HTTP_PENDING. The response is
+// available, when http_receive_body_resume() does not return HTTP_PENDING.
+uint8_t http_update_firmware(st_http_request * p_http_request, uint8_t *buf, uint16_t *len);
+uint8_t http_update_firmware_stream(st_http_request * p_http_request, uint8_t *buf, uint16_t *len);
+
+uint8_t http_store_image(st_http_request * p_http_request, uint8_t *buf, uint16_t *len);
+uint8_t http_program_image(st_http_request * p_http_request, uint8_t *buf, uint16_t *len);
+uint8_t http_delete_image(st_http_request * p_http_request, uint8_t *buf, uint16_t *len);
+uint16_t http_list_images(uint8_t *buf, uint16_t size);
+
+uint8_t http_receive_body_resume(uint8_t sock, uint8_t *buf, uint16_t *len);
+void http_receive_body_abort(uint8_t sock);
 
 #endif //__HTTPHANDLER_H
 
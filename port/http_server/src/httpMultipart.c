@@ -0,0 +1,248 @@
+/**
+ * @file	httpMultipart.c
+ * @brief	Incremental parser for multipart/form-data request bodies
+ */
+
+#include <string.h>
+
+#include "httpMultipart.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+#define MULTIPART_HEADER_END		"\r\n\r\n"
+#define MULTIPART_FILENAME			"filename="		// in Content-Disposition
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+static bool multipart_emit(http_multipart_t *parser, const uint8_t *data, size_t len)
+{
+	if(   len == 0
+	   || !parser->file_part)
+	{
+		return true;
+	}
+
+	if(!parser->sink(data, len, parser->param))
+	{
+		parser->state = MULTIPART_ERROR;
+
+		return false;
+	}
+
+	return true;
+}
+
+// The payload is passed in spans up to a delimiter or the end of the chunk.
+// A boundary cannot contain CR, so that a failed match can only restart at CR
+// and all bytes before it are payload. Only the bytes of a partial match at the
+// end of the chunk are held back. Returns the position after a delimiter.
+static const uint8_t *multipart_data(http_multipart_t *parser, const uint8_t *data, const uint8_t *end)
+{
+	const uint8_t *span = data;				// has not been passed yet
+	const uint8_t *p = data;
+	unsigned held = parser->matched;		// matched in the previous chunk
+
+	while(p < end)
+	{
+		if(parser->matched == 0)
+		{
+			p = memchr(p, '\r', end - p);
+			if(!p)
+			{
+				p = end;
+				break;
+			}
+		}
+
+		if(*p == parser->delimiter[parser->matched])
+		{
+			p++;
+			if(++parser->matched == parser->delimiter_len)
+			{
+				// the payload ends before the delimiter
+				const uint8_t *payload_end = p - (parser->matched - held);
+				if(!multipart_emit(parser, span, payload_end > span ? payload_end - span : 0))
+				{
+					return end;
+				}
+
+				parser->matched = 0;
+				parser->state = MULTIPART_DELIMITER;
+
+				return p;
+			}
+
+			continue;
+		}
+
+		// the held bytes were payload after all, they precede the span
+		if(   held > 0
+		   && !multipart_emit(parser, parser->delimiter, held))
+		{
+			return end;
+		}
+
+		held = 0;
+		parser->matched = 0;				// *p is examined again
+	}
+
+	const uint8_t *span_end = end - (parser->matched - held);
+	multipart_emit(parser, span, span_end > span ? span_end - span : 0);
+
+	return end;
+}
+
+static void multipart_control(http_multipart_t *parser, uint8_t c)
+{
+	switch(parser->state)
+	{
+	case MULTIPART_PREAMBLE:
+		if(c == parser->delimiter[parser->matched])
+		{
+			if(++parser->matched == parser->delimiter_len)
+			{
+				parser->matched = 0;
+				parser->state = MULTIPART_DELIMITER;
+			}
+		}
+		else
+		{
+			parser->matched = c == '\r' ? 1 : 0;
+		}
+		break;
+
+	case MULTIPART_DELIMITER:
+		if(c == '-')
+		{
+			parser->state = MULTIPART_DELIMITER_DASH;
+		}
+		else if(c == '\r')
+		{
+			parser->state = MULTIPART_DELIMITER_CR;
+		}
+		else if(c != ' ' && c != '\t')		// transport padding
+		{
+			parser->state = MULTIPART_ERROR;
+		}
+		break;
+
+	case MULTIPART_DELIMITER_DASH:
+		parser->state = c == '-' ? MULTIPART_DONE : MULTIPART_ERROR;
+		break;
+
+	case MULTIPART_DELIMITER_CR:
+		if(c != '\n')
+		{
+			parser->state = MULTIPART_ERROR;
+			break;
+		}
+
+		// the CRLF of the delimiter line is the start of the header end
+		parser->state = MULTIPART_HEADERS;
+		parser->matched = 2;
+		parser->filename_matched = 0;
+		break;
+
+	case MULTIPART_HEADERS:
+		if(parser->filename_matched < sizeof MULTIPART_FILENAME - 1)
+		{
+			if(c == MULTIPART_FILENAME[parser->filename_matched])
+			{
+				parser->filename_matched++;
+			}
+			else
+			{
+				parser->filename_matched = c == MULTIPART_FILENAME[0] ? 1 : 0;
+			}
+		}
+
+		if(c != MULTIPART_HEADER_END[parser->matched])
+		{
+			parser->matched = c == '\r' ? 1 : 0;
+			break;
+		}
+
+		if(++parser->matched == sizeof MULTIPART_HEADER_END - 1)
+		{
+			// only the first file is passed, other form fields are skipped
+			parser->file_part =    parser->filename_matched == sizeof MULTIPART_FILENAME - 1
+								&& parser->files == 0;
+			if(parser->file_part)
+			{
+				parser->files++;
+			}
+
+			parser->matched = 0;
+			parser->state = MULTIPART_DATA;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+bool http_multipart_init(http_multipart_t *parser, const char *boundary, size_t boundary_len,
+						 http_multipart_sink_t sink, void *param)
+{
+	if(   boundary_len == 0
+	   || boundary_len > HTTP_MULTIPART_BOUNDARY_MAX
+	   || memchr(boundary, '\r', boundary_len)
+	   || memchr(boundary, '\n', boundary_len))
+	{
+		return false;
+	}
+
+	memset(parser, 0, sizeof *parser);
+
+	memcpy(parser->delimiter, "\r\n--", 4);
+	memcpy(parser->delimiter + 4, boundary, boundary_len);
+	parser->delimiter_len = 4 + boundary_len;
+
+	// the first delimiter may start the body without a CRLF
+	parser->state = MULTIPART_PREAMBLE;
+	parser->matched = 2;
+
+	parser->sink = sink;
+	parser->param = param;
+
+	return true;
+}
+
+bool http_multipart_write(http_multipart_t *parser, const uint8_t *data, size_t len)
+{
+	const uint8_t *end = data + len;
+
+	while(data < end)
+	{
+		switch(parser->state)
+		{
+		case MULTIPART_DATA:
+			data = multipart_data(parser, data, end);
+			break;
+
+		case MULTIPART_DONE:				// the epilogue is ignored
+			return true;
+
+		case MULTIPART_ERROR:
+			return false;
+
+		default:
+			multipart_control(parser, *data++);
+			break;
+		}
+	}
+
+	return parser->state != MULTIPART_ERROR;
+}
+
+bool http_multipart_finish(const http_multipart_t *parser)
+{
+	return    parser->state == MULTIPART_DONE
+		   && parser->files > 0;
+}
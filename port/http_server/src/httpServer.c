@@ -57,6 +57,7 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request);
 static void send_http_response_header(uint8_t s, uint8_t content_type, uint32_t body_len, uint16_t http_status);
 static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf, uint32_t start_addr, uint32_t file_len);
 static void send_http_response_cgi(uint8_t s, uint8_t * buf, uint8_t * http_body, uint16_t file_len);
+static void send_http_response_post_cgi(uint8_t s, uint8_t content_found, uint32_t file_len);
 
 /*****************************************************************************
  * Public functions
@@ -119,6 +120,8 @@ void httpServer_run(uint8_t seqnum)
 	uint8_t s;	// socket number
 	uint16_t len;
 	uint32_t gettime = 0;
+	uint32_t file_len;
+	uint8_t content_found;
 
 #ifdef _HTTPSERVER_DEBUG_
 	uint8_t destip[4] = {0, };
@@ -183,11 +186,27 @@ void httpServer_run(uint8_t seqnum)
 							}
 						}
 
+						if(HTTPSock_Status[seqnum].sock_status == STATE_HTTP_BODY_INPROC) break; // The response is sent after the body
 						if(HTTPSock_Status[seqnum].file_len > 0) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_INPROC;
 						else HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE; // Send the 'HTTP response' end
 					}
 					break;
 
+				case STATE_HTTP_BODY_INPROC :
+					/* Receive the next part of the POST request body, the other sockets are served in between */
+					http_response = pHTTP_RX;
+					file_len = 0;
+
+					content_found = http_post_cgi_resume(s, http_response, &file_len);
+					if(content_found == HTTP_PENDING) break;
+
+#ifdef _HTTPSERVER_DEBUG_
+					printf("> HTTPSocket[%d] : [State] STATE_HTTP_BODY_INPROC: Body received\r\n", s);
+#endif
+					send_http_response_post_cgi(s, content_found, file_len);
+					HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
+					break;
+
 				case STATE_HTTP_RES_INPROC :
 					/* Repeat: Send the remain parts of HTTP responses */
 #ifdef _HTTPSERVER_DEBUG_
@@ -227,6 +246,11 @@ void httpServer_run(uint8_t seqnum)
 #ifdef _HTTPSERVER_DEBUG_
 		printf("> HTTPSocket[%d] : ClOSE_WAIT\r\n", s);	// if a peer requests to close the current connection
 #endif
+			if(HTTPSock_Status[seqnum].sock_status == STATE_HTTP_BODY_INPROC)
+			{
+				http_post_cgi_abort(s);
+				HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
+			}
 			disconnect(s);
 			break;
 
@@ -234,6 +258,11 @@ void httpServer_run(uint8_t seqnum)
 #ifdef _HTTPSERVER_DEBUG_
 			printf("> HTTPSocket[%d] : CLOSED\r\n", s);
 #endif
+			if(HTTPSock_Status[seqnum].sock_status == STATE_HTTP_BODY_INPROC)
+			{
+				http_post_cgi_abort(s);
+				HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
+			}
 			if(socket(s, Sn_MR_TCP, HTTP_SERVER_PORT, 0x00) == s)    /* Reinitialize the socket */
 			{
 #ifdef _HTTPSERVER_DEBUG_
@@ -626,14 +655,14 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 #ifdef _HTTPSERVER_DEBUG_
 				printf("> HTTPSocket[%d] : [CGI: %s] / Response len [ %ld ]byte\r\n", s, content_found?"Content found":"Content not found", file_len);
 #endif
-				if(content_found && (file_len <= (DATA_BUF_SIZE-(strlen(RES_CGIHEAD_OK)+8))))
-				{
-					send_http_response_cgi(s, pHTTP_TX, http_response, (uint16_t)file_len);
-				}
-				else
+				if(content_found == HTTP_PENDING)
 				{
-					send_http_response_header(s, PTYPE_CGI, 0, STATUS_NOT_FOUND);
+					// The body is received in parts by httpServer_run()
+					HTTPSock_Status[get_seqnum].sock_status = STATE_HTTP_BODY_INPROC;
+					break;
 				}
+
+				send_http_response_post_cgi(s, content_found, file_len);
 			}
 			else	// HTTP POST Method; Content not found
 			{
@@ -648,6 +677,18 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 	}
 }
 
+static void send_http_response_post_cgi(uint8_t s, uint8_t content_found, uint32_t file_len)
+{
+	if(content_found && (file_len <= (DATA_BUF_SIZE-(strlen(RES_CGIHEAD_OK)+8))))
+	{
+		send_http_response_cgi(s, pHTTP_TX, http_response, (uint16_t)file_len);
+	}
+	else
+	{
+		send_http_response_header(s, PTYPE_CGI, 0, STATUS_NOT_FOUND);
+	}
+}
+
 void httpServer_time_handler(void)
 {
 	httpServer_tick_1s++;
@@ -36,24 +36,51 @@ uint8_t http_post_cgi_handler(uint8_t * uri_name, st_http_request * p_http_reque
 	uint8_t * device_ip;
 	uint8_t val;
 
-	if(predefined_set_cgi_processor(uri_name, p_http_request, buf, &len))
-	{
-    	;
-	}
-	else
-	{
-		// CGI file not found
-		ret = HTTP_FAILED;
-	}
+	// HTTP_FAILED: CGI file not found, HTTP_PENDING: the body is still received
+	ret = predefined_set_cgi_processor(uri_name, p_http_request, buf, &len);
 
-	if(ret)	*file_len = len;
+	if(ret == HTTP_OK) *file_len = len;
+	return ret;
+}
+
+// Continues a POST request, whose handler has returned HTTP_PENDING
+uint8_t http_post_cgi_resume(uint8_t s, uint8_t * buf, uint32_t * file_len)
+{
+	uint16_t len = 0;
+	uint8_t ret = http_receive_body_resume(s, buf, &len);
+
+	if(ret == HTTP_OK) *file_len = len;
 	return ret;
 }
 
+void http_post_cgi_abort(uint8_t s)
+{
+	http_receive_body_abort(s);
+}
+
+
+// The URI of a POST request still has its query ("name.cgi?param=value")
+static uint8_t cgi_name_matches(uint8_t * uri_name, const char * name)
+{
+	size_t len = strlen(name);
+
+	return strncmp((const char *)uri_name, name, len) == 0 && (uri_name[len] == '\0' || uri_name[len] == '?');
+}
 
 uint8_t predefined_get_cgi_processor(uint8_t * uri_name, uint8_t * buf, uint16_t * len)
 {
-	;
+	uint8_t ret = 1;	// ret = 1 means 'uri_name' matched
+
+	if(strcmp((const char *)uri_name, "images.cgi") == 0)
+	{
+		*len = http_list_images(buf, DATA_BUF_SIZE - (strlen(RES_CGIHEAD_OK) + 8));
+	}
+	else
+	{
+		ret = 0;
+	}
+
+	return ret;
 }
 
 
@@ -62,10 +89,27 @@ uint8_t predefined_set_cgi_processor(uint8_t * uri_name, st_http_request * p_htt
 	uint8_t ret = 1;	// ret = 1 means 'uri_name' matched
 	uint8_t val = 0;
 
+	// the handlers return HTTP_FAILED (404 Not Found), HTTP_OK or HTTP_PENDING,
+	// if the body is received by httpServer_run()
 	if(strcmp((const char *)uri_name, "update_firmware.cgi") == 0)
 	{
-		if (http_update_firmware(p_http_request, buf))
-		*len = sprintf((char *)buf, "<html><head><title>W5500-EVB-Pico</title><body>F/W Update Complete. Application code will run.</body></html>\r\n\r\n");
+		ret = http_update_firmware(p_http_request, buf, len);
+	}
+	else if(strcmp((const char *)uri_name, "update_firmware_hs.cgi") == 0)
+	{
+		ret = http_update_firmware_stream(p_http_request, buf, len);
+	}
+	else if(cgi_name_matches(uri_name, "store_image.cgi"))
+	{
+		ret = http_store_image(p_http_request, buf, len);
+	}
+	else if(cgi_name_matches(uri_name, "program_image.cgi"))
+	{
+		ret = http_program_image(p_http_request, buf, len);
+	}
+	else if(cgi_name_matches(uri_name, "delete_image.cgi"))
+	{
+		ret = http_delete_image(p_http_request, buf, len);
 	}
 	else
 	{
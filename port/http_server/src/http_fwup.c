@@ -1,151 +1,495 @@
 
 #include "port_common.h"
+#include "socket.h"
+#include "httpServer.h"
 #include "httpParser.h"
 #include "http_fwup.h"
+#include "httpMultipart.h"
+#include "imageStore.h"
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 extern uint8_t *pHTTP_RX;
 extern uint8_t *pHTTP_TX;
 
-#define BUFFER_SIZE (30*1024)
+#define STREAM_CHUNK_SIZE 1024
+#define BODY_TIMEOUT_MS 5000        // without received data
 
-extern bool swdloader_flash_buffer(const uint8_t* buffer, size_t size);
+extern bool swdloader_stream_begin(bool compressed);
+extern bool swdloader_stream_write(const uint8_t* buffer, size_t size);
+extern bool swdloader_stream_ready(void);
+extern bool swdloader_stream_finish(bool complete);
+extern bool swdloader_stream_ended(bool *result);
+extern size_t swdloader_stream_progress(void);
 
-uint8_t http_update_firmware(st_http_request * p_http_request, uint8_t *buf)
+typedef bool (*http_body_sink_t)(const uint8_t *data, size_t len, void *param);
+
+// Length of the header of a POST request in pHTTP_RX (without the empty line),
+// -1 if it has not been received completely. The parser has cut the request
+// line, so that the whole buffer is searched.
+static int http_header_end(st_http_request * p_http_request)
 {
-  int sock = p_http_request->socket;
-  uint8_t *uri = p_http_request->URI;
-  
-  
-    // Parse boundary from URI
-    uint8_t boundary[128] = {0};
-    uint8_t boundary_len = 0;
-    char *boundary_pos = strstr((char *)uri, "boundary=");
-    if (boundary_pos) {
-        sscanf(boundary_pos, "boundary=%127s", boundary);
-        boundary_len = strlen((char *)boundary);
-        printf("boundary = %s, boundary_len = %d\n", boundary, boundary_len);
-    } else {
-        printf("Boundary not found in URI.\n");
-        return 0;
-    }
+    int total_len = p_http_request->recv_len;
 
-    // Allocate upload buffer
-    uint8_t *upload_buf = malloc(BUFFER_SIZE);
-    if (!upload_buf) {
-        printf("Memory allocation failed.\n");
-        return 0;
+    for (int i = 0; i + 3 < total_len; i++) {
+        if (memcmp(pHTTP_RX + i, "\r\n\r\n", 4) == 0) {
+            return i;
+        }
     }
 
-    // Copy initial received data
-    int total_len = p_http_request->recv_len;
-    memcpy(upload_buf, pHTTP_RX, total_len);
-
-    // Receive remaining data until socket is done
-int retry_count = 0;
-const int max_retries = 50;
-
-while (total_len < BUFFER_SIZE && retry_count < max_retries) {
-    int rx_ready = getSn_RX_RSR(sock);
-    if (rx_ready > 0) {
-        if ((total_len + rx_ready) >= BUFFER_SIZE) {
-            printf("Firmware too large.\n");
-            free(upload_buf);
-            return 0;
+    return -1;
+}
+
+// Value of a header field, which ends with CR, NULL if not found. The name is
+// matched without case at the start of a line, the whitespace after the colon
+// is skipped (RFC 7230 3.2).
+static const char *http_header_field(int header_end, const char *name)
+{
+    size_t name_len = strlen(name);
+
+    // the request line precedes the first field
+    for (int i = 1; i + (int)name_len < header_end; i++) {
+        const char *line = (const char *)pHTTP_RX + i;
+        if (line[-1] != '\n' || line[name_len] != ':' || strncasecmp(line, name, name_len) != 0) {
+            continue;
         }
 
-        int rx_len = recv(sock, upload_buf + total_len, rx_ready);
-        total_len += rx_len;
-        retry_count = 0;  // reset on successful recv
-    } else {
-        retry_count++;
-        sleep_ms(100);  // short delay to wait for more data
-    }
-}
-    printf("Total len = %d\r\n",total_len);
-    // Find header end (\r\n\r\n)
-    char *header_end = NULL;
-    for (int i = 0; i < total_len - 3; i++) {
-        if (upload_buf[i] == '\r' && upload_buf[i+1] == '\n' &&
-            upload_buf[i+2] == '\r' && upload_buf[i+3] == '\n') {
-            header_end = (char *)&upload_buf[i];
-            int offset = header_end - (char *)upload_buf;
-            printf("Header end found at offset: %d\n", offset);
-            break;
+        const char *value = line + name_len + 1;
+        while (*value == ' ' || *value == '\t') {
+            value++;
         }
+
+        return value;
+    }
+
+    return NULL;
+}
+
+// Content-Length of a POST request, the body starts at body_start in pHTTP_RX
+static int http_content_length(st_http_request * p_http_request, int *body_start)
+{
+    int header_end = http_header_end(p_http_request);
+    const char *field = http_header_field(header_end, "Content-Length");
+    if (!field) {
+        return -1;
     }
 
-    if (!header_end) {
-        printf("Header end not found.\n");
-        free(upload_buf);
+    *body_start = header_end + 4;
+
+    return atoi(field);
+}
+
+// Boundary parameter of the Content-Type of a multipart POST request (quotes removed)
+static bool http_multipart_boundary(st_http_request * p_http_request, char *boundary, size_t size)
+{
+    int header_end = http_header_end(p_http_request);
+    const char *field = http_header_field(header_end, "Content-Type");
+    if (!field) {
         return 0;
     }
 
-    char *multipart_start = header_end + 4;
-    char *firmware_start = strstr(multipart_start, "\r\n\r\n");
-    if (!firmware_start) {
-        printf("Inner multipart header not found.\n");
-        free(upload_buf);
+    const char *field_end = memchr(field, '\r', (const char *)pHTTP_RX + header_end + 1 - field);
+    const char *param = field;
+    while (param + 9 <= field_end && strncasecmp(param, "boundary=", 9) != 0) {
+        param++;
+    }
+
+    if (param + 9 > field_end) {
         return 0;
     }
-    firmware_start += 4;
-    int body_len = total_len - (firmware_start - (char *)upload_buf);
-    //int body_len = total_len - (body_start - (char *)upload_buf);
-    printf("body_len=%d\n", body_len);
-    // Copy only the body to firmware buffer
-    uint8_t *flash_temp_buf = malloc(BUFFER_SIZE);
-    if (!flash_temp_buf) {
-        printf("Firmware buffer allocation failed.\n");
-        free(upload_buf);
+
+    param += 9;
+    const char *value_end = field_end;
+    if (*param == '"') {
+        param++;
+        value_end = memchr(param, '"', field_end - param);
+    } else {
+        for (const char *p = param; p < field_end; p++) {
+            if (*p == ';' || *p == ' ') {
+                value_end = p;
+                break;
+            }
+        }
+    }
+
+    if (!value_end || value_end == param || (size_t)(value_end - param) >= size) {
         return 0;
     }
 
-    memcpy(flash_temp_buf, firmware_start, body_len);
-    int firmware_len = body_len;
+    memcpy(boundary, param, value_end - param);
+    boundary[value_end - param] = '\0';
 
-    char full_boundary[140];
-    snprintf(full_boundary, sizeof(full_boundary), "--%s--", boundary);
-    int full_boundary_len = strlen(full_boundary);
+    return 1;
+}
+
+// The body of a POST request is received in parts by httpServer_run() (see
+// http_receive_body_resume()), which serves the other sockets in between. The
+// handlers pass the part, which has been received with the header, and return
+// HTTP_PENDING. Only one body is received at a time.
+typedef uint8_t (*http_body_finish_t)(bool complete, uint8_t *buf, uint16_t *len);
+
+typedef struct {
+    int sock;                   // -1: no body is received
+    int body_len;
+    int content_len;
+    uint32_t last_recv_ms;
+    http_body_sink_t sink;
+    void *param;
+    bool (*ready)(void);        // can the sink take the next chunk without waiting? (NULL: always)
+    http_body_finish_t finish;  // called until it does not return HTTP_PENDING
+    bool received;              // the body is complete or has failed, finishing
+    bool complete;
+} http_body_t;
+
+static http_body_t s_body = {-1};
+static http_multipart_t s_multipart;
+
+static bool http_receive_body_busy(void)
+{
+    if (s_body.sock >= 0) {
+        printf("Upload busy\r\n");
+        return 1;
+    }
 
-    char *last_boundary = NULL;
-    for (int i = firmware_len - full_boundary_len; i >= 0; i--) {
-        if (memcmp(flash_temp_buf + i, full_boundary, full_boundary_len) == 0) {
-            last_boundary = (char *)(flash_temp_buf + i);
-            printf("Last boundary match at offset %d\n", i);
+    return 0;
+}
+
+// Passes the part of the body, which has been received with the header, to the sink
+static uint8_t http_receive_body_begin(st_http_request * p_http_request, int body_start, int content_len,
+                                       http_body_sink_t sink, void *param, bool (*ready)(void),
+                                       http_body_finish_t finish)
+{
+    int body_len = p_http_request->recv_len - body_start;
+    if (body_len > content_len) body_len = content_len;
+
+    s_body.sock = p_http_request->socket;
+    s_body.body_len = 0;
+    s_body.content_len = content_len;
+    s_body.last_recv_ms = to_ms_since_boot(get_absolute_time());
+    s_body.sink = sink;
+    s_body.param = param;
+    s_body.ready = ready;
+    s_body.finish = finish;
+    s_body.received = 0;
+    s_body.complete = 0;
+
+    if (body_len > 0) {
+        if (!sink(pHTTP_RX + body_start, body_len, param)) {
+            s_body.received = 1;
+        }
+
+        s_body.body_len = body_len;
+    }
+
+    return HTTP_PENDING;
+}
+
+// Receives the next chunk of the body, if any, or finishes it. Returns HTTP_PENDING,
+// until the response is in buf.
+uint8_t http_receive_body_resume(uint8_t sock, uint8_t *buf, uint16_t *len)
+{
+    if (s_body.sock != sock) {
+        return HTTP_FAILED;
+    }
+
+    static uint8_t chunk[STREAM_CHUNK_SIZE];
+
+    while (!s_body.received) {
+        if (s_body.body_len >= s_body.content_len) {
+            s_body.received = 1;
+            s_body.complete = 1;
+            break;
+        }
+
+        uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+        int rx_ready = getSn_RX_RSR(sock);
+        if (rx_ready <= 0 || (s_body.ready && !s_body.ready())) {
+            if (rx_ready <= 0 && now_ms - s_body.last_recv_ms > BODY_TIMEOUT_MS) {
+                s_body.received = 1;
+                break;
+            }
+
+            return HTTP_PENDING;
+        }
+
+        if (rx_ready > STREAM_CHUNK_SIZE) rx_ready = STREAM_CHUNK_SIZE;
+        if (rx_ready > s_body.content_len - s_body.body_len) rx_ready = s_body.content_len - s_body.body_len;
+
+        int rx_len = recv(sock, chunk, rx_ready);
+        if (rx_len <= 0 || !s_body.sink(chunk, rx_len, s_body.param)) {
+            s_body.received = 1;
             break;
         }
+
+        s_body.body_len += rx_len;
+        s_body.last_recv_ms = now_ms;
+
+        return HTTP_PENDING;    // one chunk per pass
+    }
+
+    uint8_t result = s_body.finish(s_body.complete, buf, len);
+    if (result != HTTP_PENDING) {
+        printf("Received %d of %d bytes\r\n", s_body.body_len, s_body.content_len);
+
+        s_body.sock = -1;
+    }
+
+    return result;
+}
+
+// The connection has been closed, before the body has been received
+void http_receive_body_abort(uint8_t sock)
+{
+    if (s_body.sock != sock) {
+        return;
+    }
+
+    s_body.received = 1;
+    s_body.complete = 0;
+
+    uint16_t len = 0;
+    while (http_receive_body_resume(sock, pHTTP_TX, &len) == HTTP_PENDING) {
+        tight_loop_contents();
+    }
+}
+
+// Value of a parameter in the query of the request line ("" if none)
+static void http_query_value(st_http_request * p_http_request, const char *name, char *value, size_t size)
+{
+    const char *uri = (const char *)p_http_request->URI;
+    const char *end = strchr(uri, ' ');     // before "HTTP/1.1"
+    const char *query = strchr(uri, '?');
+    size_t name_len = strlen(name);
+
+    value[0] = '\0';
+    if (!end || !query || query > end) {
+        return;
+    }
+
+    for (const char *param = query + 1; param < end; ) {
+        const char *next = memchr(param, '&', end - param);
+        if (!next) next = end;
+
+        if ((size_t)(next - param) > name_len && param[name_len] == '=' && strncmp(param, name, name_len) == 0) {
+            size_t len = next - param - name_len - 1;
+            if (len >= size) len = size - 1;
+            memcpy(value, param + name_len + 1, len);
+            value[len] = '\0';
+            return;
+        }
+
+        param = next + 1;
     }
+}
+
+static bool http_stream_sink(const uint8_t *data, size_t len, void *param)
+{
+    return swdloader_stream_write(data, len);
+}
 
-    if (last_boundary) {
-    firmware_len = (uint8_t *)last_boundary - flash_temp_buf;
+static bool http_store_sink(const uint8_t *data, size_t len, void *param)
+{
+    return imageStore_write(data, len);
+}
+
+static bool http_multipart_sink(const uint8_t *data, size_t len, void *param)
+{
+    return http_multipart_write((http_multipart_t *)param, data, len);
+}
 
-    // Trim trailing CRLF
-    while (firmware_len > 0 &&
-          (flash_temp_buf[firmware_len - 1] == '\r' || flash_temp_buf[firmware_len - 1] == '\n')) {
-        firmware_len--;
+// Waits for the chunks, which are still queued for core 1, by returning HTTP_PENDING
+static uint8_t http_firmware_finish(bool complete, uint8_t *buf, uint16_t *len)
+{
+    swdloader_stream_finish(complete);
+
+    bool result;
+    if (!swdloader_stream_ended(&result)) {
+        return HTTP_PENDING;
     }
+
+    printf("Written %u bytes\r\n", (unsigned)swdloader_stream_progress());
+    if (!result) {
+        return HTTP_FAILED;
     }
 
-    printf("Final firmware size: %d bytes\n", firmware_len);
-    for (int i = 0; i < firmware_len && i < 16; i++) {
-        printf("%02X ", flash_temp_buf[i]);
+    *len = sprintf((char *)buf, "<html><head><title>W5500-EVB-Pico</title><body>F/W Update Complete. Application code will run.</body></html>\r\n\r\n");
+
+    return HTTP_OK;
+}
+
+static uint8_t http_multipart_finish_firmware(bool complete, uint8_t *buf, uint16_t *len)
+{
+    return http_firmware_finish(complete && http_multipart_finish(&s_multipart), buf, len);
+}
+
+// multipart/form-data POST (the upload form of the web page). The file part is
+// written to the target, while it is received, so that its size is only
+// limited by the target.
+uint8_t http_update_firmware(st_http_request * p_http_request, uint8_t *buf, uint16_t *len)
+{
+    if (http_receive_body_busy()) {
+        return HTTP_FAILED;
     }
-    printf("\n");
 
-    int padded_len = (firmware_len + 3) & ~3;  // round up to nearest multiple of 4
+    int body_start;
+    int content_len = http_content_length(p_http_request, &body_start);
+    if (content_len < 0) {
+        printf("Content-Length not found.\n");
+        return HTTP_FAILED;
+    }
+
+    char boundary[HTTP_MULTIPART_BOUNDARY_MAX + 1];
+    if (!http_multipart_boundary(p_http_request, boundary, sizeof boundary)
+        || !http_multipart_init(&s_multipart, boundary, strlen(boundary), http_stream_sink, NULL)) {
+        printf("Boundary not found.\n");
+        return HTTP_FAILED;
+    }
+
+    printf("boundary = %s, content_len = %d\n", boundary, content_len);
+
+    if (!swdloader_stream_begin(false)) {
+        return HTTP_FAILED;
+    }
+
+    return http_receive_body_begin(p_http_request, body_start, content_len, http_multipart_sink, &s_multipart,
+                                   swdloader_stream_ready, http_multipart_finish_firmware);
+}
+
+// Raw POST body (not multipart) with a heatshrink compressed image (see bin2hs.py),
+// which is decompressed and written to the target while it is received.
+uint8_t http_update_firmware_stream(st_http_request * p_http_request, uint8_t *buf, uint16_t *len)
+{
+    if (http_receive_body_busy()) {
+        return HTTP_FAILED;
+    }
+
+    int body_start;
+    int content_len = http_content_length(p_http_request, &body_start);
+    if (content_len < 0) {
+        printf("Content-Length not found.\n");
+        return HTTP_FAILED;
+    }
+
+    printf("content_len=%d\n", content_len);
+
+    if (!swdloader_stream_begin(true)) {
+        return HTTP_FAILED;
+    }
+
+    return http_receive_body_begin(p_http_request, body_start, content_len, http_stream_sink, NULL,
+                                   swdloader_stream_ready, http_firmware_finish);
+}
 
-    // Pad trailing bytes with 0xFF (safe for flash or RAM)
-    for (int i = firmware_len; i < padded_len; i++) {
-        flash_temp_buf[i] = 0xFF;
+static uint8_t http_store_finish(bool complete, uint8_t *buf, uint16_t *len)
+{
+    image_info_t info;
+    if (!imageStore_end(complete, &info)) {
+        return HTTP_FAILED;
     }
 
-    // Flash to target MCU
-    extern bool swdloader_flash_buffer(const uint8_t *buf, size_t len);
-    bool success = swdloader_flash_buffer(flash_temp_buf, padded_len);
+    char hash[IMAGE_HASH_STRING_SIZE];
+    imageStore_hash_string(info.hash, hash);
+    printf("Image %s stored (%u bytes)\r\n", hash, (unsigned)info.size);
+
+    *len = sprintf((char *)buf, "%s\r\n", hash);
 
-    free(upload_buf);
-    free(flash_temp_buf);
-    return success ? 1 : 0;
-}
\ No newline at end of file
+    return HTTP_OK;
+}
+
+// Raw POST body with an image, which is kept in the image store of the probe.
+// Query: format=bin|hs (default bin), address=<hex> (default: the configured
+// image address). The response is the hash of the image.
+uint8_t http_store_image(st_http_request * p_http_request, uint8_t *buf, uint16_t *len)
+{
+    if (http_receive_body_busy()) {
+        return HTTP_FAILED;
+    }
+
+    char value[16];
+
+    http_query_value(p_http_request, "format", value, sizeof value);
+    uint32_t format = strcmp(value, "hs") == 0 ? IMAGE_FORMAT_HS : IMAGE_FORMAT_BIN;
+
+    http_query_value(p_http_request, "address", value, sizeof value);
+    uint32_t address = strtoul(value, NULL, 16);
+
+    int body_start;
+    int content_len = http_content_length(p_http_request, &body_start);
+    if (content_len <= 0) {
+        printf("Content-Length not found.\n");
+        return HTTP_FAILED;
+    }
+
+    if (!imageStore_begin(content_len, address, format)) {
+        return HTTP_FAILED;
+    }
+
+    return http_receive_body_begin(p_http_request, body_start, content_len, http_store_sink, NULL,
+                                   NULL, http_store_finish);
+}
+
+// Programs a stored image into the target, query: hash=<prefix>
+uint8_t http_program_image(st_http_request * p_http_request, uint8_t *buf, uint16_t *len)
+{
+    char hash[IMAGE_HASH_STRING_SIZE];
+    http_query_value(p_http_request, "hash", hash, sizeof hash);
+
+    image_info_t info;
+    if (!imageStore_find(hash, &info)) {
+        printf("Image %s not found\r\n", hash);
+        return HTTP_FAILED;
+    }
+
+    if (!imageStore_program(&info)) {
+        return HTTP_FAILED;
+    }
+
+    imageStore_hash_string(info.hash, hash);
+    printf("Image %s programmed\r\n", hash);
+
+    *len = sprintf((char *)buf, "%s\r\n", hash);
+
+    return HTTP_OK;
+}
+
+// Removes a stored image, query: hash=<prefix>
+uint8_t http_delete_image(st_http_request * p_http_request, uint8_t *buf, uint16_t *len)
+{
+    char hash[IMAGE_HASH_STRING_SIZE];
+    http_query_value(p_http_request, "hash", hash, sizeof hash);
+
+    if (!imageStore_delete(hash)) {
+        printf("Image %s not deleted\r\n", hash);
+        return HTTP_FAILED;
+    }
+
+    *len = sprintf((char *)buf, "OK\r\n");
+
+    return HTTP_OK;
+}
+
+// One line per stored image: hash, size, load address (0: default), format
+uint16_t http_list_images(uint8_t *buf, uint16_t size)
+{
+    static image_info_t infos[IMAGE_STORE_MAX_IMAGES];
+    unsigned count = imageStore_list(infos, IMAGE_STORE_MAX_IMAGES);
+    if (count > IMAGE_STORE_MAX_IMAGES) count = IMAGE_STORE_MAX_IMAGES;
+
+    uint16_t len = 0;
+    for (unsigned i = 0; i < count; i++) {
+        char hash[IMAGE_HASH_STRING_SIZE];
+        imageStore_hash_string(infos[i].hash, hash);
+
+        int n = snprintf((char *)buf + len, size - len, "%s %u 0x%08X %s\r\n", hash, (unsigned)infos[i].size,
+                         (unsigned)infos[i].address, infos[i].format == IMAGE_FORMAT_HS ? "hs" : "bin");
+        if (n < 0 || n >= size - len) {
+            break;
+        }
+
+        len += n;
+    }
+
+    return len;
+}
@@ -1,45 +1,727 @@
 #include "swdloader.h"
+#include "swdunpack.h"
+#include "swddap.h"
+#include "swdgdb.h"
+#include "swdrtt.h"
+#include "swdwatch.h"
+#include "swdring.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include <stdio.h>
+#include <string.h>
 
 // GPIO pin configuration
 #define SWCLK_PIN		2
 #define SWDIO_PIN		3
 #define SWD_RESET_PIN		4		// 0 for none
+#define SWD_TARGETS		1		// >1 for a gang with SWDIO on SWDIO_PIN, SWDIO_PIN+1, ...
+
+// A gang occupies SWD_TARGETS consecutive pins from SWDIO_PIN, which must not
+// include SWCLK or RESET (move SWD_RESET_PIN above the gang or set it to 0)
+#if SWCLK_PIN >= SWDIO_PIN && SWCLK_PIN < SWDIO_PIN + SWD_TARGETS
+#error "SWCLK_PIN is in the SWDIO range of the gang"
+#endif
+#if SWD_RESET_PIN != 0 && SWD_RESET_PIN >= SWDIO_PIN && SWD_RESET_PIN < SWDIO_PIN + SWD_TARGETS
+#error "SWD_RESET_PIN is in the SWDIO range of the gang"
+#endif
 
 #define SWD_CLOCK_RATE_KHZ	400
 
 #define RP2040_RAM_BASE		0x20000000U
+#define RP2040_FLASH_BASE	0x10000000U
+
+#define SWD_PROGRAM_FLASH	0		// 1 to program the target flash instead of loading to RAM
+#define SWD_DELTA_MODE		0		// 1 to rewrite only changed sectors and SRAM blocks
+#define SWD_TARGET_UNPACK	1		// decompress streams on the target (0: on the probe)
+
+#if SWD_PROGRAM_FLASH
+#define SWD_IMAGE_ADDRESS	RP2040_FLASH_BASE
+#else
+#define SWD_IMAGE_ADDRESS	RP2040_RAM_BASE
+#endif
+
+// The loader runs on core 1, so that the network on core 0 keeps running,
+// while the loader shifts data with interrupts disabled. Core 0 copies the
+// received data into chunk buffers and passes descriptors through a ring to
+// core 1, which returns each buffer with a progress event, when it has been
+// written. With more than one buffer, receiving the next chunk overlaps with
+// writing the current one.
+#define SWD_CHUNK_SIZE		1024
+#define SWD_CHUNK_BUFFERS	4
+#define SWD_RING_SIZE		8		// > SWD_CHUNK_BUFFERS + begin/end
+
+#define SWD_RTT_PAUSE_US	100000		// poll interval, while a debug session owns the pins
+#define SWD_WATCH_PAUSE_US	100000		// same for the data watch
+
+#define SWD_AUTO_PROGRAM_TRIES	5		// the target may power up later than the probe
+#define SWD_AUTO_PROGRAM_RETRY_MS	100
+
+enum swd_job_type {
+    SWD_JOB_BEGIN,			// flag: compressed, size: load address
+    SWD_JOB_DATA,			// buffer: chunk index
+    SWD_JOB_END,			// flag: complete
+    SWD_JOB_DAP,			// data, size: CMSIS-DAP request, response: its buffer
+    SWD_JOB_GDB,			// data, size: GDB packet (none: poll), flag: interrupt, response: its buffer
+    SWD_JOB_GDB_DETACH,
+    SWD_JOB_RTT,			// data, size: down data, response: up buffer of response_size
+    SWD_JOB_RTT_RELEASE,
+    SWD_JOB_WATCH,			// data, size: request (none: poll), response: frame buffer of response_size
+    SWD_JOB_AUTO_PROGRAM		// data, size: golden image
+};
+
+struct swd_job {
+    swd_job_type type;
+    const uint8_t *data;
+    size_t size;
+    unsigned buffer;
+    bool flag;
+    uint8_t *response;
+    size_t response_size;
+};
+
+enum swd_event_type {
+    SWD_EVENT_PROGRESS,			// buffer has been written (or skipped after an error)
+    SWD_EVENT_DONE			// begin, end, flash buffer, DAP or GDB job completed
+};
+
+struct swd_event {
+    swd_event_type type;
+    unsigned buffer;
+    size_t progress;			// bytes of the stream written so far
+    bool result;
+    size_t length;			// of the DAP, GDB or RTT response
+    size_t accepted;			// RTT down data written to the target
+    unsigned interval;			// until the next RTT or data watch poll in microseconds
+};
+
+static CSWDRing<swd_job, SWD_RING_SIZE> s_jobs;		// core 0 -> core 1
+static CSWDRing<swd_event, SWD_RING_SIZE> s_events;	// core 1 -> core 0
+
+static uint8_t s_chunks[SWD_CHUNK_BUFFERS][SWD_CHUNK_SIZE];
+
+// core 0
+static bool s_engine_started = false;
+static bool s_stream_active = false;
+static bool s_auto_program_pending = false;	// its done event has not been received yet
+static bool s_stream_failed = false;
+static bool s_stream_ending = false;		// the end job is queued, its done event is pending
+static bool s_stream_result = false;		// of the last ended stream
+static unsigned s_free_chunks = (1U << SWD_CHUNK_BUFFERS) - 1;
+static size_t s_stream_progress = 0;
+
+// core 1
+static CSWDLoader *s_pStreamLoader = nullptr;	// between SWD_JOB_BEGIN and SWD_JOB_END
+static CSWDUnpacker *s_pUnpacker = nullptr;	// for compressed streams
+static bool s_stream_ok = false;
+static size_t s_stream_written = 0;
+static CSWDDAP *s_pDAP = nullptr;		// debug session of a CMSIS-DAP host
+static CSWDGDB *s_pGDB = nullptr;		// debug session of a GDB client
+static CSWDRTT *s_pRTT = nullptr;		// log streaming of an RTT client
+static CSWDWatch *s_pWatch = nullptr;		// variable sampling of a data watch client
+
+static bool swdloader_stream_output(const void* data, size_t size, void* param) {
+    return static_cast<CSWDLoader*>(param)->WriteImage(data, size);
+}
+
+// Worst-case time, for which a load has blocked interrupts on core 1
+static void swd_load_report(const CSWDLoader::TLoadReport &report, void *param) {
+    if (report.bInterruptFree) {
+        printf("Interrupts not blocked during load\r\n");
+    } else {
+        printf("Interrupts blocked for up to %u us during load\r\n", report.nMaxInterruptsOffTicks);
+    }
+}
+
+// Writes the golden image at power-up, unless the target holds it already
+// (see CSWDLoader::UpdateImage()). Reports the time since the probe has booted.
+static bool swd_auto_program(const uint8_t* image, size_t size) {
+    for (unsigned i = 0; i < SWD_AUTO_PROGRAM_TRIES; i++) {
+        if (i > 0) {
+            sleep_ms(SWD_AUTO_PROGRAM_RETRY_MS);
+        }
+
+        CSWDLoader loader(SWCLK_PIN, SWDIO_PIN, SWD_RESET_PIN, SWD_CLOCK_RATE_KHZ, SWD_TARGETS);
+        loader.SetLoadHook(swd_load_report);
+
+        bool changed = false;
+        if (loader.Initialize()
+            && loader.UpdateImage(image, size, SWD_IMAGE_ADDRESS, &changed)) {
+            printf("%s golden image %u ms after power-up\r\n",
+                   changed ? "Target programmed with" : "Target holds",
+                   static_cast<unsigned>(to_ms_since_boot(get_absolute_time())));
+            return 1;
+        }
+    }
+
+    printf("Golden image not programmed\r\n");
+
+    return 0;
+}
+
 
+// Streams an image (optionally heatshrink compressed, see bin2hs.py) to the
+// target without buffering it. A compressed stream is either decompressed by
+// a stub on the target, or on the probe, which passes the window of the
+// unpacker to the loader, whenever it is full.
+static bool swd_stream_end(bool complete);
 
-// 👇 This makes the function callable from C files
-extern "C" bool swdloader_flash_buffer(const uint8_t* buffer, size_t size) {
-    
-    CSWDLoader loader(SWCLK_PIN, SWDIO_PIN, SWD_RESET_PIN, 400);  // SWCLK, SWDIO, RESET, 1MHz
-    if (!loader.Initialize()) {
-        printf("SWD init failed!\n");
+static bool swd_stream_begin(bool compressed, uint32_t address) {
+    s_pStreamLoader = new CSWDLoader(SWCLK_PIN, SWDIO_PIN, SWD_RESET_PIN, SWD_CLOCK_RATE_KHZ, SWD_TARGETS);
+    if (compressed && !SWD_TARGET_UNPACK) {
+        s_pUnpacker = new CSWDUnpacker(swdloader_stream_output, s_pStreamLoader);
+    }
+
+    s_pStreamLoader->SetDeltaMode(SWD_DELTA_MODE);
+    s_pStreamLoader->SetLoadHook(swd_load_report);
+
+    s_stream_written = 0;
+    s_stream_ok = true;
+
+    if (!s_pStreamLoader->Initialize()
+        || !s_pStreamLoader->BeginImage(address, compressed && SWD_TARGET_UNPACK)) {
+        printf("SWD stream start failed!\n");
+        swd_stream_end(0);
+        return 0;
+    }
+
+    return 1;
+}
+
+static bool swd_stream_write(const uint8_t* buffer, size_t size) {
+    // after an error the remaining chunks are only returned
+    if (!s_pStreamLoader || !s_stream_ok) {
         return 0;
     }
 
-    printf("SWD init OK.\n");
+    s_stream_ok = s_pUnpacker ? s_pUnpacker->Write(buffer, size)
+                              : s_pStreamLoader->WriteImage(buffer, size);
+    s_stream_written += size;
 
-    if(!loader.Load(buffer, size, RP2040_RAM_BASE))
-        printf("Firmware load failed\r\n");  // Flash address on target MCU
+    return s_stream_ok;
+}
 
-    uint32_t word = 0;
-    int result = loader.ReadMem(RP2040_RAM_BASE, &word);
-    if (!result) {
-        printf("SWD read failed.\n");
+// complete = 0 aborts the stream
+static bool swd_stream_end(bool complete) {
+    if (!s_pStreamLoader) {
         return 0;
     }
 
-    printf("Read flash : 0x%08X\n", word);
+    bool result = complete
+               && s_stream_ok
+               && (!s_pUnpacker || s_pUnpacker->Finish())
+               && s_pStreamLoader->EndImage();
 
-    if (word == 0xFFFFFFFF || word == 0x00000000) {
-        printf("Flash looks empty or erased.\n");
-    } else {
-        printf("Flash likely contains firmware.\n");
+    delete s_pUnpacker;
+    s_pUnpacker = nullptr;
+    delete s_pStreamLoader;
+    s_pStreamLoader = nullptr;
+
+    return result;
+}
+
+static void swd_post_event(const swd_event &event) {
+    while (!s_events.Put(event)) {
+        tight_loop_contents();	// core 0 drains the events, while it waits
+    }
+
+    __sev();
+}
+
+// An upload or the other debug server takes the SWD pins from a debug session,
+// a CMSIS-DAP host must connect again, GDB attaches again with its next packet
+static void swd_dap_release(void) {
+    if (s_pDAP && s_pDAP->IsConnected()) {
+        printf("CMSIS-DAP session closed\n");
+        s_pDAP->Disconnect();
+    }
+}
+
+static void swd_gdb_release(void) {
+    if (s_pGDB) {
+        s_pGDB->Detach();
+    }
+}
+
+// RTT attaches again with its next poll, when the pins are free
+static void swd_rtt_release(void) {
+    if (s_pRTT) {
+        s_pRTT->Detach();
+    }
+}
+
+static void swd_watch_release(void) {
+    if (s_pWatch) {
+        s_pWatch->Detach();
+    }
+}
+
+// RTT and the data watch pause, while a debug session owns the pins (they do not take them)
+static bool swd_debug_session_active(void) {
+    return    (s_pDAP && s_pDAP->IsConnected())
+           || (s_pGDB && s_pGDB->IsAttached());
+}
+
+static void swd_core1_main(void) {
+    // core 0 writes the image store in the probe flash, core 1 waits in RAM meanwhile
+    flash_safe_execute_core_init();
+
+    while (1) {
+        swd_job job;
+        if (!s_jobs.Get(&job)) {
+            __wfe();	// core 0 signals new jobs with __sev()
+
+            continue;
+        }
+
+        swd_event event = {SWD_EVENT_DONE, 0, 0, false};
+
+        switch (job.type) {
+        case SWD_JOB_BEGIN:
+            swd_dap_release();
+            swd_gdb_release();
+            swd_rtt_release();
+            swd_watch_release();
+            event.result = swd_stream_begin(job.flag, job.size);
+            break;
+
+        case SWD_JOB_DATA:
+            event.type = SWD_EVENT_PROGRESS;
+            event.buffer = job.buffer;
+            event.result = swd_stream_write(s_chunks[job.buffer], job.size);
+            event.progress = s_stream_written;
+            break;
+
+        case SWD_JOB_END:
+            event.result = swd_stream_end(job.flag);
+            break;
+
+        case SWD_JOB_DAP:
+            swd_gdb_release();
+            swd_rtt_release();
+            swd_watch_release();
+            if (!s_pDAP) {
+                s_pDAP = new CSWDDAP(SWCLK_PIN, SWDIO_PIN, SWD_RESET_PIN, SWD_CLOCK_RATE_KHZ);
+            }
+
+            event.length = s_pDAP->Process(job.data, job.size, job.response);
+            event.result = event.length > 0;
+            break;
+
+        case SWD_JOB_GDB: {
+            swd_dap_release();
+            swd_rtt_release();
+            swd_watch_release();
+            if (!s_pGDB) {
+                s_pGDB = new CSWDGDB(SWCLK_PIN, SWDIO_PIN, SWD_CLOCK_RATE_KHZ);
+            }
+
+            unsigned length = 0;
+            event.result = job.data ? s_pGDB->Process(reinterpret_cast<const char*>(job.data), job.size,
+                                                      reinterpret_cast<char*>(job.response), &length)
+                                    : s_pGDB->Poll(job.flag, reinterpret_cast<char*>(job.response), &length);
+            event.length = length;
+            break;
+        }
+
+        case SWD_JOB_GDB_DETACH:
+            swd_gdb_release();
+            event.result = true;
+            break;
+
+        case SWD_JOB_RTT: {
+            // the data watch has priority, it would lose samples while RTT attaches
+            if (swd_debug_session_active() || (s_pWatch && s_pWatch->IsActive())) {
+                event.interval = SWD_RTT_PAUSE_US;
+                break;
+            }
+
+            if (!s_pRTT) {
+                // the RAM of the attached target type is searched for the control block
+                s_pRTT = new CSWDRTT(SWCLK_PIN, SWDIO_PIN, SWD_CLOCK_RATE_KHZ);
+            }
+
+            unsigned accepted = 0;
+            event.length = s_pRTT->Poll(job.data, job.size, &accepted, job.response, job.response_size);
+            event.accepted = accepted;
+            event.interval = s_pRTT->GetPollInterval();
+            event.result = true;
+            break;
+        }
+
+        case SWD_JOB_RTT_RELEASE:
+            swd_rtt_release();
+            event.result = true;
+            break;
+
+        case SWD_JOB_WATCH: {
+            if (!s_pWatch) {
+                s_pWatch = new CSWDWatch(SWCLK_PIN, SWDIO_PIN, SWD_CLOCK_RATE_KHZ);
+            }
+
+            if (job.data) {
+                event.length = s_pWatch->Process(job.data, job.size, job.response);
+                event.result = event.length > 0;
+                break;
+            }
+
+            event.result = s_pWatch->IsActive();
+            if (!event.result || swd_debug_session_active()) {
+                event.interval = SWD_WATCH_PAUSE_US;
+                break;
+            }
+
+            swd_rtt_release();
+
+            uint64_t now = time_us_64();
+            event.length = s_pWatch->Poll(now, job.response, job.response_size);
+
+            uint64_t next = s_pWatch->GetNextDue();
+            event.interval = next > now ? static_cast<unsigned>(next - now) : 0;
+            break;
+        }
+
+        case SWD_JOB_AUTO_PROGRAM:
+            event.result = swd_auto_program(job.data, job.size);
+            break;
+        }
+
+        swd_post_event(event);
+    }
+}
+
+// Core 0 side
+
+static void swd_engine_start(void) {
+    if (!s_engine_started) {
+        multicore_launch_core1(swd_core1_main);
+        s_engine_started = true;
+    }
+}
+
+static void swd_put_job(const swd_job &job) {
+    // cannot overflow, there are never more than SWD_CHUNK_BUFFERS + 1 jobs pending
+    while (!s_jobs.Put(job)) {
+        tight_loop_contents();
+    }
+
+    __sev();
+}
+
+// Gets the next event, a progress event releases its chunk buffer.
+// With wait = 1 blocks until an event arrives, otherwise returns 0, if there is none.
+static bool swd_get_event(bool wait, swd_event *event) {
+    while (!s_events.Get(event)) {
+        if (!wait) {
+            return 0;
+        }
+
+        __wfe();	// core 1 signals new events with __sev()
+    }
+
+    if (event->type == SWD_EVENT_PROGRESS) {
+        s_free_chunks |= 1U << event->buffer;
+        s_stream_progress = event->progress;
+        if (!event->result) {
+            s_stream_failed = 1;
+        }
+    } else if (s_stream_ending) {
+        // no other jobs are queued, while a stream is active
+        s_stream_result = event->result;
+        s_stream_ending = 0;
+        s_stream_active = 0;
+    }
+
+    return 1;
+}
+
+static void swd_drain_events(void) {
+    swd_event event;
+    while (swd_get_event(0, &event)) {
+    }
+}
+
+// The golden image is written, before the first job of a server is executed
+static void swd_auto_program_wait(void) {
+    swd_event event;
+    while (s_auto_program_pending) {
+        swd_get_event(1, &event);
+        if (event.type == SWD_EVENT_DONE) {
+            s_auto_program_pending = 0;
+        }
+    }
+}
+
+static bool swd_run_job(const swd_job &job, size_t *length = nullptr, swd_event *done = nullptr) {
+    swd_engine_start();
+    swd_auto_program_wait();
+    swd_put_job(job);
+
+    swd_event event;
+    do {
+        swd_get_event(1, &event);
+    } while (event.type != SWD_EVENT_DONE);
+
+    if (length) {
+        *length = event.length;
+    }
+
+    if (done) {
+        *done = event;
+    }
+
+    return event.result;
+}
+
+// Writes the golden image on core 1 and returns at once, so that the network
+// is brought up meanwhile. The image must stay valid (e.g. in the probe flash).
+extern "C" void swdloader_auto_program(const uint8_t* image, size_t size) {
+    if (s_auto_program_pending) {
+        return;
+    }
+
+    swd_engine_start();
+
+    swd_job job = {SWD_JOB_AUTO_PROGRAM, image, size, 0, false};
+    swd_put_job(job);
+
+    s_auto_program_pending = 1;
+}
+
+// The image is loaded to the address in the target SRAM or flash (sector aligned)
+extern "C" bool swdloader_stream_begin_at(bool compressed, uint32_t address) {
+    if (s_stream_active) {
+        printf("SWD stream busy\n");
+        return 0;
+    }
+
+    s_stream_failed = 0;
+    s_stream_progress = 0;
+
+    swd_job job = {SWD_JOB_BEGIN, nullptr, address, 0, compressed};
+    if (!swd_run_job(job)) {
+        return 0;
+    }
+
+    s_stream_active = 1;
+
+    return 1;
+}
+
+extern "C" bool swdloader_stream_begin(bool compressed) {
+    return swdloader_stream_begin_at(compressed, SWD_IMAGE_ADDRESS);
+}
+
+// Returns as soon as the data is queued. Fails, if an earlier chunk could not be written.
+extern "C" bool swdloader_stream_write(const uint8_t* buffer, size_t size) {
+    if (!s_stream_active) {
+        return 0;
+    }
+
+    swd_drain_events();
+
+    while (size > 0 && !s_stream_failed) {
+        swd_event event;
+        while (!s_free_chunks) {
+            swd_get_event(1, &event);
+        }
+
+        if (s_stream_failed) {
+            break;
+        }
+
+        unsigned index = __builtin_ctz(s_free_chunks);
+        s_free_chunks &= ~(1U << index);
+
+        size_t chunk_size = size < SWD_CHUNK_SIZE ? size : SWD_CHUNK_SIZE;
+        memcpy(s_chunks[index], buffer, chunk_size);
+
+        swd_job job = {SWD_JOB_DATA, nullptr, chunk_size, index, false};
+        swd_put_job(job);
+
+        buffer += chunk_size;
+        size -= chunk_size;
+    }
+
+    return !s_stream_failed;
+}
+
+// Can a received chunk be written without waiting for a free chunk buffer? It may
+// be passed in two writes (e.g. around a multipart delimiter).
+extern "C" bool swdloader_stream_ready(void) {
+    swd_drain_events();
+
+    return s_stream_failed || __builtin_popcount(s_free_chunks) >= 2;
+}
+
+// complete = 0 aborts the stream. Queues the end of the stream (once) and returns
+// at once, so that core 0 serves the network, until swdloader_stream_ended() is 1.
+extern "C" bool swdloader_stream_finish(bool complete) {
+    if (!s_stream_active) {
+        return 0;
+    }
+
+    if (!s_stream_ending) {
+        swd_job job = {SWD_JOB_END, nullptr, 0, 0, complete};
+        swd_put_job(job);	// jobs are executed in order
+
+        s_stream_ending = 1;
+    }
+
+    return 1;
+}
+
+// Have all queued chunks been written? result: the stream has been completed successfully
+extern "C" bool swdloader_stream_ended(bool *result) {
+    swd_drain_events();
+    if (s_stream_active) {
+        return 0;
+    }
+
+    *result = s_stream_result;
+
+    return 1;
+}
+
+// complete = 0 aborts the stream. Waits until all queued chunks have been written.
+extern "C" bool swdloader_stream_end(bool complete) {
+    if (!swdloader_stream_finish(complete)) {
+        return 0;
+    }
+
+    swd_event event;
+    while (s_stream_ending) {
+        swd_get_event(1, &event);
+    }
+
+    return s_stream_result;
+}
+
+// Bytes of the current (or last) stream, which have been written to the target
+extern "C" size_t swdloader_stream_progress(void) {
+    swd_drain_events();
+
+    return s_stream_progress;
+}
+
+// Executes a CMSIS-DAP request packet on core 1, the response buffer must hold
+// CSWDDAP::PacketSize bytes. Returns 0 while a stream is active. The response
+// length is 0, if the command has no response (DAP_TransferAbort).
+extern "C" bool swdloader_dap_process(const uint8_t* request, size_t length, uint8_t* response, size_t* response_length) {
+    *response_length = 0;
+    if (s_stream_active) {
+        return 0;
     }
 
+    swd_job job = {SWD_JOB_DAP, request, length, 0, false, response};
+    swd_run_job(job, response_length);
+
     return 1;
 }
 
+// Executes a GDB packet on core 1, the response buffer must hold CSWDGDB::PacketSize
+// bytes. Returns 1, if the response is to be sent now (not after continue or kill).
+extern "C" bool swdloader_gdb_process(const char* packet, size_t length, char* response, size_t* response_length) {
+    if (s_stream_active) {
+        memcpy(response, "E10", 3);	// upload in progress
+        *response_length = 3;
+        return 1;
+    }
+
+    swd_job job = {SWD_JOB_GDB, reinterpret_cast<const uint8_t*>(packet), length, 0, false,
+                   reinterpret_cast<uint8_t*>(response)};
+
+    return swd_run_job(job, response_length);
+}
+
+// Checks, if the target has stopped after continue or step (interrupt = 1 halts it).
+// Returns 1 with the stop reply in the response buffer.
+extern "C" bool swdloader_gdb_poll(bool interrupt, char* response, size_t* response_length) {
+    if (s_stream_active) {
+        return 0;
+    }
+
+    swd_job job = {SWD_JOB_GDB, nullptr, 0, 0, interrupt, reinterpret_cast<uint8_t*>(response)};
+
+    return swd_run_job(job, response_length);
+}
+
+// Removes the breakpoints, lets the target run and releases the SWD pins
+extern "C" void swdloader_gdb_detach(void) {
+    if (s_stream_active) {
+        return;		// the upload has taken the pins already
+    }
+
+    swd_job job = {SWD_JOB_GDB_DETACH, nullptr, 0, 0, false};
+    swd_run_job(job);
+}
+
+// Exchanges RTT channel 0 data with the running target on core 1: writes the
+// input to the down-buffer (the accepted length is returned in written) and
+// reads the up-buffer into output. Returns the length read, interval_us is the
+// time until the next poll (the pins are not touched while a stream is active).
+extern "C" size_t swdloader_rtt_poll(const uint8_t* input, size_t length, size_t* written,
+                                     uint8_t* output, size_t size, unsigned* interval_us) {
+    *written = 0;
+    *interval_us = SWD_RTT_PAUSE_US;
+    if (s_stream_active) {
+        return 0;
+    }
+
+    swd_job job = {SWD_JOB_RTT, input, length, 0, false, output, size};
+
+    swd_event event;
+    swd_run_job(job, nullptr, &event);
+
+    *written = event.accepted;
+    *interval_us = event.interval;
+
+    return event.length;
+}
+
+// Releases the SWD pins, when the RTT client has gone
+extern "C" void swdloader_rtt_release(void) {
+    if (s_stream_active) {
+        return;		// the upload has taken the pins already
+    }
+
+    swd_job job = {SWD_JOB_RTT_RELEASE, nullptr, 0, 0, false};
+    swd_run_job(job);
+}
+
+// Executes a data watch request (configure or stop) on core 1, the response
+// buffer must hold CSWDWatch::FrameSize bytes. Returns the response length.
+extern "C" size_t swdloader_watch_process(const uint8_t* request, size_t length, uint8_t* response) {
+    if (s_stream_active) {
+        return 0;
+    }
+
+    swd_job job = {SWD_JOB_WATCH, request, length, 0, false, response, CSWDWatch::FrameSize};
+
+    size_t response_length = 0;
+    swd_run_job(job, &response_length);
+
+    return response_length;
+}
+
+// Samples the due variables on core 1 into a data frame (or generates the report),
+// the frame must fit into size bytes. Returns the frame length, interval_us is the
+// time until the next poll. active is 0, if no variables are configured.
+extern "C" size_t swdloader_watch_poll(uint8_t* frame, size_t size, bool* active, unsigned* interval_us) {
+    *active = false;
+    *interval_us = SWD_WATCH_PAUSE_US;
+    if (s_stream_active) {
+        *active = true;		// samples are dropped during the upload
+        return 0;
+    }
+
+    swd_job job = {SWD_JOB_WATCH, nullptr, 0, 0, false, frame, size};
+
+    swd_event event;
+    *active = swd_run_job(job, nullptr, &event);
+    *interval_us = event.interval;
+
+    return event.length;
+}
@@ -0,0 +1,402 @@
+/**
+ * @file	httpmultipart_test.c
+ * @brief	Host test of the multipart/form-data parser
+ *
+ * The same body is fed whole, byte by byte, split at each position and in
+ * random chunks. The sink must receive the same payload each time. The payload
+ * holds prefixes of the delimiter, which do not complete, so that held bytes
+ * are passed late. Delimiters are also split across three chunks. Bodies
+ * without the close delimiter must not be reported as complete.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "httpMultipart.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+#define BOUNDARY			"----probe7MA4YWxkTrZu0gW"
+#define DELIMITER			"\r\n--" BOUNDARY
+
+#define PAYLOAD_RANDOM		3000
+#define BUFFER_SIZE			8192
+#define RANDOM_RUNS			1000
+
+#define CHECK(cond)																\
+	do																			\
+	{																			\
+		if(!(cond))																\
+		{																		\
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+			failures++;															\
+		}																		\
+	}																			\
+	while(0)
+
+typedef struct
+{
+	uint8_t data[BUFFER_SIZE];
+	size_t len;
+	unsigned calls;
+	unsigned fail_call;						/**< Sink fails at this call (0: never) */
+	bool empty_call;
+	bool overflow;
+} output_t;
+
+typedef struct
+{
+	bool write_ok;							/**< All http_multipart_write() calls */
+	bool finished;							/**< http_multipart_finish() */
+} result_t;
+
+static unsigned failures;
+
+static uint8_t payload[BUFFER_SIZE];
+static size_t payload_len;
+
+static uint8_t body[BUFFER_SIZE];
+static size_t body_len;
+static size_t close_offset;					/**< of the close delimiter in the body */
+
+static size_t chunks[BUFFER_SIZE];
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+static bool sink(const uint8_t *data, size_t len, void *param)
+{
+	output_t *out = (output_t *) param;
+
+	out->calls++;
+	if(out->calls == out->fail_call)
+	{
+		return false;
+	}
+
+	out->empty_call = out->empty_call || len == 0;
+	if(out->len + len > sizeof out->data)
+	{
+		out->overflow = true;
+		return false;
+	}
+
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+
+	return true;
+}
+
+static void append(const void *data, size_t len)
+{
+	if(body_len + len > sizeof body)
+	{
+		printf("Body too large\n");
+		exit(1);
+	}
+
+	memcpy(body + body_len, data, len);
+	body_len += len;
+}
+
+static void append_str(const char *str)
+{
+	append(str, strlen(str));
+}
+
+static bool contains(const uint8_t *data, size_t len, const char *str)
+{
+	size_t str_len = strlen(str);
+
+	for(size_t i = 0; i + str_len <= len; i++)
+	{
+		if(memcmp(data + i, str, str_len) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The payload starts and ends with near misses of the delimiter and has random
+// bytes in between, which are mostly CR, LF, dashes and boundary characters
+static void build_payload(void)
+{
+	static const char *const near_misses[] =
+	{
+		"\r", "\r\n", "\r\n-", "\r\n--", "\r\n--" "----probe", "\r\n--" "----probe7MA4YWxkTrZu0g",
+		"\r\r\n--" "----probe7MA4YWxkTrZu0g\r", "\n--" BOUNDARY, "\r\n-" BOUNDARY, "--" BOUNDARY
+	};
+	static const char alphabet[] = "\r\n--\r\n-" BOUNDARY;
+
+	payload_len = 0;
+	for(unsigned i = 0; i < sizeof near_misses / sizeof near_misses[0]; i++)
+	{
+		size_t len = strlen(near_misses[i]);
+		memcpy(payload + payload_len, near_misses[i], len);
+		payload_len += len;
+		payload[payload_len++] = 'x';
+	}
+
+	srand(1);
+	for(unsigned i = 0; i < PAYLOAD_RANDOM; i++)
+	{
+		payload[payload_len++] =   rand() % 4 == 0
+								 ? (uint8_t) rand()
+								 : (uint8_t) alphabet[rand() % (sizeof alphabet - 1)];
+	}
+
+	// the payload ends with a partial delimiter, which continues as the real one
+	static const char tail[] = "\r\n--" "----probe7MA4YWxkTrZu0g\r\n-\r";
+	memcpy(payload + payload_len, tail, sizeof tail - 1);
+	payload_len += sizeof tail - 1;
+
+	if(contains(payload, payload_len, DELIMITER))
+	{
+		printf("The payload contains the delimiter\n");
+		exit(1);
+	}
+}
+
+static void build_body(void)
+{
+	body_len = 0;
+
+	append_str("This is the preamble.\r\n-\r\n--" "----probe7MA4\r\n--" BOUNDARY "\r\n");
+
+	// a form field, which is not passed
+	append_str("Content-Disposition: form-data; name=\"comment\"\r\n\r\n");
+	append_str("value\r\n--" "----probe7MA4YWxkTrZu0g\r\n");
+	append_str(DELIMITER " \t\r\n");		// with transport padding
+
+	append_str("Content-Disposition: form-data; name=\"file\"; filename=\"firmware.bin\"\r\n"
+			   "Content-Type: application/octet-stream\r\n\r\n");
+	append(payload, payload_len);
+
+	close_offset = body_len;
+	append_str(DELIMITER "--\r\n");
+
+	// a second file is skipped, it is in the epilogue
+	append_str("epilogue\r\n--" BOUNDARY "\r\n"
+			   "Content-Disposition: form-data; name=\"file2\"; filename=\"other.bin\"\r\n\r\n"
+			   "other\r\n--" BOUNDARY "--\r\n");
+}
+
+static result_t parse(const uint8_t *data, const size_t *chunk_sizes, unsigned count, output_t *out)
+{
+	result_t result = {true, false};
+
+	http_multipart_t parser;
+	if(!http_multipart_init(&parser, BOUNDARY, sizeof BOUNDARY - 1, sink, out))
+	{
+		result.write_ok = false;
+		return result;
+	}
+
+	for(unsigned i = 0; i < count; i++)
+	{
+		result.write_ok = http_multipart_write(&parser, data, chunk_sizes[i]) && result.write_ok;
+		data += chunk_sizes[i];
+	}
+
+	result.finished = http_multipart_finish(&parser);
+
+	return result;
+}
+
+static void check_payload(const char *mode, const size_t *chunk_sizes, unsigned count)
+{
+	output_t out;
+	memset(&out, 0, sizeof out);
+
+	result_t result = parse(body, chunk_sizes, count, &out);
+
+	CHECK(result.write_ok);
+	CHECK(result.finished);
+	CHECK(!out.empty_call);
+	CHECK(!out.overflow);
+	CHECK(out.len == payload_len);
+
+	if(   out.len != payload_len
+	   || memcmp(out.data, payload, payload_len) != 0)
+	{
+		printf("Payload differs (%s, %u chunks)\n", mode, count);
+		failures++;
+	}
+}
+
+static void test_whole(void)
+{
+	chunks[0] = body_len;
+	check_payload("whole", chunks, 1);
+}
+
+static void test_bytes(void)
+{
+	for(size_t i = 0; i < body_len; i++)
+	{
+		chunks[i] = 1;
+	}
+
+	check_payload("byte by byte", chunks, body_len);
+}
+
+// Each delimiter is split at each of its bytes
+static void test_split(void)
+{
+	for(size_t i = 1; i < body_len; i++)
+	{
+		chunks[0] = i;
+		chunks[1] = body_len - i;
+		check_payload("split", chunks, 2);
+	}
+}
+
+// The close delimiter straddles three chunks, the middle one is inside of it
+static void test_split_delimiter(void)
+{
+	size_t len = sizeof DELIMITER - 1;
+
+	for(size_t start = 1; start < len; start++)
+	{
+		for(size_t end = start + 1; end < len; end++)
+		{
+			chunks[0] = close_offset + start;
+			chunks[1] = end - start;
+			chunks[2] = body_len - close_offset - end;
+			check_payload("split delimiter", chunks, 3);
+		}
+	}
+}
+
+static void test_random(void)
+{
+	srand(2);
+	for(unsigned run = 0; run < RANDOM_RUNS; run++)
+	{
+		size_t max_chunk = 1 + rand() % 200;
+
+		unsigned count = 0;
+		for(size_t offset = 0; offset < body_len; offset += chunks[count++])
+		{
+			chunks[count] = 1 + rand() % max_chunk;
+			if(chunks[count] > body_len - offset)
+			{
+				chunks[count] = body_len - offset;
+			}
+		}
+
+		check_payload("random", chunks, count);
+	}
+}
+
+// The body ends in the payload or after a delimiter, which is not the close
+// delimiter. The payload is passed, as far as it is known.
+static void test_missing_close(void)
+{
+	static const char *const ends[] = {"", "\r\n", "\r\n--", DELIMITER, DELIMITER "-", DELIMITER "\r\n"};
+
+	for(unsigned i = 0; i < sizeof ends / sizeof ends[0]; i++)
+	{
+		static uint8_t truncated[BUFFER_SIZE];
+		size_t len = strlen(ends[i]);
+		memcpy(truncated, body, close_offset);
+		memcpy(truncated + close_offset, ends[i], len);
+		len += close_offset;
+
+		for(size_t chunk = 1; chunk <= len; chunk = chunk < 16 ? chunk + 1 : chunk * 4)
+		{
+			unsigned count = 0;
+			for(size_t offset = 0; offset < len; offset += chunks[count++])
+			{
+				chunks[count] = chunk < len - offset ? chunk : len - offset;
+			}
+
+			output_t out;
+			memset(&out, 0, sizeof out);
+
+			result_t result = parse(truncated, chunks, count, &out);
+
+			CHECK(result.write_ok);
+			CHECK(!result.finished);
+
+			// the last CR of the payload may start a delimiter, it is held back
+			size_t expected = i == 0 ? payload_len - 1 : payload_len;
+			CHECK(out.len == expected);
+			CHECK(memcmp(out.data, payload, expected) == 0);
+		}
+	}
+
+	// "--" after the delimiter must be complete
+	static uint8_t wrong[BUFFER_SIZE];
+	static const char wrong_end[] = DELIMITER "-x\r\n";
+	memcpy(wrong, body, close_offset);
+	memcpy(wrong + close_offset, wrong_end, sizeof wrong_end - 1);
+
+	output_t out;
+	memset(&out, 0, sizeof out);
+	chunks[0] = close_offset + sizeof wrong_end - 1;
+
+	result_t result = parse(wrong, chunks, 1, &out);
+	CHECK(!result.write_ok);
+	CHECK(!result.finished);
+}
+
+static void test_no_file(void)
+{
+	static const char form[] =
+		"--" BOUNDARY "\r\n"
+		"Content-Disposition: form-data; name=\"comment\"\r\n\r\n"
+		"value\r\n--" BOUNDARY "--\r\n";
+
+	output_t out;
+	memset(&out, 0, sizeof out);
+	chunks[0] = sizeof form - 1;
+
+	result_t result = parse((const uint8_t *) form, chunks, 1, &out);
+	CHECK(result.write_ok);
+	CHECK(!result.finished);
+	CHECK(out.calls == 0);
+}
+
+static void test_sink_failure(void)
+{
+	for(size_t i = 0; i < body_len; i++)
+	{
+		chunks[i] = 1;
+	}
+
+	output_t out;
+	memset(&out, 0, sizeof out);
+	out.fail_call = 10;
+
+	result_t result = parse(body, chunks, body_len, &out);
+	CHECK(!result.write_ok);
+	CHECK(!result.finished);
+	CHECK(out.calls == 10);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+int main(void)
+{
+	build_payload();
+	build_body();
+
+	test_whole();
+	test_bytes();
+	test_split();
+	test_split_delimiter();
+	test_random();
+	test_missing_close();
+	test_no_file();
+	test_sink_failure();
+
+	printf("httpmultipart_test: %s\n", failures == 0 ? "passed" : "FAILED");
+
+	return failures == 0 ? 0 : 1;
+}
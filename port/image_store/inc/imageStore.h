@@ -0,0 +1,70 @@
+/**
+ @file		imageStore.h
+ @brief 	Content-addressed firmware image store in the flash of the probe.
+
+ Images are stored with their SHA-256 hash, size, load address in the target
+ and format (binary or heatshrink stream, see bin2hs.py). They are looked up
+ by a prefix of the hex hash and programmed into the target without being
+ uploaded again. An image, which is stored twice, is kept once.
+
+ Each image occupies a run of flash sectors in the store area at the end of
+ the probe flash. Its header is in the first page of the run and is written
+ last, so that an interrupted upload leaves no image behind. New images are
+ placed after the newest one (round robin), so that the erases are spread
+ over the whole store area. A deleted image is only marked, its sectors are
+ erased, when they are used again.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef	__IMAGESTORE_H__
+#define	__IMAGESTORE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMAGE_STORE_SIZE			(1024 * 1024)	// at the end of the probe flash
+#define IMAGE_STORE_MAX_IMAGES		32				// listed at most
+
+#define IMAGE_HASH_SIZE				32
+#define IMAGE_HASH_STRING_SIZE		(2 * IMAGE_HASH_SIZE + 1)
+#define IMAGE_HASH_PREFIX_MIN		8				// hex digits to select an image
+
+#define IMAGE_FORMAT_BIN			0
+#define IMAGE_FORMAT_HS				1				// heatshrink stream
+
+typedef struct
+{
+	uint8_t hash[IMAGE_HASH_SIZE];
+	uint32_t size;
+	uint32_t address;					/**< Load address in the target, 0: configured in the loader */
+	uint32_t format;
+	uint32_t sequence;					/**< Increments with each stored image */
+	const uint8_t *data;				/**< In the XIP window of the probe flash */
+} image_info_t;
+
+bool imageStore_init(void);
+
+/* Storing an image, the size must be known in advance (e.g. Content-Length) */
+bool imageStore_begin(uint32_t size, uint32_t address, uint32_t format);
+bool imageStore_write(const uint8_t *data, size_t len);
+bool imageStore_end(bool complete, image_info_t *info);
+
+/* hash_prefix: at least IMAGE_HASH_PREFIX_MIN hex digits, must be unique */
+bool imageStore_find(const char *hash_prefix, image_info_t *info);
+bool imageStore_delete(const char *hash_prefix);
+unsigned imageStore_list(image_info_t *infos, unsigned max_infos);
+
+/* Writes the image to the target (see swd-interface.cpp) */
+bool imageStore_program(const image_info_t *info);
+
+void imageStore_hash_string(const uint8_t hash[IMAGE_HASH_SIZE], char str[IMAGE_HASH_STRING_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+/**
+ @file		sha256.h
+ @brief 	SHA-256 (FIPS 180-4), the content address of the stored images.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef	__SHA256_H__
+#define	__SHA256_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SHA256_HASH_SIZE			32
+#define SHA256_BLOCK_SIZE			64
+
+typedef struct
+{
+	uint32_t state[8];
+	uint64_t length;					/**< Of the message in bytes */
+	uint8_t block[SHA256_BLOCK_SIZE];	/**< Partial block */
+	uint8_t block_len;
+} sha256_ctx_t;
+
+void sha256_init(sha256_ctx_t *ctx);
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len);
+void sha256_final(sha256_ctx_t *ctx, uint8_t hash[SHA256_HASH_SIZE]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
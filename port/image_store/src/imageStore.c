@@ -0,0 +1,541 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+#include "swdcrc.h"
+#include "sha256.h"
+#include "imageStore.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+#define IMAGE_STORE_OFFSET			(PICO_FLASH_SIZE_BYTES - IMAGE_STORE_SIZE)
+#define IMAGE_STORE_SECTORS			(IMAGE_STORE_SIZE / FLASH_SECTOR_SIZE)
+
+#define IMAGE_MAGIC					0x53474D49		// "IMGS"
+#define IMAGE_HEADER_SIZE			FLASH_PAGE_SIZE	// the data follows
+#define IMAGE_DELETED_OFFSET		(FLASH_PAGE_SIZE - 4)	// 0 if deleted
+
+#define IMAGE_FLASH_TIMEOUT_MS		100				// to lock out core 1
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t sequence;
+	uint32_t size;
+	uint32_t address;
+	uint32_t format;
+	uint32_t sectors;					/**< Including the header */
+	uint8_t hash[IMAGE_HASH_SIZE];
+	uint32_t crc;						/**< Of the fields above */
+} image_header_t;
+
+typedef struct
+{
+	uint32_t offset;					/**< In the flash */
+	const uint8_t *data;
+	size_t len;
+} image_flash_op_t;
+
+extern char __flash_binary_end;
+
+static bool image_store_ok = false;
+static uint32_t image_next_sequence = 1;
+static unsigned image_next_sector = 0;	/**< Search for free sectors starts here */
+
+/* Image being stored */
+static bool image_writing = false;
+static image_header_t image_header;
+static unsigned image_first_sector;
+static uint32_t image_written;			/**< Data bytes */
+static sha256_ctx_t image_sha;
+static uint8_t image_page[FLASH_PAGE_SIZE];
+static uint16_t image_page_len = 0;
+static uint32_t image_page_offset;		/**< Of the page buffer in the flash */
+
+/* Executed on core 1 (see swd-interface.cpp) */
+extern bool swdloader_stream_begin(bool compressed);
+extern bool swdloader_stream_begin_at(bool compressed, uint32_t address);
+extern bool swdloader_stream_write(const uint8_t* buffer, size_t size);
+extern bool swdloader_stream_end(bool complete);
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+static const image_header_t *image_sector_header(unsigned sector)
+{
+	return (const image_header_t *)(XIP_BASE + IMAGE_STORE_OFFSET + sector * FLASH_SECTOR_SIZE);
+}
+
+static const uint8_t *image_sector_data(unsigned sector)
+{
+	return (const uint8_t *)image_sector_header(sector) + IMAGE_HEADER_SIZE;
+}
+
+// Returns the header of an image, which starts in this sector, or NULL. The
+// header of a deleted image may be stale, its sectors may have been reused by
+// other images, so that only live images are skipped while scanning.
+static const image_header_t *image_valid_header(unsigned sector)
+{
+	const image_header_t *header = image_sector_header(sector);
+	if(   header->magic != IMAGE_MAGIC
+	   || header->crc != SWDCRC32(0, header, offsetof(image_header_t, crc))
+	   || header->sectors == 0
+	   || header->sectors > IMAGE_STORE_SECTORS - sector)
+	{
+		return NULL;
+	}
+
+	return header;
+}
+
+static bool image_deleted(unsigned sector)
+{
+	const uint8_t *page = (const uint8_t *)image_sector_header(sector);
+	uint32_t flag;
+	memcpy(&flag, page + IMAGE_DELETED_OFFSET, sizeof flag);
+
+	return flag != 0xFFFFFFFF;
+}
+
+static void image_get_info(unsigned sector, image_info_t *info)
+{
+	const image_header_t *header = image_sector_header(sector);
+
+	memcpy(info->hash, header->hash, IMAGE_HASH_SIZE);
+	info->size = header->size;
+	info->address = header->address;
+	info->format = header->format;
+	info->sequence = header->sequence;
+	info->data = image_sector_data(sector);
+}
+
+// Sectors used by the live images
+static void image_used_sectors(uint8_t used[IMAGE_STORE_SECTORS])
+{
+	memset(used, 0, IMAGE_STORE_SECTORS);
+
+	for(unsigned sector = 0; sector < IMAGE_STORE_SECTORS; sector++)
+	{
+		const image_header_t *header = image_valid_header(sector);
+		if(header && !image_deleted(sector))
+		{
+			memset(used + sector, 1, header->sectors);
+			sector += header->sectors - 1;
+		}
+	}
+}
+
+static void image_flash_erase_unsafe(void *param)
+{
+	const image_flash_op_t *op = (const image_flash_op_t *)param;
+
+	flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+}
+
+static void image_flash_program_unsafe(void *param)
+{
+	const image_flash_op_t *op = (const image_flash_op_t *)param;
+
+	flash_range_program(op->offset, op->data, op->len);
+}
+
+// Core 1 executes from flash too, it is locked out meanwhile
+static bool image_flash_erase(uint32_t offset)
+{
+	image_flash_op_t op = {offset, NULL, 0};
+
+	return flash_safe_execute(image_flash_erase_unsafe, &op, IMAGE_FLASH_TIMEOUT_MS) == PICO_OK;
+}
+
+static bool image_flash_program(uint32_t offset, const uint8_t *data, size_t len)
+{
+	image_flash_op_t op = {offset, data, len};
+
+	return flash_safe_execute(image_flash_program_unsafe, &op, IMAGE_FLASH_TIMEOUT_MS) == PICO_OK;
+}
+
+// Writes the page buffer, the sector is erased before its first page
+static bool image_flush_page(void)
+{
+	if(image_page_len == 0)
+	{
+		return true;
+	}
+
+	memset(image_page + image_page_len, 0xFF, FLASH_PAGE_SIZE - image_page_len);
+
+	if(   (image_page_offset % FLASH_SECTOR_SIZE) == 0
+	   && !image_flash_erase(image_page_offset))
+	{
+		return false;
+	}
+
+	if(!image_flash_program(image_page_offset, image_page, FLASH_PAGE_SIZE))
+	{
+		return false;
+	}
+
+	image_page_offset += FLASH_PAGE_SIZE;
+	image_page_len = 0;
+
+	return true;
+}
+
+static int hex_value(char ch)
+{
+	if (ch >= '0' && ch <= '9') return ch - '0';
+	if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+
+	return -1;
+}
+
+// Returns the first sector of the image, -1 if none or not unique
+static int image_lookup(const char *hash_prefix)
+{
+	size_t len = strlen(hash_prefix);
+	if(len < IMAGE_HASH_PREFIX_MIN || len > 2 * IMAGE_HASH_SIZE)
+	{
+		return -1;
+	}
+
+	int found = -1;
+	for(unsigned sector = 0; sector < IMAGE_STORE_SECTORS; sector++)
+	{
+		const image_header_t *header = image_valid_header(sector);
+		if(!header || image_deleted(sector))
+		{
+			continue;
+		}
+
+		unsigned i;
+		for(i = 0; i < len; i++)
+		{
+			int digit = hex_value(hash_prefix[i]);
+			uint8_t byte = header->hash[i / 2];
+			if(digit != ((i & 1) ? (byte & 0xF) : (byte >> 4)))
+			{
+				break;
+			}
+		}
+
+		if(i == len)
+		{
+			if(found >= 0)
+			{
+				printf("Image hash %s is ambiguous\r\n", hash_prefix);
+				return -1;
+			}
+
+			found = sector;
+		}
+
+		sector += header->sectors - 1;
+	}
+
+	return found;
+}
+
+static int image_lookup_hash(const uint8_t hash[IMAGE_HASH_SIZE])
+{
+	char str[IMAGE_HASH_STRING_SIZE];
+	imageStore_hash_string(hash, str);
+
+	return image_lookup(str);
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+bool imageStore_init(void)
+{
+	uint32_t binary_end = (uint32_t)(uintptr_t)&__flash_binary_end - XIP_BASE;
+	if(binary_end > IMAGE_STORE_OFFSET)
+	{
+		printf("Image store overlaps the program (ends at 0x%X)\r\n", (unsigned)binary_end);
+		return false;
+	}
+
+	// continue after the newest image
+	unsigned images = 0;
+	uint32_t newest = 0;
+	for(unsigned sector = 0; sector < IMAGE_STORE_SECTORS; sector++)
+	{
+		const image_header_t *header = image_valid_header(sector);
+		if(!header)
+		{
+			continue;
+		}
+
+		if(header->sequence >= newest)
+		{
+			newest = header->sequence;
+			image_next_sequence = newest + 1;
+			image_next_sector = (sector + header->sectors) % IMAGE_STORE_SECTORS;
+		}
+
+		if(!image_deleted(sector))
+		{
+			images++;
+			sector += header->sectors - 1;
+		}
+	}
+
+	image_store_ok = true;
+
+	printf("Image store: %u images, %u KB\r\n", images, IMAGE_STORE_SIZE / 1024);
+
+	return true;
+}
+
+bool imageStore_begin(uint32_t size, uint32_t address, uint32_t format)
+{
+	if(!image_store_ok || image_writing)
+	{
+		return false;
+	}
+
+	unsigned sectors = (IMAGE_HEADER_SIZE + size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
+	if(size == 0 || sectors > IMAGE_STORE_SECTORS)
+	{
+		printf("Invalid image size (%u)\r\n", (unsigned)size);
+		return false;
+	}
+
+	// first free run after the newest image, wrapping at the end of the store area
+	static uint8_t used[IMAGE_STORE_SECTORS];
+	image_used_sectors(used);
+
+	int first = -1;
+	for(unsigned i = 0; i < IMAGE_STORE_SECTORS && first < 0; i++)
+	{
+		unsigned start = (image_next_sector + i) % IMAGE_STORE_SECTORS;
+		if(start + sectors > IMAGE_STORE_SECTORS)
+		{
+			continue;
+		}
+
+		unsigned n;
+		for(n = 0; n < sectors && !used[start + n]; n++)
+		{
+		}
+
+		if(n == sectors)
+		{
+			first = start;
+		}
+	}
+
+	if(first < 0)
+	{
+		printf("Image store full, delete images first\r\n");
+		return false;
+	}
+
+	memset(&image_header, 0, sizeof image_header);
+	image_header.magic = IMAGE_MAGIC;
+	image_header.size = size;
+	image_header.address = address;
+	image_header.format = format;
+	image_header.sectors = sectors;
+
+	image_first_sector = first;
+	image_written = 0;
+	sha256_init(&image_sha);
+
+	// the header page stays erased until the end
+	image_page_offset = IMAGE_STORE_OFFSET + first * FLASH_SECTOR_SIZE;
+	if(!image_flash_erase(image_page_offset))
+	{
+		return false;
+	}
+
+	image_page_offset += IMAGE_HEADER_SIZE;
+	image_page_len = 0;
+	image_writing = true;
+
+	return true;
+}
+
+bool imageStore_write(const uint8_t *data, size_t len)
+{
+	if(!image_writing)
+	{
+		return false;
+	}
+
+	if(len > image_header.size - image_written)
+	{
+		printf("Image larger than announced\r\n");
+		imageStore_end(false, NULL);
+		return false;
+	}
+
+	sha256_update(&image_sha, data, len);
+	image_written += len;
+
+	while(len > 0)
+	{
+		size_t n = FLASH_PAGE_SIZE - image_page_len;
+		if(n > len) n = len;
+
+		memcpy(image_page + image_page_len, data, n);
+		image_page_len += n;
+		data += n;
+		len -= n;
+
+		if(image_page_len == FLASH_PAGE_SIZE && !image_flush_page())
+		{
+			imageStore_end(false, NULL);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// complete = false discards the image. Returns the stored (or an identical) image.
+bool imageStore_end(bool complete, image_info_t *info)
+{
+	if(!image_writing)
+	{
+		return false;
+	}
+
+	image_writing = false;
+
+	if(!complete || image_written != image_header.size || !image_flush_page())
+	{
+		printf("Image not stored\r\n");
+		return false;
+	}
+
+	sha256_final(&image_sha, image_header.hash);
+
+	// verify the data in the flash
+	sha256_ctx_t ctx;
+	uint8_t hash[IMAGE_HASH_SIZE];
+	sha256_init(&ctx);
+	sha256_update(&ctx, image_sector_data(image_first_sector), image_header.size);
+	sha256_final(&ctx, hash);
+	if(memcmp(hash, image_header.hash, IMAGE_HASH_SIZE) != 0)
+	{
+		printf("Image verify failed\r\n");
+		return false;
+	}
+
+	// the data is left unreferenced, if the image is stored already
+	int existing = image_lookup_hash(image_header.hash);
+	if(existing < 0)
+	{
+		image_header.sequence = image_next_sequence++;
+		image_header.crc = SWDCRC32(0, &image_header, offsetof(image_header_t, crc));
+
+		memset(image_page, 0xFF, sizeof image_page);
+		memcpy(image_page, &image_header, sizeof image_header);
+		if(!image_flash_program(IMAGE_STORE_OFFSET + image_first_sector * FLASH_SECTOR_SIZE,
+		                        image_page, FLASH_PAGE_SIZE))
+		{
+			return false;
+		}
+
+		image_next_sector = (image_first_sector + image_header.sectors) % IMAGE_STORE_SECTORS;
+		existing = image_first_sector;
+	}
+
+	if(info)
+	{
+		image_get_info(existing, info);
+	}
+
+	return true;
+}
+
+bool imageStore_find(const char *hash_prefix, image_info_t *info)
+{
+	int sector = image_store_ok ? image_lookup(hash_prefix) : -1;
+	if(sector < 0)
+	{
+		return false;
+	}
+
+	image_get_info(sector, info);
+
+	return true;
+}
+
+// Clears the deleted word, the sectors are erased when they are used again
+bool imageStore_delete(const char *hash_prefix)
+{
+	int sector = image_store_ok && !image_writing ? image_lookup(hash_prefix) : -1;
+	if(sector < 0)
+	{
+		return false;
+	}
+
+	memset(image_page, 0xFF, sizeof image_page);
+	memset(image_page + IMAGE_DELETED_OFFSET, 0, 4);
+
+	return image_flash_program(IMAGE_STORE_OFFSET + sector * FLASH_SECTOR_SIZE, image_page, FLASH_PAGE_SIZE);
+}
+
+// Returns the number of live images, up to max_infos of them in infos
+unsigned imageStore_list(image_info_t *infos, unsigned max_infos)
+{
+	unsigned count = 0;
+	for(unsigned sector = 0; image_store_ok && sector < IMAGE_STORE_SECTORS; sector++)
+	{
+		const image_header_t *header = image_valid_header(sector);
+		if(!header)
+		{
+			continue;
+		}
+
+		if(!image_deleted(sector))
+		{
+			if(count < max_infos)
+			{
+				image_get_info(sector, &infos[count]);
+			}
+
+			count++;
+			sector += header->sectors - 1;
+		}
+	}
+
+	return count;
+}
+
+// The image is passed from the XIP window to the loader, it is not copied here
+bool imageStore_program(const image_info_t *info)
+{
+	bool compressed = info->format == IMAGE_FORMAT_HS;
+	if(!(info->address ? swdloader_stream_begin_at(compressed, info->address)
+	                   : swdloader_stream_begin(compressed)))
+	{
+		return false;
+	}
+
+	if(!swdloader_stream_write(info->data, info->size))
+	{
+		swdloader_stream_end(false);
+		return false;
+	}
+
+	return swdloader_stream_end(true);
+}
+
+void imageStore_hash_string(const uint8_t hash[IMAGE_HASH_SIZE], char str[IMAGE_HASH_STRING_SIZE])
+{
+	static const char hex_digits[] = "0123456789abcdef";
+
+	for(unsigned i = 0; i < IMAGE_HASH_SIZE; i++)
+	{
+		str[2*i] = hex_digits[hash[i] >> 4];
+		str[2*i+1] = hex_digits[hash[i] & 0xF];
+	}
+	str[2 * IMAGE_HASH_SIZE] = '\0';
+}
@@ -0,0 +1,36 @@
+/**
+ @file		rttServer.h
+ @brief 	RTT log streaming over TCP, the target RAM is polled by the SWD loader.
+
+ Connect with a raw TCP client (e.g. "nc <probe address> 19021"). The target
+ runs on, it is not halted. Channel 0 of the SEGGER RTT control block in the
+ target RAM is found by its ID, its up-buffer is sent to the client and data
+ received from the client is written to its down-buffer.
+
+ The poll interval adapts to the target: data is read back-to-back while it
+ flows, the interval backs off to CSWDRTT::MaxIdleIntervalUs, while the target
+ is idle. Polling pauses during uploads and GDB or CMSIS-DAP sessions.
+ */
+
+#include <stdint.h>
+
+#ifndef	__RTTSERVER_H__
+#define	__RTTSERVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTT_SERVER_PORT				19021
+
+#define RTT_UP_BUFFER_SIZE			2048	// per poll, target -> client
+#define RTT_DOWN_BUFFER_SIZE		256		// client -> target
+
+void rttServer_init(uint8_t sn);
+void rttServer_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "pico/time.h"
+
+#include "socket.h"
+#include "wizchip_conf.h"
+
+#include "rttServer.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+static uint8_t RTTSock_Num = 0;
+static bool rtt_session = false;		/**< Target has been polled on this connection */
+static uint64_t rtt_poll_time = 0;		/**< Of the next poll in microseconds */
+
+static uint8_t rtt_up_buf[RTT_UP_BUFFER_SIZE];
+static uint8_t rtt_down_buf[RTT_DOWN_BUFFER_SIZE];
+static uint16_t rtt_down_len = 0;		/**< Received, not written to the target yet */
+
+/* Executed on core 1 (see swd-interface.cpp) */
+extern size_t swdloader_rtt_poll(const uint8_t* input, size_t length, size_t* written,
+                                 uint8_t* output, size_t size, unsigned* interval_us);
+extern void swdloader_rtt_release(void);
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+static void rtt_receive(uint8_t sn)
+{
+	uint16_t len = getSn_RX_RSR(sn);
+	if(len == 0 || rtt_down_len == sizeof rtt_down_buf)
+	{
+		return;
+	}
+
+	if(len > sizeof rtt_down_buf - rtt_down_len) len = sizeof rtt_down_buf - rtt_down_len;
+
+	int32_t ret = recv(sn, rtt_down_buf + rtt_down_len, len);
+	if(ret > 0)
+	{
+		rtt_down_len += ret;
+		rtt_poll_time = 0;					// write it now
+	}
+}
+
+static void rtt_poll(uint8_t sn)
+{
+	uint64_t now = to_us_since_boot(get_absolute_time());
+	if(now < rtt_poll_time)
+	{
+		return;
+	}
+
+	// the up data must fit into the socket TX buffer, it is not kept here
+	size_t size = getSn_TX_FSR(sn);
+	if(size > sizeof rtt_up_buf) size = sizeof rtt_up_buf;
+
+	size_t written = 0;
+	unsigned interval = 0;
+	size_t len = swdloader_rtt_poll(rtt_down_buf, rtt_down_len, &written, rtt_up_buf, size, &interval);
+
+	rtt_session = true;
+	rtt_poll_time = now + interval;
+
+	// keep the remainder, until the down-buffer of the target has room
+	if(written > 0)
+	{
+		rtt_down_len -= written;
+		memmove(rtt_down_buf, rtt_down_buf + written, rtt_down_len);
+	}
+
+	if(len > 0)
+	{
+		send(sn, rtt_up_buf, len);
+	}
+}
+
+// Releases the SWD pins, when the client has gone
+static void rtt_end_session(void)
+{
+	if (rtt_session)
+	{
+		swdloader_rtt_release();
+		rtt_session = false;
+	}
+
+	rtt_down_len = 0;
+	rtt_poll_time = 0;
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+void rttServer_init(uint8_t sn)
+{
+	RTTSock_Num = sn;
+}
+
+void rttServer_run(void)
+{
+	uint8_t sn = RTTSock_Num;
+
+	switch(getSn_SR(sn))
+	{
+		case SOCK_ESTABLISHED:
+			// Interrupt clear
+			if(getSn_IR(sn) & Sn_IR_CON)
+			{
+				setSn_IR(sn, Sn_IR_CON);
+				printf("> RTTSocket[%d] : Connected\r\n", sn);
+			}
+
+			// the target is polled on core 1
+			rtt_receive(sn);
+			rtt_poll(sn);
+			break;
+
+		case SOCK_CLOSE_WAIT:
+			rtt_end_session();
+			disconnect(sn);
+			break;
+
+		case SOCK_CLOSED:
+			rtt_end_session();
+			if(socket(sn, Sn_MR_TCP, RTT_SERVER_PORT, 0x00) == sn)
+			{
+				printf("> RTTSocket[%d] : OPEN (port %d)\r\n", sn, RTT_SERVER_PORT);
+			}
+			break;
+
+		case SOCK_INIT:
+			listen(sn);
+			break;
+
+		default :
+			break;
+	}
+}
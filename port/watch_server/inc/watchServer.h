@@ -0,0 +1,37 @@
+/**
+ @file		watchServer.h
+ @brief 	Data watch over UDP, the variables are sampled by the SWD loader.
+
+ A client sends a configure request with the address, size (1, 2 or 4 bytes)
+ and sample rate of up to 32 variables to port 19022. The probe reads them
+ while the target runs and sends timestamped data frames to the address and
+ port of the client, once a second a report with the requested and achieved
+ rates and the dropped samples. A stop request (or a new configuration)
+ ends the sampling. The frame formats are described in swdwatch.cpp.
+
+ Sampling pauses during uploads and GDB or CMSIS-DAP sessions (the samples
+ are counted as dropped), RTT pauses while variables are sampled.
+ */
+
+#include <stdint.h>
+
+#ifndef	__WATCHSERVER_H__
+#define	__WATCHSERVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WATCH_SERVER_PORT			19022
+
+#define WATCH_REQUEST_MAX_SIZE		388		// CSWDWatch::RequestSize
+#define WATCH_FRAME_MAX_SIZE		392		// CSWDWatch::FrameSize
+
+void watchServer_init(uint8_t sn);
+void watchServer_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
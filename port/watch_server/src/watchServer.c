@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "pico/time.h"
+
+#include "socket.h"
+#include "wizchip_conf.h"
+
+#include "watchServer.h"
+
+/*****************************************************************************
+ * Private types/enumerations/variables
+ ****************************************************************************/
+static uint8_t WatchSock_Num = 0;
+static bool watch_active = false;		/**< Variables are configured */
+static uint64_t watch_poll_time = 0;		/**< Of the next poll in microseconds */
+
+static uint8_t watch_client_ip[4];		/**< Frames are sent to the last requester */
+static uint16_t watch_client_port = 0;
+
+static uint8_t watch_rx_buf[WATCH_REQUEST_MAX_SIZE];
+static uint8_t watch_tx_buf[WATCH_FRAME_MAX_SIZE];
+
+/* Executed on core 1 (see swd-interface.cpp) */
+extern size_t swdloader_watch_process(const uint8_t* request, size_t length, uint8_t* response);
+extern size_t swdloader_watch_poll(uint8_t* frame, size_t size, bool* active, unsigned* interval_us);
+
+/*****************************************************************************
+ * Private functions
+ ****************************************************************************/
+static void watch_receive(uint8_t sn)
+{
+	if(getSn_RX_RSR(sn) == 0)
+	{
+		return;
+	}
+
+	uint8_t ip[4];
+	uint16_t port;
+	int32_t ret = recvfrom(sn, watch_rx_buf, sizeof watch_rx_buf, ip, &port);
+	if(ret <= 0)
+	{
+		return;
+	}
+
+	size_t len = swdloader_watch_process(watch_rx_buf, ret, watch_tx_buf);
+	if(len == 0)
+	{
+		printf("> WatchSocket[%d] : Bad request\r\n", sn);
+		return;
+	}
+
+	memcpy(watch_client_ip, ip, sizeof watch_client_ip);
+	watch_client_port = port;
+
+	sendto(sn, watch_tx_buf, len, watch_client_ip, watch_client_port);
+
+	// the next poll tells, if variables have been configured
+	watch_active = true;
+	watch_poll_time = 0;
+}
+
+static void watch_poll(uint8_t sn)
+{
+	if(!watch_active)
+	{
+		return;
+	}
+
+	uint64_t now = to_us_since_boot(get_absolute_time());
+	if(now < watch_poll_time)
+	{
+		return;
+	}
+
+	// samples, which do not fit into the socket TX buffer, are dropped
+	size_t size = getSn_TX_FSR(sn);
+	if(size > sizeof watch_tx_buf) size = sizeof watch_tx_buf;
+
+	unsigned interval = 0;
+	size_t len = swdloader_watch_poll(watch_tx_buf, size, &watch_active, &interval);
+
+	watch_poll_time = now + interval;
+
+	if(len > 0)
+	{
+		sendto(sn, watch_tx_buf, len, watch_client_ip, watch_client_port);
+	}
+}
+
+/*****************************************************************************
+ * Public functions
+ ****************************************************************************/
+void watchServer_init(uint8_t sn)
+{
+	WatchSock_Num = sn;
+}
+
+void watchServer_run(void)
+{
+	uint8_t sn = WatchSock_Num;
+
+	switch(getSn_SR(sn))
+	{
+		case SOCK_UDP:
+			// the variables are sampled on core 1
+			watch_receive(sn);
+			watch_poll(sn);
+			break;
+
+		case SOCK_CLOSED:
+			watch_active = false;
+			if(socket(sn, Sn_MR_UDP, WATCH_SERVER_PORT, 0x00) == sn)
+			{
+				printf("> WatchSocket[%d] : OPEN (UDP port %d)\r\n", sn, WATCH_SERVER_PORT);
+			}
+			break;
+
+		default :
+			break;
+	}
+}